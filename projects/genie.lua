@@ -10,6 +10,7 @@ end
 local LOCATION = "tmp/" .. ide_dir
 local BINARY_DIR = LOCATION .. "/bin/"
 local build_unit_tests = false
+local build_benchmarks = false
 local build_app = true
 local build_studio = true
 local build_steam = false
@@ -92,6 +93,11 @@ newoption {
 	description = "Build unit tests."
 }
 
+newoption {
+	trigger = "with-benchmarks",
+	description = "Build benchmarks."
+}
+
 newoption {
 	trigger = "no-app",
 	description = "Do not build app."
@@ -187,6 +193,10 @@ if _OPTIONS["with-unit-tests"] then
 	build_unit_tests = true
 end
 
+if _OPTIONS["with-benchmarks"] then
+	build_benchmarks = true
+end
+
 if _OPTIONS["no-app"] then
 	build_app = false
 end
@@ -602,6 +612,9 @@ project "engine"
 			linkoptions {"/DEF:\"../../../src/engine/engine.def\""}
 		end
 
+	configuration { "windows" }
+		links { "psapi" }
+
 
 	defaultConfigurations()
 
@@ -789,6 +802,30 @@ if build_unit_tests then
 		defaultConfigurations()
 end
 
+if build_benchmarks then
+	project "benchmarks"
+		kind "ConsoleApp"
+		debugdir "../../LumixEngine_data"
+
+		files { "../src/benchmarks/**.h", "../src/benchmarks/**.cpp" }
+		includedirs { "../src", "../src/benchmarks", "../external/bgfx/include" }
+		links { "lua_script", "renderer", "engine" }
+		if _OPTIONS["static-plugins"] then	
+			forceLink("s_renderer_plugin_register")
+			forceLink("s_lua_script_plugin_register")
+			configuration { "vs*" }
+				links { "winmm", "psapi" }
+			configuration {} 
+				linkLib "bgfx"
+		end
+		configuration { "linux-*" }
+			links { "GL", "X11", "dl", "rt" }
+		configuration {}
+
+		useLua()
+		defaultConfigurations()
+end
+
 
 if build_app then
 	project "app"
@@ -2,14 +2,18 @@
 #include "engine/command_line_parser.h"
 #include "engine/crc32.h"
 #include "engine/debug/debug.h"
+#include "engine/delegate_list.h"
 #include "engine/engine.h"
 #include "engine/fs/disk_file_device.h"
 #include "engine/fs/file_system.h"
 #include "engine/fs/memory_file_device.h"
+#include "engine/fs/os_file.h"
 #include "engine/fs/pack_file_device.h"
+#include "engine/hash_map.h"
 #include "engine/input_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/math_utils.h"
 #include "engine/mt/thread.h"
 #include "engine/path_utils.h"
 #include "engine/plugin_manager.h"
@@ -22,6 +26,7 @@
 #include "renderer/renderer.h"
 #include "renderer/texture.h"
 #include <cstdio>
+#include <cstdlib>
 #include <SDL.h>
 #include <SDL_syswm.h>
 #ifdef _WIN32
@@ -51,6 +56,164 @@ struct GUIInterface : GUISystem::Interface
 };
 
 
+struct ProfileStats
+{
+	struct Series
+	{
+		explicit Series(IAllocator& allocator)
+			: samples(allocator)
+		{
+		}
+
+		const char* name;
+		bool is_counter;
+		bool is_touched;
+		float frame_value;
+		Array<float> samples;
+	};
+
+
+	explicit ProfileStats(IAllocator& allocator)
+		: allocator(allocator)
+		, series(allocator)
+		, series_map(allocator)
+		, frame_times(allocator)
+		, peak_allocated(0)
+	{
+	}
+
+
+	Series& getSeries(const char* name, bool is_counter)
+	{
+		u32 key = crc32(name);
+		if (is_counter) key = ~key;
+		auto iter = series_map.find(key);
+		if (iter.isValid()) return series[iter.value()];
+
+		series_map.insert(key, series.size());
+		Series& s = series.emplace(allocator);
+		s.name = name;
+		s.is_counter = is_counter;
+		s.is_touched = false;
+		s.frame_value = 0;
+		return s;
+	}
+
+
+	void gatherCounters(Profiler::Block* block)
+	{
+		while (block)
+		{
+			if (Profiler::getBlockType(block) == Profiler::BlockType::INT)
+			{
+				Series& s = getSeries(Profiler::getBlockName(block), true);
+				s.frame_value += (float)Profiler::getBlockInt(block);
+				s.is_touched = true;
+			}
+			gatherCounters(Profiler::getBlockFirstChild(block));
+			block = Profiler::getBlockNext(block);
+		}
+	}
+
+
+	// called by Profiler::frame() before blocks are reset
+	void onProfilerFrame()
+	{
+		for (int i = 0, c = Profiler::getThreadCount(); i < c; ++i)
+		{
+			Profiler::Block* root = Profiler::getRootBlock(Profiler::getThreadID(i));
+			for (Profiler::Block* block = root; block; block = Profiler::getBlockNext(block))
+			{
+				if (Profiler::getBlockType(block) != Profiler::BlockType::TIME) continue;
+				if (Profiler::getBlockHitCount(block) == 0) continue;
+
+				Series& s = getSeries(Profiler::getBlockName(block), false);
+				s.frame_value += Profiler::getBlockLength(block) * 1000.0f;
+				s.is_touched = true;
+			}
+			gatherCounters(root);
+		}
+
+		for (Series& s : series)
+		{
+			if (s.is_touched) s.samples.push(s.frame_value);
+			s.is_touched = false;
+			s.frame_value = 0;
+		}
+	}
+
+
+	static int compareFloats(const void* a, const void* b)
+	{
+		float fa = *(const float*)a;
+		float fb = *(const float*)b;
+		return fa < fb ? -1 : (fa > fb ? 1 : 0);
+	}
+
+
+	void writeSeries(FS::OsFile& file, const char* label, const char* name, const Array<float>& samples) const
+	{
+		if (samples.empty()) return;
+
+		Array<float> sorted(allocator);
+		sorted.resize(samples.size());
+		copyMemory(&sorted[0], &samples[0], sizeof(samples[0]) * samples.size());
+		qsort(&sorted[0], sorted.size(), sizeof(sorted[0]), compareFloats);
+
+		double sum = 0;
+		for (float value : sorted) sum += value;
+		auto percentile = [&sorted](float p) { return sorted[int(p * (sorted.size() - 1) + 0.5f)]; };
+
+		auto writeValue = [&file](const char* label, float value) {
+			char tmp[32];
+			toCString(value, tmp, lengthOf(tmp), 3);
+			file << " " << label << " " << tmp;
+		};
+
+		file << label << " \"" << name << "\":";
+		writeValue("mean", float(sum / sorted.size()));
+		writeValue("p50", percentile(0.5f));
+		writeValue("p95", percentile(0.95f));
+		writeValue("p99", percentile(0.99f));
+		writeValue("min", sorted[0]);
+		writeValue("max", sorted.back());
+		file << " frames " << (u32)sorted.size() << "\n";
+	}
+
+
+	bool write(const char* path, float time_delta) const
+	{
+		FS::OsFile file;
+		if (!file.open(path, FS::Mode::CREATE_AND_WRITE)) return false;
+
+		char tmp[32];
+		file << "frames " << (u32)frame_times.size() << "\n";
+		toCString(time_delta, tmp, lengthOf(tmp), 6);
+		file << "time_delta " << tmp << "\n";
+		file << "peak_process_memory " << getPeakProcessMemory() << "\n";
+		file << "peak_allocated_memory " << peak_allocated << "\n";
+		writeSeries(file, "frame_time_ms", "frame", frame_times);
+		for (const Series& s : series)
+		{
+			if (!s.is_counter) writeSeries(file, "block_ms", s.name, s.samples);
+		}
+		for (const Series& s : series)
+		{
+			if (s.is_counter) writeSeries(file, "counter", s.name, s.samples);
+		}
+		file.close();
+		return true;
+	}
+
+
+	IAllocator& allocator;
+	Array<Series> series;
+	HashMap<u32, int> series_map;
+	Array<float> frame_times;
+	u64 peak_allocated;
+};
+
+
 class App
 {
 public:
@@ -60,7 +223,14 @@ public:
 		, m_universe(nullptr)
 		, m_exit_code(0)
 		, m_pipeline(nullptr)
+		, m_window(nullptr)
+		, m_gui_interface(nullptr)
 		, m_finished(false)
+		, m_renderer_enabled(true)
+		, m_headless(false)
+		, m_profile_frames(0)
+		, m_profile_fps(60)
+		, m_profile_stats(nullptr)
 	{
 		m_frame_timer = Timer::create(m_allocator);
 		ASSERT(!s_instance);
@@ -78,6 +248,8 @@ public:
 
 	void onResize() const
 	{
+		if (!m_window || !m_pipeline) return;
+
 		int w, h;
 		SDL_GetWindowSize(m_window, &w, &h);
 		m_pipeline->resize(w, h);
@@ -91,6 +263,8 @@ public:
 		copyString(m_pipeline_path, "pipelines/main.lua");
 		m_pipeline_define = "APP";
 		copyString(m_startup_script_path, "startup.lua");
+		copyString(m_universe_path, "universes/main.unv");
+		copyString(m_profile_output_path, "profile.txt");
 		char cmd_line[1024];
 		getCommandLine(cmd_line, lengthOf(cmd_line));
 		CommandLineParser parser(cmd_line);
@@ -118,6 +292,44 @@ public:
 
 				parser.getCurrent(m_startup_script_path, lengthOf(m_startup_script_path));
 			}
+			else if (parser.currentEquals("-universe"))
+			{
+				if (!parser.next()) break;
+
+				parser.getCurrent(m_universe_path, lengthOf(m_universe_path));
+			}
+			else if (parser.currentEquals("-profile"))
+			{
+				if (!parser.next()) break;
+
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(tmp, lengthOf(tmp), &m_profile_frames);
+			}
+			else if (parser.currentEquals("-profile_fps"))
+			{
+				if (!parser.next()) break;
+
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(tmp, lengthOf(tmp), &m_profile_fps);
+				m_profile_fps = Math::maximum(m_profile_fps, 1);
+			}
+			else if (parser.currentEquals("-profile_output"))
+			{
+				if (!parser.next()) break;
+
+				parser.getCurrent(m_profile_output_path, lengthOf(m_profile_output_path));
+			}
+			else if (parser.currentEquals("-noop_renderer"))
+			{
+				m_headless = true;
+			}
+			else if (parser.currentEquals("-no_renderer"))
+			{
+				m_headless = true;
+				m_renderer_enabled = false;
+			}
 		}
 
 		u32 flags = SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
@@ -149,41 +361,47 @@ public:
 		m_file_system->setSaveGameDevice("memory:disk");
 
 		m_engine = Engine::create(current_dir, "", m_file_system, m_allocator);
-		m_window = SDL_CreateWindow("Lumix App", 0, 0, 600, 400, flags);
-		if (!m_window_mode) SDL_SetWindowFullscreen(m_window, SDL_WINDOW_FULLSCREEN_DESKTOP);
-		SDL_SysWMinfo window_info;
-		SDL_VERSION(&window_info.version);
-		SDL_GetWindowWMInfo(m_window, &window_info);
 		Engine::PlatformData platform_data = {};
-		#ifdef _WIN32
-			platform_data.window_handle = window_info.info.win.window;
-		#elif defined(__linux__)
-			platform_data.window_handle = (void*)(uintptr_t)window_info.info.x11.window;
-			platform_data.display = window_info.info.x11.display;
-		#else
-			#error PLATFORM_NOT_SUPPORTED
-		#endif
+		if (!m_headless)
+		{
+			m_window = SDL_CreateWindow("Lumix App", 0, 0, 600, 400, flags);
+			if (!m_window_mode) SDL_SetWindowFullscreen(m_window, SDL_WINDOW_FULLSCREEN_DESKTOP);
+			SDL_SysWMinfo window_info;
+			SDL_VERSION(&window_info.version);
+			SDL_GetWindowWMInfo(m_window, &window_info);
+			#ifdef _WIN32
+				platform_data.window_handle = window_info.info.win.window;
+			#elif defined(__linux__)
+				platform_data.window_handle = (void*)(uintptr_t)window_info.info.x11.window;
+				platform_data.display = window_info.info.x11.display;
+			#else
+				#error PLATFORM_NOT_SUPPORTED
+			#endif
+		}
 		m_engine->setPlatformData(platform_data);
 
-		m_engine->getPluginManager().load("renderer");
-		m_engine->getPluginManager().load("animation");
-		m_engine->getPluginManager().load("audio");
-		m_engine->getPluginManager().load("navigation");
-		m_engine->getPluginManager().load("lua_script");
-		m_engine->getPluginManager().load("physics");
-		m_engine->getPluginManager().load("gui");
+		loadPlugin("renderer");
+		loadPlugin("animation");
+		loadPlugin("audio");
+		loadPlugin("navigation");
+		loadPlugin("lua_script");
+		loadPlugin("physics");
+		loadPlugin("gui");
 		#ifdef LUMIXENGINE_PLUGINS
 			const char* plugins[] = { LUMIXENGINE_PLUGINS };
 			for (auto plugin : plugins)
 			{
-				m_engine->getPluginManager().load(plugin);
+				loadPlugin(plugin);
 			}
 		#endif
 		m_engine->getInputSystem().enable(true);
 		Renderer* renderer = static_cast<Renderer*>(m_engine->getPluginManager().getPlugin("renderer"));
-		m_pipeline = Pipeline::create(*renderer, Path(m_pipeline_path), m_pipeline_define, m_engine->getAllocator());
-		m_pipeline->load();
-		renderer->setMainPipeline(m_pipeline);
+		if (renderer)
+		{
+			m_pipeline = Pipeline::create(*renderer, Path(m_pipeline_path), m_pipeline_define, m_engine->getAllocator());
+			m_pipeline->load();
+			renderer->setMainPipeline(m_pipeline);
+		}
 
 		while (m_engine->getFileSystem().hasWork())
 		{
@@ -192,31 +410,55 @@ public:
 		}
 
 		m_universe = &m_engine->createUniverse(true);
-		m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
-		m_pipeline->resize(600, 400);
-		renderer->resize(600, 400);
+		m_universe->setDeferredTransforms(true);
+		if (m_pipeline)
+		{
+			m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
+			m_pipeline->resize(600, 400);
+			renderer->resize(600, 400);
+		}
 
 		registerLuaAPI();
 
-		m_gui_interface = LUMIX_NEW(m_allocator, GUIInterface);
 		auto* gui_system = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
-		m_gui_interface->pipeline = m_pipeline;
-
-		gui_system->setInterface(m_gui_interface);
+		if (gui_system)
+		{
+			m_gui_interface = LUMIX_NEW(m_allocator, GUIInterface);
+			m_gui_interface->pipeline = m_pipeline;
+			gui_system->setInterface(m_gui_interface);
+		}
 		
-		SDL_ShowCursor(false);
-		SDL_SetRelativeMouseMode(SDL_TRUE);
+		if (m_window)
+		{
+			SDL_ShowCursor(false);
+			SDL_SetRelativeMouseMode(SDL_TRUE);
+		}
 		onResize();
 
-		if (!runStartupScript())
+		if (m_profile_frames > 0 || !runStartupScript())
 		{
-			loadUniverse("universes/main.unv");
+			loadUniverse(m_universe_path);
 			while (m_engine->getFileSystem().hasWork()) m_engine->getFileSystem().updateAsyncTransactions();
 			m_engine->startGame(*m_universe);
 		}
 	}
 
 
+	void loadPlugin(const char* name) const
+	{
+		if (!m_renderer_enabled)
+		{
+			// these plugins can not work without a render scene
+			static const char* RENDERER_DEPENDENT[] = { "renderer", "animation", "navigation", "gui" };
+			for (const char* dependent : RENDERER_DEPENDENT)
+			{
+				if (equalStrings(dependent, name)) return;
+			}
+		}
+		m_engine->getPluginManager().load(name);
+	}
+
+
 	bool runStartupScript() const
 	{
 		FS::FileSystem& fs = m_engine->getFileSystem();
@@ -281,10 +523,11 @@ public:
 		}
 		m_engine->destroyUniverse(*m_universe);
 		m_universe = &m_engine->createUniverse(true);
+		m_universe->setDeferredTransforms(true);
 		char basename[MAX_PATH_LENGTH];
 		PathUtils::getBasename(basename, lengthOf(basename), m_universe_path);
 		m_universe->setName(basename);
-		m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
+		if (m_pipeline) m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
 		LuaWrapper::createSystemVariable(m_engine->getState(), "App", "universe", m_universe);
 		bool deserialize_succeeded = m_engine->deserialize(*m_universe, blob);
 		if (!deserialize_succeeded)
@@ -299,14 +542,14 @@ public:
 		m_engine->destroyUniverse(*m_universe);
 		m_universe = universe;
 		m_universe->setName("runtime");
-		m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
+		if (m_pipeline) m_pipeline->setScene((RenderScene*)m_universe->getScene(crc32("renderer")));
 		LuaWrapper::createSystemVariable(m_engine->getState(), "App", "universe", m_universe);
 	}
 
 
 	void loadUniverse(const char* path)
 	{
-		copyString(m_universe_path, path);
+		if (path != m_universe_path) copyString(m_universe_path, path);
 		auto& fs = m_engine->getFileSystem();
 		FS::ReadCallback file_read_cb;
 		file_read_cb.bind<App, &App::universeFileLoaded>(this);
@@ -317,7 +560,7 @@ public:
 	void shutdown()
 	{
 		auto* gui_system = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
-		gui_system->setInterface(nullptr);
+		if (gui_system) gui_system->setInterface(nullptr);
 		LUMIX_DELETE(m_allocator, m_gui_interface);
 
 		m_engine->destroyUniverse(*m_universe);
@@ -325,7 +568,7 @@ public:
 		LUMIX_DELETE(m_allocator, m_disk_file_device);
 		LUMIX_DELETE(m_allocator, m_mem_file_device);
 		LUMIX_DELETE(m_allocator, m_pack_file_device);
-		Pipeline::destroy(m_pipeline);
+		if (m_pipeline) Pipeline::destroy(m_pipeline);
 		Engine::destroy(m_engine, m_allocator);
 		m_engine = nullptr;
 		m_pipeline = nullptr;
@@ -471,21 +714,67 @@ public:
 	{
 		float frame_time = m_frame_timer->tick();
 		m_engine->update(*m_universe);
-		m_pipeline->render();
-		auto* renderer = m_engine->getPluginManager().getPlugin("renderer");
-		static_cast<Renderer*>(renderer)->frame(false);
+		if (m_pipeline)
+		{
+			m_pipeline->render();
+			auto* renderer = m_engine->getPluginManager().getPlugin("renderer");
+			static_cast<Renderer*>(renderer)->frame(false);
+		}
 		m_engine->getFileSystem().updateAsyncTransactions();
-		if (frame_time < 1 / 60.0f)
+		if (frame_time < 1 / 60.0f && !m_profile_stats)
 		{
 			PROFILE_BLOCK("sleep");
 			MT::sleep(u32(1000 / 60.0f - frame_time * 1000));
 		}
-		handleEvents();
+		if (m_window) handleEvents();
+	}
+
+
+	void runProfile()
+	{
+		float time_delta = 1.0f / m_profile_fps;
+		g_log_info.log("App") << "Profiling " << m_profile_frames << " frames of " << m_universe_path;
+
+		m_engine->setFixedTimeDelta(time_delta);
+		m_profile_stats = LUMIX_NEW(m_allocator, ProfileStats)(m_allocator);
+		Profiler::getFrameListeners().bind<ProfileStats, &ProfileStats::onProfilerFrame>(m_profile_stats);
+		Profiler::frame();
+
+		Timer* timer = Timer::create(m_allocator);
+		for (int i = 0; i < m_profile_frames && !m_finished; ++i)
+		{
+			timer->tick();
+			frame();
+			m_profile_stats->frame_times.push(timer->getTimeSinceTick() * 1000.0f);
+			m_profile_stats->peak_allocated = Math::maximum(m_profile_stats->peak_allocated, (u64)m_allocator.getTotalSize());
+			Profiler::frame();
+		}
+		Timer::destroy(timer);
+
+		Profiler::getFrameListeners().unbind<ProfileStats, &ProfileStats::onProfilerFrame>(m_profile_stats);
+		m_engine->setFixedTimeDelta(0);
+		if (m_profile_stats->write(m_profile_output_path, time_delta))
+		{
+			g_log_info.log("App") << "Profile summary written to " << m_profile_output_path;
+		}
+		else
+		{
+			g_log_error.log("App") << "Failed to write profile summary to " << m_profile_output_path;
+			m_exit_code = 1;
+		}
+		LUMIX_DELETE(m_allocator, m_profile_stats);
+		m_profile_stats = nullptr;
 	}
 
 
 	void run()
 	{
+		if (m_profile_frames > 0)
+		{
+			runProfile();
+			return;
+		}
+
 		while (!m_finished)
 		{
 			frame();
@@ -508,7 +797,13 @@ private:
 	GUIInterface* m_gui_interface;
 	bool m_finished;
 	bool m_window_mode;
+	bool m_renderer_enabled;
+	bool m_headless;
 	int m_exit_code;
+	int m_profile_frames;
+	int m_profile_fps;
+	ProfileStats* m_profile_stats;
+	char m_profile_output_path[MAX_PATH_LENGTH];
 	char m_startup_script_path[MAX_PATH_LENGTH];
 	char m_pipeline_path[MAX_PATH_LENGTH];
 	StaticString<64> m_pipeline_define;
@@ -529,6 +824,9 @@ INT WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, INT)
 int main(int args, char* argv[])
 #endif
 {
+	#ifndef _WIN32
+		Lumix::setCommandLine(args, argv);
+	#endif
 	Lumix::App app;
 	app.init();
 	app.run();
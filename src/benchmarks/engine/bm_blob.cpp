@@ -0,0 +1,104 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/blob.h"
+#include "engine/matrix.h"
+#include "engine/universe/universe.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const int VALUES_COUNT = 100000;
+
+
+	void BM_blob_write(Benchmark::Context& ctx)
+	{
+		OutputBlob blob(ctx.getAllocator());
+		ctx.setItemsPerIteration(VALUES_COUNT);
+		while (ctx.iterate())
+		{
+			blob.clear();
+			for (int i = 0; i < VALUES_COUNT; ++i)
+			{
+				blob.write(i);
+				blob.write(Vec3((float)i, 0, 1));
+			}
+			Benchmark::Context::consume(blob.getData());
+		}
+	}
+
+
+	void BM_blob_read(Benchmark::Context& ctx)
+	{
+		OutputBlob out(ctx.getAllocator());
+		for (int i = 0; i < VALUES_COUNT; ++i)
+		{
+			out.write(i);
+			out.write(Vec3((float)i, 0, 1));
+		}
+
+		ctx.setItemsPerIteration(VALUES_COUNT);
+		while (ctx.iterate())
+		{
+			InputBlob blob(out);
+			float sum = 0;
+			for (int i = 0; i < VALUES_COUNT; ++i)
+			{
+				int value;
+				Vec3 v;
+				blob.read(value);
+				blob.read(v);
+				sum += v.x;
+			}
+			Benchmark::Context::consume(sum);
+		}
+	}
+
+
+	void BM_blob_strings(Benchmark::Context& ctx)
+	{
+		OutputBlob out(ctx.getAllocator());
+		char tmp[Universe::ENTITY_NAME_MAX_LENGTH];
+		ctx.setItemsPerIteration(VALUES_COUNT);
+		while (ctx.iterate())
+		{
+			out.clear();
+			for (int i = 0; i < VALUES_COUNT; ++i) out.writeString("some_entity_name");
+			InputBlob in(out);
+			for (int i = 0; i < VALUES_COUNT; ++i) in.readString(tmp, lengthOf(tmp));
+			Benchmark::Context::consume(tmp);
+		}
+	}
+
+
+	void BM_blob_universe(Benchmark::Context& ctx)
+	{
+		const int entities_count = 10000;
+		Universe universe(ctx.getAllocator());
+		for (int i = 0; i < entities_count; ++i)
+		{
+			Entity e = universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+			if (i % 4 == 0) universe.setEntityName(e, "named");
+			if (i % 8 == 1) universe.setParent({i - 1}, e);
+		}
+
+		OutputBlob blob(ctx.getAllocator());
+		ctx.setItemsPerIteration(entities_count);
+		while (ctx.iterate())
+		{
+			blob.clear();
+			universe.serialize(blob);
+			InputBlob in(blob);
+			Universe loaded(ctx.getAllocator());
+			loaded.deserialize(in);
+			Benchmark::Context::consume(blob.getData());
+		}
+	}
+}
+
+
+REGISTER_BENCHMARK("engine/blob/write", BM_blob_write, "");
+REGISTER_BENCHMARK("engine/blob/read", BM_blob_read, "");
+REGISTER_BENCHMARK("engine/blob/strings", BM_blob_strings, "");
+REGISTER_BENCHMARK("engine/blob/universe", BM_blob_universe, "");
@@ -0,0 +1,124 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/array.h"
+#include "engine/associative_array.h"
+#include "engine/hash_map.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const int ITEMS_COUNT = 100000;
+
+
+	u32 randomKey(u32 i)
+	{
+		// cheap integer hash so keys are not inserted in order
+		i ^= i >> 16;
+		i *= 0x7feb352d;
+		i ^= i >> 15;
+		i *= 0x846ca68b;
+		i ^= i >> 16;
+		return i;
+	}
+
+
+	void BM_hash_map_insert(Benchmark::Context& ctx)
+	{
+		ctx.setItemsPerIteration(ITEMS_COUNT);
+		while (ctx.iterate())
+		{
+			HashMap<u32, u32> map(ctx.getAllocator());
+			for (u32 i = 0; i < ITEMS_COUNT; ++i) map.insert(randomKey(i), i);
+			Benchmark::Context::consume((u64)map.size());
+		}
+	}
+
+
+	void BM_hash_map_find(Benchmark::Context& ctx)
+	{
+		HashMap<u32, u32> map(ctx.getAllocator());
+		for (u32 i = 0; i < ITEMS_COUNT; ++i) map.insert(randomKey(i), i);
+
+		ctx.setItemsPerIteration(ITEMS_COUNT);
+		while (ctx.iterate())
+		{
+			u64 sum = 0;
+			for (u32 i = 0; i < ITEMS_COUNT; ++i)
+			{
+				auto iter = map.find(randomKey(i));
+				if (iter.isValid()) sum += iter.value();
+			}
+			Benchmark::Context::consume(sum);
+		}
+	}
+
+
+	void BM_associative_array_insert(Benchmark::Context& ctx)
+	{
+		// insertion keeps the array sorted, so it is quadratic; use less items than the hash map
+		const int count = ITEMS_COUNT / 10;
+		ctx.setItemsPerIteration(count);
+		while (ctx.iterate())
+		{
+			AssociativeArray<u32, u32> array(ctx.getAllocator());
+			for (u32 i = 0; i < count; ++i) array.insert(randomKey(i), i);
+			Benchmark::Context::consume((u64)array.size());
+		}
+	}
+
+
+	void BM_associative_array_find(Benchmark::Context& ctx)
+	{
+		const int count = ITEMS_COUNT / 10;
+		AssociativeArray<u32, u32> array(ctx.getAllocator());
+		array.reserve(count);
+		for (u32 i = 0; i < count; ++i) array.insert(randomKey(i), i);
+
+		ctx.setItemsPerIteration(count);
+		while (ctx.iterate())
+		{
+			u64 sum = 0;
+			for (u32 i = 0; i < count; ++i)
+			{
+				u32 value;
+				if (array.find(randomKey(i), value)) sum += value;
+			}
+			Benchmark::Context::consume(sum);
+		}
+	}
+
+
+	void BM_array_growth(Benchmark::Context& ctx)
+	{
+		ctx.setItemsPerIteration(ITEMS_COUNT * 10);
+		while (ctx.iterate())
+		{
+			Array<u32> array(ctx.getAllocator());
+			for (u32 i = 0; i < ITEMS_COUNT * 10; ++i) array.push(i);
+			Benchmark::Context::consume(&array[0]);
+		}
+	}
+
+
+	void BM_array_reserved(Benchmark::Context& ctx)
+	{
+		ctx.setItemsPerIteration(ITEMS_COUNT * 10);
+		while (ctx.iterate())
+		{
+			Array<u32> array(ctx.getAllocator());
+			array.reserve(ITEMS_COUNT * 10);
+			for (u32 i = 0; i < ITEMS_COUNT * 10; ++i) array.push(i);
+			Benchmark::Context::consume(&array[0]);
+		}
+	}
+}
+
+
+REGISTER_BENCHMARK("engine/hash_map/insert", BM_hash_map_insert, "");
+REGISTER_BENCHMARK("engine/hash_map/find", BM_hash_map_find, "");
+REGISTER_BENCHMARK("engine/associative_array/insert", BM_associative_array_insert, "");
+REGISTER_BENCHMARK("engine/associative_array/find", BM_associative_array_find, "");
+REGISTER_BENCHMARK("engine/array/growth", BM_array_growth, "");
+REGISTER_BENCHMARK("engine/array/reserved", BM_array_reserved, "");
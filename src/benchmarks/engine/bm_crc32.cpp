@@ -0,0 +1,50 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/array.h"
+#include "engine/crc32.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	void BM_crc32_buffer(Benchmark::Context& ctx)
+	{
+		const int size = 1024 * 1024;
+		Array<u8> data(ctx.getAllocator());
+		data.resize(size);
+		for (int i = 0; i < size; ++i) data[i] = u8(i * 31);
+
+		ctx.setItemsPerIteration(size);
+		while (ctx.iterate())
+		{
+			Benchmark::Context::consume((u64)crc32(&data[0], size));
+		}
+	}
+
+
+	void BM_crc32_string(Benchmark::Context& ctx)
+	{
+		static const char* const NAMES[] = {
+			"renderable",
+			"point_light",
+			"particle_emitter",
+			"models/characters/hero/hero_lod0.msh",
+			"pipelines/main.lua",
+			"global_light",
+		};
+		const int count = 100000;
+
+		ctx.setItemsPerIteration(count);
+		while (ctx.iterate())
+		{
+			u64 sum = 0;
+			for (int i = 0; i < count; ++i) sum += crc32(NAMES[i % lengthOf(NAMES)]);
+			Benchmark::Context::consume(sum);
+		}
+	}
+}
+
+
+REGISTER_BENCHMARK("engine/crc32/buffer_1MB", BM_crc32_buffer, "");
+REGISTER_BENCHMARK("engine/crc32/string", BM_crc32_string, "");
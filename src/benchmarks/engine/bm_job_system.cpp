@@ -0,0 +1,86 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/array.h"
+#include "engine/job_system.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	void emptyJob(void* data)
+	{
+		Benchmark::Context::consume(data);
+	}
+
+
+	void fanOut(Benchmark::Context& ctx, int jobs_count)
+	{
+		Array<JobSystem::JobDecl> jobs(ctx.getAllocator());
+		jobs.resize(jobs_count);
+		for (JobSystem::JobDecl& job : jobs)
+		{
+			job.task = &emptyJob;
+			job.data = &job;
+		}
+
+		JobSystem::init(ctx.getAllocator());
+		ctx.setItemsPerIteration(jobs_count);
+		while (ctx.iterate())
+		{
+			volatile int counter = 0;
+			JobSystem::runJobs(&jobs[0], jobs.size(), &counter);
+			JobSystem::wait(&counter);
+		}
+		JobSystem::shutdown();
+	}
+
+
+	void BM_job_system_single(Benchmark::Context& ctx) { fanOut(ctx, 1); }
+	void BM_job_system_fan_out_64(Benchmark::Context& ctx) { fanOut(ctx, 64); }
+	void BM_job_system_fan_out_1024(Benchmark::Context& ctx) { fanOut(ctx, 1024); }
+
+
+	void BM_job_system_nested(Benchmark::Context& ctx)
+	{
+		// each outer job spawns and waits for its own children, measures wait inside a job
+		struct Outer
+		{
+			static void run(void* data)
+			{
+				JobSystem::JobDecl children[16];
+				for (JobSystem::JobDecl& child : children)
+				{
+					child.task = &emptyJob;
+					child.data = data;
+				}
+				volatile int counter = 0;
+				JobSystem::runJobs(children, lengthOf(children), &counter);
+				JobSystem::wait(&counter);
+			}
+		};
+
+		JobSystem::JobDecl jobs[16];
+		for (JobSystem::JobDecl& job : jobs)
+		{
+			job.task = &Outer::run;
+			job.data = &job;
+		}
+
+		JobSystem::init(ctx.getAllocator());
+		ctx.setItemsPerIteration(lengthOf(jobs) * 16);
+		while (ctx.iterate())
+		{
+			volatile int counter = 0;
+			JobSystem::runJobs(jobs, lengthOf(jobs), &counter);
+			JobSystem::wait(&counter);
+		}
+		JobSystem::shutdown();
+	}
+}
+
+
+REGISTER_BENCHMARK("engine/job_system/single", BM_job_system_single, "");
+REGISTER_BENCHMARK("engine/job_system/fan_out_64", BM_job_system_fan_out_64, "");
+REGISTER_BENCHMARK("engine/job_system/fan_out_1024", BM_job_system_fan_out_1024, "");
+REGISTER_BENCHMARK("engine/job_system/nested", BM_job_system_nested, "");
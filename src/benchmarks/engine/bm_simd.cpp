@@ -0,0 +1,124 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/array.h"
+#include "engine/simd.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const int FLOATS_COUNT = 64 * 1024;
+
+
+	struct SimdData
+	{
+		explicit SimdData(IAllocator& allocator)
+			: a(allocator)
+			, b(allocator)
+			, out(allocator)
+		{
+			// float4 loads need 16B alignment, Array allocates with the default alignment
+			a.resize(FLOATS_COUNT + 4);
+			b.resize(FLOATS_COUNT + 4);
+			out.resize(FLOATS_COUNT + 4);
+			for (int i = 0; i < a.size(); ++i)
+			{
+				a[i] = 1.0f + (i % 17);
+				b[i] = 2.0f + (i % 13);
+			}
+		}
+
+		static float* aligned(Array<float>& array)
+		{
+			uintptr ptr = (uintptr)&array[0];
+			return (float*)((ptr + 15) & ~(uintptr)15);
+		}
+
+		Array<float> a;
+		Array<float> b;
+		Array<float> out;
+	};
+
+
+	template <float4 (*OP)(float4, float4)>
+	void BM_f4_binary(Benchmark::Context& ctx)
+	{
+		SimdData data(ctx.getAllocator());
+		const float* a = SimdData::aligned(data.a);
+		const float* b = SimdData::aligned(data.b);
+		float* out = SimdData::aligned(data.out);
+
+		ctx.setItemsPerIteration(FLOATS_COUNT);
+		while (ctx.iterate())
+		{
+			for (int i = 0; i < FLOATS_COUNT; i += 4)
+			{
+				f4Store(out + i, OP(f4Load(a + i), f4Load(b + i)));
+			}
+			Benchmark::Context::consume(out[FLOATS_COUNT - 1]);
+		}
+	}
+
+
+	template <float4 (*OP)(float4)>
+	void BM_f4_unary(Benchmark::Context& ctx)
+	{
+		SimdData data(ctx.getAllocator());
+		const float* a = SimdData::aligned(data.a);
+		float* out = SimdData::aligned(data.out);
+
+		ctx.setItemsPerIteration(FLOATS_COUNT);
+		while (ctx.iterate())
+		{
+			for (int i = 0; i < FLOATS_COUNT; i += 4)
+			{
+				f4Store(out + i, OP(f4Load(a + i)));
+			}
+			Benchmark::Context::consume(out[FLOATS_COUNT - 1]);
+		}
+	}
+
+
+	void BM_f4_sphere_test(Benchmark::Context& ctx)
+	{
+		// same pattern as the culling kernel - multiply-add against a plane and a movemask
+		SimdData data(ctx.getAllocator());
+		const float* a = SimdData::aligned(data.a);
+		const float* b = SimdData::aligned(data.b);
+		float4 nx = f4Splat(0.3f);
+		float4 ny = f4Splat(-0.5f);
+		float4 d = f4Splat(4.0f);
+
+		ctx.setItemsPerIteration(FLOATS_COUNT);
+		while (ctx.iterate())
+		{
+			u64 inside = 0;
+			for (int i = 0; i < FLOATS_COUNT; i += 4)
+			{
+				float4 dist = f4Add(f4Add(f4Mul(f4Load(a + i), nx), f4Mul(f4Load(b + i), ny)), d);
+				inside += f4MoveMask(dist);
+			}
+			Benchmark::Context::consume(inside);
+		}
+	}
+
+
+	void BM_f4_add(Benchmark::Context& ctx) { BM_f4_binary<f4Add>(ctx); }
+	void BM_f4_mul(Benchmark::Context& ctx) { BM_f4_binary<f4Mul>(ctx); }
+	void BM_f4_div(Benchmark::Context& ctx) { BM_f4_binary<f4Div>(ctx); }
+	void BM_f4_min(Benchmark::Context& ctx) { BM_f4_binary<f4Min>(ctx); }
+	void BM_f4_sqrt(Benchmark::Context& ctx) { BM_f4_unary<f4Sqrt>(ctx); }
+	void BM_f4_rsqrt(Benchmark::Context& ctx) { BM_f4_unary<f4Rsqrt>(ctx); }
+	void BM_f4_rcp(Benchmark::Context& ctx) { BM_f4_unary<f4Rcp>(ctx); }
+}
+
+
+REGISTER_BENCHMARK("engine/simd/add", BM_f4_add, "");
+REGISTER_BENCHMARK("engine/simd/mul", BM_f4_mul, "");
+REGISTER_BENCHMARK("engine/simd/div", BM_f4_div, "");
+REGISTER_BENCHMARK("engine/simd/min", BM_f4_min, "");
+REGISTER_BENCHMARK("engine/simd/sqrt", BM_f4_sqrt, "");
+REGISTER_BENCHMARK("engine/simd/rsqrt", BM_f4_rsqrt, "");
+REGISTER_BENCHMARK("engine/simd/rcp", BM_f4_rcp, "");
+REGISTER_BENCHMARK("engine/simd/sphere_test", BM_f4_sphere_test, "");
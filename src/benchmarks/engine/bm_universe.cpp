@@ -0,0 +1,325 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/blob.h"
+#include "engine/job_system.h"
+#include "engine/snapshot.h"
+#include "engine/string.h"
+#include "engine/universe/universe.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const int ENTITIES_COUNT = 10000;
+
+
+	void BM_universe_set_position(Benchmark::Context& ctx)
+	{
+		Universe universe(ctx.getAllocator());
+		for (int i = 0; i < ENTITIES_COUNT; ++i) universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		float offset = 0;
+		while (ctx.iterate())
+		{
+			offset += 1;
+			for (int i = 0; i < ENTITIES_COUNT; ++i) universe.setPosition({i}, {(float)i, offset, 0});
+		}
+	}
+
+
+	void BM_universe_propagate_flat(Benchmark::Context& ctx)
+	{
+		Universe universe(ctx.getAllocator());
+		Entity root = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		for (int i = 0; i < ENTITIES_COUNT; ++i)
+		{
+			Entity child = universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+			universe.setParent(root, child);
+		}
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		float offset = 0;
+		while (ctx.iterate())
+		{
+			offset += 1;
+			universe.setPosition(root, {0, offset, 0});
+		}
+	}
+
+
+	void BM_universe_propagate_deep(Benchmark::Context& ctx)
+	{
+		// 100 chains of 100 entities
+		const int depth = 100;
+		Universe universe(ctx.getAllocator());
+		Entity root = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		for (int i = 0; i < ENTITIES_COUNT / depth; ++i)
+		{
+			Entity parent = root;
+			for (int j = 0; j < depth; ++j)
+			{
+				Entity child = universe.createEntity({(float)i, (float)j, 0}, {0, 0, 0, 1});
+				universe.setParent(parent, child);
+				parent = child;
+			}
+		}
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		float offset = 0;
+		while (ctx.iterate())
+		{
+			offset += 1;
+			universe.setPosition(root, {0, offset, 0});
+		}
+	}
+
+
+	// many independently moving hierarchies, each root is moved twice per frame
+	void BM_universe_move_roots(Benchmark::Context& ctx)
+	{
+		const int depth = 10;
+		const int roots_count = ENTITIES_COUNT / depth;
+		IAllocator& allocator = ctx.getAllocator();
+		JobSystem::init(allocator);
+		{
+			Universe universe(allocator);
+			universe.setDeferredTransforms(findSubstring(ctx.getParams(), "deferred") != nullptr);
+			for (int i = 0; i < roots_count; ++i)
+			{
+				Entity parent = universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+				for (int j = 1; j < depth; ++j)
+				{
+					Entity child = universe.createEntity({(float)i, (float)j, 0}, {0, 0, 0, 1});
+					universe.setParent(parent, child);
+					parent = child;
+				}
+			}
+
+			ctx.setItemsPerIteration(ENTITIES_COUNT);
+			float offset = 0;
+			while (ctx.iterate())
+			{
+				offset += 1;
+				for (int i = 0; i < roots_count; ++i)
+				{
+					Entity root = {i * depth};
+					universe.setPosition(root, {(float)i, offset, 0});
+					universe.setRotation(root, {0, 0, 0, 1});
+				}
+				universe.updateTransforms();
+			}
+		}
+		JobSystem::shutdown();
+	}
+
+
+	// spawning and moving projectiles, one by one or through the bulk API
+	void BM_universe_spawn(Benchmark::Context& ctx)
+	{
+		bool bulk = findSubstring(ctx.getParams(), "bulk") != nullptr;
+		IAllocator& allocator = ctx.getAllocator();
+		Array<Entity> entities(allocator);
+		Array<Transform> transforms(allocator);
+		entities.resize(ENTITIES_COUNT);
+		transforms.resize(ENTITIES_COUNT);
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		while (ctx.iterate())
+		{
+			Universe universe(allocator);
+			for (int i = 0; i < ENTITIES_COUNT; ++i) transforms[i] = {{(float)i, 1, 0}, {0, 0, 0, 1}, 1};
+			if (bulk)
+			{
+				universe.createEntities(&entities[0], ENTITIES_COUNT);
+				universe.setTransforms(&entities[0], &transforms[0], ENTITIES_COUNT);
+				universe.destroyEntities(&entities[0], ENTITIES_COUNT);
+			}
+			else
+			{
+				for (int i = 0; i < ENTITIES_COUNT; ++i) entities[i] = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+				for (int i = 0; i < ENTITIES_COUNT; ++i) universe.setTransform(entities[i], transforms[i]);
+				for (int i = 0; i < ENTITIES_COUNT; ++i) universe.destroyEntity(entities[i]);
+			}
+		}
+	}
+
+
+	void BM_universe_find_by_name(Benchmark::Context& ctx)
+	{
+		Universe universe(ctx.getAllocator());
+		for (int i = 0; i < ENTITIES_COUNT; ++i)
+		{
+			Entity entity = universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+			StaticString<32> name("entity_", i);
+			universe.setEntityName(entity, name);
+		}
+
+		const int lookups_count = 100;
+		ctx.setItemsPerIteration(lookups_count);
+		while (ctx.iterate())
+		{
+			for (int i = 0; i < lookups_count; ++i)
+			{
+				StaticString<32> name("entity_", ENTITIES_COUNT - 1 - i * 97);
+				Benchmark::Context::consume((u64)universe.findByName(INVALID_ENTITY, name).index);
+			}
+		}
+	}
+
+
+	// sums positions of entities with two of four component types, params "scan" or "query"
+	void BM_universe_iterate_components(Benchmark::Context& ctx)
+	{
+		const ComponentType types[] = {{0}, {1}, {2}, {3}};
+		Universe universe(ctx.getAllocator());
+		for (int i = 0; i < ENTITIES_COUNT; ++i)
+		{
+			Entity entity = universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+			for (int j = 0; j < lengthOf(types); ++j)
+			{
+				if ((i >> j) & 1) universe.onComponentCreated(entity, types[j], nullptr);
+			}
+		}
+
+		bool use_query = findSubstring(ctx.getParams(), "query") != nullptr;
+		int query = universe.registerQuery(types, 2);
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		while (ctx.iterate())
+		{
+			float sum = 0;
+			if (use_query)
+			{
+				const Entity* entities = universe.getQueryEntities(query);
+				for (int i = 0, c = universe.getQueryEntitiesCount(query); i < c; ++i)
+				{
+					sum += universe.getPosition(entities[i]).x;
+				}
+			}
+			else
+			{
+				for (Entity e = universe.getFirstEntity(); e.isValid(); e = universe.getNextEntity(e))
+				{
+					if (universe.hasComponent(e, types[0]) && universe.hasComponent(e, types[1]))
+					{
+						sum += universe.getPosition(e).x;
+					}
+				}
+			}
+			Benchmark::Context::consume(sum);
+		}
+		universe.unregisterQuery(query);
+	}
+
+
+	// destroying children of one parent, params "single" or "batch"
+	void BM_universe_destroy_children(Benchmark::Context& ctx)
+	{
+		bool batch = findSubstring(ctx.getParams(), "batch") != nullptr;
+		IAllocator& allocator = ctx.getAllocator();
+		Universe universe(allocator);
+		Array<Entity> children(allocator);
+		children.resize(ENTITIES_COUNT);
+		Entity parent = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		while (ctx.iterate())
+		{
+			{
+				Benchmark::ScopedPhase phase(ctx, "create");
+				for (Entity& child : children)
+				{
+					child = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+					universe.setParent(parent, child);
+				}
+			}
+
+			Benchmark::ScopedPhase phase(ctx, "destroy");
+			if (batch)
+			{
+				for (Entity child : children) universe.destroyEntityDeferred(child);
+				universe.flushDestroyedEntities();
+			}
+			else
+			{
+				for (Entity child : children) universe.destroyEntity(child);
+			}
+		}
+	}
+
+
+	// play/stop cycle, a few entities move and spawn during play, then the universe is reverted
+	// to a checkpoint or to a snapshot, params "checkpoint" or "snapshot"
+	void BM_universe_revert(Benchmark::Context& ctx)
+	{
+		const int moved_count = 100;
+		bool checkpoint = findSubstring(ctx.getParams(), "checkpoint") != nullptr;
+		IAllocator& allocator = ctx.getAllocator();
+		Universe universe(allocator);
+		for (int i = 0; i < ENTITIES_COUNT * 10; ++i) universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+
+		OutputBlob blob(allocator);
+		SnapshotWriter writer(blob, allocator);
+		universe.serialize(writer);
+		writer.end();
+		InputBlob in(blob);
+		SnapshotReader reader(allocator);
+		reader.read(in);
+
+		ctx.setItemsPerIteration(ENTITIES_COUNT * 10);
+		float offset = 0;
+		while (ctx.iterate())
+		{
+			{
+				Benchmark::ScopedPhase phase(ctx, "save");
+				if (checkpoint) universe.saveCheckpoint();
+			}
+			offset += 1;
+			for (int i = 0; i < moved_count; ++i)
+			{
+				universe.setPosition({i * 997}, {(float)i, offset, 0});
+				universe.createEntity({(float)i, offset, 0}, {0, 0, 0, 1});
+			}
+
+			Benchmark::ScopedPhase phase(ctx, "revert");
+			if (checkpoint)
+			{
+				universe.restoreCheckpoint();
+			}
+			else
+			{
+				universe.deserialize(reader);
+			}
+		}
+	}
+
+
+	void BM_universe_create_destroy(Benchmark::Context& ctx)
+	{
+		Universe universe(ctx.getAllocator());
+		ctx.setItemsPerIteration(ENTITIES_COUNT);
+		while (ctx.iterate())
+		{
+			for (int i = 0; i < ENTITIES_COUNT; ++i) universe.createEntity({(float)i, 0, 0}, {0, 0, 0, 1});
+			for (int i = 0; i < ENTITIES_COUNT; ++i) universe.destroyEntity({i});
+		}
+	}
+}
+
+
+REGISTER_BENCHMARK("engine/universe/set_position", BM_universe_set_position, "");
+REGISTER_BENCHMARK("engine/universe/propagate_flat", BM_universe_propagate_flat, "");
+REGISTER_BENCHMARK("engine/universe/propagate_deep", BM_universe_propagate_deep, "");
+REGISTER_BENCHMARK("engine/universe/move_roots_immediate", BM_universe_move_roots, "immediate");
+REGISTER_BENCHMARK("engine/universe/move_roots_deferred", BM_universe_move_roots, "deferred");
+REGISTER_BENCHMARK("engine/universe/spawn_single", BM_universe_spawn, "single");
+REGISTER_BENCHMARK("engine/universe/spawn_bulk", BM_universe_spawn, "bulk");
+REGISTER_BENCHMARK("engine/universe/find_by_name", BM_universe_find_by_name, "");
+REGISTER_BENCHMARK("engine/universe/iterate_components_scan", BM_universe_iterate_components, "scan");
+REGISTER_BENCHMARK("engine/universe/iterate_components_query", BM_universe_iterate_components, "query");
+REGISTER_BENCHMARK("engine/universe/destroy_children_single", BM_universe_destroy_children, "single");
+REGISTER_BENCHMARK("engine/universe/destroy_children_batch", BM_universe_destroy_children, "batch");
+REGISTER_BENCHMARK("engine/universe/create_destroy", BM_universe_create_destroy, "");
+REGISTER_BENCHMARK("engine/universe/revert_checkpoint", BM_universe_revert, "checkpoint");
+REGISTER_BENCHMARK("engine/universe/revert_snapshot", BM_universe_revert, "snapshot");
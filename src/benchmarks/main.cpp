@@ -0,0 +1,75 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/log.h"
+#include "engine/string.h"
+#include "engine/system.h"
+#include <cstdio>
+
+
+using namespace Lumix;
+
+
+static void outputToConsole(const char* system, const char* message)
+{
+	printf("%s: %s\n", system, message);
+}
+
+
+static int parseInt(const char* str, int default_value)
+{
+	int value;
+	if (!fromCString(str, stringLength(str), &value) || value < 0) return default_value;
+	return value;
+}
+
+
+int main(int argc, char* argv[])
+{
+	#ifndef _WIN32
+		// benchmarks have no window, the renderer plugin must not create a real backend;
+		// on Windows the command line is not settable, pass -noop_renderer there
+		static char noop_renderer[] = "-noop_renderer";
+		char* args[64];
+		int args_count = 0;
+		for (int i = 0; i < argc && args_count < lengthOf(args) - 1; ++i) args[args_count++] = argv[i];
+		args[args_count++] = noop_renderer;
+		setCommandLine(args_count, args);
+	#endif
+	g_log_info.getCallback().bind<outputToConsole>();
+	g_log_warning.getCallback().bind<outputToConsole>();
+	g_log_error.getCallback().bind<outputToConsole>();
+
+	const char* filter = "";
+	const char* json_path = nullptr;
+	int warmup = 3;
+	int repetitions = 20;
+	for (int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if (equalStrings(argv[i], "-filter") && has_value) filter = argv[++i];
+		else if (equalStrings(argv[i], "-json") && has_value) json_path = argv[++i];
+		else if (equalStrings(argv[i], "-warmup") && has_value) warmup = parseInt(argv[++i], warmup);
+		else if (equalStrings(argv[i], "-repetitions") && has_value) repetitions = parseInt(argv[++i], repetitions);
+		else if (equalStrings(argv[i], "-list"))
+		{
+			Benchmark::Manager::instance().dumpBenchmarks();
+			Benchmark::Manager::release();
+			return 0;
+		}
+	}
+	if (repetitions < 1) repetitions = 1;
+
+	int count = Benchmark::Manager::instance().run(filter, warmup, repetitions);
+	int ret = 0;
+	if (json_path && !Benchmark::Manager::instance().writeJSON(json_path))
+	{
+		g_log_error.log("Benchmark") << "Failed to write " << json_path;
+		ret = 1;
+	}
+	if (count == 0)
+	{
+		g_log_warning.log("Benchmark") << "No benchmark matches \"" << filter << "\"";
+	}
+
+	Benchmark::Manager::release();
+	return ret;
+}
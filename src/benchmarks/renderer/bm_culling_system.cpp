@@ -0,0 +1,124 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/array.h"
+#include "engine/geometry.h"
+#include "engine/job_system.h"
+#include "engine/math_utils.h"
+#include "engine/string.h"
+#include "renderer/culling_system.h"
+#include <cmath>
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	void BM_culling_system_cull(Benchmark::Context& ctx)
+	{
+		int count;
+		fromCString(ctx.getParams(), stringLength(ctx.getParams()), &count);
+
+		// spheres on a square grid around the camera, roughly 1/6 of them is in the frustum
+		IAllocator& allocator = ctx.getAllocator();
+		Array<Sphere> spheres(allocator);
+		Array<Entity> entities(allocator);
+		spheres.reserve(count);
+		entities.reserve(count);
+		int side = int(sqrtf((float)count)) + 1;
+		for (int i = 0; i < count; ++i)
+		{
+			float x = float(i % side - side / 2) * 4;
+			float z = float(i / side - side / 2) * 4;
+			spheres.push(Sphere(x, 0, z, 1.5f));
+			entities.push({i});
+		}
+
+		JobSystem::init(allocator);
+		CullingSystem* culling_system = CullingSystem::create(allocator);
+		culling_system->insert(spheres, entities);
+		// moved spheres are not in the tree, every one of them goes through the kernel
+		if (findSubstring(ctx.getParams(), "dynamic"))
+		{
+			for (int i = 0; i < count; ++i) culling_system->updateBoundingSphere(spheres[i], entities[i]);
+		}
+
+		Frustum frustum;
+		Vec3 camera_pos(0, 10, 0);
+		frustum.computePerspective(camera_pos,
+			{0, 0, 1},
+			{0, 1, 0},
+			Math::degreesToRadians(60),
+			16 / 9.0f,
+			0.1f,
+			side * 4.0f);
+
+		// camera and four shadow cascades, culled one by one or in a single pass
+		Frustum views[5];
+		u64 layer_masks[lengthOf(views)];
+		views[0] = frustum;
+		layer_masks[0] = 1;
+		for (int i = 1; i < lengthOf(views); ++i)
+		{
+			float size = side * 0.5f * i;
+			views[i].computeOrtho({0, 100, size}, {0, 1, 0}, {0, 0, 1}, size, size, 0.1f, 200);
+			layer_masks[i] = 1;
+		}
+		int views_count = findSubstring(ctx.getParams(), "views") ? lengthOf(views) : 1;
+		bool single_pass = findSubstring(ctx.getParams(), "single_pass") != nullptr;
+		// fixed or slowly moving camera, a cached view walks the tree again only after it moves by 1
+		int cached_view = findSubstring(ctx.getParams(), "cached") ? culling_system->createView(1) : -1;
+		bool moving = findSubstring(ctx.getParams(), "moving") != nullptr;
+
+		ctx.setItemsPerIteration(count);
+		while (ctx.iterate())
+		{
+			if (cached_view >= 0)
+			{
+				if (moving)
+				{
+					camera_pos.z += 0.1f;
+					frustum.computePerspective(camera_pos,
+						{0, 0, 1},
+						{0, 1, 0},
+						Math::degreesToRadians(60),
+						16 / 9.0f,
+						0.1f,
+						side * 4.0f);
+				}
+				const CullingSystem::Results& results = culling_system->cull(cached_view, frustum, 1);
+				Benchmark::Context::consume(&results);
+				continue;
+			}
+			if (single_pass)
+			{
+				const CullingSystem::Results* results = culling_system->cull(views, layer_masks, views_count);
+				Benchmark::Context::consume(results);
+				continue;
+			}
+			for (int i = 0; i < views_count; ++i)
+			{
+				const CullingSystem::Results& results = culling_system->cull(views[i], layer_masks[i]);
+				Benchmark::Context::consume(&results);
+			}
+		}
+
+		if (cached_view >= 0) culling_system->destroyView(cached_view);
+		CullingSystem::destroy(*culling_system);
+		JobSystem::shutdown();
+	}
+}
+
+
+REGISTER_BENCHMARK("renderer/culling_system/cull_10k", BM_culling_system_cull, "10000");
+REGISTER_BENCHMARK("renderer/culling_system/cull_100k", BM_culling_system_cull, "100000");
+REGISTER_BENCHMARK("renderer/culling_system/cull_1M", BM_culling_system_cull, "1000000");
+REGISTER_BENCHMARK("renderer/culling_system/cull_dynamic_100k", BM_culling_system_cull, "100000 dynamic");
+REGISTER_BENCHMARK("renderer/culling_system/cull_dynamic_1M", BM_culling_system_cull, "1000000 dynamic");
+REGISTER_BENCHMARK("renderer/culling_system/cull_cached_1M", BM_culling_system_cull, "1000000 cached");
+REGISTER_BENCHMARK("renderer/culling_system/cull_cached_moving_1M", BM_culling_system_cull, "1000000 cached moving");
+REGISTER_BENCHMARK("renderer/culling_system/cull_views_1M", BM_culling_system_cull, "1000000 views");
+REGISTER_BENCHMARK("renderer/culling_system/cull_views_single_pass_1M", BM_culling_system_cull, "1000000 views single_pass");
+REGISTER_BENCHMARK("renderer/culling_system/cull_dynamic_views_1M", BM_culling_system_cull, "1000000 dynamic views");
+REGISTER_BENCHMARK("renderer/culling_system/cull_dynamic_views_single_pass_1M",
+	BM_culling_system_cull,
+	"1000000 dynamic views single_pass");
@@ -0,0 +1,112 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/geometry.h"
+#include "engine/job_system.h"
+#include "engine/math_utils.h"
+#include "engine/string.h"
+#include "renderer/model.h"
+#include "renderer/occlusion_buffer.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const int GRID_SIZE = 32;
+	const int OCCLUDERS_COUNT = 16;
+	const int BOXES_COUNT = 10000;
+
+
+	// GRID_SIZE x GRID_SIZE quads in the z = 0 plane facing +z
+	void initGrid(Mesh& mesh)
+	{
+		for (int j = 0; j <= GRID_SIZE; ++j)
+		{
+			for (int i = 0; i <= GRID_SIZE; ++i)
+			{
+				mesh.vertices.push({(float)i / GRID_SIZE - 0.5f, (float)j / GRID_SIZE - 0.5f, 0});
+			}
+		}
+		auto push = [&mesh](int index) {
+			mesh.indices.push(u8(index & 0xff));
+			mesh.indices.push(u8((index >> 8) & 0xff));
+			mesh.indices.push(u8((index >> 16) & 0xff));
+			mesh.indices.push(u8(index >> 24));
+		};
+		for (int j = 0; j < GRID_SIZE; ++j)
+		{
+			for (int i = 0; i < GRID_SIZE; ++i)
+			{
+				int index = i + j * (GRID_SIZE + 1);
+				push(index);
+				push(index + 1);
+				push(index + GRID_SIZE + 2);
+				push(index);
+				push(index + GRID_SIZE + 2);
+				push(index + GRID_SIZE + 1);
+			}
+		}
+	}
+
+
+	// walls in front of the camera and boxes behind them, params "rasterize" or "test"
+	void BM_occlusion_buffer(Benchmark::Context& ctx)
+	{
+		IAllocator& allocator = ctx.getAllocator();
+		JobSystem::init(allocator);
+		{
+			bgfx::VertexDecl decl;
+			Mesh grid(nullptr, decl, "grid", allocator);
+			initGrid(grid);
+
+			Matrix projection;
+			projection.setPerspective(Math::degreesToRadians(60), 16 / 9.0f, 0.1f, 1000, true, true);
+			OcclusionBuffer buffer(allocator);
+			buffer.clear();
+			buffer.setCamera(Matrix::IDENTITY, projection, true);
+
+			Matrix walls[OCCLUDERS_COUNT];
+			for (int i = 0; i < OCCLUDERS_COUNT; ++i)
+			{
+				walls[i] = Matrix::IDENTITY;
+				walls[i].multiply3x3(12);
+				walls[i].setTranslation({float(i % 4 - 2) * 10 + 5, float(i / 4 - 2) * 6 + 3, -20.0f - i});
+			}
+			AABB box(Vec3(-0.5f, -0.5f, -0.5f), Vec3(0.5f, 0.5f, 0.5f));
+			Array<Matrix> boxes(allocator);
+			for (int i = 0; i < BOXES_COUNT; ++i)
+			{
+				Matrix& mtx = boxes.emplace(Matrix::IDENTITY);
+				mtx.setTranslation({float(i % 100 - 50), float(i / 100 % 10 - 5), -40.0f - i / 1000});
+			}
+
+			bool rasterize = findSubstring(ctx.getParams(), "rasterize") != nullptr;
+			ctx.setItemsPerIteration(rasterize ? OCCLUDERS_COUNT * GRID_SIZE * GRID_SIZE * 2 : BOXES_COUNT);
+			bool is_rasterized = false;
+			while (ctx.iterate())
+			{
+				if (rasterize || !is_rasterized)
+				{
+					buffer.clear();
+					for (const Matrix& mtx : walls) buffer.addOccluder(mtx, grid);
+					buffer.rasterize();
+					buffer.buildHierarchy();
+					is_rasterized = true;
+				}
+				if (rasterize) continue;
+
+				int occluded_count = 0;
+				for (const Matrix& mtx : boxes)
+				{
+					if (buffer.isOccluded(mtx, box)) ++occluded_count;
+				}
+				Benchmark::Context::consume((u64)occluded_count);
+			}
+		}
+		JobSystem::shutdown();
+	}
+}
+
+
+REGISTER_BENCHMARK("renderer/occlusion_buffer/rasterize", BM_occlusion_buffer, "rasterize");
+REGISTER_BENCHMARK("renderer/occlusion_buffer/test", BM_occlusion_buffer, "test");
@@ -0,0 +1,255 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/blob.h"
+#include "engine/command_line_parser.h"
+#include "engine/engine.h"
+#include "engine/fs/file_system.h"
+#include "engine/geometry.h"
+#include "engine/log.h"
+#include "engine/path.h"
+#include "engine/plugin_manager.h"
+#include "engine/reflection.h"
+#include "engine/string.h"
+#include "engine/system.h"
+#include "engine/universe/universe.h"
+#include "lua_script/lua_script_system.h"
+#include "renderer/render_scene.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	const ComponentType MODEL_INSTANCE_TYPE = Reflection::getComponentType("renderable");
+	const ComponentType POINT_LIGHT_TYPE = Reflection::getComponentType("point_light");
+	const ComponentType PARTICLE_EMITTER_TYPE = Reflection::getComponentType("particle_emitter");
+	const ComponentType LUA_SCRIPT_TYPE = Reflection::getComponentType("lua_script");
+	const ComponentType CAMERA_TYPE = Reflection::getComponentType("camera");
+
+	// chains are this long in the deep variant, recursion in Universe::transformEntity is as deep
+	const int DEEP_HIERARCHY_DEPTH = 64;
+	const int POINT_LIGHT_PERIOD = 256;
+	const int PARTICLE_EMITTER_PERIOD = 512;
+	const int LUA_SCRIPT_PERIOD = 128;
+
+
+	struct Options
+	{
+		// resources are optional, without them components exist but are not loaded
+		char model[MAX_PATH_LENGTH];
+		char script[MAX_PATH_LENGTH];
+	};
+
+
+	void getOptions(Options& options)
+	{
+		options.model[0] = '\0';
+		options.script[0] = '\0';
+
+		char cmd_line[2048];
+		getCommandLine(cmd_line, lengthOf(cmd_line));
+		CommandLineParser parser(cmd_line);
+		while (parser.next())
+		{
+			if (parser.currentEquals("-stress_model"))
+			{
+				if (!parser.next()) break;
+				parser.getCurrent(options.model, lengthOf(options.model));
+			}
+			else if (parser.currentEquals("-stress_script"))
+			{
+				if (!parser.next()) break;
+				parser.getCurrent(options.script, lengthOf(options.script));
+			}
+		}
+	}
+
+
+	void waitForResources(Engine& engine)
+	{
+		FS::FileSystem& fs = engine.getFileSystem();
+		while (fs.hasWork()) fs.updateAsyncTransactions();
+	}
+
+
+	// returns roots, moving them propagates to the whole universe
+	void populate(Universe& universe, int count, bool deep, const Options& options, Array<Entity>& roots)
+	{
+		auto* render_scene = static_cast<RenderScene*>(universe.getScene(MODEL_INSTANCE_TYPE));
+		auto* script_scene = static_cast<LuaScriptScene*>(universe.getScene(LUA_SCRIPT_TYPE));
+		Path model_path(options.model);
+		Path script_path(options.script);
+
+		roots.clear();
+		int side = 1;
+		while (side * side < count) ++side;
+		Entity parent = INVALID_ENTITY;
+		for (int i = 0; i < count; ++i)
+		{
+			Vec3 pos(float(i % side) * 4, 0, float(i / side) * 4);
+			Entity entity = universe.createEntity(pos, {0, 0, 0, 1});
+			if (deep ? i % DEEP_HIERARCHY_DEPTH == 0 : i == 0)
+			{
+				roots.push(entity);
+			}
+			else
+			{
+				universe.setParent(parent, entity);
+			}
+			// flat - one root with everything else as its direct children
+			if (deep || i == 0) parent = entity;
+
+			universe.createComponent(MODEL_INSTANCE_TYPE, entity);
+			if (model_path.isValid()) render_scene->setModelInstancePath(entity, model_path);
+			if (i % POINT_LIGHT_PERIOD == 0) universe.createComponent(POINT_LIGHT_TYPE, entity);
+			if (i % PARTICLE_EMITTER_PERIOD == 0) universe.createComponent(PARTICLE_EMITTER_TYPE, entity);
+			if (script_scene && i % LUA_SCRIPT_PERIOD == 0)
+			{
+				universe.createComponent(LUA_SCRIPT_TYPE, entity);
+				script_scene->addScript(entity);
+				if (script_path.isValid()) script_scene->setScriptPath(entity, 0, script_path);
+			}
+		}
+	}
+
+
+	Entity createCamera(Universe& universe, int count)
+	{
+		auto* render_scene = static_cast<RenderScene*>(universe.getScene(CAMERA_TYPE));
+		int side = 1;
+		while (side * side < count) ++side;
+		float extent = side * 4.0f;
+		Entity camera = universe.createEntity({extent * 0.5f, 20, -10}, {0, 0, 0, 1});
+		universe.createComponent(CAMERA_TYPE, camera);
+		render_scene->setCameraFarPlane(camera, extent);
+		render_scene->setCameraScreenSize(camera, 1920, 1080);
+		return camera;
+	}
+
+
+	void BM_large_universe(Benchmark::Context& ctx)
+	{
+		int count;
+		fromCString(ctx.getParams(), stringLength(ctx.getParams()), &count);
+		bool deep = findSubstring(ctx.getParams(), "deep") != nullptr;
+		Options options;
+		getOptions(options);
+
+		IAllocator& allocator = ctx.getAllocator();
+		Engine* engine = Engine::create("", "", nullptr, allocator);
+		PluginManager& plugin_manager = engine->getPluginManager();
+		if (!plugin_manager.load("renderer"))
+		{
+			g_log_error.log("Benchmark") << "Failed to load renderer plugin";
+			Engine::destroy(engine, allocator);
+			return;
+		}
+		plugin_manager.load("lua_script");
+
+		// without a model nothing is in the culling system, culling would time empty work
+		bool has_model = options.model[0] != '\0';
+		if (!has_model)
+		{
+			g_log_warning.log("Benchmark")
+				<< "No -stress_model, skipping cull, get_model_instance_infos and point_lights phases";
+		}
+
+		ctx.limitRepetitions(1, count >= 1000000 ? 3 : 10);
+		ctx.setItemsPerIteration(count);
+		Array<Entity> roots(allocator);
+		Array<Entity> visible(allocator);
+		Array<Entity> lights(allocator);
+		Array<MeshInstance> light_infos(allocator);
+		OutputBlob blob(allocator);
+		float offset = 0;
+		while (ctx.iterate())
+		{
+			Universe* universe;
+			Entity camera;
+			{
+				Benchmark::ScopedPhase phase(ctx, "create");
+				universe = &engine->createUniverse(false);
+				populate(*universe, count, deep, options, roots);
+				camera = createCamera(*universe, count);
+			}
+			{
+				Benchmark::ScopedPhase phase(ctx, "wait_for_resources");
+				waitForResources(*engine);
+			}
+			auto* render_scene = static_cast<RenderScene*>(universe->getScene(MODEL_INSTANCE_TYPE));
+
+			{
+				Benchmark::ScopedPhase phase(ctx, "set_transform");
+				offset += 1;
+				for (Entity root : roots)
+				{
+					Vec3 pos = universe->getPosition(root);
+					pos.y = offset;
+					universe->setPosition(root, pos);
+				}
+			}
+
+			Frustum frustum = render_scene->getCameraFrustum(camera);
+			if (has_model)
+			{
+				Benchmark::ScopedPhase phase(ctx, "cull");
+				visible.clear();
+				render_scene->getModelInstanceEntities(frustum, visible);
+			}
+
+			if (has_model)
+			{
+				Benchmark::ScopedPhase phase(ctx, "get_model_instance_infos");
+				auto& infos = render_scene->getModelInstanceInfos(frustum, universe->getPosition(camera), camera, ~0ULL);
+				Benchmark::Context::consume(&infos);
+			}
+
+			if (has_model)
+			{
+				Benchmark::ScopedPhase phase(ctx, "point_lights");
+				lights.clear();
+				render_scene->getPointLights(frustum, lights);
+				for (Entity light : lights)
+				{
+					light_infos.clear();
+					render_scene->getPointLightInfluencedGeometry(light, camera, universe->getPosition(camera), frustum, light_infos);
+				}
+				Benchmark::Context::consume(&light_infos);
+			}
+
+			{
+				Benchmark::ScopedPhase phase(ctx, "serialize");
+				blob.clear();
+				engine->serialize(*universe, blob);
+			}
+
+			Universe* loaded;
+			{
+				Benchmark::ScopedPhase phase(ctx, "deserialize");
+				loaded = &engine->createUniverse(false);
+				InputBlob in(blob);
+				if (!engine->deserialize(*loaded, in)) g_log_error.log("Benchmark") << "Failed to deserialize universe";
+			}
+
+			{
+				Benchmark::ScopedPhase phase(ctx, "destroy_loaded");
+				engine->destroyUniverse(*loaded);
+			}
+
+			{
+				Benchmark::ScopedPhase phase(ctx, "destroy");
+				engine->destroyUniverse(*universe);
+			}
+		}
+
+		Engine::destroy(engine, allocator);
+	}
+}
+
+
+REGISTER_BENCHMARK("scene/large_universe/flat_10k", BM_large_universe, "10000 flat");
+REGISTER_BENCHMARK("scene/large_universe/deep_10k", BM_large_universe, "10000 deep");
+REGISTER_BENCHMARK("scene/large_universe/flat_100k", BM_large_universe, "100000 flat");
+REGISTER_BENCHMARK("scene/large_universe/deep_100k", BM_large_universe, "100000 deep");
+REGISTER_BENCHMARK("scene/large_universe/flat_1M", BM_large_universe, "1000000 flat");
+REGISTER_BENCHMARK("scene/large_universe/deep_1M", BM_large_universe, "1000000 deep");
@@ -0,0 +1,352 @@
+#include "benchmarks/suite/benchmark.h"
+#include "engine/fs/os_file.h"
+#include "engine/log.h"
+#include "engine/string.h"
+#include "engine/timer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace Lumix
+{
+namespace Benchmark
+{
+
+
+static volatile u64 g_u64_sink;
+static volatile float g_float_sink;
+static const void* volatile g_ptr_sink;
+
+
+Context::Context(IAllocator& allocator, Timer& timer, const char* params, int warmup, int repetitions)
+	: m_allocator(allocator)
+	, m_timer(timer)
+	, m_params(params)
+	, m_samples(allocator)
+	, m_phases(allocator)
+	, m_items_per_iteration(0)
+	, m_iteration_start(0)
+	, m_iteration(0)
+	, m_warmup(warmup)
+	, m_repetitions(repetitions)
+{
+	m_samples.reserve(repetitions);
+}
+
+
+bool Context::iterate()
+{
+	u64 now = m_timer.getRawTimeSinceStart();
+	if (m_iteration > m_warmup) m_samples.push(now - m_iteration_start);
+	if (m_iteration >= m_warmup + m_repetitions) return false;
+	++m_iteration;
+	m_iteration_start = m_timer.getRawTimeSinceStart();
+	return true;
+}
+
+
+void Context::limitRepetitions(int warmup, int repetitions)
+{
+	ASSERT(m_iteration == 0);
+	if (warmup < m_warmup) m_warmup = warmup;
+	if (repetitions < m_repetitions) m_repetitions = repetitions;
+}
+
+
+void Context::recordPhase(const char* name, u64 ticks)
+{
+	if (isWarmup()) return;
+
+	for (Phase& phase : m_phases)
+	{
+		if (phase.name == name || equalStrings(phase.name, name))
+		{
+			phase.samples.push(ticks);
+			return;
+		}
+	}
+	Phase& phase = m_phases.emplace(m_allocator);
+	phase.name = name;
+	phase.samples.push(ticks);
+}
+
+
+ScopedPhase::ScopedPhase(Context& ctx, const char* name)
+	: m_context(ctx)
+	, m_name(name)
+	, m_start(ctx.getTimer().getRawTimeSinceStart())
+{
+}
+
+
+ScopedPhase::~ScopedPhase()
+{
+	m_context.recordPhase(m_name, m_context.getTimer().getRawTimeSinceStart() - m_start);
+}
+
+
+void Context::consume(u64 value)
+{
+	g_u64_sink = value;
+}
+
+
+void Context::consume(float value)
+{
+	g_float_sink = value;
+}
+
+
+void Context::consume(const void* ptr)
+{
+	g_ptr_sink = ptr;
+}
+
+
+static int compareSamples(const void* a, const void* b)
+{
+	u64 x = *(const u64*)a;
+	u64 y = *(const u64*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+static void computeStatistics(Array<u64>& samples, u64 frequency, u64 items_per_iteration, Statistics& stats)
+{
+	stats = {};
+	stats.repetitions = samples.size();
+	if (samples.empty()) return;
+
+	qsort(&samples[0], samples.size(), sizeof(samples[0]), compareSamples);
+	double to_ns = 1e9 / double(frequency);
+	auto percentile = [&](float p) {
+		int idx = int(p * (samples.size() - 1) + 0.5f);
+		return samples[idx] * to_ns;
+	};
+
+	double sum = 0;
+	for (u64 sample : samples) sum += sample * to_ns;
+	stats.mean_ns = sum / samples.size();
+	double variance = 0;
+	for (u64 sample : samples)
+	{
+		double d = sample * to_ns - stats.mean_ns;
+		variance += d * d;
+	}
+	stats.stddev_ns = sqrt(variance / samples.size());
+	stats.min_ns = samples[0] * to_ns;
+	stats.max_ns = samples.back() * to_ns;
+	stats.median_ns = percentile(0.5f);
+	stats.p95_ns = percentile(0.95f);
+	stats.items_per_second = stats.mean_ns > 0 ? items_per_iteration * 1e9 / stats.mean_ns : 0;
+}
+
+
+void Context::computeStatistics(Statistics& stats)
+{
+	Benchmark::computeStatistics(m_samples, m_timer.getFrequency(), m_items_per_iteration, stats);
+}
+
+
+void Context::computePhaseStatistics(int index, Statistics& stats)
+{
+	Benchmark::computeStatistics(m_phases[index].samples, m_timer.getFrequency(), m_items_per_iteration, stats);
+}
+
+
+struct BenchmarkEntry
+{
+	const char* name;
+	const char* params;
+	BenchmarkFunc func;
+};
+
+
+struct PhaseResult
+{
+	const char* name;
+	Statistics stats;
+};
+
+
+struct BenchmarkResult
+{
+	explicit BenchmarkResult(IAllocator& allocator) : phases(allocator) {}
+
+	const char* name;
+	const char* params;
+	Statistics stats;
+	Array<PhaseResult> phases;
+};
+
+
+struct ManagerImpl
+{
+	explicit ManagerImpl(IAllocator& allocator)
+		: m_allocator(allocator)
+		, m_benchmarks(allocator)
+		, m_results(allocator)
+	{
+	}
+
+	IAllocator& m_allocator;
+	Array<BenchmarkEntry> m_benchmarks;
+	Array<BenchmarkResult> m_results;
+};
+
+
+Manager* Manager::s_instance = nullptr;
+
+
+IAllocator& Manager::getAllocator()
+{
+	static DefaultAllocator allocator;
+	return allocator;
+}
+
+
+Manager& Manager::instance()
+{
+	if (!s_instance) s_instance = LUMIX_NEW(getAllocator(), Manager)(getAllocator());
+	return *s_instance;
+}
+
+
+void Manager::release()
+{
+	LUMIX_DELETE(getAllocator(), s_instance);
+	s_instance = nullptr;
+}
+
+
+Manager::Manager(IAllocator& allocator)
+{
+	m_impl = LUMIX_NEW(allocator, ManagerImpl)(allocator);
+}
+
+
+Manager::~Manager()
+{
+	LUMIX_DELETE(m_impl->m_allocator, m_impl);
+}
+
+
+void Manager::registerFunction(const char* name, BenchmarkFunc func, const char* params)
+{
+	BenchmarkEntry& entry = m_impl->m_benchmarks.emplace();
+	entry.name = name;
+	entry.params = params;
+	entry.func = func;
+}
+
+
+void Manager::dumpBenchmarks() const
+{
+	for (const BenchmarkEntry& entry : m_impl->m_benchmarks)
+	{
+		g_log_info.log("Benchmark") << entry.name;
+	}
+}
+
+
+static void printStatistics(const char* label, const Statistics& s)
+{
+	printf("%-56s %12.3f %12.3f %12.3f %12.3f %14.0f\n",
+		label,
+		s.mean_ns / 1000,
+		s.median_ns / 1000,
+		s.p95_ns / 1000,
+		s.stddev_ns / 1000,
+		s.items_per_second);
+}
+
+
+int Manager::run(const char* filter, int warmup, int repetitions)
+{
+	Timer* timer = Timer::create(m_impl->m_allocator);
+	m_impl->m_results.clear();
+	printf("%-56s %12s %12s %12s %12s %14s\n", "benchmark", "mean [us]", "median [us]", "p95 [us]", "stddev [us]", "items/s");
+	for (const BenchmarkEntry& entry : m_impl->m_benchmarks)
+	{
+		if (filter && filter[0] && !findSubstring(entry.name, filter)) continue;
+
+		Context ctx(m_impl->m_allocator, *timer, entry.params, warmup, repetitions);
+		entry.func(ctx);
+
+		BenchmarkResult& result = m_impl->m_results.emplace(m_impl->m_allocator);
+		result.name = entry.name;
+		result.params = entry.params;
+		ctx.computeStatistics(result.stats);
+		printStatistics(entry.name, result.stats);
+		for (int i = 0, c = ctx.getPhasesCount(); i < c; ++i)
+		{
+			PhaseResult& phase = result.phases.emplace();
+			phase.name = ctx.getPhaseName(i);
+			ctx.computePhaseStatistics(i, phase.stats);
+			StaticString<128> label("  ", phase.name);
+			printStatistics(label, phase.stats);
+		}
+	}
+	Timer::destroy(timer);
+	return m_impl->m_results.size();
+}
+
+
+static void writeNumber(FS::OsFile& file, const char* indent, const char* label, double value, bool last = false)
+{
+	char tmp[64];
+	snprintf(tmp, sizeof(tmp), "%.3f", value);
+	file << indent << "\"" << label << "\": " << tmp << (last ? "\n" : ",\n");
+}
+
+
+static void writeStatistics(FS::OsFile& file, const char* indent, const Statistics& s)
+{
+	file << indent << "\"repetitions\": " << s.repetitions << ",\n";
+	writeNumber(file, indent, "min_ns", s.min_ns);
+	writeNumber(file, indent, "max_ns", s.max_ns);
+	writeNumber(file, indent, "mean_ns", s.mean_ns);
+	writeNumber(file, indent, "median_ns", s.median_ns);
+	writeNumber(file, indent, "p95_ns", s.p95_ns);
+	writeNumber(file, indent, "stddev_ns", s.stddev_ns);
+	writeNumber(file, indent, "items_per_second", s.items_per_second, true);
+}
+
+
+bool Manager::writeJSON(const char* path) const
+{
+	FS::OsFile file;
+	if (!file.open(path, FS::Mode::CREATE_AND_WRITE)) return false;
+
+	file << "{\n\t\"benchmarks\": [\n";
+	for (int i = 0, c = m_impl->m_results.size(); i < c; ++i)
+	{
+		const BenchmarkResult& result = m_impl->m_results[i];
+		file << "\t\t{\n";
+		file << "\t\t\t\"name\": \"" << result.name << "\",\n";
+		file << "\t\t\t\"params\": \"" << result.params << "\",\n";
+		if (!result.phases.empty())
+		{
+			file << "\t\t\t\"phases\": [\n";
+			for (int j = 0, phases_count = result.phases.size(); j < phases_count; ++j)
+			{
+				const PhaseResult& phase = result.phases[j];
+				file << "\t\t\t\t{\n";
+				file << "\t\t\t\t\t\"name\": \"" << phase.name << "\",\n";
+				writeStatistics(file, "\t\t\t\t\t", phase.stats);
+				file << (j + 1 < phases_count ? "\t\t\t\t},\n" : "\t\t\t\t}\n");
+			}
+			file << "\t\t\t],\n";
+		}
+		writeStatistics(file, "\t\t\t", result.stats);
+		file << (i + 1 < c ? "\t\t},\n" : "\t\t}\n");
+	}
+	file << "\t]\n}\n";
+	file.close();
+	return true;
+}
+
+
+} // namespace Benchmark
+} // namespace Lumix
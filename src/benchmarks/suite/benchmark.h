@@ -0,0 +1,137 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+class Timer;
+
+
+namespace Benchmark
+{
+
+
+class Context;
+typedef void (*BenchmarkFunc)(Context&);
+
+
+struct Statistics
+{
+	int repetitions;
+	double min_ns;
+	double max_ns;
+	double mean_ns;
+	double median_ns;
+	double p95_ns;
+	double stddev_ns;
+	double items_per_second;
+};
+
+
+class Context
+{
+public:
+	Context(IAllocator& allocator, Timer& timer, const char* params, int warmup, int repetitions);
+
+	// call in a loop, everything inside the loop is measured, the first warmup iterations are discarded
+	bool iterate();
+	void setItemsPerIteration(u64 items) { m_items_per_iteration = items; }
+	// for expensive benchmarks, call before the first iterate()
+	void limitRepetitions(int warmup, int repetitions);
+	bool isWarmup() const { return m_iteration <= m_warmup; }
+	void recordPhase(const char* name, u64 ticks);
+	Timer& getTimer() { return m_timer; }
+	const char* getParams() const { return m_params; }
+	IAllocator& getAllocator() { return m_allocator; }
+
+	// keeps the compiler from optimizing away results of the measured code
+	static void consume(u64 value);
+	static void consume(float value);
+	static void consume(const void* ptr);
+
+	void computeStatistics(Statistics& stats);
+	int getPhasesCount() const { return m_phases.size(); }
+	const char* getPhaseName(int index) const { return m_phases[index].name; }
+	void computePhaseStatistics(int index, Statistics& stats);
+
+private:
+	struct Phase
+	{
+		explicit Phase(IAllocator& allocator) : samples(allocator) {}
+
+		const char* name;
+		Array<u64> samples;
+	};
+
+private:
+	IAllocator& m_allocator;
+	Timer& m_timer;
+	const char* m_params;
+	Array<u64> m_samples;
+	Array<Phase> m_phases;
+	u64 m_items_per_iteration;
+	u64 m_iteration_start;
+	int m_iteration;
+	int m_warmup;
+	int m_repetitions;
+};
+
+
+// measures a part of an iteration, reported as a separate row
+class ScopedPhase
+{
+public:
+	ScopedPhase(Context& ctx, const char* name);
+	~ScopedPhase();
+
+private:
+	Context& m_context;
+	const char* m_name;
+	u64 m_start;
+};
+
+
+class Manager
+{
+public:
+	static IAllocator& getAllocator();
+	static Manager& instance();
+	static void release();
+
+	void registerFunction(const char* name, BenchmarkFunc func, const char* params);
+	void dumpBenchmarks() const;
+	int run(const char* filter, int warmup, int repetitions);
+	bool writeJSON(const char* path) const;
+
+	explicit Manager(IAllocator& allocator);
+	~Manager();
+
+private:
+	struct ManagerImpl* m_impl;
+	static Manager* s_instance;
+};
+
+
+struct Helper
+{
+	Helper(const char* name, BenchmarkFunc func, const char* params)
+	{
+		Manager::instance().registerFunction(name, func, params);
+	}
+};
+
+
+} // namespace Benchmark
+} // namespace Lumix
+
+
+#define BENCHMARK_JOIN_STRINGS_2(A, B) A ## B
+#define BENCHMARK_JOIN_STRINGS(A, B) BENCHMARK_JOIN_STRINGS_2(A, B)
+
+#define REGISTER_BENCHMARK(name, method, params) \
+	namespace { Lumix::Benchmark::Helper BENCHMARK_JOIN_STRINGS(BENCHMARK_JOIN_STRINGS(benchmark_register_, method), __LINE__)(name, method, params); }
@@ -23,6 +23,7 @@ namespace Lumix
 
 
 static const int MAX_FRAMES = 200;
+static const int SPIKE_FRAMES_AFTER = 20;
 
 
 enum Column
@@ -58,6 +59,7 @@ struct ProfilerUIImpl LUMIX_FINAL : public ProfilerUI
 		m_current_frame = -1;
 		m_is_open = false;
 		m_is_paused = true;
+		m_spike_threshold = 0;
 		m_current_block = nullptr;
 		m_frame_start = m_frame_end = 0;
 		Profiler::getFrameListeners().bind<ProfilerUIImpl, &ProfilerUIImpl::onFrame>(this);
@@ -376,6 +378,12 @@ struct ProfilerUIImpl LUMIX_FINAL : public ProfilerUI
 			unsigned long long length;
 		};
 		Array<Hit> m_hits;
+		struct HitJob
+		{
+			u32 job;
+			u32 parent_job;
+		};
+		Array<HitJob> m_hit_jobs; // parallel to m_hits, m_hits must stay pairs of u64 for IntervalGraph
 		Array<int> m_int_values; // hit count in case of m_type == TIME
 	};
 
@@ -424,6 +432,7 @@ struct ProfilerUIImpl LUMIX_FINAL : public ProfilerUI
 	void onGUIResources();
 	void onFrame();
 	void showProfileBlock(Block* block, int column);
+	void showHitJobs(const Block& block) const;
 	void cloneBlock(Block* my_block, Profiler::Block* remote_block);
 	void addToTree(Debug::Allocator::AllocationInfo* info);
 	void refreshAllocations();
@@ -448,6 +457,7 @@ struct ProfilerUIImpl LUMIX_FINAL : public ProfilerUI
 	int m_allocation_size_to;
 	int m_current_frame;
 	bool m_is_paused;
+	float m_spike_threshold;
 	char m_filter[100];
 	char m_resource_filter[100];
 	Array<OpenedFile> m_open_files;
@@ -483,11 +493,15 @@ void ProfilerUIImpl::cloneBlock(Block* my_block, Profiler::Block* remote_block)
 			break;
 	}
 	my_block->m_hits.resize(Profiler::getBlockHitCount(remote_block));
+	my_block->m_hit_jobs.resize(my_block->m_hits.size());
 	for(int i = 0, c = my_block->m_hits.size(); i < c; ++i)
 	{
 		auto& hit = my_block->m_hits[i];
 		hit.start = Profiler::getBlockHitStart(remote_block, i);
 		hit.length = Profiler::getBlockHitLength(remote_block, i);
+		auto& hit_job = my_block->m_hit_jobs[i];
+		hit_job.job = Profiler::getBlockHitJob(remote_block, i);
+		hit_job.parent_job = Profiler::getBlockHitParentJob(remote_block, i);
 	}
 
 	if (my_block->m_frames.size() > MAX_FRAMES)
@@ -557,6 +571,7 @@ void ProfilerUIImpl::onFrame()
 {
 	if (!m_is_open) return;
 	if (m_is_paused) return;
+	if (Profiler::isFrozen()) return;
 
 	m_frame_start = m_frame_end;
 	m_frame_end = Profiler::now();
@@ -601,6 +616,34 @@ void ProfilerUIImpl::onFrame()
 }
 
 
+void ProfilerUIImpl::showHitJobs(const Block& block) const
+{
+	static const int MAX_LINES = 16;
+	int lines = 0;
+	ImGui::BeginTooltip();
+	for (const Block::HitJob& hit_job : block.m_hit_jobs)
+	{
+		if (hit_job.job == 0) continue;
+		if (lines == MAX_LINES)
+		{
+			ImGui::Text("...");
+			break;
+		}
+		if (hit_job.parent_job == 0)
+		{
+			ImGui::Text("job %u", hit_job.job);
+		}
+		else
+		{
+			ImGui::Text("job %u spawned by job %u", hit_job.job, hit_job.parent_job);
+		}
+		++lines;
+	}
+	if (lines == 0) ImGui::Text("not in a job");
+	ImGui::EndTooltip();
+}
+
+
 void ProfilerUIImpl::showProfileBlock(Block* block, int column)
 {
 	if (!block) return;
@@ -730,6 +773,7 @@ void ProfilerUIImpl::showProfileBlock(Block* block, int column)
 				else
 				{
 					ImGui::IntervalGraph(&block->m_hits[0].start, block->m_hits.size(), m_frame_start, m_frame_end);
+					if (ImGui::IsItemHovered()) showHitJobs(*block);
 				}
 				if(block->m_is_open)
 				{
@@ -1053,6 +1097,28 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	if (!ImGui::CollapsingHeader("CPU")) return;
 
 	ImGui::Checkbox("Pause", &m_is_paused);
+	ImGui::SameLine();
+	ImGui::PushItemWidth(100);
+	if (ImGui::DragFloat("Freeze on spike (ms)", &m_spike_threshold, 0.1f, 0, FLT_MAX))
+	{
+		m_spike_threshold = Math::maximum(m_spike_threshold, 0.0f);
+		Profiler::setSpikeThreshold(m_spike_threshold / 1000.0f, SPIKE_FRAMES_AFTER);
+	}
+	ImGui::PopItemWidth();
+	if (Profiler::isFrozen())
+	{
+		ImGui::SameLine();
+		if (ImGui::Button("Resume")) Profiler::freeze(false);
+	}
+
+	Profiler::HistoryStats frame_stats = Profiler::getFrameHistoryStats();
+	ImGui::Text("Frame time (ms) min %.2f mean %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f",
+		frame_stats.min * 1000,
+		frame_stats.mean * 1000,
+		frame_stats.p50 * 1000,
+		frame_stats.p95 * 1000,
+		frame_stats.p99 * 1000,
+		frame_stats.max * 1000);
 
 	auto thread_getter = [](void* data, int index, const char** out) -> bool {
 		auto id = Profiler::getThreadID(index);
@@ -1122,6 +1188,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 ProfilerUIImpl::Block::Block(IAllocator& allocator)
 	: m_frames(allocator)
 	, m_hits(allocator)
+	, m_hit_jobs(allocator)
 	, m_int_values(allocator)
 	, m_is_open(false)
 {
@@ -68,7 +68,12 @@ namespace Lumix
 		if (newptr == nullptr) {
 			return nullptr;
 		}
-		memcpy(newptr, ptr, malloc_usable_size(ptr));
+		if (ptr)
+		{
+			// usable size can be bigger than the new block when the old block was not split
+			size_t old_size = malloc_usable_size(ptr);
+			memcpy(newptr, ptr, old_size < size ? old_size : size);
+		}
 		free(ptr);
 		return newptr;
 	}
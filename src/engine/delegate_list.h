@@ -50,6 +50,8 @@ public:
 		for (auto& i : m_delegates) i.invoke(args...);
 	}
 
+	bool empty() const { return m_delegates.empty(); }
+
 private:
 	Array<Delegate<R(Args...)>> m_delegates;
 };
@@ -20,6 +20,8 @@
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/snapshot.h"
+#include "engine/string.h"
 #include "engine/timer.h"
 #include "engine/universe/component.h"
 #include "engine/universe/universe.h"
@@ -406,18 +408,30 @@ void registerCFunction(lua_State* L, const char* name, lua_CFunction f)
 }
 
 static const u32 SERIALIZED_ENGINE_MAGIC = 0x5f4c454e; // == '_LEN'
+static const u32 PLUGINS_CHUNK = crc32("plugins");
+static const u32 PATHS_CHUNK = crc32("paths");
+static const u32 PLUGIN_MANAGER_CHUNK = crc32("plugin_manager");
 
 
 static FS::OsFile g_error_file;
 static bool g_is_error_file_open = false;
 
 
+enum class SerializedEngineVersion : u32
+{
+	STREAM,
+	SNAPSHOT,
+
+	LATEST
+};
+
+
 #pragma pack(1)
 class SerializedEngineHeader
 {
 public:
 	u32 m_magic;
-	u32 m_reserved; // for crc
+	SerializedEngineVersion m_version;
 };
 #pragma pack()
 
@@ -457,6 +471,7 @@ public:
 		, m_time(0)
 		, m_path_manager(m_allocator)
 		, m_time_multiplier(1.0f)
+		, m_fixed_time_delta(0)
 		, m_paused(false)
 		, m_next_frame(false)
 		, m_lifo_allocator(m_allocator, 10 * 1024 * 1024)
@@ -821,6 +836,134 @@ public:
 	}
 
 
+	static int LUA_createEntities(lua_State* L)
+	{
+		auto* universe = LuaWrapper::checkArg<Universe*>(L, 1);
+		int count = LuaWrapper::checkArg<int>(L, 2);
+		if (count < 0) count = 0;
+
+		Array<Entity> entities(universe->getAllocator());
+		entities.resize(count);
+		if (count > 0) universe->createEntities(&entities[0], count);
+
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; ++i)
+		{
+			LuaWrapper::push(L, entities[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+
+	static int LUA_destroyEntities(lua_State* L)
+	{
+		auto* universe = LuaWrapper::checkArg<Universe*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+
+		int count = (int)lua_rawlen(L, 2);
+		IAllocator& allocator = universe->getAllocator();
+		Array<Entity> entities(allocator);
+		entities.reserve(count);
+		// scripts can pass anything, dead entities and duplicates are dropped
+		Array<u8> is_listed(allocator);
+		is_listed.resize(universe->getEntitySlotsCount());
+		if (!is_listed.empty()) setMemory(&is_listed[0], 0, is_listed.size());
+		for (int i = 0; i < count; ++i)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			Entity entity = LuaWrapper::toType<Entity>(L, -1);
+			lua_pop(L, 1);
+			if (!universe->hasEntity(entity) || is_listed[entity.index]) continue;
+			is_listed[entity.index] = 1;
+			entities.push(entity);
+		}
+		if (!entities.empty()) universe->destroyEntities(&entities[0], entities.size());
+		return 0;
+	}
+
+
+	// setEntityTransforms(universe, entities, positions [, rotations]), scales are kept
+	static int LUA_setEntityTransforms(lua_State* L)
+	{
+		auto* universe = LuaWrapper::checkArg<Universe*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+		LuaWrapper::checkTableArg(L, 3);
+		bool has_rotations = lua_istable(L, 4);
+
+		int count = Math::minimum((int)lua_rawlen(L, 2), (int)lua_rawlen(L, 3));
+		if (has_rotations) count = Math::minimum(count, (int)lua_rawlen(L, 4));
+		IAllocator& allocator = universe->getAllocator();
+		Array<Entity> entities(allocator);
+		Array<Transform> transforms(allocator);
+		entities.reserve(count);
+		transforms.reserve(count);
+		for (int i = 0; i < count; ++i)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			Entity entity = LuaWrapper::toType<Entity>(L, -1);
+			lua_pop(L, 1);
+			if (!universe->hasEntity(entity)) continue;
+
+			Transform& tr = transforms.emplace();
+			lua_rawgeti(L, 3, i + 1);
+			tr.pos = LuaWrapper::toType<Vec3>(L, -1);
+			lua_pop(L, 1);
+			if (has_rotations)
+			{
+				lua_rawgeti(L, 4, i + 1);
+				tr.rot = LuaWrapper::toType<Quat>(L, -1);
+				lua_pop(L, 1);
+			}
+			else
+			{
+				tr.rot = universe->getRotation(entity);
+			}
+			tr.scale = universe->getScale(entity);
+			entities.push(entity);
+		}
+		if (!entities.empty()) universe->setTransforms(&entities[0], &transforms[0], entities.size());
+		return 0;
+	}
+
+
+	// queryEntities(universe, {"renderable", "point_light"}), the query is kept for the lifetime of the universe
+	static int LUA_queryEntities(lua_State* L)
+	{
+		auto* universe = LuaWrapper::checkArg<Universe*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+
+		ComponentType types[ComponentType::MAX_TYPES_COUNT];
+		int types_count = Math::minimum((int)lua_rawlen(L, 2), lengthOf(types));
+		for (int i = 0; i < types_count; ++i)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			const char* type_name = lua_tostring(L, -1);
+			types[i] = type_name ? Reflection::getComponentType(type_name) : INVALID_COMPONENT_TYPE;
+			lua_pop(L, 1);
+			if (types[i] == INVALID_COMPONENT_TYPE) types_count = 0;
+		}
+		if (types_count == 0)
+		{
+			lua_newtable(L);
+			return 1;
+		}
+
+		int query = universe->findQuery(types, types_count);
+		if (query < 0) query = universe->registerQuery(types, types_count);
+
+		const Entity* entities = universe->getQueryEntities(query);
+		int count = universe->getQueryEntitiesCount(query);
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; ++i)
+		{
+			LuaWrapper::push(L, entities[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+
 	static IScene* LUA_getScene(Universe* universe, const char* name)
 	{
 		u32 hash = crc32(name);
@@ -1050,7 +1193,9 @@ public:
 		REGISTER_FUNCTION(getNextSibling);
 		REGISTER_FUNCTION(cloneEntity);
 		REGISTER_FUNCTION(destroyEntity);
+		REGISTER_FUNCTION(destroyEntityDeferred);
 		REGISTER_FUNCTION(findByName);
+		REGISTER_FUNCTION(findByPath);
 		REGISTER_FUNCTION(getFirstEntity);
 		REGISTER_FUNCTION(getNextEntity);
 		REGISTER_FUNCTION(getParent);
@@ -1062,6 +1207,10 @@ public:
 
 		LuaWrapper::createSystemFunction(m_state, "Engine", "instantiatePrefab", &LUA_instantiatePrefab);
 		LuaWrapper::createSystemFunction(m_state, "Engine", "createEntityEx", &LUA_createEntityEx);
+		LuaWrapper::createSystemFunction(m_state, "Engine", "createEntities", &LUA_createEntities);
+		LuaWrapper::createSystemFunction(m_state, "Engine", "destroyEntities", &LUA_destroyEntities);
+		LuaWrapper::createSystemFunction(m_state, "Engine", "setEntityTransforms", &LUA_setEntityTransforms);
+		LuaWrapper::createSystemFunction(m_state, "Engine", "queryEntities", &LUA_queryEntities);
 		LuaWrapper::createSystemFunction(m_state, "Engine", "multVecQuat", &LUA_multVecQuat);
 
 		lua_newtable(m_state);
@@ -1408,6 +1557,12 @@ public:
 	}
 
 
+	void setFixedTimeDelta(float time_delta) override
+	{
+		m_fixed_time_delta = Math::maximum(time_delta, 0.0f);
+	}
+
+
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
@@ -1417,7 +1572,9 @@ public:
 			m_fps = m_fps_frame / m_fps_timer->tick();
 			m_fps_frame = 0;
 		}
-		float dt = m_timer->tick() * m_time_multiplier;
+		float dt = m_timer->tick();
+		if (m_fixed_time_delta > 0) dt = m_fixed_time_delta;
+		dt *= m_time_multiplier;
 		if (m_next_frame)
 		{
 			m_paused = false;
@@ -1432,6 +1589,7 @@ public:
 				scene->update(dt, m_paused);
 			}
 		}
+		context.updateTransforms();
 		{
 			PROFILE_BLOCK("late update scenes");
 			for (auto* scene : context.getScenes())
@@ -1439,6 +1597,8 @@ public:
 				scene->lateUpdate(dt, m_paused);
 			}
 		}
+		context.updateTransforms();
+		context.flushDestroyedEntities();
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		getFileSystem().updateAsyncTransactions();
@@ -1527,34 +1687,32 @@ public:
 	{
 		SerializedEngineHeader header;
 		header.m_magic = SERIALIZED_ENGINE_MAGIC; // == '_LEN'
-		header.m_reserved = 0;
+		header.m_version = SerializedEngineVersion::LATEST;
 		serializer.write(header);
+		SnapshotWriter snapshot(serializer, m_allocator);
+		snapshot.beginChunk(PLUGINS_CHUNK);
 		serializePluginList(serializer);
 		serializerSceneVersions(serializer, ctx);
+		snapshot.beginChunk(PATHS_CHUNK);
 		m_path_manager.serialize(serializer);
 		int pos = serializer.getPos();
-		ctx.serialize(serializer);
+		ctx.serialize(snapshot);
+		snapshot.beginChunk(PLUGIN_MANAGER_CHUNK);
 		m_plugin_manager->serialize(serializer);
-		serializer.write((i32)ctx.getScenes().size());
 		for (auto* scene : ctx.getScenes())
 		{
-			serializer.writeString(scene->getPlugin().getName());
+			snapshot.beginChunk(crc32(scene->getPlugin().getName()));
 			scene->serialize(serializer);
 		}
 		u32 crc = crc32((const u8*)serializer.getData() + pos, serializer.getPos() - pos);
+		snapshot.end();
 		return crc;
 	}
 
 
-	bool deserialize(Universe& ctx, InputBlob& serializer) override
+	// universes saved before snapshots
+	bool deserializeStream(Universe& ctx, InputBlob& serializer)
 	{
-		SerializedEngineHeader header;
-		serializer.read(header);
-		if (header.m_magic != SERIALIZED_ENGINE_MAGIC)
-		{
-			g_log_error.log("Core") << "Wrong or corrupted file";
-			return false;
-		}
 		if (!hasSerializedPlugins(serializer)) return false;
 		if (!hasSupportedSceneVersions(serializer, ctx)) return false;
 
@@ -1575,6 +1733,51 @@ public:
 	}
 
 
+	bool deserialize(Universe& ctx, InputBlob& serializer) override
+	{
+		SerializedEngineHeader header;
+		serializer.read(header);
+		if (header.m_magic != SERIALIZED_ENGINE_MAGIC)
+		{
+			g_log_error.log("Core") << "Wrong or corrupted file";
+			return false;
+		}
+		if (header.m_version == SerializedEngineVersion::STREAM) return deserializeStream(ctx, serializer);
+		if (header.m_version > SerializedEngineVersion::LATEST)
+		{
+			g_log_error.log("Core") << "Unsupported version of universe";
+			return false;
+		}
+
+		SnapshotReader snapshot(m_allocator);
+		if (!snapshot.read(serializer)) return false;
+		InputBlob plugins = snapshot.getChunkBlob(PLUGINS_CHUNK);
+		if (!hasSerializedPlugins(plugins)) return false;
+		if (!hasSupportedSceneVersions(plugins, ctx)) return false;
+
+		InputBlob paths = snapshot.getChunkBlob(PATHS_CHUNK);
+		m_path_manager.deserialize(paths);
+		if (!ctx.deserialize(snapshot))
+		{
+			g_log_error.log("Core") << "Wrong or corrupted file";
+			m_path_manager.clear();
+			return false;
+		}
+		InputBlob plugin_manager_data = snapshot.getChunkBlob(PLUGIN_MANAGER_CHUNK);
+		m_plugin_manager->deserialize(plugin_manager_data);
+		// scenes touch the universe and load resources, so they can not run in parallel yet
+		for (auto* scene : ctx.getScenes())
+		{
+			u32 id = crc32(scene->getPlugin().getName());
+			if (!snapshot.hasChunk(id)) continue;
+			InputBlob scene_data = snapshot.getChunkBlob(id);
+			scene->deserialize(scene_data);
+		}
+		m_path_manager.clear();
+		return true;
+	}
+
+
 	ComponentUID createComponent(Universe& universe, Entity entity, ComponentType type) override
 	{
 		IScene* scene = universe.getScene(type);
@@ -1684,6 +1887,7 @@ private:
 	Timer* m_fps_timer;
 	int m_fps_frame;
 	float m_time_multiplier;
+	float m_fixed_time_delta;
 	float m_fps;
 	float m_last_time_delta;
 	double m_time;
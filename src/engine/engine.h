@@ -73,6 +73,7 @@ public:
 	virtual double getTime() const = 0;
 	virtual float getLastTimeDelta() const = 0;
 	virtual void setTimeMultiplier(float multiplier) = 0;
+	virtual void setFixedTimeDelta(float time_delta) = 0;
 	virtual void pause(bool pause) = 0;
 	virtual void nextFrame() = 0;
 	virtual PathManager& getPathManager() = 0;
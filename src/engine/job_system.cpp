@@ -23,6 +23,8 @@ struct Job
 {
 	JobDecl decl;
 	volatile int* counter;
+	u32 id;
+	u32 parent_id;
 };
 
 
@@ -54,6 +56,7 @@ struct System
 		, m_sync(false)
 		, m_work_signal(true)
 		, m_event_outside_job(true)
+		, m_last_job_id(0)
 	{
 		m_event_outside_job.trigger();
 		m_work_signal.reset();
@@ -69,6 +72,7 @@ struct System
 	int m_free_fibers_indices[256];
 	int m_num_free_fibers;
 	Array<SleepingFiber> m_sleeping_fibers;
+	u32 m_last_job_id;
 	IAllocator& m_allocator;
 };
 
@@ -226,7 +230,9 @@ static void fiberProc(void* data)
 	for (;;)
 	{
 		Job job = fiber_decl->current_job;
+		Profiler::beginJob(job.id, job.parent_id);
 		job.decl.task(job.decl.data);
+		Profiler::endJob();
 		if(job.counter) MT::atomicDecrement(job.counter);
 
 		fiber_decl->switch_state = nullptr;
@@ -306,6 +312,9 @@ void runJobs(const JobDecl* jobs, int count, int volatile* counter)
 	ASSERT(g_system);
 	ASSERT(count > 0);
 
+	FiberDecl* parent_fiber = g_worker ? ((WorkerTask*)g_worker)->m_current_fiber : nullptr;
+	u32 parent_id = parent_fiber ? parent_fiber->current_job.id : 0;
+
 	MT::SpinLock lock(g_system->m_sync);
 	g_system->m_work_signal.trigger();
 	if (counter) MT::atomicAdd(counter, count);
@@ -314,6 +323,8 @@ void runJobs(const JobDecl* jobs, int count, int volatile* counter)
 		Job job;
 		job.decl = jobs[i];
 		job.counter = counter;
+		job.id = ++g_system->m_last_job_id;
+		job.parent_id = parent_id;
 		g_system->m_job_queue.push(job);
 	}
 }
@@ -324,10 +335,14 @@ void wait(int volatile* counter)
 	if (*counter <= 0) return;
 	if (g_worker)
 	{
-		//ASSERT(Profiler::getCurrentBlock() == Profiler::getRootBlock(MT::getCurrentThreadID()));
+		// profiler blocks opened in this job are closed here and reopened on whichever worker resumes the fiber
+		Profiler::FiberSwitchData switch_data;
+		Profiler::beforeFiberSwitch(switch_data);
 		FiberDecl* fiber_decl = ((WorkerTask*)g_worker)->m_current_fiber;
 		fiber_decl->switch_state = (void*)counter;
 		Fiber::switchTo(&fiber_decl->fiber, fiber_decl->worker_task->m_primary_fiber);
+		Profiler::afterFiberSwitch(switch_data);
+		Profiler::recordBlock("blocked on counter", switch_data.switch_time, Profiler::now());
 	}
 	else
 	{
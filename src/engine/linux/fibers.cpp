@@ -14,30 +14,37 @@ namespace Fiber
 thread_local Handle g_finisher;
 
 
+static Handle create(int stack_size, FiberProc proc, void* parameter, ucontext_t* link)
+{
+	ucontext_t fib;
+	getcontext(&fib);
+	fib.uc_stack.ss_sp = (::malloc)(stack_size);
+	fib.uc_stack.ss_size = stack_size;
+	// makecontext stores uc_link on the new stack, it must be set before the call
+	// a fiber returning with null uc_link calls exit(0)
+	fib.uc_link = link;
+	makecontext(&fib, (void(*)())proc, 1, parameter); 
+	return fib;
+}
+
+
 void initThread(FiberProc proc, Handle* out)
 {
-	*out = create(64*1024, proc, nullptr);
-	getcontext(&g_finisher);
-	out->uc_link = &g_finisher;
+	*out = create(64*1024, proc, nullptr, &g_finisher);
 	switchTo(&g_finisher, *out);
+	(::free)(out->uc_stack.ss_sp);
 }
 
 
 Handle create(int stack_size, FiberProc proc, void* parameter)
 {
-	ucontext_t fib;
-	getcontext(&fib);
-    fib.uc_stack.ss_sp = (::malloc)(stack_size);
-    fib.uc_stack.ss_size = stack_size;
-    fib.uc_link = 0;
-    makecontext(&fib, (void(*)())proc, 1, parameter); 
-	return fib;
+	return create(stack_size, proc, parameter, nullptr);
 }
 
 
 void destroy(Handle fiber)
 {
-	ASSERT(false);
+	(::free)(fiber.uc_stack.ss_sp);
 }
 
 
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -87,4 +88,12 @@ namespace Lumix
 	{
 		return dlsym(handle, name);
 	}
+
+
+	u64 getPeakProcessMemory()
+	{
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+		return u64(usage.ru_maxrss) * 1024;
+	}
 }
@@ -1,9 +1,11 @@
 #include "engine/hash_map.h"
 #include "engine/log.h"
+#include "engine/math_utils.h"
 #include "engine/timer.h"
 #include "engine/mt/sync.h"
 #include "engine/mt/thread.h"
 #include "profiler.h"
+#include <cstdlib>
 
 
 namespace Lumix
@@ -20,6 +22,8 @@ struct Block
 	{
 		u64 m_length;
 		u64 m_start;
+		u32 m_job;
+		u32 m_parent_job;
 	};
 
 
@@ -27,6 +31,7 @@ struct Block
 		: allocator(allocator)
 		, m_hits(allocator)
 		, m_type(BlockType::TIME)
+		, m_first_frame(0)
 	{
 	}
 
@@ -69,6 +74,8 @@ struct Block
 		float float_value;
 		int int_value;
 	} m_values;
+	float m_history[MAX_HISTORY_FRAMES];
+	u32 m_first_frame;
 };
 
 
@@ -120,16 +127,36 @@ int getBlockHitCount(Block* block)
 }
 
 
+u32 getBlockHitJob(Block* block, int hit_index)
+{
+	return block->m_hits[hit_index].m_job;
+}
+
+
+u32 getBlockHitParentJob(Block* block, int hit_index)
+{
+	return block->m_hits[hit_index].m_parent_job;
+}
+
+
 struct ThreadData
 {
 	ThreadData() 
 	{
-		root_block = current_block = nullptr;
+		root_block = current_block = fiber_base_block = nullptr;
 		name[0] = '\0';
+		job = parent_job = 0;
+		missing_ends = 0;
 	}
 
 	Block* root_block;
 	Block* current_block;
+	u32 job;
+	u32 parent_job;
+	// a resumed fiber had more blocks open than FiberSwitchData keeps, its ends of the outer
+	// blocks are ignored once it gets back to fiber_base_block
+	Block* fiber_base_block;
+	int missing_ends;
 	char name[30];
 };
 
@@ -140,6 +167,12 @@ struct Instance
 		: threads(allocator)
 		, frame_listeners(allocator)
 		, m_mutex(false)
+		, frame_index(0)
+		, last_frame_time(0)
+		, spike_threshold(0)
+		, spike_frames_after(0)
+		, frames_to_freeze(-1)
+		, is_frozen(false)
 	{
 		threads.insert(MT::getCurrentThreadID(), &main_thread);
 		timer = Timer::create(allocator);
@@ -162,10 +195,160 @@ struct Instance
 	ThreadData main_thread;
 	Timer* timer;
 	MT::SpinMutex m_mutex;
+	float frame_history[MAX_HISTORY_FRAMES];
+	u32 frame_index;
+	u64 last_frame_time;
+	float spike_threshold;
+	int spike_frames_after;
+	int frames_to_freeze;
+	bool is_frozen;
 };
 
 
 Instance g_instance;
+static thread_local ThreadData* g_thread_data = nullptr;
+
+
+static int getHistoryCount(u32 first_frame)
+{
+	return (int)Math::minimum(g_instance.frame_index - first_frame, (u32)MAX_HISTORY_FRAMES);
+}
+
+
+static float getHistoryValue(const float* history, int frames_ago)
+{
+	return history[(g_instance.frame_index - 1 - frames_ago) % MAX_HISTORY_FRAMES];
+}
+
+
+static int compareFloats(const void* a, const void* b)
+{
+	float fa = *(const float*)a;
+	float fb = *(const float*)b;
+	return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+
+static int getSortedHistory(const float* history, u32 first_frame, float* out)
+{
+	int count = getHistoryCount(first_frame);
+	for (int i = 0; i < count; ++i)
+	{
+		out[i] = getHistoryValue(history, i);
+	}
+	qsort(out, count, sizeof(out[0]), compareFloats);
+	return count;
+}
+
+
+static float getPercentile(const float* sorted, int count, float percentile)
+{
+	if (count == 0) return 0;
+	int idx = int(Math::clamp(percentile, 0.0f, 1.0f) * (count - 1) + 0.5f);
+	return sorted[idx];
+}
+
+
+static HistoryStats getHistoryStats(const float* history, u32 first_frame)
+{
+	float sorted[MAX_HISTORY_FRAMES];
+	int count = getSortedHistory(history, first_frame, sorted);
+
+	HistoryStats stats;
+	stats.count = count;
+	if (count == 0)
+	{
+		stats.min = stats.max = stats.mean = stats.p50 = stats.p95 = stats.p99 = 0;
+		return stats;
+	}
+
+	double sum = 0;
+	for (int i = 0; i < count; ++i) sum += sorted[i];
+	stats.min = sorted[0];
+	stats.max = sorted[count - 1];
+	stats.mean = float(sum / count);
+	stats.p50 = getPercentile(sorted, count, 0.5f);
+	stats.p95 = getPercentile(sorted, count, 0.95f);
+	stats.p99 = getPercentile(sorted, count, 0.99f);
+	return stats;
+}
+
+
+int getBlockHistoryCount(Block* block)
+{
+	return getHistoryCount(block->m_first_frame);
+}
+
+
+float getBlockHistory(Block* block, int frames_ago)
+{
+	ASSERT(frames_ago >= 0 && frames_ago < getBlockHistoryCount(block));
+	return getHistoryValue(block->m_history, frames_ago);
+}
+
+
+float getBlockPercentile(Block* block, float percentile)
+{
+	float sorted[MAX_HISTORY_FRAMES];
+	int count = getSortedHistory(block->m_history, block->m_first_frame, sorted);
+	return getPercentile(sorted, count, percentile);
+}
+
+
+HistoryStats getBlockHistoryStats(Block* block)
+{
+	return getHistoryStats(block->m_history, block->m_first_frame);
+}
+
+
+int getFrameHistoryCount()
+{
+	return getHistoryCount(0);
+}
+
+
+float getFrameHistory(int frames_ago)
+{
+	ASSERT(frames_ago >= 0 && frames_ago < getFrameHistoryCount());
+	return getHistoryValue(g_instance.frame_history, frames_ago);
+}
+
+
+float getFramePercentile(float percentile)
+{
+	float sorted[MAX_HISTORY_FRAMES];
+	int count = getSortedHistory(g_instance.frame_history, 0, sorted);
+	return getPercentile(sorted, count, percentile);
+}
+
+
+HistoryStats getFrameHistoryStats()
+{
+	return getHistoryStats(g_instance.frame_history, 0);
+}
+
+
+void setSpikeThreshold(float threshold, int frames_after)
+{
+	MT::SpinLock lock(g_instance.m_mutex);
+	g_instance.spike_threshold = threshold;
+	g_instance.spike_frames_after = Math::clamp(frames_after, 0, MAX_HISTORY_FRAMES - 1);
+	g_instance.frames_to_freeze = -1;
+}
+
+
+bool isFrozen()
+{
+	return g_instance.is_frozen;
+}
+
+
+void freeze(bool frozen)
+{
+	MT::SpinLock lock(g_instance.m_mutex);
+	g_instance.is_frozen = frozen;
+	g_instance.frames_to_freeze = -1;
+}
 
 
 float getBlockLength(Block* block)
@@ -185,23 +368,28 @@ struct BlockInfo
 	ThreadData* thread_data;
 };
 
-static BlockInfo getBlock(const char* name)
+static ThreadData* getCurrentThreadData()
 {
-	auto thread_id = MT::getCurrentThreadID();
+	if (g_thread_data) return g_thread_data;
 
-	ThreadData* thread_data;
+	MT::SpinLock lock(g_instance.m_mutex);
+	auto iter = g_instance.threads.find(MT::getCurrentThreadID());
+	if (iter.isValid())
 	{
-		MT::SpinLock lock(g_instance.m_mutex);
-		auto iter = g_instance.threads.find(thread_id);
-		if (iter == g_instance.threads.end())
-		{
-			g_instance.threads.insert(thread_id, LUMIX_NEW(g_instance.allocator, ThreadData));
-			iter = g_instance.threads.find(thread_id);
-		}
-
-		thread_data = iter.value();
+		g_thread_data = iter.value();
+		return g_thread_data;
 	}
 
+	g_thread_data = LUMIX_NEW(g_instance.allocator, ThreadData);
+	g_instance.threads.insert(MT::getCurrentThreadID(), g_thread_data);
+	return g_thread_data;
+}
+
+
+static BlockInfo getBlock(const char* name)
+{
+	ThreadData* thread_data = getCurrentThreadData();
+
 	if (!thread_data->current_block)
 	{
 		Block* LUMIX_RESTRICT root = thread_data->root_block;
@@ -220,6 +408,7 @@ static BlockInfo getBlock(const char* name)
 			root->m_next = thread_data->root_block;
 			root->m_first_child = nullptr;
 			root->m_name = name;
+			root->m_first_frame = g_instance.frame_index;
 			thread_data->root_block = thread_data->current_block = root;
 		}
 	}
@@ -236,6 +425,7 @@ static BlockInfo getBlock(const char* name)
 			child->m_parent = thread_data->current_block;
 			child->m_first_child = nullptr;
 			child->m_name = name;
+			child->m_first_frame = g_instance.frame_index;
 			child->m_next = thread_data->current_block->m_first_child;
 			thread_data->current_block->m_first_child = child;
 		}
@@ -267,11 +457,26 @@ void* beginBlock(const char* name)
 	Block::Hit& hit = data.block->m_hits.emplace();
 	hit.m_start = g_instance.timer->getRawTimeSinceStart();
 	hit.m_length = 0;
+	hit.m_job = data.thread_data->job;
+	hit.m_parent_job = data.thread_data->parent_job;
 
 	return data.block;
 }
 
 
+void recordBlock(const char* name, u64 start, u64 end)
+{
+	BlockInfo data = getBlock(name);
+
+	Block::Hit& hit = data.block->m_hits.emplace();
+	hit.m_start = start;
+	hit.m_length = end - start;
+	hit.m_job = data.thread_data->job;
+	hit.m_parent_job = data.thread_data->parent_job;
+	data.thread_data->current_block = data.block->m_parent;
+}
+
+
 const char* getThreadName(MT::ThreadID thread_id)
 {
 	auto iter = g_instance.threads.find(thread_id);
@@ -282,15 +487,9 @@ const char* getThreadName(MT::ThreadID thread_id)
 
 void setThreadName(const char* name)
 {
+	ThreadData* thread_data = getCurrentThreadData();
 	MT::SpinLock lock(g_instance.m_mutex);
-	MT::ThreadID thread_id = MT::getCurrentThreadID();
-	auto iter = g_instance.threads.find(thread_id);
-	if (iter == g_instance.threads.end())
-	{
-		g_instance.threads.insert(thread_id, LUMIX_NEW(g_instance.allocator, ThreadData));
-		iter = g_instance.threads.find(thread_id);
-	}
-	copyString(iter.value()->name, name);
+	copyString(thread_data->name, name);
 }
 
 
@@ -345,30 +544,84 @@ Block* getRootBlock(MT::ThreadID thread_id)
 
 Block* getCurrentBlock()
 {
-	auto thread_id = MT::getCurrentThreadID();
+	return getCurrentThreadData()->current_block;
+}
 
-	ThreadData* thread_data;
+
+void beginJob(u32 job, u32 parent_job)
+{
+	ThreadData* thread_data = getCurrentThreadData();
+	thread_data->job = job;
+	thread_data->parent_job = parent_job;
+}
+
+
+void endJob()
+{
+	ThreadData* thread_data = getCurrentThreadData();
+	thread_data->job = 0;
+	thread_data->parent_job = 0;
+}
+
+
+void beforeFiberSwitch(FiberSwitchData& data)
+{
+	ThreadData* thread_data = getCurrentThreadData();
+	u64 now = g_instance.timer->getRawTimeSinceStart();
+	data.switch_time = now;
+	data.job = thread_data->job;
+	data.parent_job = thread_data->parent_job;
+	thread_data->job = 0;
+	thread_data->parent_job = 0;
+
+	// root level block belongs to the thread the fiber runs on, everything under it belongs to the fiber;
+	// only the innermost MAX_DEPTH blocks are reopened, the rest counts in depth
+	Block* stack[FiberSwitchData::MAX_DEPTH];
+	int count = 0;
+	int depth = thread_data->missing_ends;
+	Block* block = thread_data->current_block;
+	while (block && block->m_parent && block != thread_data->fiber_base_block)
 	{
-		MT::SpinLock lock(g_instance.m_mutex);
-		auto iter = g_instance.threads.find(thread_id);
-		ASSERT(iter.isValid());
-		thread_data = iter.value();
+		Block::Hit& hit = block->m_hits.back();
+		hit.m_length = now - hit.m_start;
+		if (count < lengthOf(stack)) stack[count++] = block;
+		++depth;
+		block = block->m_parent;
 	}
+	thread_data->current_block = block;
+	thread_data->fiber_base_block = nullptr;
+	thread_data->missing_ends = 0;
 
-	return thread_data->current_block;
+	data.count = count;
+	data.depth = depth;
+	for (int i = 0; i < count; ++i)
+	{
+		data.blocks[i] = stack[count - i - 1]->m_name;
+	}
 }
 
 
-void* endBlock()
+void afterFiberSwitch(const FiberSwitchData& data)
 {
-	auto thread_id = MT::getCurrentThreadID();
+	ThreadData* thread_data = getCurrentThreadData();
+	thread_data->job = data.job;
+	thread_data->parent_job = data.parent_job;
+	thread_data->missing_ends = data.depth - data.count;
+	thread_data->fiber_base_block = thread_data->missing_ends > 0 ? thread_data->current_block : nullptr;
+	for (int i = 0; i < data.count; ++i)
+	{
+		beginBlock(data.blocks[i]);
+	}
+}
 
-	ThreadData* thread_data;
+
+void* endBlock()
+{
+	ThreadData* thread_data = getCurrentThreadData();
+	if (thread_data->missing_ends > 0 && thread_data->current_block == thread_data->fiber_base_block)
 	{
-		MT::SpinLock lock(g_instance.m_mutex);
-		auto iter = g_instance.threads.find(thread_id);
-		ASSERT(iter.isValid());
-		thread_data = iter.value();
+		--thread_data->missing_ends;
+		return nullptr;
 	}
 
 	ASSERT(thread_data->current_block);
@@ -380,11 +633,65 @@ void* endBlock()
 }
 
 
+static void recordHistory(Block* block, u32 slot)
+{
+	while (block)
+	{
+		float value;
+		if (block->m_type == BlockType::INT)
+		{
+			value = (float)block->m_values.int_value;
+		}
+		else
+		{
+			u64 length = 0;
+			for (const Block::Hit& hit : block->m_hits) length += hit.m_length;
+			value = float(length / (double)g_instance.timer->getFrequency());
+		}
+		block->m_history[slot] = value;
+		recordHistory(block->m_first_child, slot);
+		block = block->m_next;
+	}
+}
+
+
+static void updateHistory(u64 now)
+{
+	float frame_time = float((now - g_instance.last_frame_time) / (double)g_instance.timer->getFrequency());
+	g_instance.last_frame_time = now;
+	if (g_instance.is_frozen) return;
+
+	u32 slot = g_instance.frame_index % MAX_HISTORY_FRAMES;
+	g_instance.frame_history[slot] = frame_time;
+	for (auto* i : g_instance.threads)
+	{
+		recordHistory(i->root_block, slot);
+	}
+	++g_instance.frame_index;
+
+	if (g_instance.frames_to_freeze < 0)
+	{
+		bool is_spike = g_instance.spike_threshold > 0 && frame_time > g_instance.spike_threshold;
+		if (is_spike) g_instance.frames_to_freeze = g_instance.spike_frames_after;
+	}
+	if (g_instance.frames_to_freeze == 0)
+	{
+		g_instance.is_frozen = true;
+		g_instance.frames_to_freeze = -1;
+	}
+	else if (g_instance.frames_to_freeze > 0)
+	{
+		--g_instance.frames_to_freeze;
+	}
+}
+
+
 void frame()
 {
 	PROFILE_FUNCTION();
 
 	MT::SpinLock lock(g_instance.m_mutex);
+	updateHistory(g_instance.timer->getRawTimeSinceStart());
 	g_instance.frame_listeners.invoke();
 	u64 now = g_instance.timer->getRawTimeSinceStart();
 
@@ -398,6 +705,8 @@ void frame()
 			auto& hit = block->m_hits.emplace();
 			hit.m_start = now;
 			hit.m_length = 0;
+			hit.m_job = i->job;
+			hit.m_parent_job = i->parent_job;
 			block = block->m_parent;
 		}
 	}
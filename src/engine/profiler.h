@@ -24,6 +24,34 @@ enum class BlockType
 };
 
 
+struct HistoryStats
+{
+	int count;
+	float min;
+	float max;
+	float mean;
+	float p50;
+	float p95;
+	float p99;
+};
+
+
+// profiler context of a fiber, saved when the fiber is switched out and restored 
+// when it continues, possibly on another thread; blocks deeper than MAX_DEPTH
+// are not reopened, their ends are ignored
+struct FiberSwitchData
+{
+	enum { MAX_DEPTH = 16 };
+
+	const char* blocks[MAX_DEPTH];
+	int count;
+	int depth;
+	u32 job;
+	u32 parent_job;
+	u64 switch_time;
+};
+
+
 LUMIX_ENGINE_API MT::ThreadID getThreadID(int index);
 LUMIX_ENGINE_API void setThreadName(const char* name);
 LUMIX_ENGINE_API const char* getThreadName(MT::ThreadID thread_id);
@@ -42,10 +70,32 @@ LUMIX_ENGINE_API int getBlockHitCount(Block* block);
 LUMIX_ENGINE_API u64 getBlockHitStart(Block* block, int hit_index);
 LUMIX_ENGINE_API u64 getBlockHitLength(Block* block, int hit_index);
 LUMIX_ENGINE_API const char* getBlockName(Block* block);
+LUMIX_ENGINE_API u32 getBlockHitJob(Block* block, int hit_index);
+LUMIX_ENGINE_API u32 getBlockHitParentJob(Block* block, int hit_index);
+
+// history of the last MAX_HISTORY_FRAMES frames, time in seconds, counters as values
+enum { MAX_HISTORY_FRAMES = 256 };
+LUMIX_ENGINE_API int getBlockHistoryCount(Block* block);
+LUMIX_ENGINE_API float getBlockHistory(Block* block, int frames_ago);
+LUMIX_ENGINE_API float getBlockPercentile(Block* block, float percentile);
+LUMIX_ENGINE_API HistoryStats getBlockHistoryStats(Block* block);
+LUMIX_ENGINE_API int getFrameHistoryCount();
+LUMIX_ENGINE_API float getFrameHistory(int frames_ago);
+LUMIX_ENGINE_API float getFramePercentile(float percentile);
+LUMIX_ENGINE_API HistoryStats getFrameHistoryStats();
+// history stops being recorded frames_after frames after a frame longer than threshold seconds, 0 disables
+LUMIX_ENGINE_API void setSpikeThreshold(float threshold, int frames_after);
+LUMIX_ENGINE_API bool isFrozen();
+LUMIX_ENGINE_API void freeze(bool frozen);
 
 LUMIX_ENGINE_API void record(const char* name, int value);
 LUMIX_ENGINE_API void* beginBlock(const char* name);
 LUMIX_ENGINE_API void* endBlock();
+LUMIX_ENGINE_API void recordBlock(const char* name, u64 start, u64 end);
+LUMIX_ENGINE_API void beginJob(u32 job, u32 parent_job);
+LUMIX_ENGINE_API void endJob();
+LUMIX_ENGINE_API void beforeFiberSwitch(FiberSwitchData& data);
+LUMIX_ENGINE_API void afterFiberSwitch(const FiberSwitchData& data);
 LUMIX_ENGINE_API void frame();
 LUMIX_ENGINE_API DelegateList<void ()>& getFrameListeners();
 
@@ -56,8 +106,9 @@ LUMIX_ENGINE_API DelegateList<void ()>& getFrameListeners();
 		explicit Scope(const char* name) { ptr = beginBlock(name); }
 		~Scope()
 		{
+			// a fiber can resume on another thread, the block is then a different one with the same name
 			void* tmp = endBlock();
-			ASSERT(tmp == ptr);
+			ASSERT(!tmp || getBlockName((Block*)tmp) == getBlockName((Block*)ptr));
 		}
 
 		const void* ptr;
@@ -0,0 +1,156 @@
+#include "engine/radix_sort.h"
+#include "engine/iallocator.h"
+#include "engine/job_system.h"
+#include "engine/math_utils.h"
+#include "engine/mt/thread.h"
+#include "engine/profiler.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+static const int RADIX_BITS = 8;
+static const int BUCKETS_COUNT = 1 << RADIX_BITS;
+static const int PASSES_COUNT = 64 / RADIX_BITS;
+static const int MAX_CHUNKS = 64;
+// smaller chunks do not pay for the job overhead
+static const int MIN_CHUNK_SIZE = 4096;
+
+
+struct RadixSortChunk
+{
+	const u64* keys;
+	const u32* values;
+	u64* out_keys;
+	u32* out_values;
+	int from;
+	int to;
+	int shift;
+	int histogram[BUCKETS_COUNT];
+};
+
+
+static void histogramJob(void* data)
+{
+	RadixSortChunk* chunk = (RadixSortChunk*)data;
+	int* histogram = chunk->histogram;
+	for (int i = 0; i < BUCKETS_COUNT; ++i) histogram[i] = 0;
+	const u64* keys = chunk->keys;
+	int shift = chunk->shift;
+	for (int i = chunk->from; i < chunk->to; ++i)
+	{
+		++histogram[(keys[i] >> shift) & (BUCKETS_COUNT - 1)];
+	}
+}
+
+
+// histogram holds output offsets of the chunk at this point
+static void scatterJob(void* data)
+{
+	RadixSortChunk* chunk = (RadixSortChunk*)data;
+	int* offsets = chunk->histogram;
+	const u64* keys = chunk->keys;
+	const u32* values = chunk->values;
+	u64* out_keys = chunk->out_keys;
+	u32* out_values = chunk->out_values;
+	int shift = chunk->shift;
+	for (int i = chunk->from; i < chunk->to; ++i)
+	{
+		u64 key = keys[i];
+		int dst = offsets[(key >> shift) & (BUCKETS_COUNT - 1)]++;
+		out_keys[dst] = key;
+		out_values[dst] = values[i];
+	}
+}
+
+
+static void runChunks(RadixSortChunk* chunks, int count, void (*task)(void*))
+{
+	if (count == 1)
+	{
+		task(&chunks[0]);
+		return;
+	}
+	JobSystem::JobDecl jobs[MAX_CHUNKS];
+	for (int i = 0; i < count; ++i)
+	{
+		jobs[i].data = &chunks[i];
+		jobs[i].task = task;
+	}
+	volatile int counter = 0;
+	JobSystem::runJobs(jobs, count, &counter);
+	JobSystem::wait(&counter);
+}
+
+
+void radixSort(u64* keys, u32* values, int size, u64* tmp_keys, u32* tmp_values, IAllocator& allocator)
+{
+	PROFILE_FUNCTION();
+	if (size <= 1) return;
+
+	int chunks_count = Math::clamp(size / MIN_CHUNK_SIZE, 1, Math::minimum((int)MT::getCPUsCount() * 4, MAX_CHUNKS));
+	int chunk_size = (size + chunks_count - 1) / chunks_count;
+	// histograms are too big for the stack of a job fiber
+	auto* chunks = (RadixSortChunk*)allocator.allocate(sizeof(RadixSortChunk) * chunks_count);
+	for (int i = 0; i < chunks_count; ++i)
+	{
+		chunks[i].from = i * chunk_size;
+		chunks[i].to = Math::minimum(size, (i + 1) * chunk_size);
+	}
+
+	u64* src_keys = keys;
+	u32* src_values = values;
+	u64* dst_keys = tmp_keys;
+	u32* dst_values = tmp_values;
+	for (int pass = 0; pass < PASSES_COUNT; ++pass)
+	{
+		for (int i = 0; i < chunks_count; ++i)
+		{
+			RadixSortChunk& chunk = chunks[i];
+			chunk.keys = src_keys;
+			chunk.values = src_values;
+			chunk.out_keys = dst_keys;
+			chunk.out_values = dst_values;
+			chunk.shift = pass * RADIX_BITS;
+		}
+		runChunks(chunks, chunks_count, histogramJob);
+
+		// bucket by bucket, chunk by chunk, so equal keys keep their order
+		int offset = 0;
+		bool is_single_bucket = false;
+		for (int bucket = 0; bucket < BUCKETS_COUNT; ++bucket)
+		{
+			int bucket_size = 0;
+			for (int i = 0; i < chunks_count; ++i)
+			{
+				int count = chunks[i].histogram[bucket];
+				chunks[i].histogram[bucket] = offset;
+				offset += count;
+				bucket_size += count;
+			}
+			if (bucket_size == size) is_single_bucket = true;
+		}
+		if (is_single_bucket) continue;
+
+		runChunks(chunks, chunks_count, scatterJob);
+
+		u64* tmp_k = src_keys;
+		src_keys = dst_keys;
+		dst_keys = tmp_k;
+		u32* tmp_v = src_values;
+		src_values = dst_values;
+		dst_values = tmp_v;
+	}
+
+	if (src_keys != keys)
+	{
+		copyMemory(keys, src_keys, sizeof(keys[0]) * size);
+		copyMemory(values, src_values, sizeof(values[0]) * size);
+	}
+	allocator.deallocate(chunks);
+}
+
+
+} // namespace Lumix
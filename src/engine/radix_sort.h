@@ -0,0 +1,26 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+struct IAllocator;
+
+
+// stable LSD radix sort of values by keys, 8 bits per pass, passes where all keys share the digit are skipped;
+// big inputs are split into chunks which are histogrammed and scattered in parallel by the job system;
+// tmp_keys and tmp_values must have room for size items, the result is in keys and values;
+// allocator is used for the per chunk histograms
+LUMIX_ENGINE_API void radixSort(u64* keys,
+	u32* values,
+	int size,
+	u64* tmp_keys,
+	u32* tmp_values,
+	IAllocator& allocator);
+
+
+} // namespace Lumix
@@ -247,7 +247,10 @@ static void destroy(ComponentLink* link)
 void shutdown()
 {
 	destroy(g_first_component);
+	g_first_component = nullptr;
+	g_scenes_count = 0;
 	LUMIX_DELETE(*g_allocator, g_enums);
+	g_enums = nullptr;
 	g_allocator = nullptr;
 }
 
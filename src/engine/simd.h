@@ -4,7 +4,8 @@
 #include "engine/lumix.h"
 
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(__SSE2__)
+	#define LUMIX_SSE
 	#include <xmmintrin.h>
 #else
 	#include <cmath>
@@ -14,7 +15,7 @@ namespace Lumix
 {
 
 
-#ifdef _WIN32
+#ifdef LUMIX_SSE
 	typedef __m128 float4;
 
 
@@ -42,6 +43,12 @@ namespace Lumix
 	}
 
 
+	LUMIX_FORCE_INLINE void f4StoreUnaligned(void* dest, float4 src)
+	{
+		_mm_storeu_ps((float*)dest, src);
+	}
+
+
 	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
 	{
 		return _mm_movemask_ps(a);
@@ -132,6 +139,12 @@ namespace Lumix
 	}
 
 
+	LUMIX_FORCE_INLINE void f4StoreUnaligned(void* dest, float4 src)
+	{
+		(*(float4*)dest) = src;
+	}
+
+
 	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
 	{
 		return (a.w < 0 ? (1 << 3) : 0) | 
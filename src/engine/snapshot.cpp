@@ -0,0 +1,151 @@
+#include "engine/snapshot.h"
+#include "engine/blob.h"
+#include "engine/log.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+#pragma pack(1)
+struct SnapshotHeader
+{
+	// relative to the start of the snapshot
+	u32 table_offset;
+	u32 chunks_count;
+};
+#pragma pack()
+
+
+SnapshotWriter::SnapshotWriter(OutputBlob& blob, IAllocator& allocator)
+	: m_blob(blob)
+	, m_chunks(allocator)
+	, m_start(blob.getPos())
+	, m_is_in_chunk(false)
+{
+	SnapshotHeader header = {};
+	m_blob.write(header);
+}
+
+
+void SnapshotWriter::endChunk()
+{
+	if (!m_is_in_chunk) return;
+	Chunk& chunk = m_chunks.back();
+	chunk.size = u32(m_blob.getPos() - m_start) - chunk.offset;
+	m_is_in_chunk = false;
+}
+
+
+void SnapshotWriter::beginChunk(u32 id)
+{
+	endChunk();
+
+	static const u8 padding[ALIGNMENT] = {};
+	int misalignment = m_blob.getPos() % ALIGNMENT;
+	if (misalignment != 0) m_blob.write(padding, ALIGNMENT - misalignment);
+
+	Chunk& chunk = m_chunks.emplace();
+	chunk.id = id;
+	chunk.offset = u32(m_blob.getPos() - m_start);
+	chunk.size = 0;
+	m_is_in_chunk = true;
+}
+
+
+void SnapshotWriter::writeChunk(u32 id, const void* data, int size)
+{
+	beginChunk(id);
+	m_blob.write(data, size);
+	endChunk();
+}
+
+
+void SnapshotWriter::end()
+{
+	endChunk();
+	SnapshotHeader header;
+	header.table_offset = u32(m_blob.getPos() - m_start);
+	header.chunks_count = m_chunks.size();
+	if (!m_chunks.empty()) m_blob.write(&m_chunks[0], m_chunks.size() * sizeof(m_chunks[0]));
+	copyMemory((u8*)m_blob.getMutableData() + m_start, &header, sizeof(header));
+}
+
+
+SnapshotReader::SnapshotReader(IAllocator& allocator)
+	: m_chunks(allocator)
+	, m_data(nullptr)
+{
+}
+
+
+bool SnapshotReader::read(InputBlob& blob)
+{
+	m_chunks.clear();
+	int start = blob.getPosition();
+	SnapshotHeader header;
+	if (!blob.read(&header, sizeof(header))) return false;
+
+	int table_size = header.chunks_count * sizeof(Chunk);
+	if (header.table_offset < sizeof(header) || start + (i64)header.table_offset + table_size > blob.getSize())
+	{
+		g_log_error.log("Engine") << "Corrupted snapshot";
+		return false;
+	}
+
+	m_data = (const u8*)blob.getData() + start;
+	m_chunks.resize(header.chunks_count);
+	if (table_size > 0) copyMemory(&m_chunks[0], m_data + header.table_offset, table_size);
+	for (const Chunk& chunk : m_chunks)
+	{
+		if ((u64)chunk.offset + chunk.size > header.table_offset)
+		{
+			g_log_error.log("Engine") << "Corrupted snapshot";
+			m_chunks.clear();
+			return false;
+		}
+	}
+	blob.setPosition(start + header.table_offset + table_size);
+	return true;
+}
+
+
+const SnapshotReader::Chunk* SnapshotReader::findChunk(u32 id) const
+{
+	for (const Chunk& chunk : m_chunks)
+	{
+		if (chunk.id == id) return &chunk;
+	}
+	return nullptr;
+}
+
+
+bool SnapshotReader::hasChunk(u32 id) const
+{
+	return findChunk(id) != nullptr;
+}
+
+
+const void* SnapshotReader::getChunk(u32 id, int* size) const
+{
+	const Chunk* chunk = findChunk(id);
+	if (!chunk)
+	{
+		*size = 0;
+		return nullptr;
+	}
+	*size = chunk->size;
+	return m_data + chunk->offset;
+}
+
+
+InputBlob SnapshotReader::getChunkBlob(u32 id) const
+{
+	int size;
+	const void* data = getChunk(id, &size);
+	return InputBlob(data, size);
+}
+
+
+} // namespace Lumix
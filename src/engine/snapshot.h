@@ -0,0 +1,78 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+class InputBlob;
+class OutputBlob;
+
+
+// Chunked binary data. Chunks start at aligned positions in the blob and the offset table
+// is at the end, a chunk can be accessed directly in the loaded buffer without parsing the others.
+class LUMIX_ENGINE_API SnapshotWriter
+{
+public:
+	enum { ALIGNMENT = 16 };
+
+	// the snapshot starts at the current position of the blob
+	SnapshotWriter(OutputBlob& blob, IAllocator& allocator);
+
+	OutputBlob& getBlob() { return m_blob; }
+	// everything written to the blob until the next beginChunk or end belongs to the chunk
+	void beginChunk(u32 id);
+	void writeChunk(u32 id, const void* data, int size);
+	void end();
+
+private:
+	struct Chunk
+	{
+		u32 id;
+		u32 offset;
+		u32 size;
+	};
+
+	void endChunk();
+
+	OutputBlob& m_blob;
+	Array<Chunk> m_chunks;
+	int m_start;
+	bool m_is_in_chunk;
+};
+
+
+class LUMIX_ENGINE_API SnapshotReader
+{
+public:
+	explicit SnapshotReader(IAllocator& allocator);
+
+	// the snapshot starts at the current position of the blob, the blob is moved to its end,
+	// chunks point to the blob's memory so it must outlive the reader
+	bool read(InputBlob& blob);
+	bool hasChunk(u32 id) const;
+	// nullptr if there is no such chunk
+	const void* getChunk(u32 id, int* size) const;
+	// empty blob if there is no such chunk
+	InputBlob getChunkBlob(u32 id) const;
+
+private:
+	struct Chunk
+	{
+		u32 id;
+		u32 offset;
+		u32 size;
+	};
+
+	const Chunk* findChunk(u32 id) const;
+
+	Array<Chunk> m_chunks;
+	const u8* m_data;
+};
+
+
+} // namespace Lumix
@@ -14,4 +14,5 @@ namespace Lumix
 	LUMIX_ENGINE_API void* loadLibrary(const char* path);
 	LUMIX_ENGINE_API void unloadLibrary(void* handle);
 	LUMIX_ENGINE_API void* getLibrarySymbol(void* handle, const char* name);
+	LUMIX_ENGINE_API u64 getPeakProcessMemory();
 }
\ No newline at end of file
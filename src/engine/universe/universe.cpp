@@ -2,11 +2,18 @@
 #include "engine/blob.h"
 #include "engine/crc32.h"
 #include "engine/iplugin.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
+#include "engine/math_utils.h"
 #include "engine/matrix.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/serializer.h"
+#include "engine/snapshot.h"
+#include "engine/string.h"
 #include "engine/universe/component.h"
 
 
@@ -15,25 +22,387 @@ namespace Lumix
 
 
 static const int RESERVED_ENTITIES_COUNT = 5000;
+static const int MAX_TRANSFORM_JOBS = 16;
+static const int MIN_ROOTS_PER_TRANSFORM_JOB = 64;
+static const int CHECKPOINT_CHUNK_SIZE = 64;
 
 
-Universe::~Universe() = default;
+// states of checkpoint chunks
+enum : i32
+{
+	CHUNK_SHARED, // the universe still has the same data as the checkpoint
+	CHUNK_COPYING,
+	CHUNK_COPIED
+};
+
+
+struct Universe::Checkpoint
+{
+	// entity slots as they were when the checkpoint was saved
+	struct EntityChunk
+	{
+		EntityData entities[CHECKPOINT_CHUNK_SIZE];
+		Vec3 positions[CHECKPOINT_CHUNK_SIZE];
+		Quat rotations[CHECKPOINT_CHUNK_SIZE];
+		float scales[CHECKPOINT_CHUNK_SIZE];
+		u64 component_masks[CHECKPOINT_CHUNK_SIZE];
+		u32 generations[CHECKPOINT_CHUNK_SIZE];
+	};
+
+	struct HierarchyChunk
+	{
+		Hierarchy hierarchy[CHECKPOINT_CHUNK_SIZE];
+	};
+
+	explicit Checkpoint(IAllocator& allocator)
+		: entity_states(allocator)
+		, entity_chunks(allocator)
+		, hierarchy_states(allocator)
+		, hierarchy_chunks(allocator)
+		, names(allocator)
+		, scenes(allocator)
+	{
+	}
+
+	Array<i32> entity_states;
+	// nullptr if the chunk is not copied
+	Array<EntityChunk*> entity_chunks;
+	Array<i32> hierarchy_states;
+	Array<HierarchyChunk*> hierarchy_chunks;
+	// names are few and change rarely, they are copied as a whole
+	Array<EntityName> names;
+	bool are_names_copied;
+	int entities_count;
+	int hierarchy_count;
+	int first_free_slot;
+	// in the order of Universe::m_scenes
+	Array<OutputBlob> scenes;
+};
+
+
+// true if the caller has to copy the chunk and then release it, false if it is already copied;
+// transforms are propagated by several jobs at once, only one of them can claim a chunk
+static bool claimChunk(Array<i32>& states, int chunk)
+{
+	// chunks created after the checkpoint are not in it
+	if (chunk >= states.size()) return false;
+	volatile i32* state = &states[chunk];
+	if (*state == CHUNK_COPIED) return false;
+	if (MT::compareAndExchange(state, CHUNK_COPYING, CHUNK_SHARED)) return true;
+	while (*state != CHUNK_COPIED) MT::yield();
+	return false;
+}
+
+
+static void releaseChunk(Array<i32>& states, int chunk)
+{
+	MT::compareAndExchange(&states[chunk], CHUNK_COPIED, CHUNK_COPYING);
+}
+
+
+// must be called before anything about the entity slot changes, except its transform_dirty flag
+LUMIX_FORCE_INLINE void Universe::beforeEntityChange(int index)
+{
+	if (m_checkpoint) copyEntityChunk(index / CHECKPOINT_CHUNK_SIZE);
+}
+
+
+LUMIX_FORCE_INLINE void Universe::beforeHierarchyChange(int index)
+{
+	if (m_checkpoint) copyHierarchyChunk(index / CHECKPOINT_CHUNK_SIZE);
+}
+
+
+void Universe::beforeNamesChange()
+{
+	if (!m_checkpoint || m_checkpoint->are_names_copied) return;
+	m_checkpoint->names = m_names;
+	m_checkpoint->are_names_copied = true;
+}
+
+
+void Universe::copyEntityChunk(int chunk)
+{
+	Checkpoint& checkpoint = *m_checkpoint;
+	if (!claimChunk(checkpoint.entity_states, chunk)) return;
+
+	auto* saved = LUMIX_NEW(m_allocator, Checkpoint::EntityChunk);
+	int from = chunk * CHECKPOINT_CHUNK_SIZE;
+	int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.entities_count - from);
+	copyMemory(saved->entities, &m_entities[from], count * sizeof(saved->entities[0]));
+	copyMemory(saved->positions, &m_positions[from], count * sizeof(saved->positions[0]));
+	copyMemory(saved->rotations, &m_rotations[from], count * sizeof(saved->rotations[0]));
+	copyMemory(saved->scales, &m_scales[from], count * sizeof(saved->scales[0]));
+	copyMemory(saved->component_masks, &m_component_masks[from], count * sizeof(saved->component_masks[0]));
+	copyMemory(saved->generations, &m_generations[from], count * sizeof(saved->generations[0]));
+	checkpoint.entity_chunks[chunk] = saved;
+	releaseChunk(checkpoint.entity_states, chunk);
+}
+
+
+// elements are popped only after beforeHierarchyChange, so the chunk is still whole in m_hierarchy
+void Universe::copyHierarchyChunk(int chunk)
+{
+	Checkpoint& checkpoint = *m_checkpoint;
+	if (!claimChunk(checkpoint.hierarchy_states, chunk)) return;
+
+	auto* saved = LUMIX_NEW(m_allocator, Checkpoint::HierarchyChunk);
+	int from = chunk * CHECKPOINT_CHUNK_SIZE;
+	int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.hierarchy_count - from);
+	copyMemory(saved->hierarchy, &m_hierarchy[from], count * sizeof(saved->hierarchy[0]));
+	checkpoint.hierarchy_chunks[chunk] = saved;
+	releaseChunk(checkpoint.hierarchy_states, chunk);
+}
+
+
+void Universe::saveCheckpoint()
+{
+	PROFILE_FUNCTION();
+	// transform_dirty flags and the destroy queue are not saved, they must be empty
+	flushDestroyedEntities();
+	updateTransforms();
+	releaseCheckpoint();
+
+	m_checkpoint = LUMIX_NEW(m_allocator, Checkpoint)(m_allocator);
+	Checkpoint& checkpoint = *m_checkpoint;
+	checkpoint.entities_count = m_entities.size();
+	checkpoint.hierarchy_count = m_hierarchy.size();
+	checkpoint.first_free_slot = m_first_free_slot;
+	checkpoint.are_names_copied = false;
+	int entity_chunks_count = (m_entities.size() + CHECKPOINT_CHUNK_SIZE - 1) / CHECKPOINT_CHUNK_SIZE;
+	checkpoint.entity_states.resize(entity_chunks_count);
+	checkpoint.entity_chunks.resize(entity_chunks_count);
+	int hierarchy_chunks_count = (m_hierarchy.size() + CHECKPOINT_CHUNK_SIZE - 1) / CHECKPOINT_CHUNK_SIZE;
+	checkpoint.hierarchy_states.resize(hierarchy_chunks_count);
+	checkpoint.hierarchy_chunks.resize(hierarchy_chunks_count);
+
+	checkpoint.scenes.reserve(m_scenes.size());
+	for (IScene* scene : m_scenes)
+	{
+		OutputBlob& blob = checkpoint.scenes.emplace(m_allocator);
+		scene->serialize(blob);
+	}
+}
+
+
+void Universe::releaseCheckpoint()
+{
+	if (!m_checkpoint) return;
+
+	for (Checkpoint::EntityChunk* chunk : m_checkpoint->entity_chunks)
+	{
+		if (chunk) LUMIX_DELETE(m_allocator, chunk);
+	}
+	for (Checkpoint::HierarchyChunk* chunk : m_checkpoint->hierarchy_chunks)
+	{
+		if (chunk) LUMIX_DELETE(m_allocator, chunk);
+	}
+	LUMIX_DELETE(m_allocator, m_checkpoint);
+	m_checkpoint = nullptr;
+}
+
+
+// entities from the checkpoint must be alive and keep their components, new ones can be destroyed;
+// chunks which are not copied are the same as in the checkpoint
+bool Universe::isCheckpointRestorable()
+{
+	const Checkpoint& checkpoint = *m_checkpoint;
+	if (m_scenes.size() != checkpoint.scenes.size()) return false;
+	for (int chunk = 0, c = checkpoint.entity_chunks.size(); chunk < c; ++chunk)
+	{
+		const Checkpoint::EntityChunk* saved = checkpoint.entity_chunks[chunk];
+		if (!saved) continue;
+
+		int from = chunk * CHECKPOINT_CHUNK_SIZE;
+		int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.entities_count - from);
+		for (int i = 0; i < count; ++i)
+		{
+			if (!saved->entities[i].valid) continue;
+			if (!m_entities[from + i].valid || m_generations[from + i] != saved->generations[i]) return false;
+			if ((saved->component_masks[i] & ~m_component_masks[from + i]) != 0) return false;
+		}
+	}
+	return true;
+}
+
+
+bool Universe::haveScenesChanged()
+{
+	const Checkpoint& checkpoint = *m_checkpoint;
+	OutputBlob blob(m_allocator);
+	for (int i = 0, c = m_scenes.size(); i < c; ++i)
+	{
+		blob.clear();
+		m_scenes[i]->serialize(blob);
+		const OutputBlob& saved = checkpoint.scenes[i];
+		if (blob.getPos() != saved.getPos()) return true;
+		if (compareMemory(blob.getData(), saved.getData(), blob.getPos()) != 0) return true;
+	}
+	return false;
+}
+
+
+bool Universe::restoreCheckpoint()
+{
+	PROFILE_FUNCTION();
+	if (!m_checkpoint) return false;
+	updateTransforms();
+	if (!isCheckpointRestorable()) return false;
+
+	// new entities and components are destroyed by their scenes, so the scenes can be compared
+	Checkpoint& checkpoint = *m_checkpoint;
+	Array<Entity> created(m_allocator);
+	for (int chunk = 0, c = checkpoint.entity_chunks.size(); chunk < c; ++chunk)
+	{
+		const Checkpoint::EntityChunk* saved = checkpoint.entity_chunks[chunk];
+		if (!saved) continue;
+
+		int from = chunk * CHECKPOINT_CHUNK_SIZE;
+		int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.entities_count - from);
+		for (int i = 0; i < count; ++i)
+		{
+			Entity entity = {from + i};
+			if (!m_entities[entity.index].valid) continue;
+			if (!saved->entities[i].valid)
+			{
+				created.push(entity);
+				continue;
+			}
+			u64 new_components = m_component_masks[entity.index] & ~saved->component_masks[i];
+			for (int type = 0; new_components != 0; ++type)
+			{
+				if ((new_components & ((u64)1 << type)) == 0) continue;
+				destroyComponent(entity, {type});
+				new_components &= ~((u64)1 << type);
+			}
+		}
+	}
+	for (int i = checkpoint.entities_count, c = m_entities.size(); i < c; ++i)
+	{
+		if (m_entities[i].valid) created.push({i});
+	}
+	if (!created.empty()) destroyEntities(created.begin(), created.size());
+	if (haveScenesChanged()) return false;
+
+	for (int chunk = 0, c = checkpoint.entity_chunks.size(); chunk < c; ++chunk)
+	{
+		Checkpoint::EntityChunk* saved = checkpoint.entity_chunks[chunk];
+		if (!saved) continue;
+
+		int from = chunk * CHECKPOINT_CHUNK_SIZE;
+		int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.entities_count - from);
+		for (int i = 0; i < count; ++i)
+		{
+			if (!saved->entities[i].valid) continue;
+			int idx = from + i;
+			if (m_positions[idx] != saved->positions[i] || m_scales[idx] != saved->scales[i] ||
+				compareMemory(&m_rotations[idx], &saved->rotations[i], sizeof(Quat)) != 0)
+			{
+				m_moved_entities.push({idx});
+			}
+		}
+		// generations are not restored, handles of destroyed entities must stay dead
+		copyMemory(&m_entities[from], saved->entities, count * sizeof(saved->entities[0]));
+		copyMemory(&m_positions[from], saved->positions, count * sizeof(saved->positions[0]));
+		copyMemory(&m_rotations[from], saved->rotations, count * sizeof(saved->rotations[0]));
+		copyMemory(&m_scales[from], saved->scales, count * sizeof(saved->scales[0]));
+		copyMemory(&m_component_masks[from], saved->component_masks, count * sizeof(saved->component_masks[0]));
+		for (int i = 0; i < count; ++i) m_entities[from + i].transform_dirty = false;
+		LUMIX_DELETE(m_allocator, saved);
+		checkpoint.entity_chunks[chunk] = nullptr;
+		checkpoint.entity_states[chunk] = CHUNK_SHARED;
+	}
+
+	m_hierarchy.resize(checkpoint.hierarchy_count);
+	for (int chunk = 0, c = checkpoint.hierarchy_chunks.size(); chunk < c; ++chunk)
+	{
+		Checkpoint::HierarchyChunk* saved = checkpoint.hierarchy_chunks[chunk];
+		if (!saved) continue;
+
+		int from = chunk * CHECKPOINT_CHUNK_SIZE;
+		int count = Math::minimum(CHECKPOINT_CHUNK_SIZE, checkpoint.hierarchy_count - from);
+		copyMemory(&m_hierarchy[from], saved->hierarchy, count * sizeof(saved->hierarchy[0]));
+		LUMIX_DELETE(m_allocator, saved);
+		checkpoint.hierarchy_chunks[chunk] = nullptr;
+		checkpoint.hierarchy_states[chunk] = CHUNK_SHARED;
+	}
+
+	if (checkpoint.are_names_copied)
+	{
+		m_names = checkpoint.names;
+		m_name_index.clear();
+		for (int i = 0, c = m_names.size(); i < c; ++i) addNameToIndex(i);
+		checkpoint.are_names_copied = false;
+	}
+
+	// slots added since the checkpoint stay free, so their generations are kept; the checkpoint
+	// takes them too, free slots are not visible and nothing else differs from it now
+	m_first_free_slot = checkpoint.first_free_slot;
+	for (int i = checkpoint.entities_count, c = m_entities.size(); i < c; ++i)
+	{
+		if (m_first_free_slot >= 0) m_entities[m_first_free_slot].prev = i;
+		m_entities[i].next = m_first_free_slot;
+		m_entities[i].prev = -1;
+		m_first_free_slot = i;
+	}
+	checkpoint.first_free_slot = m_first_free_slot;
+	checkpoint.entities_count = m_entities.size();
+	int entity_chunks_count = (m_entities.size() + CHECKPOINT_CHUNK_SIZE - 1) / CHECKPOINT_CHUNK_SIZE;
+	checkpoint.entity_states.resize(entity_chunks_count);
+	checkpoint.entity_chunks.resize(entity_chunks_count);
+
+	m_destroy_queue.clear();
+	notifyMovedEntities(false);
+	return true;
+}
+
+
+Universe::~Universe()
+{
+	releaseCheckpoint();
+}
 
 
 Universe::Universe(IAllocator& allocator)
 	: m_allocator(allocator)
 	, m_names(m_allocator)
+	, m_name_index(m_allocator)
+	, m_queries(m_allocator)
 	, m_entities(m_allocator)
+	, m_positions(m_allocator)
+	, m_rotations(m_allocator)
+	, m_scales(m_allocator)
+	, m_component_masks(m_allocator)
+	, m_generations(m_allocator)
 	, m_component_added(m_allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_created(m_allocator)
+	, m_entities_created(m_allocator)
 	, m_entity_destroyed(m_allocator)
+	, m_entities_destroyed(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
+	, m_dirty_entities(m_allocator)
+	, m_moved_entities(m_allocator)
+	, m_transform_roots(m_allocator)
+	, m_transform_listeners(m_allocator)
+	, m_filtered_moved_entities(m_allocator)
+	, m_jobs_moved_entities(m_allocator)
+	, m_destroy_queue(m_allocator)
+	, m_destroyed_entities(m_allocator)
+	, m_destroy_marks(m_allocator)
+	, m_deferred_transforms(false)
+	, m_checkpoint(nullptr)
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
+	m_positions.reserve(RESERVED_ENTITIES_COUNT);
+	m_rotations.reserve(RESERVED_ENTITIES_COUNT);
+	m_scales.reserve(RESERVED_ENTITIES_COUNT);
+	m_component_masks.reserve(RESERVED_ENTITIES_COUNT);
+	m_generations.reserve(RESERVED_ENTITIES_COUNT);
 }
 
 
@@ -76,20 +445,45 @@ void Universe::removeScene(IScene* scene)
 
 const Vec3& Universe::getPosition(Entity entity) const
 {
-	return m_entities[entity.index].position;
+	return m_positions[entity.index];
 }
 
 
 const Quat& Universe::getRotation(Entity entity) const
 {
-	return m_entities[entity.index].rotation;
+	return m_rotations[entity.index];
 }
 
 
 void Universe::transformEntity(Entity entity, bool update_local)
 {
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
-	entityTransformed().invoke(entity);
+	if (m_deferred_transforms)
+	{
+		if (update_local && hierarchy_idx >= 0 && m_hierarchy[hierarchy_idx].parent.isValid())
+		{
+			// flushing a dirty ancestor overwrites the new transform of the entity
+			Transform my_transform = getTransform(entity);
+			Entity parent = m_hierarchy[hierarchy_idx].parent;
+			updateDirtyAncestors(parent);
+			beforeEntityChange(entity.index);
+			beforeHierarchyChange(hierarchy_idx);
+			m_positions[entity.index] = my_transform.pos;
+			m_rotations[entity.index] = my_transform.rot;
+			m_scales[entity.index] = my_transform.scale;
+			Transform parent_tr = getTransform(parent);
+			m_hierarchy[hierarchy_idx].local_transform = parent_tr.inverted() * my_transform;
+		}
+		EntityData& data = m_entities[entity.index];
+		if (!data.transform_dirty)
+		{
+			data.transform_dirty = true;
+			m_dirty_entities.push(entity);
+		}
+		return;
+	}
+
+	notifyMovedEntity(entity);
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -97,6 +491,7 @@ void Universe::transformEntity(Entity entity, bool update_local)
 		if (update_local && h.parent.isValid())
 		{
 			Transform parent_tr = getTransform(h.parent);
+			beforeHierarchyChange(hierarchy_idx);
 			h.local_transform = (parent_tr.inverted() * my_transform);
 		}
 
@@ -105,10 +500,10 @@ void Universe::transformEntity(Entity entity, bool update_local)
 		{
 			Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
 			Transform abs_tr = my_transform * child_h.local_transform;
-			EntityData& child_data = m_entities[child.index];
-			child_data.position = abs_tr.pos;
-			child_data.rotation = abs_tr.rot;
-			child_data.scale = abs_tr.scale;
+			beforeEntityChange(child.index);
+			m_positions[child.index] = abs_tr.pos;
+			m_rotations[child.index] = abs_tr.rot;
+			m_scales[child.index] = abs_tr.scale;
 			transformEntity(child, false);
 
 			child = child_h.next_sibling;
@@ -119,14 +514,16 @@ void Universe::transformEntity(Entity entity, bool update_local)
 
 void Universe::setRotation(Entity entity, const Quat& rot)
 {
-	m_entities[entity.index].rotation = rot;
+	beforeEntityChange(entity.index);
+	m_rotations[entity.index] = rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setRotation(Entity entity, float x, float y, float z, float w)
 {
-	m_entities[entity.index].rotation.set(x, y, z, w);
+	beforeEntityChange(entity.index);
+	m_rotations[entity.index].set(x, y, z, w);
 	transformEntity(entity, true);
 }
 
@@ -139,30 +536,45 @@ bool Universe::hasEntity(Entity entity) const
 
 void Universe::setMatrix(Entity entity, const Matrix& mtx)
 {
-	EntityData& out = m_entities[entity.index];
-	mtx.decompose(out.position, out.rotation, out.scale);
+	beforeEntityChange(entity.index);
+	mtx.decompose(m_positions[entity.index], m_rotations[entity.index], m_scales[entity.index]);
 	transformEntity(entity, true);
 }
 
 
 Matrix Universe::getPositionAndRotation(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	Matrix mtx = transform.rotation.toMatrix();
-	mtx.setTranslation(transform.position);
+	Matrix mtx = m_rotations[entity.index].toMatrix();
+	mtx.setTranslation(m_positions[entity.index]);
 	return mtx;
 }
 
 
 void Universe::setTransformKeepChildren(Entity entity, const Transform& transform)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = transform.pos;
-	tmp.rotation = transform.rot;
-	tmp.scale = transform.scale;
+	if (m_deferred_transforms)
+	{
+		updateDirtyAncestors(entity);
+		if (m_entities[entity.index].transform_dirty)
+		{
+			propagateTransform(entity, m_moved_entities);
+			m_entities[entity.index].transform_dirty = false;
+		}
+	}
+	beforeEntityChange(entity.index);
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
+	m_scales[entity.index] = transform.scale;
 	
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
-	entityTransformed().invoke(entity);
+	if (m_deferred_transforms)
+	{
+		m_moved_entities.push(entity);
+	}
+	else
+	{
+		notifyMovedEntity(entity);
+	}
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -170,14 +582,17 @@ void Universe::setTransformKeepChildren(Entity entity, const Transform& transfor
 		if (h.parent.isValid())
 		{
 			Transform parent_tr = getTransform(h.parent);
+			beforeHierarchyChange(hierarchy_idx);
 			h.local_transform = parent_tr.inverted() * my_transform;
 		}
 
 		Entity child = h.first_child;
 		while (child.isValid())
 		{
-			Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
+			int child_idx = m_entities[child.index].hierarchy;
+			Hierarchy& child_h = m_hierarchy[child_idx];
 
+			beforeHierarchyChange(child_idx);
 			child_h.local_transform = my_transform.inverted() * getTransform(child);
 			child = child_h.next_sibling;
 		}
@@ -188,62 +603,98 @@ void Universe::setTransformKeepChildren(Entity entity, const Transform& transfor
 
 void Universe::setTransform(Entity entity, const Transform& transform)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = transform.pos;
-	tmp.rotation = transform.rot;
-	tmp.scale = transform.scale;
+	beforeEntityChange(entity.index);
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
+	m_scales[entity.index] = transform.scale;
 	transformEntity(entity, true);
 }
 
 
+void Universe::setTransforms(const Entity* entities, const Transform* transforms, int count)
+{
+	if (m_deferred_transforms)
+	{
+		for (int i = 0; i < count; ++i) setTransform(entities[i], transforms[i]);
+		return;
+	}
+
+	ASSERT(m_moved_entities.empty());
+	for (int i = 0; i < count; ++i)
+	{
+		Entity entity = entities[i];
+		beforeEntityChange(entity.index);
+		m_positions[entity.index] = transforms[i].pos;
+		m_rotations[entity.index] = transforms[i].rot;
+		m_scales[entity.index] = transforms[i].scale;
+
+		int hierarchy_idx = m_entities[entity.index].hierarchy;
+		if (hierarchy_idx < 0)
+		{
+			m_moved_entities.push(entity);
+			continue;
+		}
+
+		Hierarchy& h = m_hierarchy[hierarchy_idx];
+		if (h.parent.isValid())
+		{
+			Transform parent_tr = getTransform(h.parent);
+			beforeHierarchyChange(hierarchy_idx);
+			h.local_transform = parent_tr.inverted() * transforms[i];
+		}
+		propagateTransform(entity, m_moved_entities);
+	}
+	// an entity and its ancestor can both be in entities
+	notifyMovedEntities(true);
+}
+
+
 void Universe::setTransform(Entity entity, const RigidTransform& transform)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = transform.pos;
-	tmp.rotation = transform.rot;
+	beforeEntityChange(entity.index);
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(Entity entity, const Vec3& pos, const Quat& rot, float scale)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = pos;
-	tmp.rotation = rot;
-	tmp.scale = scale;
+	beforeEntityChange(entity.index);
+	m_positions[entity.index] = pos;
+	m_rotations[entity.index] = rot;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 Transform Universe::getTransform(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	return {transform.position, transform.rotation, transform.scale};
+	return {m_positions[entity.index], m_rotations[entity.index], m_scales[entity.index]};
 }
 
 
 Matrix Universe::getMatrix(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	Matrix mtx = transform.rotation.toMatrix();
-	mtx.setTranslation(transform.position);
-	mtx.multiply3x3(transform.scale);
+	Matrix mtx = m_rotations[entity.index].toMatrix();
+	mtx.setTranslation(m_positions[entity.index]);
+	mtx.multiply3x3(m_scales[entity.index]);
 	return mtx;
 }
 
 
 void Universe::setPosition(Entity entity, float x, float y, float z)
 {
-	auto& transform = m_entities[entity.index];
-	transform.position.set(x, y, z);
+	beforeEntityChange(entity.index);
+	m_positions[entity.index].set(x, y, z);
 	transformEntity(entity, true);
 }
 
 
 void Universe::setPosition(Entity entity, const Vec3& pos)
 {
-	auto& transform = m_entities[entity.index];
-	transform.position = pos;
+	beforeEntityChange(entity.index);
+	m_positions[entity.index] = pos;
 	transformEntity(entity, true);
 }
 
@@ -254,18 +705,83 @@ void Universe::setEntityName(Entity entity, const char* name)
 	if (name_idx < 0)
 	{
 		if (name[0] == '\0') return;
+		beforeEntityChange(entity.index);
+		beforeNamesChange();
 		m_entities[entity.index].name = m_names.size();
 		EntityName& name_data = m_names.emplace();
 		name_data.entity = entity;
 		copyString(name_data.name, name);
+		addNameToIndex(m_names.size() - 1);
 	}
 	else
 	{
+		beforeNamesChange();
+		removeNameFromIndex(name_idx);
 		copyString(m_names[name_idx].name, name);
+		addNameToIndex(name_idx);
 	}
 }
 
 
+void Universe::addNameToIndex(int name_idx)
+{
+	EntityName& name = m_names[name_idx];
+	name.hash = crc32(name.name);
+	auto iter = m_name_index.find(name.hash);
+	if (iter.isValid())
+	{
+		name.next = iter.value();
+		iter.value() = name_idx;
+	}
+	else
+	{
+		name.next = -1;
+		m_name_index.insert(name.hash, name_idx);
+	}
+}
+
+
+void Universe::removeNameFromIndex(int name_idx)
+{
+	const EntityName& name = m_names[name_idx];
+	auto iter = m_name_index.find(name.hash);
+	ASSERT(iter.isValid());
+	if (iter.value() == name_idx)
+	{
+		if (name.next < 0)
+		{
+			m_name_index.erase(iter);
+		}
+		else
+		{
+			iter.value() = name.next;
+		}
+		return;
+	}
+
+	int prev = iter.value();
+	while (m_names[prev].next != name_idx) prev = m_names[prev].next;
+	m_names[prev].next = name.next;
+}
+
+
+void Universe::eraseName(int name_idx)
+{
+	beforeNamesChange();
+	removeNameFromIndex(name_idx);
+	int last = m_names.size() - 1;
+	if (name_idx != last)
+	{
+		removeNameFromIndex(last);
+		beforeEntityChange(m_names[last].entity.index);
+		m_names[name_idx] = m_names[last];
+		m_entities[m_names[name_idx].entity.index].name = name_idx;
+		addNameToIndex(name_idx);
+	}
+	m_names.pop();
+}
+
+
 const char* Universe::getEntityName(Entity entity) const
 {
 	int name_idx = m_entities[entity.index].name;
@@ -274,39 +790,51 @@ const char* Universe::getEntityName(Entity entity) const
 }
 
 
-Entity Universe::findByName(Entity parent, const char* name)
+Entity Universe::findChildByName(Entity parent, const char* name, int length) const
 {
-	if (parent.isValid())
-	{
-		int h_idx = m_entities[parent.index].hierarchy;
-		if (h_idx < 0) return INVALID_ENTITY;
+	auto iter = m_name_index.find(crc32(name, length));
+	if (!iter.isValid()) return INVALID_ENTITY;
 
-		Entity e = m_hierarchy[h_idx].first_child;
-		while (e.isValid())
-		{
-			const EntityData& data = m_entities[e.index];
-			int name_idx = data.name;
-			if (name_idx >= 0)
-			{
-				if (equalStrings(m_names[name_idx].name, name)) return e;
-			}
-			e = m_hierarchy[data.hierarchy].next_sibling;
-		}
+	for (int i = iter.value(); i >= 0; i = m_names[i].next)
+	{
+		const EntityName& entity_name = m_names[i];
+		if (compareStringN(entity_name.name, name, length) != 0 || entity_name.name[length] != '\0') continue;
+		if (getParent(entity_name.entity) == parent) return entity_name.entity;
 	}
-	else
+	return INVALID_ENTITY;
+}
+
+
+Entity Universe::findByName(Entity parent, const char* name)
+{
+	return findChildByName(parent, name, stringLength(name));
+}
+
+
+Entity Universe::findByPath(Entity root, const char* path)
+{
+	Entity entity = root;
+	const char* c = path;
+	for (;;)
 	{
-		for (int i = 0, c = m_names.size(); i < c; ++i)
-		{
-			if (equalStrings(m_names[i].name, name))
-			{
-				const EntityData& data = m_entities[m_names[i].entity.index];
-				if (data.hierarchy < 0) return m_names[i].entity;
-				if (!m_hierarchy[data.hierarchy].parent.isValid()) return m_names[i].entity;
-			}
-		}
+		const char* end = c;
+		while (*end != '\0' && *end != '/') ++end;
+		entity = findChildByName(entity, c, int(end - c));
+		if (!entity.isValid() || *end == '\0') return entity;
+		c = end + 1;
 	}
+}
 
-	return INVALID_ENTITY;
+
+int Universe::pushEntitySlot()
+{
+	m_positions.emplace();
+	m_rotations.emplace();
+	m_scales.push(1);
+	m_component_masks.push(0);
+	m_generations.push(0);
+	m_entities.emplace().transform_dirty = false;
+	return m_entities.size() - 1;
 }
 
 
@@ -314,15 +842,15 @@ void Universe::emplaceEntity(Entity entity)
 {
 	while (m_entities.size() <= entity.index)
 	{
-		EntityData& data = m_entities.emplace();
+		EntityData& data = m_entities[pushEntitySlot()];
 		data.valid = false;
 		data.prev = -1;
 		data.name = -1;
 		data.hierarchy = -1;
 		data.next = m_first_free_slot;
-		data.scale = -1;
 		if (m_first_free_slot >= 0)
 		{
+			beforeEntityChange(m_first_free_slot);
 			m_entities[m_first_free_slot].prev = m_entities.size() - 1;
 		}
 		m_first_free_slot = m_entities.size() - 1;
@@ -333,21 +861,242 @@ void Universe::emplaceEntity(Entity entity)
 	}
 	if (m_entities[entity.index].prev >= 0)
 	{
+		beforeEntityChange(m_entities[entity.index].prev);
 		m_entities[m_entities[entity.index].prev].next = m_entities[entity.index].next;
 	}
-	if (m_entities[entity.index].next >= 0)
+	if (m_entities[entity.index].next >= 0)
+	{
+		beforeEntityChange(m_entities[entity.index].next);
+		m_entities[m_entities[entity.index].next].prev= m_entities[entity.index].prev;
+	}
+	beforeEntityChange(entity.index);
+	EntityData& data = m_entities[entity.index];
+	m_positions[entity.index].set(0, 0, 0);
+	m_rotations[entity.index].set(0, 0, 0, 1);
+	m_scales[entity.index] = 1;
+	m_component_masks[entity.index] = 0;
+	data.name = -1;
+	data.hierarchy = -1;
+	data.valid = true;
+	data.transform_dirty = false;
+	m_entity_created.invoke(entity);
+	m_entities_created.invoke(&entity, 1);
+}
+
+
+void Universe::createEntities(Entity* entities, int count)
+{
+	PROFILE_FUNCTION();
+	if (count <= 0) return;
+
+	// free slots are taken from the head of the list, the list is relinked once
+	int reused = 0;
+	while (reused < count && m_first_free_slot >= 0)
+	{
+		entities[reused].index = m_first_free_slot;
+		m_first_free_slot = m_entities[m_first_free_slot].next;
+		++reused;
+	}
+	if (m_first_free_slot >= 0)
+	{
+		beforeEntityChange(m_first_free_slot);
+		m_entities[m_first_free_slot].prev = -1;
+	}
+
+	int needed = m_entities.size() + count - reused;
+	if (needed > m_entities.capacity())
+	{
+		int capacity = Math::maximum(needed, m_entities.capacity() * 2);
+		m_entities.reserve(capacity);
+		m_positions.reserve(capacity);
+		m_rotations.reserve(capacity);
+		m_scales.reserve(capacity);
+		m_component_masks.reserve(capacity);
+		m_generations.reserve(capacity);
+	}
+	for (int i = reused; i < count; ++i)
+	{
+		entities[i].index = pushEntitySlot();
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int idx = entities[i].index;
+		beforeEntityChange(idx);
+		m_positions[idx].set(0, 0, 0);
+		m_rotations[idx].set(0, 0, 0, 1);
+		m_scales[idx] = 1;
+		m_component_masks[idx] = 0;
+		EntityData& data = m_entities[idx];
+		data.name = -1;
+		data.hierarchy = -1;
+		data.valid = true;
+		data.transform_dirty = false;
+	}
+
+	for (int i = 0; i < count; ++i) m_entity_created.invoke(entities[i]);
+	m_entities_created.invoke(entities, count);
+}
+
+
+void Universe::destroyEntities(const Entity* entities, int count)
+{
+	Array<EntityHandle> handles(m_allocator);
+	handles.resize(count);
+	for (int i = 0; i < count; ++i) handles[i] = getHandle(entities[i]);
+	destroyEntitiesBatch(handles.begin(), count);
+}
+
+
+void Universe::destroyEntityDeferred(Entity entity)
+{
+	if (!entity.isValid()) return;
+	m_destroy_queue.push(getHandle(entity));
+}
+
+
+void Universe::flushDestroyedEntities()
+{
+	if (m_destroy_queue.empty()) return;
+
+	Array<EntityHandle> queue(m_allocator);
+	queue.swap(m_destroy_queue);
+	destroyEntitiesBatch(queue.begin(), queue.size());
+	// entities queued by destroy listeners wait for the next flush
+	if (m_destroy_queue.empty())
+	{
+		queue.clear();
+		queue.swap(m_destroy_queue);
+	}
+}
+
+
+bool Universe::isAlive(EntityHandle handle) const
+{
+	return hasEntity(handle.entity) && m_generations[handle.entity.index] == handle.generation;
+}
+
+
+void Universe::destroyEntitiesBatch(const EntityHandle* handles, int count)
+{
+	PROFILE_FUNCTION();
+	// world transforms of children which outlive their parents must be up to date
+	updateTransforms();
+
+	Array<Entity>& destroyed = m_destroyed_entities;
+	destroyed.clear();
+	if (m_destroy_marks.size() < m_entities.size())
+	{
+		int old_size = m_destroy_marks.size();
+		m_destroy_marks.resize(m_entities.size());
+		setMemory(&m_destroy_marks[old_size], 0, m_entities.size() - old_size);
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		Entity entity = handles[i].entity;
+		if (!isAlive(handles[i]) || m_destroy_marks[entity.index]) continue;
+		m_destroy_marks[entity.index] = 1;
+		destroyed.push(entity);
+	}
+	if (destroyed.empty()) return;
+
+	// the hierarchy is unlinked for the whole batch, so every child list is walked at most once
+	Array<Entity> unlinked(m_allocator);
+	Array<Entity> parents(m_allocator);
+	for (Entity entity : destroyed)
+	{
+		int hierarchy_idx = m_entities[entity.index].hierarchy;
+		if (hierarchy_idx < 0) continue;
+
+		Hierarchy& h = m_hierarchy[hierarchy_idx];
+		beforeHierarchyChange(hierarchy_idx);
+		Entity child = h.first_child;
+		while (child.isValid())
+		{
+			int child_idx = m_entities[child.index].hierarchy;
+			Hierarchy& child_h = m_hierarchy[child_idx];
+			Entity next = child_h.next_sibling;
+			beforeHierarchyChange(child_idx);
+			child_h.parent = INVALID_ENTITY;
+			child_h.next_sibling = INVALID_ENTITY;
+			unlinked.push(child);
+			child = next;
+		}
+		h.first_child = INVALID_ENTITY;
+
+		// 2 - the parent is not destroyed, destroyed entities are removed from its children below
+		if (h.parent.isValid() && m_destroy_marks[h.parent.index] == 0)
+		{
+			m_destroy_marks[h.parent.index] = 2;
+			parents.push(h.parent);
+		}
+		unlinked.push(entity);
+	}
+
+	for (Entity parent : parents)
+	{
+		m_destroy_marks[parent.index] = 0;
+		int parent_idx = m_entities[parent.index].hierarchy;
+		beforeHierarchyChange(parent_idx);
+		Entity* x = &m_hierarchy[parent_idx].first_child;
+		while (x->isValid())
+		{
+			int child_idx = m_entities[x->index].hierarchy;
+			Hierarchy& child_h = m_hierarchy[child_idx];
+			// the next iteration can change the sibling link
+			beforeHierarchyChange(child_idx);
+			if (m_destroy_marks[x->index] == 1)
+			{
+				*x = child_h.next_sibling;
+				child_h.parent = INVALID_ENTITY;
+				child_h.next_sibling = INVALID_ENTITY;
+			}
+			else
+			{
+				x = &child_h.next_sibling;
+			}
+		}
+		unlinked.push(parent);
+	}
+
+	// same as collectGarbage in setParent
+	for (Entity entity : unlinked)
+	{
+		int hierarchy_idx = m_entities[entity.index].hierarchy;
+		if (hierarchy_idx < 0) continue;
+		Hierarchy& h = m_hierarchy[hierarchy_idx];
+		if (h.parent.isValid() || h.first_child.isValid()) continue;
+
+		const Hierarchy& last = m_hierarchy.back();
+		beforeHierarchyChange(hierarchy_idx);
+		beforeHierarchyChange(m_hierarchy.size() - 1);
+		beforeEntityChange(last.entity.index);
+		beforeEntityChange(entity.index);
+		m_entities[last.entity.index].hierarchy = hierarchy_idx;
+		m_entities[entity.index].hierarchy = -1;
+		h = last;
+		m_hierarchy.pop();
+	}
+
+	for (Entity entity : destroyed)
 	{
-		m_entities[m_entities[entity.index].next].prev= m_entities[entity.index].prev;
+		u64 mask = m_component_masks[entity.index];
+		for (int i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i)
+		{
+			if ((mask & ((u64)1 << i)) != 0)
+			{
+				IScene* scene = m_component_type_map[i].scene;
+				auto destroy_method = m_component_type_map[i].destroy;
+				(scene->*destroy_method)(entity);
+				mask = m_component_masks[entity.index];
+			}
+		}
+		releaseEntitySlot(entity);
+		m_destroy_marks[entity.index] = 0;
 	}
-	EntityData& data = m_entities[entity.index];
-	data.position.set(0, 0, 0);
-	data.rotation.set(0, 0, 0, 1);
-	data.scale = 1;
-	data.name = -1;
-	data.hierarchy = -1;
-	data.components = 0;
-	data.valid = true;
-	m_entity_created.invoke(entity);
+
+	for (Entity entity : destroyed) m_entity_destroyed.invoke(entity);
+	m_entities_destroyed.invoke(destroyed.begin(), destroyed.size());
 }
 
 
@@ -391,22 +1140,29 @@ Entity Universe::createEntity(const Vec3& position, const Quat& rotation)
 	{
 		data = &m_entities[m_first_free_slot];
 		entity.index = m_first_free_slot;
-		if (data->next >= 0) m_entities[data->next].prev = -1;
+		beforeEntityChange(entity.index);
+		if (data->next >= 0)
+		{
+			beforeEntityChange(data->next);
+			m_entities[data->next].prev = -1;
+		}
 		m_first_free_slot = data->next;
 	}
 	else
 	{
-		entity.index = m_entities.size();
-		data = &m_entities.emplace();
+		entity.index = pushEntitySlot();
+		data = &m_entities[entity.index];
 	}
-	data->position = position;
-	data->rotation = rotation;
-	data->scale = 1;
+	m_positions[entity.index] = position;
+	m_rotations[entity.index] = rotation;
+	m_scales[entity.index] = 1;
+	m_component_masks[entity.index] = 0;
 	data->name = -1;
 	data->hierarchy = -1;
-	data->components = 0;
 	data->valid = true;
+	data->transform_dirty = false;
 	m_entity_created.invoke(entity);
+	m_entities_created.invoke(&entity, 1);
 
 	return entity;
 }
@@ -425,7 +1181,7 @@ void Universe::destroyEntity(Entity entity)
 	setParent(INVALID_ENTITY, entity);
 	
 
-	u64 mask = entity_data.components;
+	u64 mask = m_component_masks[entity.index];
 	for (int i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i)
 	{
 		if ((mask & ((u64)1 << i)) != 0)
@@ -434,11 +1190,21 @@ void Universe::destroyEntity(Entity entity)
 			IScene* scene = m_component_type_map[i].scene;
 			auto destroy_method = m_component_type_map[i].destroy;
 			(scene->*destroy_method)(entity);
-			mask = entity_data.components;
+			mask = m_component_masks[entity.index];
 			ASSERT(original_mask != mask);
 		}
 	}
 
+	releaseEntitySlot(entity);
+	m_entity_destroyed.invoke(entity);
+	m_entities_destroyed.invoke(&entity, 1);
+}
+
+
+void Universe::releaseEntitySlot(Entity entity)
+{
+	beforeEntityChange(entity.index);
+	EntityData& entity_data = m_entities[entity.index];
 	entity_data.next = m_first_free_slot;
 	entity_data.prev = -1;
 	entity_data.hierarchy = -1;
@@ -446,18 +1212,18 @@ void Universe::destroyEntity(Entity entity)
 	entity_data.valid = false;
 	if (m_first_free_slot >= 0)
 	{
+		beforeEntityChange(m_first_free_slot);
 		m_entities[m_first_free_slot].prev = entity.index;
 	}
 
 	if (entity_data.name >= 0)
 	{
-		m_entities[m_names.back().entity.index].name = entity_data.name;
-		m_names.eraseFast(entity_data.name);
+		eraseName(entity_data.name);
 		entity_data.name = -1;
 	}
 
+	++m_generations[entity.index];
 	m_first_free_slot = entity.index;
-	m_entity_destroyed.invoke(entity);
 }
 
 
@@ -527,12 +1293,23 @@ void Universe::setParent(Entity new_parent, Entity child)
 		return;
 	}
 
+	if (m_deferred_transforms)
+	{
+		// world transforms of both are read below
+		updateDirtyAncestors(child);
+		if (new_parent.isValid()) updateDirtyAncestors(new_parent);
+	}
+
 	auto collectGarbage = [this](Entity entity) {
 		Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
 		if (h.parent.isValid()) return;
 		if (h.first_child.isValid()) return;
 
 		const Hierarchy& last = m_hierarchy.back();
+		beforeHierarchyChange(m_entities[entity.index].hierarchy);
+		beforeHierarchyChange(m_hierarchy.size() - 1);
+		beforeEntityChange(last.entity.index);
+		beforeEntityChange(entity.index);
 		m_entities[last.entity.index].hierarchy = m_entities[entity.index].hierarchy;
 		m_entities[entity.index].hierarchy = -1;
 		h = last;
@@ -547,8 +1324,9 @@ void Universe::setParent(Entity new_parent, Entity child)
 
 		if (old_parent.isValid())
 		{
-			Hierarchy& old_parent_h = m_hierarchy[m_entities[old_parent.index].hierarchy];
-			Entity* x = &old_parent_h.first_child;
+			int old_parent_idx = m_entities[old_parent.index].hierarchy;
+			beforeHierarchyChange(old_parent_idx);
+			Entity* x = &m_hierarchy[old_parent_idx].first_child;
 			while (x->isValid())
 			{
 				if (*x == child)
@@ -556,8 +1334,12 @@ void Universe::setParent(Entity new_parent, Entity child)
 					*x = getNextSibling(child);
 					break;
 				}
-				x = &m_hierarchy[m_entities[x->index].hierarchy].next_sibling;
+				int sibling_idx = m_entities[x->index].hierarchy;
+				// the next iteration can change the sibling link
+				beforeHierarchyChange(sibling_idx);
+				x = &m_hierarchy[sibling_idx].next_sibling;
 			}
+			beforeHierarchyChange(child_idx);
 			m_hierarchy[child_idx].parent = INVALID_ENTITY;
 			m_hierarchy[child_idx].next_sibling = INVALID_ENTITY;
 			collectGarbage(old_parent);
@@ -567,6 +1349,8 @@ void Universe::setParent(Entity new_parent, Entity child)
 	else if(new_parent.isValid())
 	{
 		child_idx = m_hierarchy.size();
+		beforeEntityChange(child.index);
+		beforeHierarchyChange(child_idx);
 		m_entities[child.index].hierarchy = child_idx;
 		Hierarchy& h = m_hierarchy.emplace();
 		h.entity = child;
@@ -581,6 +1365,8 @@ void Universe::setParent(Entity new_parent, Entity child)
 		if (new_parent_idx < 0)
 		{
 			new_parent_idx = m_hierarchy.size();
+			beforeEntityChange(new_parent.index);
+			beforeHierarchyChange(new_parent_idx);
 			m_entities[new_parent.index].hierarchy = new_parent_idx;
 			Hierarchy& h = m_hierarchy.emplace();
 			h.entity = new_parent;
@@ -589,6 +1375,8 @@ void Universe::setParent(Entity new_parent, Entity child)
 			h.next_sibling = INVALID_ENTITY;
 		}
 
+		beforeHierarchyChange(child_idx);
+		beforeHierarchyChange(new_parent_idx);
 		m_hierarchy[child_idx].parent = new_parent;
 		Transform parent_tr = getTransform(new_parent);
 		Transform child_tr = getTransform(child);
@@ -605,6 +1393,7 @@ void Universe::setParent(Entity new_parent, Entity child)
 
 void Universe::updateGlobalTransform(Entity entity)
 {
+	if (m_deferred_transforms) updateDirtyAncestors(entity);
 	const Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
 	Transform parent_tr = getTransform(h.parent);
 	
@@ -613,6 +1402,227 @@ void Universe::updateGlobalTransform(Entity entity)
 }
 
 
+void Universe::updateDirtyAncestors(Entity entity)
+{
+	if (m_dirty_entities.empty()) return;
+
+	Entity dirty_root = INVALID_ENTITY;
+	for (Entity e = getParent(entity); e.isValid(); e = getParent(e))
+	{
+		if (m_entities[e.index].transform_dirty) dirty_root = e;
+	}
+	if (!dirty_root.isValid()) return;
+
+	propagateTransform(dirty_root, m_moved_entities);
+	m_entities[dirty_root.index].transform_dirty = false;
+}
+
+
+// parents are processed before children, moved is used as the queue
+void Universe::propagateTransform(Entity root, Array<Entity>& moved)
+{
+	int first = moved.size();
+	moved.push(root);
+	for (int i = first; i < moved.size(); ++i)
+	{
+		Entity entity = moved[i];
+		int hierarchy_idx = m_entities[entity.index].hierarchy;
+		if (hierarchy_idx < 0) continue;
+
+		Transform tr = getTransform(entity);
+		Entity child = m_hierarchy[hierarchy_idx].first_child;
+		while (child.isValid())
+		{
+			const Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
+			Transform abs_tr = tr * child_h.local_transform;
+			beforeEntityChange(child.index);
+			m_positions[child.index] = abs_tr.pos;
+			m_rotations[child.index] = abs_tr.rot;
+			m_scales[child.index] = abs_tr.scale;
+			moved.push(child);
+			child = child_h.next_sibling;
+		}
+	}
+}
+
+
+void Universe::setDeferredTransforms(bool deferred)
+{
+	if (!deferred) updateTransforms();
+	m_deferred_transforms = deferred;
+}
+
+
+void Universe::updateTransforms()
+{
+	PROFILE_FUNCTION();
+	if (m_dirty_entities.empty() && m_moved_entities.empty()) return;
+
+	// subtrees of dirty entities without dirty ancestors are disjoint and cover everything
+	Array<Entity>& roots = m_transform_roots;
+	roots.clear();
+	for (Entity entity : m_dirty_entities)
+	{
+		const EntityData& data = m_entities[entity.index];
+		if (!data.valid || !data.transform_dirty) continue;
+		bool has_dirty_ancestor = false;
+		for (Entity e = getParent(entity); e.isValid() && !has_dirty_ancestor; e = getParent(e))
+		{
+			has_dirty_ancestor = m_entities[e.index].transform_dirty;
+		}
+		if (!has_dirty_ancestor) roots.push(entity);
+	}
+	// an entity can be in m_dirty_entities more than once if it was made dirty again after an early flush
+	int roots_count = 0;
+	for (Entity root : roots)
+	{
+		EntityData& data = m_entities[root.index];
+		if (!data.transform_dirty) continue;
+		data.transform_dirty = false;
+		roots[roots_count++] = root;
+	}
+	roots.resize(roots_count);
+	for (Entity entity : m_dirty_entities) m_entities[entity.index].transform_dirty = false;
+	m_dirty_entities.clear();
+
+	// early flushes (updateDirtyAncestors) could have moved some entities already
+	bool has_duplicates = !m_moved_entities.empty();
+	int jobs_count = Math::minimum(roots_count / MIN_ROOTS_PER_TRANSFORM_JOB, MAX_TRANSFORM_JOBS);
+	if (jobs_count > 1)
+	{
+		while (m_jobs_moved_entities.size() < jobs_count) m_jobs_moved_entities.emplace(m_allocator);
+
+		struct JobData
+		{
+			Universe* universe;
+			int from;
+			int to;
+			Array<Entity>* moved;
+		} jobs_data[MAX_TRANSFORM_JOBS];
+		JobSystem::JobDecl jobs[MAX_TRANSFORM_JOBS];
+		for (int i = 0; i < jobs_count; ++i)
+		{
+			m_jobs_moved_entities[i].clear();
+			jobs_data[i] = { this, i * roots_count / jobs_count, (i + 1) * roots_count / jobs_count, &m_jobs_moved_entities[i] };
+			jobs[i].data = &jobs_data[i];
+			jobs[i].task = [](void* data) {
+				PROFILE_BLOCK("propagate transforms");
+				JobData* job = (JobData*)data;
+				Universe* universe = job->universe;
+				for (int j = job->from; j < job->to; ++j)
+				{
+					universe->propagateTransform(universe->m_transform_roots[j], *job->moved);
+				}
+			};
+		}
+		volatile int counter = 0;
+		JobSystem::runJobs(jobs, jobs_count, &counter);
+		JobSystem::wait(&counter);
+
+		for (int i = 0; i < jobs_count; ++i)
+		{
+			const Array<Entity>& moved = m_jobs_moved_entities[i];
+			int offset = m_moved_entities.size();
+			m_moved_entities.resize(offset + moved.size());
+			if (!moved.empty()) copyMemory(&m_moved_entities[offset], &moved[0], moved.size() * sizeof(moved[0]));
+		}
+	}
+	else
+	{
+		for (Entity root : roots) propagateTransform(root, m_moved_entities);
+	}
+
+	notifyMovedEntities(has_duplicates);
+}
+
+
+void Universe::notifyMovedEntities(bool has_duplicates)
+{
+	if (has_duplicates)
+	{
+		// all transform_dirty flags are clear at this point, reuse them to mark reported entities
+		int count = 0;
+		for (Entity entity : m_moved_entities)
+		{
+			EntityData& data = m_entities[entity.index];
+			if (!data.valid || data.transform_dirty) continue;
+			data.transform_dirty = true;
+			m_moved_entities[count++] = entity;
+		}
+		m_moved_entities.resize(count);
+		for (Entity entity : m_moved_entities) m_entities[entity.index].transform_dirty = false;
+	}
+
+	if (m_moved_entities.empty()) return;
+
+	m_entities_moved.invoke(&m_moved_entities[0], m_moved_entities.size());
+	if (!m_entity_moved.empty())
+	{
+		for (Entity entity : m_moved_entities) m_entity_moved.invoke(entity);
+	}
+	for (TransformListener& listener : m_transform_listeners)
+	{
+		m_filtered_moved_entities.clear();
+		for (Entity entity : m_moved_entities)
+		{
+			if (m_component_masks[entity.index] & listener.mask) m_filtered_moved_entities.push(entity);
+		}
+		if (m_filtered_moved_entities.empty()) continue;
+
+		if (listener.moved_batch.isValid())
+		{
+			listener.moved_batch.invoke(&m_filtered_moved_entities[0], m_filtered_moved_entities.size());
+		}
+		else
+		{
+			for (Entity entity : m_filtered_moved_entities) listener.moved.invoke(entity);
+		}
+	}
+	m_moved_entities.clear();
+}
+
+
+void Universe::notifyMovedEntity(Entity entity)
+{
+	m_entity_moved.invoke(entity);
+	u64 mask = m_component_masks[entity.index];
+	if (mask == 0) return;
+	for (const TransformListener& listener : m_transform_listeners)
+	{
+		if (mask & listener.mask) listener.moved.invoke(entity);
+	}
+}
+
+
+void Universe::addTransformListener(const ComponentType* types,
+	int count,
+	const Delegate<void(Entity)>& moved,
+	const Delegate<void(const Entity*, int)>& moved_batch)
+{
+	TransformListener& listener = m_transform_listeners.emplace();
+	listener.mask = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (types[i] != INVALID_COMPONENT_TYPE) listener.mask |= (u64)1 << types[i].index;
+	}
+	listener.moved = moved;
+	listener.moved_batch = moved_batch;
+}
+
+
+void Universe::removeTransformListener(const Delegate<void(Entity)>& moved)
+{
+	for (int i = 0; i < m_transform_listeners.size(); ++i)
+	{
+		if (m_transform_listeners[i].moved == moved)
+		{
+			m_transform_listeners.erase(i);
+			return;
+		}
+	}
+}
+
+
 void Universe::setLocalPosition(Entity entity, const Vec3& pos)
 {
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
@@ -622,6 +1632,7 @@ void Universe::setLocalPosition(Entity entity, const Vec3& pos)
 		return;
 	}
 
+	beforeHierarchyChange(hierarchy_idx);
 	m_hierarchy[hierarchy_idx].local_transform.pos = pos;
 	updateGlobalTransform(entity);
 }
@@ -635,6 +1646,7 @@ void Universe::setLocalRotation(Entity entity, const Quat& rot)
 		setRotation(entity, rot);
 		return;
 	}
+	beforeHierarchyChange(hierarchy_idx);
 	m_hierarchy[hierarchy_idx].local_transform.rot = rot;
 	updateGlobalTransform(entity);
 }
@@ -656,6 +1668,7 @@ void Universe::setLocalTransform(Entity entity, const Transform& transform)
 		return;
 	}
 
+	beforeHierarchyChange(hierarchy_idx);
 	Hierarchy& h = m_hierarchy[hierarchy_idx];
 	h.local_transform = transform;
 	updateGlobalTransform(entity);
@@ -703,10 +1716,55 @@ void Universe::deserializeComponent(IDeserializer& serializer, Entity entity, Co
 }
 
 
+// layout of entities in serialized universes, from before transforms were split into separate arrays
+struct SerializedEntityData
+{
+	Vec3 position;
+	Quat rotation;
+	int hierarchy;
+	int name;
+	union
+	{
+		struct
+		{
+			float scale;
+			u64 components;
+		};
+		struct
+		{
+			int prev;
+			int next;
+		};
+	};
+	bool valid;
+};
+
+
 void Universe::serialize(OutputBlob& serializer)
 {
 	serializer.write((i32)m_entities.size());
-	serializer.write(&m_entities[0], sizeof(m_entities[0]) * m_entities.size());
+	for (int i = 0, c = m_entities.size(); i < c; ++i)
+	{
+		const EntityData& data = m_entities[i];
+		SerializedEntityData tmp;
+		setMemory(&tmp, 0, sizeof(tmp));
+		tmp.position = m_positions[i];
+		tmp.rotation = m_rotations[i];
+		tmp.hierarchy = data.hierarchy;
+		tmp.name = data.name;
+		if (data.valid)
+		{
+			tmp.scale = m_scales[i];
+			tmp.components = m_component_masks[i];
+		}
+		else
+		{
+			tmp.prev = data.prev;
+			tmp.next = data.next;
+		}
+		tmp.valid = data.valid;
+		serializer.write(tmp);
+	}
 	serializer.write((i32)m_names.size());
 	for (const EntityName& name : m_names)
 	{
@@ -722,11 +1780,42 @@ void Universe::serialize(OutputBlob& serializer)
 
 void Universe::deserialize(InputBlob& serializer)
 {
+	releaseCheckpoint();
 	i32 count;
 	serializer.read(count);
 	m_entities.resize(count);
+	m_positions.resize(count);
+	m_rotations.resize(count);
+	m_scales.resize(count);
+	m_component_masks.resize(count);
+	m_generations.resize(count);
+	if (count > 0) setMemory(&m_generations[0], 0, count * sizeof(m_generations[0]));
 
-	if (count > 0) serializer.read(&m_entities[0], sizeof(m_entities[0]) * m_entities.size());
+	for (int i = 0; i < count; ++i)
+	{
+		SerializedEntityData tmp;
+		serializer.read(tmp);
+		EntityData& data = m_entities[i];
+		m_positions[i] = tmp.position;
+		m_rotations[i] = tmp.rotation;
+		data.hierarchy = tmp.hierarchy;
+		data.name = tmp.name;
+		data.valid = tmp.valid;
+		data.transform_dirty = false;
+		if (tmp.valid)
+		{
+			m_scales[i] = tmp.scale;
+			m_component_masks[i] = tmp.components;
+			data.prev = data.next = -1;
+		}
+		else
+		{
+			m_scales[i] = 1;
+			m_component_masks[i] = 0;
+			data.prev = tmp.prev;
+			data.next = tmp.next;
+		}
+	}
 
 	serializer.read(count);
 	for (int i = 0; i < count; ++i)
@@ -735,6 +1824,7 @@ void Universe::deserialize(InputBlob& serializer)
 		serializer.read(name.entity);
 		serializer.readString(name.name, lengthOf(name.name));
 		m_entities[name.entity.index].name = m_names.size() - 1;
+		addNameToIndex(m_names.size() - 1);
 	}
 
 	serializer.read(m_first_free_slot);
@@ -742,6 +1832,226 @@ void Universe::deserialize(InputBlob& serializer)
 	serializer.read(count);
 	m_hierarchy.resize(count);
 	if (count > 0) serializer.read(&m_hierarchy[0], sizeof(m_hierarchy[0]) * m_hierarchy.size());
+
+	for (int i = 0, c = m_queries.size(); i < c; ++i)
+	{
+		if (m_queries[i].ref_count > 0) rebuildQuery(i);
+	}
+}
+
+
+static const u32 UNIVERSE_CHUNK = crc32("universe");
+static const u32 ENTITIES_CHUNK = crc32("universe_entities");
+static const u32 POSITIONS_CHUNK = crc32("universe_positions");
+static const u32 ROTATIONS_CHUNK = crc32("universe_rotations");
+static const u32 SCALES_CHUNK = crc32("universe_scales");
+static const u32 COMPONENTS_CHUNK = crc32("universe_components");
+static const u32 NAMES_CHUNK = crc32("universe_names");
+static const u32 HIERARCHY_CHUNK = crc32("universe_hierarchy");
+static const u32 GENERATIONS_CHUNK = crc32("universe_generations");
+
+
+#pragma pack(1)
+struct UniverseSnapshotHeader
+{
+	i32 entities_count;
+	i32 names_count;
+	i32 hierarchy_count;
+	i32 first_free_slot;
+};
+
+
+// explicit records instead of raw EntityData and EntityName,
+// so padding and bytes after the name's terminator do not end up in the snapshot
+struct EntitySnapshotRecord
+{
+	i32 hierarchy;
+	i32 name;
+	i32 prev;
+	i32 next;
+	u8 valid;
+};
+
+
+struct EntityNameSnapshotRecord
+{
+	i32 entity;
+	char name[Universe::ENTITY_NAME_MAX_LENGTH];
+};
+#pragma pack()
+
+
+template <typename T> static void writeArrayChunk(SnapshotWriter& snapshot, u32 id, const Array<T>& array)
+{
+	snapshot.writeChunk(id, array.begin(), array.size() * sizeof(T));
+}
+
+
+// nullptr if the chunk does not exist or does not have exactly count items
+template <typename T> static const T* getArrayChunk(const SnapshotReader& snapshot, u32 id, int count)
+{
+	int size;
+	const void* data = snapshot.getChunk(id, &size);
+	if (!data || size != count * (int)sizeof(T)) return nullptr;
+	return (const T*)data;
+}
+
+
+template <typename T> static void copyArray(Array<T>& array, const T* data, int count)
+{
+	array.resize(count);
+	if (count > 0) copyMemory(&array[0], data, count * sizeof(T));
+}
+
+
+static bool isIndexValid(int index, int count)
+{
+	return index >= -1 && index < count;
+}
+
+
+void Universe::serialize(SnapshotWriter& snapshot)
+{
+	// transform_dirty flags are not stored, a loaded universe must not have any of them set
+	updateTransforms();
+
+	UniverseSnapshotHeader header;
+	header.entities_count = m_entities.size();
+	header.names_count = m_names.size();
+	header.hierarchy_count = m_hierarchy.size();
+	header.first_free_slot = m_first_free_slot;
+	snapshot.writeChunk(UNIVERSE_CHUNK, &header, sizeof(header));
+
+	OutputBlob& blob = snapshot.getBlob();
+	snapshot.beginChunk(ENTITIES_CHUNK);
+	for (const EntityData& data : m_entities)
+	{
+		EntitySnapshotRecord record;
+		record.hierarchy = data.hierarchy;
+		record.name = data.name;
+		record.prev = data.prev;
+		record.next = data.next;
+		record.valid = data.valid ? 1 : 0;
+		blob.write(record);
+	}
+
+	writeArrayChunk(snapshot, POSITIONS_CHUNK, m_positions);
+	writeArrayChunk(snapshot, ROTATIONS_CHUNK, m_rotations);
+	writeArrayChunk(snapshot, SCALES_CHUNK, m_scales);
+	writeArrayChunk(snapshot, COMPONENTS_CHUNK, m_component_masks);
+
+	snapshot.beginChunk(NAMES_CHUNK);
+	for (const EntityName& name : m_names)
+	{
+		EntityNameSnapshotRecord record;
+		setMemory(record.name, 0, sizeof(record.name));
+		record.entity = name.entity.index;
+		copyString(record.name, name.name);
+		blob.write(record);
+	}
+
+	writeArrayChunk(snapshot, HIERARCHY_CHUNK, m_hierarchy);
+	writeArrayChunk(snapshot, GENERATIONS_CHUNK, m_generations);
+}
+
+
+bool Universe::deserialize(const SnapshotReader& snapshot)
+{
+	releaseCheckpoint();
+	UniverseSnapshotHeader header;
+	int size;
+	const void* data = snapshot.getChunk(UNIVERSE_CHUNK, &size);
+	if (!data || size != sizeof(header)) return false;
+	copyMemory(&header, data, sizeof(header));
+
+	// everything is checked before the universe is touched, a broken snapshot leaves it as it was
+	int count = header.entities_count;
+	int names_count = header.names_count;
+	int hierarchy_count = header.hierarchy_count;
+	if (count < 0 || names_count < 0 || hierarchy_count < 0) return false;
+	if (!isIndexValid(header.first_free_slot, count)) return false;
+
+	auto* entities = getArrayChunk<EntitySnapshotRecord>(snapshot, ENTITIES_CHUNK, count);
+	auto* positions = getArrayChunk<Vec3>(snapshot, POSITIONS_CHUNK, count);
+	auto* rotations = getArrayChunk<Quat>(snapshot, ROTATIONS_CHUNK, count);
+	auto* scales = getArrayChunk<float>(snapshot, SCALES_CHUNK, count);
+	auto* component_masks = getArrayChunk<u64>(snapshot, COMPONENTS_CHUNK, count);
+	auto* names = getArrayChunk<EntityNameSnapshotRecord>(snapshot, NAMES_CHUNK, names_count);
+	auto* hierarchy = getArrayChunk<Hierarchy>(snapshot, HIERARCHY_CHUNK, hierarchy_count);
+	// snapshots without generations
+	auto* generations = getArrayChunk<u32>(snapshot, GENERATIONS_CHUNK, count);
+	if (!entities || !positions || !rotations || !scales || !component_masks || !names || !hierarchy)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		const EntitySnapshotRecord& record = entities[i];
+		if (!isIndexValid(record.prev, count) || !isIndexValid(record.next, count)) return false;
+		if (!isIndexValid(record.hierarchy, hierarchy_count)) return false;
+		if (!isIndexValid(record.name, names_count)) return false;
+		if (record.hierarchy >= 0 && hierarchy[record.hierarchy].entity.index != i) return false;
+		if (record.name >= 0 && names[record.name].entity != i) return false;
+	}
+	for (int i = 0; i < names_count; ++i)
+	{
+		int entity = names[i].entity;
+		if (entity < 0 || entity >= count || entities[entity].name != i) return false;
+		if (names[i].name[ENTITY_NAME_MAX_LENGTH - 1] != 0) return false;
+	}
+	for (int i = 0; i < hierarchy_count; ++i)
+	{
+		const Hierarchy& h = hierarchy[i];
+		if (h.entity.index < 0 || h.entity.index >= count || entities[h.entity.index].hierarchy != i) return false;
+		if (!isIndexValid(h.parent.index, count)) return false;
+		if (!isIndexValid(h.first_child.index, count)) return false;
+		if (!isIndexValid(h.next_sibling.index, count)) return false;
+	}
+
+	m_entities.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const EntitySnapshotRecord& record = entities[i];
+		EntityData& data = m_entities[i];
+		data.hierarchy = record.hierarchy;
+		data.name = record.name;
+		data.prev = record.prev;
+		data.next = record.next;
+		data.valid = record.valid != 0;
+		data.transform_dirty = false;
+	}
+	copyArray(m_positions, positions, count);
+	copyArray(m_rotations, rotations, count);
+	copyArray(m_scales, scales, count);
+	copyArray(m_component_masks, component_masks, count);
+	copyArray(m_hierarchy, hierarchy, hierarchy_count);
+	if (generations)
+	{
+		copyArray(m_generations, generations, count);
+	}
+	else
+	{
+		m_generations.resize(count);
+		if (count > 0) setMemory(&m_generations[0], 0, count * sizeof(m_generations[0]));
+	}
+	m_first_free_slot = header.first_free_slot;
+
+	m_name_index.clear();
+	m_names.resize(names_count);
+	for (int i = 0; i < names_count; ++i)
+	{
+		EntityName& name = m_names[i];
+		name.entity = {names[i].entity};
+		copyString(name.name, names[i].name);
+		addNameToIndex(i);
+	}
+
+	for (int i = 0, c = m_queries.size(); i < c; ++i)
+	{
+		if (m_queries[i].ref_count > 0) rebuildQuery(i);
+	}
+	return true;
 }
 
 
@@ -827,22 +2137,21 @@ Entity Universe::instantiatePrefab(const PrefabResource& prefab,
 
 void Universe::setScale(Entity entity, float scale)
 {
-	auto& transform = m_entities[entity.index];
-	transform.scale = scale;
+	beforeEntityChange(entity.index);
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 float Universe::getScale(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	return transform.scale;
+	return m_scales[entity.index];
 }
 
 
 ComponentUID Universe::getFirstComponent(Entity entity) const
 {
-	u64 mask = m_entities[entity.index].components;
+	u64 mask = m_component_masks[entity.index];
 	for (int i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i)
 	{
 		if ((mask & (u64(1) << i)) != 0)
@@ -857,7 +2166,7 @@ ComponentUID Universe::getFirstComponent(Entity entity) const
 
 ComponentUID Universe::getNextComponent(const ComponentUID& cmp) const
 {
-	u64 mask = m_entities[cmp.entity.index].components;
+	u64 mask = m_component_masks[cmp.entity.index];
 	for (int i = cmp.type.index + 1; i < ComponentType::MAX_TYPES_COUNT; ++i)
 	{
 		if ((mask & (u64(1) << i)) != 0)
@@ -872,7 +2181,7 @@ ComponentUID Universe::getNextComponent(const ComponentUID& cmp) const
 
 ComponentUID Universe::getComponent(Entity entity, ComponentType component_type) const
 {
-	u64 mask = m_entities[entity.index].components;
+	u64 mask = m_component_masks[entity.index];
 	if ((mask & (u64(1) << component_type.index)) == 0) return ComponentUID::INVALID;
 	IScene* scene = m_component_type_map[component_type.index].scene;
 	return ComponentUID(entity, component_type, scene);
@@ -881,18 +2190,20 @@ ComponentUID Universe::getComponent(Entity entity, ComponentType component_type)
 
 bool Universe::hasComponent(Entity entity, ComponentType component_type) const
 {
-	u64 mask = m_entities[entity.index].components;
+	u64 mask = m_component_masks[entity.index];
 	return (mask & (u64(1) << component_type.index)) != 0;
 }
 
 
 void Universe::onComponentDestroyed(Entity entity, ComponentType component_type, IScene* scene)
 {
-	auto mask = m_entities[entity.index].components;
+	auto mask = m_component_masks[entity.index];
 	auto old_mask = mask;
 	mask &= ~((u64)1 << component_type.index);
 	ASSERT(old_mask != mask);
-	m_entities[entity.index].components = mask;
+	beforeEntityChange(entity.index);
+	m_component_masks[entity.index] = mask;
+	updateQueries(entity, old_mask, mask);
 	m_component_destroyed.invoke(ComponentUID(entity, component_type, scene));
 }
 
@@ -916,9 +2227,109 @@ void Universe::destroyComponent(Entity entity, ComponentType type)
 void Universe::onComponentCreated(Entity entity, ComponentType component_type, IScene* scene)
 {
 	ComponentUID cmp(entity, component_type, scene);
-	m_entities[entity.index].components |= (u64)1 << component_type.index;
+	u64 old_mask = m_component_masks[entity.index];
+	beforeEntityChange(entity.index);
+	m_component_masks[entity.index] |= (u64)1 << component_type.index;
+	updateQueries(entity, old_mask, m_component_masks[entity.index]);
 	m_component_added.invoke(cmp);
 }
 
 
+static u64 getComponentsMask(const ComponentType* types, int count)
+{
+	u64 mask = 0;
+	for (int i = 0; i < count; ++i) mask |= (u64)1 << types[i].index;
+	return mask;
+}
+
+
+int Universe::findQuery(const ComponentType* types, int count) const
+{
+	u64 mask = getComponentsMask(types, count);
+	for (int i = 0, c = m_queries.size(); i < c; ++i)
+	{
+		if (m_queries[i].ref_count > 0 && m_queries[i].mask == mask) return i;
+	}
+	return -1;
+}
+
+
+int Universe::registerQuery(const ComponentType* types, int count)
+{
+	ASSERT(count > 0);
+	int idx = findQuery(types, count);
+	if (idx >= 0)
+	{
+		++m_queries[idx].ref_count;
+		return idx;
+	}
+
+	idx = m_queries.find([](const Query& query) { return query.ref_count == 0; });
+	if (idx < 0)
+	{
+		idx = m_queries.size();
+		m_queries.emplace(m_allocator);
+	}
+	Query& query = m_queries[idx];
+	query.mask = getComponentsMask(types, count);
+	query.ref_count = 1;
+	rebuildQuery(idx);
+	return idx;
+}
+
+
+void Universe::rebuildQuery(int query_idx)
+{
+	Query& query = m_queries[query_idx];
+	query.entities.clear();
+	query.indices.resize(m_entities.size());
+	for (int i = 0, c = m_entities.size(); i < c; ++i)
+	{
+		bool is_matching = m_entities[i].valid && (m_component_masks[i] & query.mask) == query.mask;
+		query.indices[i] = is_matching ? query.entities.size() : -1;
+		if (is_matching) query.entities.push({i});
+	}
+}
+
+
+void Universe::unregisterQuery(int query)
+{
+	Query& q = m_queries[query];
+	ASSERT(q.ref_count > 0);
+	--q.ref_count;
+	if (q.ref_count > 0) return;
+
+	q.entities.free();
+	q.indices.free();
+}
+
+
+void Universe::updateQueries(Entity entity, u64 old_mask, u64 new_mask)
+{
+	for (Query& query : m_queries)
+	{
+		if (query.ref_count == 0) continue;
+		bool was_matching = (old_mask & query.mask) == query.mask;
+		bool is_matching = (new_mask & query.mask) == query.mask;
+		if (was_matching == is_matching) continue;
+
+		if (is_matching)
+		{
+			while (query.indices.size() <= entity.index) query.indices.push(-1);
+			query.indices[entity.index] = query.entities.size();
+			query.entities.push(entity);
+		}
+		else
+		{
+			int idx = query.indices[entity.index];
+			Entity last = query.entities.back();
+			query.entities[idx] = last;
+			query.indices[last.index] = idx;
+			query.entities.pop();
+			query.indices[entity.index] = -1;
+		}
+	}
+}
+
+
 } // namespace Lumix
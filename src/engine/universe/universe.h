@@ -3,6 +3,7 @@
 
 #include "engine/array.h"
 #include "engine/delegate_list.h"
+#include "engine/hash_map.h"
 #include "engine/iplugin.h"
 #include "engine/lumix.h"
 #include "engine/matrix.h"
@@ -21,6 +22,17 @@ struct IScene;
 struct ISerializer;
 class OutputBlob;
 struct PrefabResource;
+class SnapshotReader;
+class SnapshotWriter;
+
+
+// entity slots are reused, the generation of a slot changes every time its entity is destroyed,
+// so a stored handle can be checked lazily instead of being purged in entityDestroyed
+struct EntityHandle
+{
+	Entity entity;
+	u32 generation;
+};
 
 
 class LUMIX_ENGINE_API Universe
@@ -48,14 +60,31 @@ public:
 	IAllocator& getAllocator() { return m_allocator; }
 	void emplaceEntity(Entity entity);
 	Entity createEntity(const Vec3& position, const Quat& rotation);
+	// entities are created at the origin and reported in one entitiesCreated call
+	void createEntities(Entity* entities, int count);
 	Entity cloneEntity(Entity entity);
 	void destroyEntity(Entity entity);
+	// entities are reported in one entitiesDestroyed call
+	void destroyEntities(const Entity* entities, int count);
+	// the entity is destroyed in flushDestroyedEntities with all the other queued entities
+	void destroyEntityDeferred(Entity entity);
+	void flushDestroyedEntities();
+	EntityHandle getHandle(Entity entity) const { return {entity, m_generations[entity.index]}; }
+	bool isAlive(EntityHandle handle) const;
 	void createComponent(ComponentType type, Entity entity);
 	void destroyComponent(Entity entity, ComponentType type);
 	void onComponentCreated(Entity entity, ComponentType component_type, IScene* scene);
 	void onComponentDestroyed(Entity entity, ComponentType component_type, IScene* scene);
 	bool hasComponent(Entity entity, ComponentType component_type) const;
 	ComponentUID getComponent(Entity entity, ComponentType type) const;
+
+	// entities with all the components, kept up to date when components are created or destroyed,
+	// queries with the same components are shared, the order of entities changes as they are removed
+	int registerQuery(const ComponentType* types, int count);
+	void unregisterQuery(int query);
+	int findQuery(const ComponentType* types, int count) const;
+	const Entity* getQueryEntities(int query) const { return m_queries[query].entities.begin(); }
+	int getQueryEntitiesCount(int query) const { return m_queries[query].entities.size(); }
 	ComponentUID getFirstComponent(Entity entity) const;
 	ComponentUID getNextComponent(const ComponentUID& cmp) const;
 	ComponentTypeEntry& registerComponentType(ComponentType type) { return m_component_type_map[type.index]; }
@@ -73,6 +102,8 @@ public:
 	Entity getNextEntity(Entity entity) const;
 	const char* getEntityName(Entity entity) const;
 	Entity findByName(Entity parent, const char* name);
+	// "a/b/c" - c is a child of b, b is a child of a and a is a child of root or has no parent if root is invalid
+	Entity findByPath(Entity root, const char* path);
 	void setEntityName(Entity entity, const char* name);
 	bool hasEntity(Entity entity) const;
 
@@ -93,6 +124,8 @@ public:
 	Matrix getMatrix(Entity entity) const;
 	void setTransform(Entity entity, const RigidTransform& transform);
 	void setTransform(Entity entity, const Transform& transform);
+	// moved entities are reported in one entitiesTransformed call even in the immediate mode
+	void setTransforms(const Entity* entities, const Transform* transforms, int count);
 	void setTransformKeepChildren(Entity entity, const Transform& transform);
 	void setTransform(Entity entity, const Vec3& pos, const Quat& rot, float scale);
 	Transform getTransform(Entity entity) const;
@@ -108,15 +141,55 @@ public:
 	float getScale(Entity entity) const;
 	const Vec3& getPosition(Entity entity) const;
 	const Quat& getRotation(Entity entity) const;
+	// transforms of all entity slots indexed by Entity::index, slots of destroyed entities contain garbage
+	int getEntitySlotsCount() const { return m_entities.size(); }
+	const Vec3* getPositions() const { return m_positions.begin(); }
+	const Quat* getRotations() const { return m_rotations.begin(); }
+	const float* getScales() const { return m_scales.begin(); }
 	const char* getName() const { return m_name; }
 	void setName(const char* name) 
 	{ 
 		m_name = name; 
 	}
 
+	// deferred - setters update only the entity itself, its descendants get their world transforms
+	// and everything is reported in updateTransforms(): entitiesTransformed once with all moved entities,
+	// entityTransformed once per moved entity
+	void setDeferredTransforms(bool deferred);
+	bool areTransformsDeferred() const { return m_deferred_transforms; }
+	void updateTransforms();
+
+	// listeners are notified only about entities with at least one of the component types,
+	// entityTransformed and entitiesTransformed get all entities; in deferred mode a listener
+	// gets moved_batch, or moved per entity if moved_batch is not bound
+	void addTransformListener(const ComponentType* types,
+		int count,
+		const Delegate<void(Entity)>& moved,
+		const Delegate<void(const Entity*, int)>& moved_batch);
+	void removeTransformListener(const Delegate<void(Entity)>& moved);
+	template <typename C, void (C::*Moved)(Entity), void (C::*MovedBatch)(const Entity*, int)>
+	void subscribeTransformed(C* instance, const ComponentType* types, int count)
+	{
+		Delegate<void(Entity)> moved;
+		moved.bind<C, Moved>(instance);
+		Delegate<void(const Entity*, int)> moved_batch;
+		moved_batch.bind<C, MovedBatch>(instance);
+		addTransformListener(types, count, moved, moved_batch);
+	}
+	template <typename C, void (C::*Moved)(Entity)> void unsubscribeTransformed(C* instance)
+	{
+		Delegate<void(Entity)> moved;
+		moved.bind<C, Moved>(instance);
+		removeTransformListener(moved);
+	}
 	DelegateList<void(Entity)>& entityTransformed() { return m_entity_moved; }
+	DelegateList<void(const Entity*, int)>& entitiesTransformed() { return m_entities_moved; }
+	// the single entity events fire for each entity, the batched ones once per create or destroy call,
+	// including createEntity and destroyEntity with a batch of one
 	DelegateList<void(Entity)>& entityCreated() { return m_entity_created; }
+	DelegateList<void(const Entity*, int)>& entitiesCreated() { return m_entities_created; }
 	DelegateList<void(Entity)>& entityDestroyed() { return m_entity_destroyed; }
+	DelegateList<void(const Entity*, int)>& entitiesDestroyed() { return m_entities_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentAdded() { return m_component_added; }
 
@@ -124,6 +197,19 @@ public:
 	void deserializeComponent(IDeserializer& serializer, Entity entity, ComponentType type, int scene_version);
 	void serialize(OutputBlob& serializer);
 	void deserialize(InputBlob& serializer);
+	// arrays are stored as they are in memory, each in its own chunk, and loaded by copying them in bulk
+	void serialize(SnapshotWriter& snapshot);
+	bool deserialize(const SnapshotReader& snapshot);
+
+	// copy-on-write checkpoint; saving only marks the entity data as shared with the checkpoint, a chunk
+	// of it is copied right before its first change and restoring copies back only the copied chunks;
+	// scenes are serialized when the checkpoint is saved and must serialize the same when it is restored;
+	// restoring fails without any change if an entity from the checkpoint was destroyed or lost
+	// a component, if only the scenes differ it fails after destroying entities and components created since
+	void saveCheckpoint();
+	bool restoreCheckpoint();
+	void releaseCheckpoint();
+	bool hasCheckpoint() const { return m_checkpoint != nullptr; }
 
 	IScene* getScene(ComponentType type) const;
 	IScene* getScene(u32 hash) const;
@@ -134,6 +220,26 @@ public:
 private:
 	void transformEntity(Entity entity, bool update_local);
 	void updateGlobalTransform(Entity entity);
+	int pushEntitySlot();
+	void updateDirtyAncestors(Entity entity);
+	void propagateTransform(Entity root, Array<Entity>& moved);
+	void notifyMovedEntity(Entity entity);
+	void destroyEntitiesBatch(const EntityHandle* handles, int count);
+	void releaseEntitySlot(Entity entity);
+	void notifyMovedEntities(bool has_duplicates);
+	void addNameToIndex(int name_idx);
+	void removeNameFromIndex(int name_idx);
+	void eraseName(int name_idx);
+	Entity findChildByName(Entity parent, const char* name, int length) const;
+	void updateQueries(Entity entity, u64 old_mask, u64 new_mask);
+	void rebuildQuery(int query);
+	void beforeEntityChange(int index);
+	void beforeHierarchyChange(int index);
+	void beforeNamesChange();
+	void copyEntityChunk(int chunk);
+	void copyHierarchyChunk(int chunk);
+	bool isCheckpointRestorable();
+	bool haveScenesChanged();
 
 	struct Hierarchy
 	{
@@ -148,50 +254,84 @@ private:
 
 	struct EntityData
 	{
-		EntityData() {}
-
-		Vec3 position;
-		Quat rotation;
-		
 		int hierarchy;
 		int name;
-
-		union
-		{
-			struct 
-			{
-				float scale;
-				u64 components;
-			};
-			struct
-			{
-				int prev;
-				int next;
-			};
-		};
+		// free list links, valid only if the slot is not used
+		int prev;
+		int next;
 		bool valid;
+		// deferred transforms, descendants do not match the entity yet
+		bool transform_dirty;
+	};
+
+	struct Query
+	{
+		explicit Query(IAllocator& allocator) : entities(allocator), indices(allocator) {}
+
+		u64 mask;
+		int ref_count;
+		Array<Entity> entities;
+		// index in entities by Entity::index, -1 if the entity does not match
+		Array<int> indices;
+	};
+
+	struct TransformListener
+	{
+		u64 mask;
+		Delegate<void(Entity)> moved;
+		Delegate<void(const Entity*, int)> moved_batch;
 	};
 
 	struct EntityName
 	{
 		Entity entity;
 		char name[ENTITY_NAME_MAX_LENGTH];
+		u32 hash;
+		// next name with the same hash
+		int next;
 	};
 
+	struct Checkpoint;
+
 private:
 	IAllocator& m_allocator;
 	ComponentTypeEntry m_component_type_map[ComponentType::MAX_TYPES_COUNT];
 	Array<IScene*> m_scenes;
 	Array<EntityData> m_entities;
+	Array<Vec3> m_positions;
+	Array<Quat> m_rotations;
+	Array<float> m_scales;
+	Array<u64> m_component_masks;
+	Array<u32> m_generations;
 	Array<Hierarchy> m_hierarchy;
 	Array<EntityName> m_names;
+	// crc32 of a name -> first of the names with the same hash
+	HashMap<u32, int> m_name_index;
+	Array<Query> m_queries;
+	Array<Entity> m_dirty_entities;
+	Array<Entity> m_moved_entities;
+	Array<Entity> m_transform_roots;
+	Array<TransformListener> m_transform_listeners;
+	// moved entities matching a listener
+	Array<Entity> m_filtered_moved_entities;
+	Array<Array<Entity>> m_jobs_moved_entities;
+	Array<EntityHandle> m_destroy_queue;
+	Array<Entity> m_destroyed_entities;
+	// non-zero for entities destroyed in the current batch, indexed by Entity::index
+	Array<u8> m_destroy_marks;
+	bool m_deferred_transforms;
 	DelegateList<void(Entity)> m_entity_moved;
+	DelegateList<void(const Entity*, int)> m_entities_moved;
 	DelegateList<void(Entity)> m_entity_created;
+	DelegateList<void(const Entity*, int)> m_entities_created;
 	DelegateList<void(Entity)> m_entity_destroyed;
+	DelegateList<void(const Entity*, int)> m_entities_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
 	int m_first_free_slot;
 	StaticString<64> m_name;
+	// nullptr if there is no checkpoint
+	Checkpoint* m_checkpoint;
 };
 
 
@@ -2,6 +2,7 @@
 #include "engine/iallocator.h"
 #include "engine/string.h"
 #include <ShlObj.h>
+#include <psapi.h>
 
 
 namespace Lumix
@@ -64,4 +65,12 @@ namespace Lumix
 	{
 		return (void*)GetProcAddress((HMODULE)handle, name);
 	}
+
+
+	u64 getPeakProcessMemory()
+	{
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PeakWorkingSetSize;
+	}
 }
@@ -90,7 +90,9 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		, m_on_update(m_allocator)
 	{
 		setGeneratorParams(0.3f, 0.1f, 0.3f, 2.0f, 60.0f, 0.3f);
-		m_universe.entityTransformed().bind<NavigationSceneImpl, &NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.subscribeTransformed<NavigationSceneImpl,
+			&NavigationSceneImpl::onEntityMoved,
+			&NavigationSceneImpl::onEntitiesMoved>(this, &NAVMESH_AGENT_TYPE, 1);
 		universe.registerComponentType(NAVMESH_AGENT_TYPE
 			, this
 			, &NavigationSceneImpl::createAgent
@@ -102,7 +104,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 
 	~NavigationSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<NavigationSceneImpl, &NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.unsubscribeTransformed<NavigationSceneImpl, &NavigationSceneImpl::onEntityMoved>(this);
 		clearNavmesh();
 	}
 
@@ -113,6 +115,12 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	}
 
 
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		for (int i = 0; i < count; ++i) onEntityMoved(entities[i]);
+	}
+
+
 	void onEntityMoved(Entity entity)
 	{
 		auto iter = m_agents.find(entity);
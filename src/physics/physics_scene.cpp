@@ -340,6 +340,8 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 		, m_debug_visualization_flags(0)
 		, m_is_updating_ragdoll(false)
 		, m_update_in_progress(nullptr)
+		, m_simulation_moves(m_allocator)
+		, m_simulation_moves_stamp(1)
 	{
 		setMemory(m_layers_names, 0, sizeof(m_layers_names));
 		for (int i = 0; i < lengthOf(m_layers_names); ++i)
@@ -379,6 +381,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	~PhysicsSceneImpl()
 	{
+		m_universe.unsubscribeTransformed<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityMoved>(this);
 		m_controller_manager->release();
 		m_default_material->release();
 		m_dummy_actor->release();
@@ -1594,6 +1597,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 			m_update_in_progress = actor;
 			PxTransform trans = actor->physx_actor->getGlobalPose();
 			m_universe.setTransform(actor->entity, fromPhysx(trans));
+			markMovedBySimulation(actor->entity);
 		}
 		m_update_in_progress = nullptr;
 	}
@@ -2180,6 +2184,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 				RigidTransform rigid_tr = fromPhysx(bone_pose) * ragdoll.root_transform;
 				m_universe.setTransform(ragdoll.entity, {rigid_tr.pos, rigid_tr.rot, 1.0f});
+				markMovedBySimulation(ragdoll.entity);
 
 				m_is_updating_ragdoll = false;
 			}
@@ -2448,17 +2453,41 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 		return status;
 	}
 
-	void onEntityDestroyed(Entity entity)
+	void onEntitiesDestroyed(const Entity* entities, int count)
 	{
+		// one pass for the whole batch, destroyed bodies are not alive anymore
 		for (int i = 0, c = m_joints.size(); i < c; ++i)
 		{
-			if (m_joints.at(i).connected_body == entity)
+			Entity body = m_joints.at(i).connected_body;
+			if (body.isValid() && !m_universe.hasEntity(body))
 			{
 				setJointConnectedBody({m_joints.getKey(i).index}, INVALID_ENTITY);
 			}
 		}
 	}
 
+	// with deferred transforms the moves are reported after update, so the simulation's own write-backs are
+	// remembered and skipped; in the immediate mode m_update_in_progress and m_is_updating_ragdoll do that
+	void markMovedBySimulation(Entity entity)
+	{
+		if (!m_universe.areTransformsDeferred()) return;
+		if (m_simulation_moves.size() <= entity.index) m_simulation_moves.resize(m_universe.getEntitySlotsCount());
+		m_simulation_moves[entity.index] = m_simulation_moves_stamp;
+	}
+
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			Entity entity = entities[i];
+			bool is_simulated =
+				entity.index < m_simulation_moves.size() && m_simulation_moves[entity.index] == m_simulation_moves_stamp;
+			if (!is_simulated) onEntityMoved(entity);
+		}
+		++m_simulation_moves_stamp;
+	}
+
 	void onEntityMoved(Entity entity)
 	{
 		int ctrl_idx = m_controllers.find(entity);
@@ -5009,6 +5038,10 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	Array<RigidActor*> m_dynamic_actors;
 	RigidActor* m_update_in_progress;
+	// per entity slot, equal to m_simulation_moves_stamp if the simulation moved the entity
+	// since the last batched transform notification
+	Array<u32> m_simulation_moves;
+	u32 m_simulation_moves_stamp;
 	DelegateList<void(const ContactData&)> m_contact_callbacks;
 	bool m_is_game_running;
 	bool m_is_updating_ragdoll;
@@ -5023,8 +5056,16 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 PhysicsScene* PhysicsScene::create(PhysicsSystem& system, Universe& context, Engine& engine, IAllocator& allocator)
 {
 	PhysicsSceneImpl* impl = LUMIX_NEW(allocator, PhysicsSceneImpl)(context, allocator);
-	impl->m_universe.entityTransformed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityMoved>(impl);
-	impl->m_universe.entityDestroyed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityDestroyed>(impl);
+	const ComponentType moved_types[] = {CONTROLLER_TYPE,
+		RAGDOLL_TYPE,
+		RIGID_ACTOR_TYPE,
+		BOX_ACTOR_TYPE,
+		SPHERE_ACTOR_TYPE,
+		CAPSULE_ACTOR_TYPE,
+		MESH_ACTOR_TYPE};
+	impl->m_universe.subscribeTransformed<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityMoved, &PhysicsSceneImpl::onEntitiesMoved>(
+		impl, moved_types, lengthOf(moved_types));
+	impl->m_universe.entitiesDestroyed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntitiesDestroyed>(impl);
 	impl->m_engine = &engine;
 	PxSceneDesc sceneDesc(system.getPhysics()->getTolerancesScale());
 	sceneDesc.gravity = PxVec3(0.0f, -9.8f, 0.0f);
@@ -1,11 +1,13 @@
 #include "culling_system.h"
 #include "engine/array.h"
-#include "engine/free_list.h"
 #include "engine/geometry.h"
 #include "engine/job_system.h"
 #include "engine/lumix.h"
+#include "engine/math_utils.h"
 #include "engine/profiler.h"
 #include "engine/simd.h"
+#include <cfloat>
+#include <cmath>
 
 namespace Lumix
 {
@@ -13,95 +15,342 @@ typedef Array<u64> LayerMasks;
 typedef Array<int> ModelInstancetoSphereMap;
 typedef Array<Entity> SphereToModelInstanceMap;
 
-static void doCulling(int start_index,
-	const Sphere* LUMIX_RESTRICT start,
-	const Sphere* LUMIX_RESTRICT end,
-	const Frustum* LUMIX_RESTRICT frustum,
-	const u64* LUMIX_RESTRICT layer_masks,
-	const Entity* LUMIX_RESTRICT sphere_to_model_instance_map,
-	u64 layer_mask,
-	CullingSystem::Subresults& results)
+// spheres are stored as separate streams so the kernel can load several of them at once
+struct CullingSpheres
+{
+	explicit CullingSpheres(IAllocator& allocator)
+		: xs(allocator)
+		, ys(allocator)
+		, zs(allocator)
+		, radiuses(allocator)
+	{
+	}
+
+
+	int size() const { return xs.size(); }
+
+
+	Sphere get(int index) const
+	{
+		return Sphere(xs[index], ys[index], zs[index], radiuses[index]);
+	}
+
+
+	void set(int index, const Sphere& sphere)
+	{
+		xs[index] = sphere.position.x;
+		ys[index] = sphere.position.y;
+		zs[index] = sphere.position.z;
+		radiuses[index] = sphere.radius;
+	}
+
+
+	void push(const Sphere& sphere)
+	{
+		xs.push(sphere.position.x);
+		ys.push(sphere.position.y);
+		zs.push(sphere.position.z);
+		radiuses.push(sphere.radius);
+	}
+
+
+	void pop()
+	{
+		xs.pop();
+		ys.pop();
+		zs.pop();
+		radiuses.pop();
+	}
+
+
+	void reserve(int capacity)
+	{
+		xs.reserve(capacity);
+		ys.reserve(capacity);
+		zs.reserve(capacity);
+		radiuses.reserve(capacity);
+	}
+
+
+	void clear()
+	{
+		xs.clear();
+		ys.clear();
+		zs.clear();
+		radiuses.clear();
+	}
+
+
+	void swap(CullingSpheres& rhs)
+	{
+		xs.swap(rhs.xs);
+		ys.swap(rhs.ys);
+		zs.swap(rhs.zs);
+		radiuses.swap(rhs.radiuses);
+	}
+
+
+	Array<float> xs;
+	Array<float> ys;
+	Array<float> zs;
+	Array<float> radiuses;
+};
+
+
+struct CullingPlanes
 {
-	PROFILE_FUNCTION();
-	int i = start_index;
-	ASSERT(results.empty());
-	PROFILE_INT("objects", int(end - start));
-	float4 px = f4Load(frustum->xs);
-	float4 py = f4Load(frustum->ys);
-	float4 pz = f4Load(frustum->zs);
-	float4 pd = f4Load(frustum->ds);
-	float4 px2 = f4Load(&frustum->xs[4]);
-	float4 py2 = f4Load(&frustum->ys[4]);
-	float4 pz2 = f4Load(&frustum->zs[4]);
-	float4 pd2 = f4Load(&frustum->ds[4]);
-	
-	for (const Sphere *sphere = start; sphere <= end; sphere++, ++i)
-	{
-		float4 cx = f4Splat(sphere->position.x);
-		float4 cy = f4Splat(sphere->position.y);
-		float4 cz = f4Splat(sphere->position.z);
-		float4 r = f4Splat(-sphere->radius);
-
-		float4 t = f4Mul(cx, px);
-		t = f4Add(t, f4Mul(cy, py));
-		t = f4Add(t, f4Mul(cz, pz));
-		t = f4Add(t, pd);
-		t = f4Sub(t, r);
-		if (f4MoveMask(t)) continue;
-
-		t = f4Mul(cx, px2);
-		t = f4Add(t, f4Mul(cy, py2));
-		t = f4Add(t, f4Mul(cz, pz2));
-		t = f4Add(t, pd2);
-		t = f4Sub(t, r);
-		if (f4MoveMask(t)) continue;
-
-		if(layer_masks[i] & layer_mask) results.push(sphere_to_model_instance_map[i]);
+	void set(const Frustum& frustum)
+	{
+		for (int i = 0; i < PLANES_COUNT; ++i)
+		{
+			xs[i] = f4Splat(frustum.xs[i]);
+			ys[i] = f4Splat(frustum.ys[i]);
+			zs[i] = f4Splat(frustum.zs[i]);
+			ds[i] = f4Splat(frustum.ds[i]);
+		}
 	}
+
+
+	static const int PLANES_COUNT = (int)Frustum::Planes::COUNT;
+	float4 xs[PLANES_COUNT];
+	float4 ys[PLANES_COUNT];
+	float4 zs[PLANES_COUNT];
+	float4 ds[PLANES_COUNT];
+};
+
+
+// returns a sign per sphere, negative if the sphere is outside of any plane
+static LUMIX_FORCE_INLINE float4 testSpheres(const CullingPlanes& planes, float4 x, float4 y, float4 z, float4 r)
+{
+	float4 min = f4Add(f4Add(f4Mul(x, planes.xs[0]), f4Mul(y, planes.ys[0])), f4Add(f4Mul(z, planes.zs[0]), planes.ds[0]));
+	min = f4Add(min, r);
+	for (int i = 1; i < CullingPlanes::PLANES_COUNT; ++i)
+	{
+		float4 t = f4Add(f4Add(f4Mul(x, planes.xs[i]), f4Mul(y, planes.ys[i])), f4Add(f4Mul(z, planes.zs[i]), planes.ds[i]));
+		min = f4Min(min, f4Add(t, r));
+	}
+	return min;
 }
 
+
+// spheres of a subtree are stored contiguously, [first, first + count)
+struct CullingNode
+{
+	Vec3 min;
+	Vec3 max;
+	int first;
+	int count;
+	int right; // index of the second child, the first one follows its parent, -1 in leaves
+};
+
+
+// bit per view, inside is a subset of views
+struct CullingItem
+{
+	int node;
+	u32 views;
+	u32 inside;
+};
+
+
+// static spheres visible from the frustum grown by threshold, dynamic ones are appended to the last subresults
+struct CullingView
+{
+	explicit CullingView(IAllocator& allocator)
+		: results(allocator)
+		, static_counts(allocator)
+	{
+	}
+
+
+	CullingSystem::Results results;
+	Array<int> static_counts;
+	Frustum frustum;
+	u64 layer_mask;
+	u32 static_version;
+	float threshold;
+	bool is_valid;
+};
+
+
 struct CullingJobData
 {
-	const CullingSystem::InputSpheres* spheres;
-	CullingSystem::Subresults* results;
+	const CullingSpheres* spheres;
+	CullingSystem::Results* results; // one per view, each job writes to its own subresults
 	const LayerMasks* layer_masks;
 	const SphereToModelInstanceMap* sphere_to_model_instance_map;
-	u64 layer_mask;
+	const Frustum* frusta;
+	const u64* view_layer_masks;
+	int views_count;
+	int job_index;
 	int start;
 	int end;
-	const Frustum* frustum;
+	const CullingNode* nodes;
+	const CullingItem* items;
+	int first_item;
+	int items_count;
+	int items_step;
 };
 
+
+// loads 8 spheres per iteration and tests them against every view in views,
+// survivors are compacted from the visibility masks
+static void doCulling(int start, int end, u32 views, const CullingJobData& data, const CullingPlanes* planes)
+{
+	const float* LUMIX_RESTRICT xs = &data.spheres->xs[0];
+	const float* LUMIX_RESTRICT ys = &data.spheres->ys[0];
+	const float* LUMIX_RESTRICT zs = &data.spheres->zs[0];
+	const float* LUMIX_RESTRICT radiuses = &data.spheres->radiuses[0];
+	const u64* LUMIX_RESTRICT layer_masks = &(*data.layer_masks)[0];
+	const Entity* LUMIX_RESTRICT sphere_to_model_instance_map = &(*data.sphere_to_model_instance_map)[0];
+
+	int i = start;
+	for (; i + 8 <= end; i += 8)
+	{
+		float4 x0 = f4LoadUnaligned(&xs[i]);
+		float4 y0 = f4LoadUnaligned(&ys[i]);
+		float4 z0 = f4LoadUnaligned(&zs[i]);
+		float4 r0 = f4LoadUnaligned(&radiuses[i]);
+		float4 x1 = f4LoadUnaligned(&xs[i + 4]);
+		float4 y1 = f4LoadUnaligned(&ys[i + 4]);
+		float4 z1 = f4LoadUnaligned(&zs[i + 4]);
+		float4 r1 = f4LoadUnaligned(&radiuses[i + 4]);
+		for (int view = 0; (views >> view) != 0; ++view)
+		{
+			if (!(views & (1 << view))) continue;
+
+			float4 t0 = testSpheres(planes[view], x0, y0, z0, r0);
+			float4 t1 = testSpheres(planes[view], x1, y1, z1, r1);
+			int visible = ~(f4MoveMask(t0) | (f4MoveMask(t1) << 4)) & 0xff;
+			if (!visible) continue;
+
+			u64 layer_mask = data.view_layer_masks[view];
+			CullingSystem::Subresults& results = data.results[view][data.job_index];
+			for (int j = 0; j < 8; ++j)
+			{
+				if ((visible & (1 << j)) && (layer_masks[i + j] & layer_mask))
+				{
+					results.push(sphere_to_model_instance_map[i + j]);
+				}
+			}
+		}
+	}
+
+	for (; i < end; ++i)
+	{
+		for (int view = 0; (views >> view) != 0; ++view)
+		{
+			if (!(views & (1 << view))) continue;
+			if (!(layer_masks[i] & data.view_layer_masks[view])) continue;
+			if (data.frusta[view].isSphereInside({xs[i], ys[i], zs[i]}, radiuses[i]))
+			{
+				data.results[view][data.job_index].push(sphere_to_model_instance_map[i]);
+			}
+		}
+	}
+}
+
+
+enum class CullingTestResult
+{
+	OUTSIDE,
+	INSIDE,
+	INTERSECT
+};
+
+
+static CullingTestResult testNode(const CullingNode& node, const Frustum& frustum)
+{
+	Vec3 center = (node.min + node.max) * 0.5f;
+	Vec3 extents = (node.max - node.min) * 0.5f;
+	CullingTestResult result = CullingTestResult::INSIDE;
+	for (int i = 0; i < (int)Frustum::Planes::COUNT; ++i)
+	{
+		float dist = frustum.xs[i] * center.x + frustum.ys[i] * center.y + frustum.zs[i] * center.z + frustum.ds[i];
+		float radius = fabsf(frustum.xs[i]) * extents.x + fabsf(frustum.ys[i]) * extents.y + fabsf(frustum.zs[i]) * extents.z;
+		if (dist + radius < 0) return CullingTestResult::OUTSIDE;
+		if (dist - radius < 0) result = CullingTestResult::INTERSECT;
+	}
+	return result;
+}
+
+
+static void acceptRange(int start,
+	int end,
+	const u64* LUMIX_RESTRICT layer_masks,
+	const Entity* LUMIX_RESTRICT sphere_to_model_instance_map,
+	u64 layer_mask,
+	CullingSystem::Subresults& results)
+{
+	for (int i = start; i < end; ++i)
+	{
+		if (layer_masks[i] & layer_mask) results.push(sphere_to_model_instance_map[i]);
+	}
+}
+
+
 class CullingSystemImpl LUMIX_FINAL : public CullingSystem
 {
 public:
+	static const int LEAF_SIZE = 64;
+	// deeper nodes are split in half to keep the traversal stack bounded
+	static const int MAX_SPATIAL_SPLIT_DEPTH = 40;
+	static const int MAX_TREE_DEPTH = 128;
+	static const int MIN_REBUILD_COUNT = 1024;
+
+
 	explicit CullingSystemImpl(IAllocator& allocator)
 		: m_allocator(allocator)
-		, m_job_allocator(allocator)
 		, m_spheres(allocator)
-		, m_result(allocator)
+		, m_results(allocator)
 		, m_layer_masks(m_allocator)
 		, m_sphere_to_model_instance_map(m_allocator)
 		, m_model_instance_to_sphere_map(m_allocator)
+		, m_dynamic(m_allocator)
+		, m_nodes(m_allocator)
+		, m_items(m_allocator)
+		, m_tmp_items(m_allocator)
+		, m_job_data(m_allocator)
+		, m_jobs(m_allocator)
+		, m_views(m_allocator)
+		, m_tree_count(0)
+		, m_holes_count(0)
+		, m_pending_count(0)
+		, m_version(0)
+		, m_static_version(0)
 	{
-		m_result.emplace(m_allocator);
 		m_model_instance_to_sphere_map.reserve(5000);
 		m_sphere_to_model_instance_map.reserve(5000);
 		m_spheres.reserve(5000);
-		int cpu_count = (int)MT::getCPUsCount();
-		while (m_result.size() < cpu_count)
+		int cpu_count = Math::maximum((int)MT::getCPUsCount(), 1);
+		m_job_data.resize(cpu_count);
+		m_jobs.resize(cpu_count);
+		addResults();
+	}
+
+
+	~CullingSystemImpl()
+	{
+		for (CullingView* view : m_views)
 		{
-			m_result.emplace(m_allocator);
+			if (view) LUMIX_DELETE(m_allocator, view);
 		}
 	}
 
 
 	void clear() override
 	{
+		++m_version;
+		++m_static_version;
 		m_spheres.clear();
 		m_layer_masks.clear();
 		m_model_instance_to_sphere_map.clear();
 		m_sphere_to_model_instance_map.clear();
+		m_dynamic.clear();
+		m_nodes.clear();
+		m_tree_count = 0;
+		m_holes_count = 0;
+		m_pending_count = 0;
 	}
 
 
@@ -110,58 +359,525 @@ public:
 
 	const Results& getResult() override
 	{
-		return m_result;
+		return m_results[0];
+	}
+
+
+	void addResults()
+	{
+		Results& results = m_results.emplace(m_allocator);
+		while (results.size() < m_jobs.size())
+		{
+			results.emplace(m_allocator);
+		}
+	}
+
+
+	// the node is tested only against views its parent intersects
+	static void pushItem(const CullingNode* nodes,
+		int node,
+		const Frustum* frusta,
+		u32 views,
+		u32 inside,
+		CullingItem* items,
+		int& count)
+	{
+		u32 node_views = inside;
+		u32 node_inside = inside;
+		u32 intersecting = views & ~inside;
+		for (int view = 0; (intersecting >> view) != 0; ++view)
+		{
+			if (!(intersecting & (1 << view))) continue;
+			CullingTestResult result = testNode(nodes[node], frusta[view]);
+			if (result == CullingTestResult::OUTSIDE) continue;
+			node_views |= 1 << view;
+			if (result == CullingTestResult::INSIDE) node_inside |= 1 << view;
+		}
+		if (!node_views) return;
+		items[count] = {node, node_views, node_inside};
+		++count;
+	}
+
+
+	static void cullSubtree(const CullingJobData& data, const CullingPlanes* planes, const CullingItem& root)
+	{
+		const u64* layer_masks = &(*data.layer_masks)[0];
+		const Entity* sphere_to_model_instance_map = &(*data.sphere_to_model_instance_map)[0];
+		CullingItem stack[MAX_TREE_DEPTH * 2];
+		int stack_size = 1;
+		stack[0] = root;
+		while (stack_size > 0)
+		{
+			--stack_size;
+			const CullingItem item = stack[stack_size];
+			const CullingNode& node = data.nodes[item.node];
+			for (int view = 0; (item.inside >> view) != 0; ++view)
+			{
+				if (!(item.inside & (1 << view))) continue;
+				acceptRange(node.first,
+					node.first + node.count,
+					layer_masks,
+					sphere_to_model_instance_map,
+					data.view_layer_masks[view],
+					data.results[view][data.job_index]);
+			}
+
+			u32 intersecting = item.views & ~item.inside;
+			if (!intersecting) continue;
+
+			if (node.right < 0)
+			{
+				doCulling(node.first, node.first + node.count, intersecting, data, planes);
+			}
+			else
+			{
+				// views this node is inside of are already accepted, children only refine the rest
+				ASSERT(stack_size + 2 <= lengthOf(stack));
+				pushItem(data.nodes, node.right, data.frusta, intersecting, 0, stack, stack_size);
+				pushItem(data.nodes, item.node + 1, data.frusta, intersecting, 0, stack, stack_size);
+			}
+		}
 	}
 
 
 	static void cullTask(void* data)
 	{
+		PROFILE_FUNCTION();
 		CullingJobData* cull_data = (CullingJobData*)data;
-		if (cull_data->end < cull_data->start) return;
-		doCulling(cull_data->start
-			, &(*cull_data->spheres)[cull_data->start]
-			, &(*cull_data->spheres)[cull_data->end]
-			, cull_data->frustum
-			, &(*cull_data->layer_masks)[0]
-			, &(*cull_data->sphere_to_model_instance_map)[0]
-			, cull_data->layer_mask
-			, *cull_data->results);
+		CullingPlanes planes[MAX_VIEWS];
+		for (int i = 0; i < cull_data->views_count; ++i)
+		{
+			planes[i].set(cull_data->frusta[i]);
+		}
+		if (cull_data->end > cull_data->start)
+		{
+			PROFILE_INT("objects", cull_data->end - cull_data->start);
+			u32 all_views = (1 << cull_data->views_count) - 1;
+			doCulling(cull_data->start, cull_data->end, all_views, *cull_data, planes);
+		}
+		for (int i = cull_data->first_item; i < cull_data->items_count; i += cull_data->items_step)
+		{
+			cullSubtree(*cull_data, planes, cull_data->items[i]);
+		}
 	}
 
 
-	Results& cull(const Frustum& frustum, u64 layer_mask) override
+	void buildNode(int* indices, int first, int count, int depth)
+	{
+		ASSERT(depth < MAX_TREE_DEPTH);
+		int node_index = m_nodes.size();
+		CullingNode& node = m_nodes.emplace();
+		Vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		Vec3 centers_min = min;
+		Vec3 centers_max = max;
+		for (int i = first, end = first + count; i < end; ++i)
+		{
+			Sphere sphere = m_spheres.get(indices[i]);
+			for (int j = 0; j < 3; ++j)
+			{
+				float center = sphere.position[j];
+				min[j] = Math::minimum(min[j], center - sphere.radius);
+				max[j] = Math::maximum(max[j], center + sphere.radius);
+				centers_min[j] = Math::minimum(centers_min[j], center);
+				centers_max[j] = Math::maximum(centers_max[j], center);
+			}
+		}
+		node.min = min;
+		node.max = max;
+		node.first = first;
+		node.count = count;
+		node.right = -1;
+		if (count <= LEAF_SIZE) return;
+
+		int split = first;
+		if (depth < MAX_SPATIAL_SPLIT_DEPTH)
+		{
+			Vec3 size = centers_max - centers_min;
+			int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+			float middle = (centers_min[axis] + centers_max[axis]) * 0.5f;
+			for (int i = first, end = first + count; i < end; ++i)
+			{
+				if (m_spheres.get(indices[i]).position[axis] >= middle) continue;
+				int tmp = indices[i];
+				indices[i] = indices[split];
+				indices[split] = tmp;
+				++split;
+			}
+		}
+		if (split == first || split == first + count) split = first + count / 2;
+
+		buildNode(indices, first, split - first, depth + 1);
+		m_nodes[node_index].right = m_nodes.size();
+		buildNode(indices, split, first + count - split, depth + 1);
+	}
+
+
+	// puts all static spheres in the tree and reorders the arrays so subtrees are contiguous
+	void rebuild()
 	{
-		int count = m_spheres.size();
-		for(auto& i : m_result) i.clear();
+		PROFILE_FUNCTION();
+		Array<int> indices(m_allocator);
+		indices.reserve(m_spheres.size() - m_holes_count);
+		for (int i = 0, c = m_spheres.size(); i < c; ++i)
+		{
+			if (m_sphere_to_model_instance_map[i].isValid() && !m_dynamic[i]) indices.push(i);
+		}
+		int tree_count = indices.size();
+		m_nodes.clear();
+		if (tree_count > 0) buildNode(&indices[0], 0, tree_count, 0);
+		for (int i = m_tree_count, c = m_spheres.size(); i < c; ++i)
+		{
+			if (m_dynamic[i]) indices.push(i);
+		}
 
-		int step = count / m_result.size();
-		ASSERT(lengthOf(jobs) >= m_result.size());
-		for (int i = 0; i < m_result.size(); i++)
+		CullingSpheres spheres(m_allocator);
+		LayerMasks layer_masks(m_allocator);
+		SphereToModelInstanceMap sphere_to_model_instance_map(m_allocator);
+		Array<bool> dynamic(m_allocator);
+		spheres.reserve(indices.size());
+		layer_masks.reserve(indices.size());
+		sphere_to_model_instance_map.reserve(indices.size());
+		dynamic.reserve(indices.size());
+		for (int index : indices)
 		{
-			m_result[i].clear();
-			job_data[i] = {
+			Entity model_instance = m_sphere_to_model_instance_map[index];
+			m_model_instance_to_sphere_map[model_instance.index] = spheres.size();
+			spheres.push(m_spheres.get(index));
+			layer_masks.push(m_layer_masks[index]);
+			sphere_to_model_instance_map.push(model_instance);
+			dynamic.push(m_dynamic[index]);
+		}
+		m_spheres.swap(spheres);
+		m_layer_masks.swap(layer_masks);
+		m_sphere_to_model_instance_map.swap(sphere_to_model_instance_map);
+		m_dynamic.swap(dynamic);
+		m_tree_count = tree_count;
+		m_holes_count = 0;
+		m_pending_count = 0;
+	}
+
+
+	// splits the top of the tree until there are enough subtrees to keep all jobs busy
+	void gatherItems(const Frustum* frusta, int views_count)
+	{
+		m_items.clear();
+		if (m_tree_count == 0) return;
+
+		int min_items_count = m_jobs.size() * 4;
+		m_items.resize(1);
+		int count = 0;
+		pushItem(&m_nodes[0], 0, frusta, (1 << views_count) - 1, 0, &m_items[0], count);
+		m_items.resize(count);
+		while (!m_items.empty() && m_items.size() < min_items_count)
+		{
+			m_tmp_items.resize(m_items.size() * 2);
+			count = 0;
+			bool split = false;
+			for (const CullingItem& item : m_items)
+			{
+				const CullingNode& node = m_nodes[item.node];
+				if (item.inside == item.views || node.right < 0)
+				{
+					m_tmp_items[count] = item;
+					++count;
+					continue;
+				}
+				pushItem(&m_nodes[0], item.node + 1, frusta, item.views, item.inside, &m_tmp_items[0], count);
+				pushItem(&m_nodes[0], node.right, frusta, item.views, item.inside, &m_tmp_items[0], count);
+				split = true;
+			}
+			m_tmp_items.resize(count);
+			m_items.swap(m_tmp_items);
+			if (!split) break;
+		}
+	}
+
+
+	void updateTree() override
+	{
+		if (m_pending_count + m_holes_count >= Math::maximum(MIN_REBUILD_COUNT, m_tree_count / 4)) rebuild();
+	}
+
+
+	const Results* cull(const Frustum* frusta, const u64* layer_masks, int count) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(count > 0 && count <= MAX_VIEWS);
+		updateTree();
+		gatherItems(frusta, count);
+
+		while (m_results.size() < count) addResults();
+		for (int i = 0; i < count; ++i)
+		{
+			for (auto& subresults : m_results[i]) subresults.clear();
+		}
+
+		int jobs_count = m_jobs.size();
+		int loose_count = m_spheres.size() - m_tree_count;
+		int step = loose_count / jobs_count;
+		for (int i = 0; i < jobs_count; i++)
+		{
+			m_job_data[i] = {
 				&m_spheres,
-				&m_result[i],
+				&m_results[0],
 				&m_layer_masks,
 				&m_sphere_to_model_instance_map,
-				layer_mask,
-				i * step,
-				i == m_result.size() - 1 ? count - 1 : (i + 1) * step - 1,
-				&frustum
+				frusta,
+				layer_masks,
+				count,
+				i,
+				m_tree_count + i * step,
+				m_tree_count + (i == jobs_count - 1 ? loose_count : (i + 1) * step),
+				m_nodes.empty() ? nullptr : &m_nodes[0],
+				m_items.empty() ? nullptr : &m_items[0],
+				i,
+				m_items.size(),
+				jobs_count
 			};
-			jobs[i].data = &job_data[i];
-			jobs[i].task = &cullTask;
+			m_jobs[i].data = &m_job_data[i];
+			m_jobs[i].task = &cullTask;
 		}
 		volatile int job_counter = 0;
-		JobSystem::runJobs(jobs, m_result.size(), &job_counter);
+		JobSystem::runJobs(&m_jobs[0], jobs_count, &job_counter);
 		JobSystem::wait(&job_counter);
-		return m_result;
+		return &m_results[0];
+	}
+
+
+	Results& cull(const Frustum& frustum, u64 layer_mask) override
+	{
+		cull(&frustum, &layer_mask, 1);
+		return m_results[0];
+	}
+
+
+	int createView(float threshold) override
+	{
+		CullingView* view = LUMIX_NEW(m_allocator, CullingView)(m_allocator);
+		view->threshold = threshold;
+		view->is_valid = false;
+		for (int i = 0; i < m_views.size(); ++i)
+		{
+			if (!m_views[i])
+			{
+				m_views[i] = view;
+				return i;
+			}
+		}
+		m_views.push(view);
+		return m_views.size() - 1;
+	}
+
+
+	void destroyView(int view) override
+	{
+		LUMIX_DELETE(m_allocator, m_views[view]);
+		m_views[view] = nullptr;
+	}
+
+
+	// every corner of the frustum is within threshold of where it was when the view was culled
+	static bool isViewValid(const CullingView& view, const Frustum& frustum)
+	{
+		float threshold_squared = view.threshold * view.threshold;
+		for (int i = 0; i < lengthOf(frustum.points); ++i)
+		{
+			if ((frustum.points[i] - view.frustum.points[i]).squaredLength() > threshold_squared) return false;
+		}
+		return true;
+	}
+
+
+	// walks the tree with the grown frustum and keeps only static spheres, dynamic ones are tested every call
+	void cullViewStatic(CullingView& view, const Frustum& frustum, u64 layer_mask)
+	{
+		PROFILE_FUNCTION();
+		Frustum grown = frustum;
+		for (float& d : grown.ds) d += view.threshold;
+		cull(&grown, &layer_mask, 1);
+
+		Results& results = m_results[0];
+		while (view.results.size() < results.size()) view.results.emplace(m_allocator);
+		view.static_counts.resize(results.size());
+		for (int i = 0; i < results.size(); ++i)
+		{
+			Subresults& subresults = view.results[i];
+			subresults.swap(results[i]);
+			int count = 0;
+			for (Entity entity : subresults)
+			{
+				if (m_dynamic[m_model_instance_to_sphere_map[entity.index]]) continue;
+				subresults[count] = entity;
+				++count;
+			}
+			subresults.resize(count);
+			view.static_counts[i] = count;
+		}
+
+		view.frustum = frustum;
+		view.layer_mask = layer_mask;
+		view.static_version = m_static_version;
+		view.is_valid = true;
+	}
+
+
+	const Results& cull(int view_index, const Frustum& frustum, u64 layer_mask) override
+	{
+		PROFILE_FUNCTION();
+		CullingView& view = *m_views[view_index];
+		if (!view.is_valid || view.static_version != m_static_version || view.layer_mask != layer_mask ||
+			!isViewValid(view, frustum))
+		{
+			cullViewStatic(view, frustum, layer_mask);
+		}
+		else
+		{
+			for (int i = 0; i < view.results.size(); ++i) view.results[i].resize(view.static_counts[i]);
+		}
+
+		Subresults& dynamic_results = view.results.back();
+		for (int i = m_tree_count, c = m_spheres.size(); i < c; ++i)
+		{
+			if (!m_dynamic[i] || !(m_layer_masks[i] & layer_mask)) continue;
+			if (frustum.isSphereInside({m_spheres.xs[i], m_spheres.ys[i], m_spheres.zs[i]}, m_spheres.radiuses[i]))
+			{
+				dynamic_results.push(m_sphere_to_model_instance_map[i]);
+			}
+		}
+		return view.results;
+	}
+
+
+	template <typename T>
+	void queryRange(int start, int end, u64 layer_mask, const T& overlaps, Array<Entity>& entities) const
+	{
+		for (int i = start; i < end; ++i)
+		{
+			if ((m_layer_masks[i] & layer_mask) && overlaps(m_spheres.get(i)))
+			{
+				entities.push(m_sphere_to_model_instance_map[i]);
+			}
+		}
+	}
+
+
+	// nodes are rejected by bounds, spheres by overlaps
+	template <typename T>
+	void query(const AABB& bounds, u64 layer_mask, const T& overlaps, Array<Entity>& entities)
+	{
+		PROFILE_FUNCTION();
+		updateTree();
+		if (m_tree_count > 0)
+		{
+			int stack[MAX_TREE_DEPTH * 2];
+			int stack_size = 1;
+			stack[0] = 0;
+			while (stack_size > 0)
+			{
+				--stack_size;
+				int node_index = stack[stack_size];
+				const CullingNode& node = m_nodes[node_index];
+				if (!bounds.overlaps(AABB(node.min, node.max))) continue;
+
+				if (node.right < 0)
+				{
+					queryRange(node.first, node.first + node.count, layer_mask, overlaps, entities);
+				}
+				else
+				{
+					ASSERT(stack_size + 2 <= lengthOf(stack));
+					stack[stack_size] = node.right;
+					stack[stack_size + 1] = node_index + 1;
+					stack_size += 2;
+				}
+			}
+		}
+		queryRange(m_tree_count, m_spheres.size(), layer_mask, overlaps, entities);
+	}
+
+
+	void cull(const Sphere& sphere, u64 layer_mask, Array<Entity>& entities) override
+	{
+		Vec3 extents(sphere.radius, sphere.radius, sphere.radius);
+		AABB bounds(sphere.position - extents, sphere.position + extents);
+		query(bounds, layer_mask, [&sphere](const Sphere& tested) {
+			float radius = sphere.radius + tested.radius;
+			return (tested.position - sphere.position).squaredLength() <= radius * radius;
+		}, entities);
+	}
+
+
+	void cull(const AABB& aabb, u64 layer_mask, Array<Entity>& entities) override
+	{
+		query(aabb, layer_mask, [&aabb](const Sphere& tested) {
+			return getSquaredDistance(aabb.min, aabb.max, tested.position) <= tested.radius * tested.radius;
+		}, entities);
+	}
+
+
+	static float getSquaredDistance(const Vec3& min, const Vec3& max, const Vec3& point)
+	{
+		Vec3 closest = AABB::maxCoords(min, AABB::minCoords(max, point));
+		return (closest - point).squaredLength();
+	}
+
+
+	Entity getNearest(const Vec3& position, u64 layer_mask) override
+	{
+		PROFILE_FUNCTION();
+		updateTree();
+		Entity nearest = INVALID_ENTITY;
+		float nearest_dist_squared = FLT_MAX;
+		auto testRange = [&](int start, int end) {
+			for (int i = start; i < end; ++i)
+			{
+				if (!(m_layer_masks[i] & layer_mask)) continue;
+				Sphere sphere = m_spheres.get(i);
+				float dist_squared = (sphere.position - position).squaredLength();
+				if (dist_squared < nearest_dist_squared)
+				{
+					nearest_dist_squared = dist_squared;
+					nearest = m_sphere_to_model_instance_map[i];
+				}
+			}
+		};
+		testRange(m_tree_count, m_spheres.size());
+		if (m_tree_count == 0) return nearest;
+
+		// centers are inside of node bounds, so the distance to the bounds is a lower bound
+		int stack[MAX_TREE_DEPTH * 2];
+		int stack_size = 1;
+		stack[0] = 0;
+		while (stack_size > 0)
+		{
+			--stack_size;
+			int node_index = stack[stack_size];
+			const CullingNode& node = m_nodes[node_index];
+			if (getSquaredDistance(node.min, node.max, position) >= nearest_dist_squared) continue;
+
+			if (node.right < 0)
+			{
+				testRange(node.first, node.first + node.count);
+			}
+			else
+			{
+				ASSERT(stack_size + 2 <= lengthOf(stack));
+				stack[stack_size] = node.right;
+				stack[stack_size + 1] = node_index + 1;
+				stack_size += 2;
+			}
+		}
+		return nearest;
 	}
 
 
 	void setLayerMask(Entity model_instance, u64 layer) override
 	{
-		m_layer_masks[m_model_instance_to_sphere_map[model_instance.index]] = layer;
+		++m_version;
+		int index = m_model_instance_to_sphere_map[model_instance.index];
+		if (!m_dynamic[index]) ++m_static_version;
+		m_layer_masks[index] = layer;
 	}
 
 
@@ -177,15 +893,8 @@ public:
 	}
 
 
-	void addStatic(Entity model_instance, const Sphere& sphere, u64 layer_mask) override
+	void push(Entity model_instance, const Sphere& sphere, u64 layer_mask, bool dynamic)
 	{
-		if (model_instance.index < m_model_instance_to_sphere_map.size() &&
-			m_model_instance_to_sphere_map[model_instance.index] != -1)
-		{
-			ASSERT(false);
-			return;
-		}
-
 		m_spheres.push(sphere);
 		m_sphere_to_model_instance_map.push(model_instance);
 		while(model_instance.index >= m_model_instance_to_sphere_map.size())
@@ -194,6 +903,35 @@ public:
 		}
 		m_model_instance_to_sphere_map[model_instance.index] = m_spheres.size() - 1;
 		m_layer_masks.push(layer_mask);
+		m_dynamic.push(dynamic);
+		if (!dynamic)
+		{
+			++m_pending_count;
+			++m_static_version;
+		}
+		++m_version;
+	}
+
+
+	// tree is not modified until the next rebuild, removed spheres are only masked out
+	void makeHole(int index)
+	{
+		m_layer_masks[index] = 0;
+		m_sphere_to_model_instance_map[index] = INVALID_ENTITY;
+		++m_holes_count;
+	}
+
+
+	void addStatic(Entity model_instance, const Sphere& sphere, u64 layer_mask) override
+	{
+		if (model_instance.index < m_model_instance_to_sphere_map.size() &&
+			m_model_instance_to_sphere_map[model_instance.index] != -1)
+		{
+			ASSERT(false);
+			return;
+		}
+
+		push(model_instance, sphere, layer_mask, false);
 	}
 
 
@@ -204,22 +942,52 @@ public:
 		if (index < 0) return;
 		ASSERT(index < m_spheres.size());
 
-		m_model_instance_to_sphere_map[m_sphere_to_model_instance_map.back().index] = index;
-		m_spheres[index] = m_spheres.back();
-		m_sphere_to_model_instance_map[index] = m_sphere_to_model_instance_map.back();
-		m_layer_masks[index] = m_layer_masks.back();
+		++m_version;
+		if (!m_dynamic[index]) ++m_static_version;
+		m_model_instance_to_sphere_map[model_instance.index] = -1;
+		if (index < m_tree_count)
+		{
+			makeHole(index);
+			return;
+		}
+
+		if (!m_dynamic[index]) --m_pending_count;
+		int last = m_spheres.size() - 1;
+		if (index != last) m_model_instance_to_sphere_map[m_sphere_to_model_instance_map[last].index] = index;
+		m_spheres.set(index, m_spheres.get(last));
+		m_sphere_to_model_instance_map[index] = m_sphere_to_model_instance_map[last];
+		m_layer_masks[index] = m_layer_masks[last];
+		m_dynamic[index] = m_dynamic[last];
 
 		m_spheres.pop();
 		m_sphere_to_model_instance_map.pop();
 		m_layer_masks.pop();
-		m_model_instance_to_sphere_map[model_instance.index] = -1;
+		m_dynamic.pop();
 	}
 
 
 	void updateBoundingSphere(const Sphere& sphere, Entity model_instance) override
 	{
 		int idx = m_model_instance_to_sphere_map[model_instance.index];
-		if (idx >= 0) m_spheres[idx] = sphere;
+		if (idx < 0) return;
+
+		++m_version;
+		if (!m_dynamic[idx]) ++m_static_version;
+		if (idx < m_tree_count)
+		{
+			// moving objects leave the tree, they are culled one by one
+			u64 layer_mask = m_layer_masks[idx];
+			makeHole(idx);
+			push(model_instance, sphere, layer_mask, true);
+			return;
+		}
+
+		if (!m_dynamic[idx])
+		{
+			m_dynamic[idx] = true;
+			--m_pending_count;
+		}
+		m_spheres.set(idx, sphere);
 	}
 
 
@@ -227,34 +995,41 @@ public:
 	{
 		for (int i = 0; i < spheres.size(); i++)
 		{
-			m_spheres.push(spheres[i]);
-			while(m_model_instance_to_sphere_map.size() <= model_instances[i].index)
-			{
-				m_model_instance_to_sphere_map.push(-1);
-			}
-			m_model_instance_to_sphere_map[model_instances[i].index] = m_spheres.size() - 1;
-			m_sphere_to_model_instance_map.push(model_instances[i]);
-			m_layer_masks.push(1);
+			push(model_instances[i], spheres[i], 1, false);
 		}
 	}
 
 
-	const Sphere& getSphere(Entity model_instance) override
+	Sphere getSphere(Entity model_instance) override
 	{
-		return m_spheres[m_model_instance_to_sphere_map[model_instance.index]];
+		return m_spheres.get(m_model_instance_to_sphere_map[model_instance.index]);
 	}
 
 
+	u32 getVersion() const override { return m_version; }
+
+
 private:
 	IAllocator& m_allocator;
-	FreeList<CullingJobData, 16> m_job_allocator;
-	InputSpheres m_spheres;
-	Results m_result;
+	CullingSpheres m_spheres;
+	Array<Results> m_results;
 	LayerMasks m_layer_masks;
 	ModelInstancetoSphereMap m_model_instance_to_sphere_map;
 	SphereToModelInstanceMap m_sphere_to_model_instance_map;
-	CullingJobData job_data[16];
-	JobSystem::JobDecl jobs[16];
+	// spheres [0, m_tree_count) are in the tree, the rest is culled one by one
+	Array<bool> m_dynamic;
+	Array<CullingNode> m_nodes;
+	Array<CullingItem> m_items;
+	Array<CullingItem> m_tmp_items;
+	int m_tree_count;
+	int m_holes_count;
+	int m_pending_count;
+	u32 m_version;
+	// changes only when static spheres are added, removed, moved or their layers change
+	u32 m_static_version;
+	Array<CullingJobData> m_job_data;
+	Array<JobSystem::JobDecl> m_jobs;
+	Array<CullingView*> m_views;
 };
 
 
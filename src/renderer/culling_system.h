@@ -7,6 +7,7 @@
 namespace Lumix
 {
 	template <typename T> class Array;
+	struct AABB;
 	struct IAllocator;
 	struct Sphere;
 	struct Vec3;
@@ -21,6 +22,8 @@ namespace Lumix
 		typedef Array<Entity> Subresults;
 		typedef Array<Subresults> Results;
 
+		static const int MAX_VIEWS = 16;
+
 		CullingSystem() { }
 		virtual ~CullingSystem() { }
 
@@ -31,6 +34,25 @@ namespace Lumix
 		virtual const Results& getResult() = 0;
 
 		virtual Results& cull(const Frustum& frustum, u64 layer_mask) = 0;
+		// one traversal for all frusta, returns count results, valid until the next cull
+		virtual const Results* cull(const Frustum* frusta, const u64* layer_masks, int count) = 0;
+
+		// a view keeps the static spheres visible from its frustum grown by threshold and returns them again,
+		// without walking the tree, while no frustum corner moves by more than threshold and no static sphere
+		// is added, removed, moved or relayered; results may contain static spheres up to threshold outside
+		// of the frustum, dynamic spheres are tested every call; valid until the next cull of the view
+		virtual int createView(float threshold) = 0;
+		virtual void destroyView(int view) = 0;
+		virtual const Results& cull(int view, const Frustum& frustum, u64 layer_mask) = 0;
+
+		// rebuilds the tree if it has enough pending changes; after that the shape queries below
+		// can run on several threads at once, as long as no sphere is added, removed or moved
+		virtual void updateTree() = 0;
+		// spheres overlapping the shape, the tree is walked on the calling thread and entities are appended
+		virtual void cull(const Sphere& sphere, u64 layer_mask, Array<Entity>& entities) = 0;
+		virtual void cull(const AABB& aabb, u64 layer_mask, Array<Entity>& entities) = 0;
+		// sphere with the nearest center, INVALID_ENTITY if there is none
+		virtual Entity getNearest(const Vec3& position, u64 layer_mask) = 0;
 
 		virtual bool isAdded(Entity model_instance) = 0;
 		virtual void addStatic(Entity model_instance, const Sphere& sphere, u64 layer_mask) = 0;
@@ -42,6 +64,8 @@ namespace Lumix
 		virtual void updateBoundingSphere(const Sphere& sphere, Entity model_instance) = 0;
 
 		virtual void insert(const InputSpheres& spheres, const Array<Entity>& model_instances) = 0;
-		virtual const Sphere& getSphere(Entity model_instance) = 0;
+		virtual Sphere getSphere(Entity model_instance) = 0;
+		// changes when spheres are added, removed, moved or their layers change, so results can be cached
+		virtual u32 getVersion() const = 0;
 	};
 } // namespace Lux
@@ -241,6 +241,7 @@ void GameView::onStatsGUI(const ImVec2& view_pos)
 		const bgfx::Stats* bgfx_stats = bgfx::getStats();
 		const auto& stats = m_pipeline->getStats();
 		ImGui::LabelText("Draw calls", "%d", stats.draw_call_count);
+		ImGui::LabelText("Instanced draw calls", "%d", stats.instanced_draw_call_count);
 		ImGui::LabelText("Instances", "%d", stats.instance_count);
 		char buf[30];
 		toCStringPretty(stats.triangle_count, buf, lengthOf(buf));
@@ -255,6 +256,14 @@ void GameView::onStatsGUI(const ImVec2& view_pos)
 		ImGui::LabelText("GPU time", "%.2f", gpu_time);
 		ImGui::LabelText("Waiting for submit", "%.2f", wait_submit_time);
 		ImGui::LabelText("Waiting for render thread", "%.2f", wait_render_time);
+		for (int i = 0; i < stats.shadow_view_count; ++i)
+		{
+			const Pipeline::ShadowViewStats& view_stats = stats.shadow_views[i];
+			ImGui::Text("Shadow view %d: %d meshes, %.2f ms",
+				view_stats.bgfx_view_id,
+				view_stats.mesh_count,
+				view_stats.cpu_time * 1000);
+		}
 	}
 	ImGui::End();
 	ImGui::PopStyleColor();
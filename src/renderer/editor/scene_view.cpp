@@ -519,6 +519,7 @@ void SceneView::onWindowGUI()
 			const bgfx::Stats* bgfx_stats = bgfx::getStats();
 			const auto& stats = m_pipeline->getStats();
 			ImGui::LabelText("Draw calls (scene view only)", "%d", stats.draw_call_count);
+			ImGui::LabelText("Instanced draw calls (scene view only)", "%d", stats.instanced_draw_call_count);
 			ImGui::LabelText("Instances (scene view only)", "%d", stats.instance_count);
 			char buf[30];
 			toCStringPretty(stats.triangle_count, buf, lengthOf(buf));
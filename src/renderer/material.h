@@ -96,6 +96,7 @@ public:
 	void setDefine(u8 define_idx, bool enabled);
 	bool hasDefine(u8 define_idx) const;
 	bool isDefined(u8 define_idx) const;
+	u32 getDefineMask() const { return m_define_mask; }
 
 	void setCustomFlag(u32 flag) { m_custom_flags |= flag; }
 	void unsetCustomFlag(u32 flag) { m_custom_flags &= ~flag; }
@@ -10,6 +10,7 @@
 #include "engine/vec.h"
 #include "engine/resource.h"
 #include <bgfx/bgfx.h>
+#include <cfloat>
 
 
 struct lua_State;
@@ -185,11 +186,20 @@ public:
 
 	ResourceType getType() const override { return TYPE; }
 
-	LODMeshIndices getLODMeshIndices(float squared_distance) const
+	// squared_screen_size is the squared ratio of the bounding radius to the distance, the authored (squared) LOD
+	// distances are compared as the size of the model's own bounding sphere at that distance, so a scaled up
+	// instance keeps its details further away
+	int getLODIndex(float squared_screen_size) const
 	{
+		float squared_radius = m_bounding_radius * m_bounding_radius;
 		int i = 0;
-		while (squared_distance >= m_lods[i].distance) ++i;
-		return {m_lods[i].from_mesh, m_lods[i].to_mesh};
+		while (m_lods[i].distance != FLT_MAX && squared_screen_size * m_lods[i].distance <= squared_radius) ++i;
+		return i;
+	}
+
+	LODMeshIndices getLODMeshIndices(int lod_index) const
+	{
+		return {m_lods[lod_index].from_mesh, m_lods[lod_index].to_mesh};
 	}
 
 	Mesh& getMesh(int index) { return m_meshes[index]; }
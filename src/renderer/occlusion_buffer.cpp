@@ -1,109 +1,90 @@
-// clipping is inspired by urho 
-// https://github.com/urho3d/Urho3D/blob/9c666ae6b82e21e67bfb003d84e95e26f8a3d341/Source/Urho3D/Graphics/OcclusionBuffer.cpp#L681 
-
 #include "occlusion_buffer.h"
 #include "engine/array.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/matrix.h"
 #include "engine/math_utils.h"
+#include "engine/mt/thread.h"
 #include "engine/profiler.h"
-#include "engine/universe/universe.h"
+#include "engine/simd.h"
 #include "renderer/model.h"
-#include "renderer/render_scene.h"
+#include <cfloat>
+#include <cmath>
 
 
 namespace Lumix
 {
 
 
-static const int Z_SCALE = 1 << 30;
-static const int XY_SCALE = 1 << 16;
-static const int WIDTH = 384;
-static const int HEIGHT = 192;
+static const int DEFAULT_WIDTH = 384;
+static const int DEFAULT_HEIGHT = 192;
+static const int TILE_SIZE = 32;
+static const int MAX_JOBS = 64;
+// larger than any depth, added to depth of pixels outside of a triangle so min() keeps the old value
+static const float OUTSIDE_OFFSET = 1e20f;
 
 
-OcclusionBuffer::OcclusionBuffer(IAllocator& allocator)
-	: m_mips(allocator)
-	, m_allocator(allocator)
+OcclusionBuffer::Bins::Bins(IAllocator& allocator)
+	: triangles(allocator)
+	, tiles(allocator)
 {
 }
 
 
-void OcclusionBuffer::setCamera(const Matrix& view, const Matrix& projection)
+OcclusionBuffer::OcclusionBuffer(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_width(DEFAULT_WIDTH)
+	, m_height(DEFAULT_HEIGHT)
+	, m_mips(allocator)
+	, m_occluders(allocator)
+	, m_bins(allocator)
+	, m_triangles_count(0)
+	, m_projection_scale(1)
+	, m_depth_sign(1)
+	, m_near_plane(0, 0, 1, 1)
 {
-	m_view_projection_matrix = projection * view;
+	m_view_projection_matrix.setIdentity();
 }
 
 
-static LUMIX_FORCE_INLINE Vec3 toViewport(const Vec4& v)
+void OcclusionBuffer::setSize(int width, int height)
 {
-	float inv = 0.5f / v.w;
-	return { v.x * inv + 0.5f, v.y * inv + 0.5f, v.z * inv + 0.5f };
+	// whole tiles, so mips can be built down to the tile size
+	width = (width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+	height = (height + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+	if (width == m_width && height == m_height) return;
+
+	m_width = width;
+	m_height = height;
+	m_mips.clear();
+	m_bins.clear();
 }
 
 
-LUMIX_FORCE_INLINE static Vec3 transform(const Matrix& mtx, const Vec3& rhs)
+void OcclusionBuffer::setCamera(const Matrix& view, const Matrix& projection, bool homogeneous_depth)
 {
-	Vec4 v4(
-		mtx.m11 * rhs.x + mtx.m21 * rhs.y + mtx.m31 * rhs.z + mtx.m41,
-		mtx.m12 * rhs.x + mtx.m22 * rhs.y + mtx.m32 * rhs.z + mtx.m42,
-		mtx.m13 * rhs.x + mtx.m23 * rhs.y + mtx.m33 * rhs.z + mtx.m43,
-		mtx.m14 * rhs.x + mtx.m24 * rhs.y + mtx.m34 * rhs.z + mtx.m44
-	);
-	return toViewport(v4);
-}
-
+	m_view_projection_matrix = projection * view;
+	m_projection_scale = projection.m22;
 
-bool OcclusionBuffer::isOccluded(const Matrix& world_transform, const AABB& aabb)
-{
-	Matrix mtx = m_view_projection_matrix * world_transform;
-	Vec3 vertices[] = {
-		transform(mtx, aabb.min),
-		transform(mtx, Vec3(aabb.min.x, aabb.min.y, aabb.max.z)),
-		transform(mtx, Vec3(aabb.min.x, aabb.max.y, aabb.min.z)),
-		transform(mtx, Vec3(aabb.min.x, aabb.max.y, aabb.max.z)),
-		transform(mtx, Vec3(aabb.max.x, aabb.min.y, aabb.min.z)),
-		transform(mtx, Vec3(aabb.max.x, aabb.min.y, aabb.max.z)),
-		transform(mtx, Vec3(aabb.max.x, aabb.max.y, aabb.min.z)),
-		transform(mtx, aabb.max)
-	};
-	
-	Vec3 min = vertices[0];
-	Vec3 max = vertices[0];
-
-	for (int i = 1; i < lengthOf(vertices); ++i)
+	// depth can grow or shrink with distance (reversed z), it's stored so nearer is always smaller
+	bool is_depth_growing = projection.m34 * projection.m43 - projection.m33 * projection.m44 > 0;
+	m_depth_sign = is_depth_growing ? 1.0f : -1.0f;
+	if (is_depth_growing)
 	{
-		min.x = Math::minimum(vertices[i].x, min.x);
-		min.y = Math::minimum(vertices[i].y, min.y);
-		min.z = Math::minimum(vertices[i].z, min.z);
-
-		max.x = Math::maximum(vertices[i].x, max.x);
-		max.y = Math::maximum(vertices[i].y, max.y);
+		m_near_plane.set(0, 0, 1, homogeneous_depth ? 1.0f : 0.0f);
 	}
-
-	if (max.x < 0) return false;
-	if (max.y < 0) return false;
-	if (min.x >= 1) return false;
-	if (min.y >= 1) return false;
-
-	int min_x = Math::maximum(0, int(min.x * (WIDTH - 1) + 0.5f));
-	int max_x = Math::minimum(WIDTH - 1, int(max.x * (WIDTH - 1) + 0.5f));
-	int min_y = Math::maximum(0, int(min.y * (HEIGHT - 1) + 0.5f));
-	int max_y = Math::minimum(HEIGHT - 1, int(max.y * (HEIGHT - 1) + 0.5f));
-
-	int z = int(min.z * Z_SCALE);
-
-	// TODO check whole hierarchy
-	const int* LUMIX_RESTRICT depth = &m_mips[0][0];
-	for (int j = min_y; j <= max_y; ++j)
+	else
 	{
-		for (int i = min_x; i < max_x; ++i)
-		{
-			if (depth[i + j * WIDTH] > z) return false;
-		}
+		m_near_plane.set(0, 0, -1, 1);
 	}
+}
 
-	return true;
+
+float OcclusionBuffer::getScreenSize(const Sphere& sphere) const
+{
+	Vec4 pos = m_view_projection_matrix * Vec4(sphere.position, 1);
+	if (pos.w <= sphere.radius) return FLT_MAX;
+	return sphere.radius * m_projection_scale / pos.w;
 }
 
 
@@ -112,9 +93,8 @@ void OcclusionBuffer::init()
 	PROFILE_FUNCTION();
 	ASSERT(m_mips.empty());
 
-	int w = WIDTH;
-	int h = HEIGHT;
-
+	int w = m_width;
+	int h = m_height;
 	while (w % 2 != 1 && h % 2 != 1)
 	{
 		auto& mip = m_mips.emplace(m_allocator);
@@ -122,286 +102,354 @@ void OcclusionBuffer::init()
 		w >>= 1;
 		h >>= 1;
 	}
+
+	int cpu_count = Math::clamp((int)MT::getCPUsCount(), 1, MAX_JOBS);
+	int tiles_count = (m_width / TILE_SIZE) * (m_height / TILE_SIZE);
+	for (int i = 0; i < cpu_count; ++i)
+	{
+		Bins& bins = m_bins.emplace(m_allocator);
+		for (int j = 0; j < tiles_count; ++j) bins.tiles.emplace(m_allocator);
+	}
 }
 
 
-void OcclusionBuffer::buildHierarchy()
+void OcclusionBuffer::clear()
 {
-	// TODO multithreading
 	PROFILE_FUNCTION();
-	for (int level = 1; level < m_mips.size(); ++level)
+	if (m_mips.empty()) init();
+	for (auto& mip : m_mips)
 	{
-		int prev_w = WIDTH >> (level - 1);
-		int w = WIDTH >> level;
-		int h = HEIGHT >> level;
-		for (int j = 0; j < h; ++j)
-		{
-			int prev_j = j << 1;
-			const int* LUMIX_RESTRICT prev_mip = &m_mips[level - 1][prev_j * prev_w];
-			int* LUMIX_RESTRICT mip = &m_mips[level][j * w];
-			int* end = mip + w;
-			while (mip != end)
-			{
-				*mip = Math::maximum(prev_mip[0], prev_mip[1], prev_mip[prev_w], prev_mip[prev_w + 1]);
-				++mip;
-				prev_mip += 2;
-			}
-		}
+		for (float& depth : mip) depth = FLT_MAX;
 	}
+	m_occluders.clear();
+	m_triangles_count = 0;
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
+void OcclusionBuffer::addOccluder(const Matrix& world_transform, const Mesh& mesh)
 {
-	Vec3 n = crossProduct(v[1] - v[0], v[2] - v[0]);
-	bool is_backface = n.z <= 0;
-	if (is_backface) return;
-
-	if (v[0].y > v[2].y) Math::swap(v[0], v[2]);
-	if (v[0].y > v[1].y) Math::swap(v[0], v[1]);
-	if (v[1].y > v[2].y) Math::swap(v[1], v[2]);
-
-	int width = WIDTH;
-	int height = HEIGHT;
+	int index_size = mesh.flags.isSet(Mesh::INDICES_16_BIT) ? sizeof(u16) : sizeof(u32);
+	Occluder& occluder = m_occluders.emplace();
+	occluder.mvp = m_view_projection_matrix * world_transform;
+	occluder.mesh = &mesh;
+	occluder.first_triangle = m_triangles_count;
+	m_triangles_count += mesh.indices.size() / index_size / 3;
+}
 
-	struct Point { int x, y; };
-	Point p0 = { int(v[0].x * (width - 1) + 0.5f), int(v[0].y * (height - 1) + 0.5f) };
-	Point p1 = { int(v[1].x * (width - 1) + 0.5f), int(v[1].y * (height - 1) + 0.5f) };
-	Point p2 = { int(v[2].x * (width - 1) + 0.5f), int(v[2].y * (height - 1) + 0.5f) };
 
-	if (p0.y == p2.y) return;
+template <typename IndexType>
+static LUMIX_FORCE_INLINE void getTriangle(const Mesh& mesh, int triangle, const Matrix& mvp, Vec4 (&out)[3])
+{
+	const Vec3* vertices = &mesh.vertices[0];
+	const IndexType* indices = (const IndexType*)&mesh.indices[0] + triangle * 3;
+	for (int i = 0; i < 3; ++i) out[i] = mvp * Vec4(vertices[indices[i]], 1);
+}
 
-	float xdz = -n.x / n.z;
-	int xdz_int = int(xdz * Z_SCALE / WIDTH);
 
-	if (p1.y != p0.y)
+// clips the triangle by the near plane, returns the number of polygon's vertices
+static int clipNear(const Vec4 (&triangle)[3], const Vec4& near_plane, Vec4 (&polygon)[4])
+{
+	float d[3];
+	for (int i = 0; i < 3; ++i)
 	{
-		int dl = (p1.x - p0.x) * 2 * XY_SCALE / (2*p1.y - 2*p0.y + 1);
-		int dr = (p2.x - p0.x) * 2 * XY_SCALE / (2*p2.y - 2*p0.y + 1);
-		Vec3 left_p = dl > dr ? v[2] : v[1];
-		int dz_left = int((left_p.z - v[0].z) * Z_SCALE / (left_p.y - (v[0].y + 0.5f / HEIGHT)) / HEIGHT);
-		int z_left = int(v[0].z * Z_SCALE) + (dz_left >> 1);
-		if (dl > dr) Math::swap(dl, dr);
-		int left = p0.x * XY_SCALE + (dl >> 1);
-		int right = p0.x * XY_SCALE + (dr >> 1);
-		for (int y = p0.y; y <= p1.y; ++y)
-		{
-			int base = y * width + left / XY_SCALE;
-			int z = z_left;
-			for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
-			{
-				if (z < depth[base + x]) depth[base + x] = z;
-				z += xdz_int;
-			}
-			left += dl;
-			right += dr;
-			z_left += dz_left;
-		}
+		d[i] = dotProduct(near_plane, triangle[i]);
 	}
-	
-	if (p2.y == p1.y) return;
-
-	int dl = -(p1.x - p2.x) * 2 * XY_SCALE / (2 * p1.y - 2 * p2.y - 1);
-	int dr = -(p0.x - p2.x) * 2 * XY_SCALE / (2 * p0.y - 2 * p2.y - 1);
-	Vec3 left_p = dl > dr ? v[0] : v[1];
-	int dz_left = -int((left_p.z - v[2].z) * Z_SCALE / (left_p.y - (v[2].y - 0.5f / HEIGHT)) / HEIGHT);
-
-	if (dl > dr) Math::swap(dl, dr);
-	int left = p2.x * XY_SCALE + (dl >> 1);
-	int right = p2.x * XY_SCALE + (dr >> 1);
-	int z_left = int(v[2].z * Z_SCALE) + (dz_left >> 1);
-	for (int y = p2.y; y >= p1.y; --y)
+
+	int count = 0;
+	for (int i = 0; i < 3; ++i)
 	{
-		int base = y * width + left / XY_SCALE;
-		int z = z_left;
-		for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
+		int next = (i + 1) % 3;
+		if (d[i] >= 0) polygon[count++] = triangle[i];
+		if ((d[i] >= 0) != (d[next] >= 0))
 		{
-			if (z < depth[base + x]) depth[base + x] = z;
-			z += xdz_int;
+			float t = d[i] / (d[i] - d[next]);
+			polygon[count++] = triangle[i] + t * (triangle[next] - triangle[i]);
 		}
-		left += dl;
-		right += dr;
-		z_left += dz_left;
 	}
-
+	return count;
 }
 
 
-static LUMIX_FORCE_INLINE Vec4 clip(const Vec4& v0, const Vec4& v1, float d0, float d1)
+void OcclusionBuffer::binTriangles(Bins& bins, int from, int to) const
 {
-	float t = d0 / (d0 - d1);
-	return v0 + t * (v1 - v0);
+	bins.triangles.clear();
+	for (Array<int>& tile : bins.tiles) tile.clear();
+	if (from >= to) return;
+
+	const int tiles_x = m_width / TILE_SIZE;
+	const float width = (float)m_width;
+	const float height = (float)m_height;
+	int occluder_index = 0;
+	while (occluder_index + 1 < m_occluders.size() && m_occluders[occluder_index + 1].first_triangle <= from)
+	{
+		++occluder_index;
+	}
+
+	for (int triangle = from; triangle < to; ++triangle)
+	{
+		while (occluder_index + 1 < m_occluders.size() && m_occluders[occluder_index + 1].first_triangle <= triangle)
+		{
+			++occluder_index;
+		}
+		const Occluder& occluder = m_occluders[occluder_index];
+		Vec4 clip_space[3];
+		int mesh_triangle = triangle - occluder.first_triangle;
+		if (occluder.mesh->flags.isSet(Mesh::INDICES_16_BIT))
+		{
+			getTriangle<u16>(*occluder.mesh, mesh_triangle, occluder.mvp, clip_space);
+		}
+		else
+		{
+			getTriangle<u32>(*occluder.mesh, mesh_triangle, occluder.mvp, clip_space);
+		}
+
+		Vec4 polygon[4];
+		int vertices_count = clipNear(clip_space, m_near_plane, polygon);
+		Vec3 projected[4];
+		for (int i = 0; i < vertices_count; ++i)
+		{
+			float inv_w = 1 / polygon[i].w;
+			projected[i].x = (polygon[i].x * inv_w * 0.5f + 0.5f) * width;
+			projected[i].y = (polygon[i].y * inv_w * 0.5f + 0.5f) * height;
+			projected[i].z = polygon[i].z * inv_w * m_depth_sign;
+		}
+
+		for (int fan = 2; fan < vertices_count; ++fan)
+		{
+			const Vec3& p0 = projected[0];
+			const Vec3& p1 = projected[fan - 1];
+			const Vec3& p2 = projected[fan];
+			float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+			if (area <= 0) continue;
+
+			int min_x = Math::maximum(0, (int)floorf(Math::minimum(p0.x, p1.x, p2.x)));
+			int min_y = Math::maximum(0, (int)floorf(Math::minimum(p0.y, p1.y, p2.y)));
+			int max_x = Math::minimum(m_width - 1, (int)ceilf(Math::maximum(p0.x, p1.x, p2.x)));
+			int max_y = Math::minimum(m_height - 1, (int)ceilf(Math::maximum(p0.y, p1.y, p2.y)));
+			if (min_x > max_x || min_y > max_y) continue;
+
+			ScreenTriangle& screen_triangle = bins.triangles.emplace();
+			const Vec3* points[] = {&p0, &p1, &p2};
+			for (int i = 0; i < 3; ++i)
+			{
+				const Vec3& a = *points[i];
+				const Vec3& b = *points[(i + 1) % 3];
+				screen_triangle.edges[i][0] = a.y - b.y;
+				screen_triangle.edges[i][1] = b.x - a.x;
+				screen_triangle.edges[i][2] = -(a.y - b.y) * a.x - (b.x - a.x) * a.y;
+			}
+			float inv_area = 1 / area;
+			float dz_dx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) * inv_area;
+			float dz_dy = ((p1.x - p0.x) * (p2.z - p0.z) - (p2.x - p0.x) * (p1.z - p0.z)) * inv_area;
+			screen_triangle.z[0] = dz_dx;
+			screen_triangle.z[1] = dz_dy;
+			screen_triangle.z[2] = p0.z - dz_dx * p0.x - dz_dy * p0.y;
+			screen_triangle.min_x = min_x;
+			screen_triangle.min_y = min_y;
+			screen_triangle.max_x = max_x;
+			screen_triangle.max_y = max_y;
+
+			int index = bins.triangles.size() - 1;
+			for (int tile_y = min_y / TILE_SIZE; tile_y <= max_y / TILE_SIZE; ++tile_y)
+			{
+				for (int tile_x = min_x / TILE_SIZE; tile_x <= max_x / TILE_SIZE; ++tile_x)
+				{
+					bins.tiles[tile_x + tile_y * tiles_x].push(index);
+				}
+			}
+		}
+	}
 }
 
 
-static LUMIX_FORCE_INLINE bool tryClip2Vertices(Vec4* vertices, int index, float* d, int d0, int d1, int d2)
+void OcclusionBuffer::rasterizeTile(int tile) const
 {
-	if (d[d0] < 0.0f && d[d1] < 0.0f)
+	const int tiles_x = m_width / TILE_SIZE;
+	const int tile_min_x = (tile % tiles_x) * TILE_SIZE;
+	const int tile_min_y = (tile / tiles_x) * TILE_SIZE;
+	float* LUMIX_RESTRICT depth = const_cast<float*>(&m_mips[0][0]);
+	const float4 lane_offsets = {0.5f, 1.5f, 2.5f, 3.5f};
+	const float4 zero = f4Splat(0);
+	const float4 outside_offset = f4Splat(OUTSIDE_OFFSET);
+
+	for (const Bins& bins : m_bins)
 	{
-		vertices[index + d0] = clip(vertices[index + d0], vertices[index + d2], d[d0], d[d2]);
-		vertices[index + d1] = clip(vertices[index + d1], vertices[index + d2], d[d1], d[d2]);
-		return true;
+		for (int triangle_index : bins.tiles[tile])
+		{
+			const ScreenTriangle& triangle = bins.triangles[triangle_index];
+			int min_x = Math::maximum(tile_min_x, triangle.min_x) & ~3;
+			int max_x = Math::minimum(tile_min_x + TILE_SIZE - 1, triangle.max_x);
+			int min_y = Math::maximum(tile_min_y, triangle.min_y);
+			int max_y = Math::minimum(tile_min_y + TILE_SIZE - 1, triangle.max_y);
+
+			float4 edge_x[3];
+			for (int i = 0; i < 3; ++i) edge_x[i] = f4Splat(triangle.edges[i][0]);
+			float4 z_x = f4Splat(triangle.z[0]);
+
+			for (int y = min_y; y <= max_y; ++y)
+			{
+				float pixel_y = y + 0.5f;
+				float4 edge_row[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					edge_row[i] = f4Splat(triangle.edges[i][1] * pixel_y + triangle.edges[i][2]);
+				}
+				float4 z_row = f4Splat(triangle.z[1] * pixel_y + triangle.z[2]);
+				float* LUMIX_RESTRICT row = depth + y * m_width;
+				for (int x = min_x; x <= max_x; x += 4)
+				{
+					float4 pixel_x = f4Add(f4Splat((float)x), lane_offsets);
+					float4 e0 = f4Add(f4Mul(edge_x[0], pixel_x), edge_row[0]);
+					float4 e1 = f4Add(f4Mul(edge_x[1], pixel_x), edge_row[1]);
+					float4 e2 = f4Add(f4Mul(edge_x[2], pixel_x), edge_row[2]);
+					float4 inside = f4Min(e0, f4Min(e1, e2));
+					if (f4MoveMask(inside) == 0xf) continue;
+
+					float4 z = f4Add(f4Mul(z_x, pixel_x), z_row);
+					z = f4Sub(z, f4Mul(f4Min(inside, zero), outside_offset));
+					f4StoreUnaligned(row + x, f4Min(f4LoadUnaligned(row + x), z));
+				}
+			}
+		}
 	}
-	return false;
 }
 
 
-static LUMIX_FORCE_INLINE bool tryClip1Vertex(Vec4* vertices, int index, float* d, int d0, int d1, int d2, bool* triangles, int& tringles_count)
+struct OcclusionJobData
 {
-	bool is_behind_plane = d[d0] < 0;
-	if (!is_behind_plane) return false;
-
-	int new_index = tringles_count * 3;
-	triangles[tringles_count] = true;
-	++tringles_count;
+	OcclusionBuffer* buffer;
+	int index;
+	int count;
+};
 
-	vertices[new_index + 0] = clip(vertices[index + d0], vertices[index + d2], d[d0], d[d2]);
-	vertices[new_index + 1] = clip(vertices[index + d0], vertices[index + d1], d[d0], d[d1]);
-	vertices[new_index + 2] = vertices[index + d2];
-	vertices[index + d0] = vertices[new_index + 1];
 
-	return true;
+void OcclusionBuffer::binJob(void* data)
+{
+	PROFILE_FUNCTION();
+	OcclusionJobData* job_data = (OcclusionJobData*)data;
+	OcclusionBuffer& buffer = *job_data->buffer;
+	int step = buffer.m_triangles_count / job_data->count;
+	int from = job_data->index * step;
+	int to = job_data->index == job_data->count - 1 ? buffer.m_triangles_count : from + step;
+	buffer.binTriangles(buffer.m_bins[job_data->index], from, to);
 }
 
 
-static void clipTriangles(const Vec4& plane, Vec4* vertices, bool* triangles, int& triangles_count)
+void OcclusionBuffer::rasterizeJob(void* data)
 {
-	int count = triangles_count;
-	for (int i = 0; i < count; ++i)
+	PROFILE_FUNCTION();
+	OcclusionJobData* job_data = (OcclusionJobData*)data;
+	const OcclusionBuffer& buffer = *job_data->buffer;
+	int tiles_count = (buffer.m_width / TILE_SIZE) * (buffer.m_height / TILE_SIZE);
+	for (int tile = job_data->index; tile < tiles_count; tile += job_data->count)
 	{
-		if (!triangles[i]) continue;
-		int index = i * 3;
-		float d[3] = { dotProduct(plane, vertices[index])
-			, dotProduct(plane, vertices[index + 1])
-			, dotProduct(plane, vertices[index + 2])
-		};
-		
-		bool all_behind = d[0] < 0.0f && d[1] < 0.0f && d[2] < 0.0f;
-		if (all_behind)
-		{
-			triangles[i] = false;
-			continue;
-		}
-		if (tryClip2Vertices(vertices, index, d, 0, 1, 2)) continue;
-		if (tryClip2Vertices(vertices, index, d, 0, 2, 1)) continue;
-		if (tryClip2Vertices(vertices, index, d, 1, 2, 0)) continue;
-		if (tryClip1Vertex(vertices, index, d, 0, 1, 2, triangles, triangles_count)) continue;
-		if (tryClip1Vertex(vertices, index, d, 1, 2, 0, triangles, triangles_count)) continue;
-		if (tryClip1Vertex(vertices, index, d, 2, 0, 1, triangles, triangles_count)) continue;
+		buffer.rasterizeTile(tile);
 	}
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int* depth)
+void OcclusionBuffer::rasterize()
 {
-	enum ClipMask
-	{
-		NEGATIVE_X = 1 << 0,
-		POSITIVE_X = 1 << 1,
-		NEGATIVE_Y = 1 << 2,
-		POSITIVE_Y = 1 << 3,
-		NEGATIVE_Z = 1 << 4,
-		POSITIVE_Z = 1 << 5
-	};
-	u32 triangle_mask = 0;
-	u32 and_mask = 0;
-	for (int i = 0; i < 3; ++i)
+	PROFILE_FUNCTION();
+	PROFILE_INT("occluders", m_occluders.size());
+	PROFILE_INT("triangles", m_triangles_count);
+	if (m_mips.empty()) init();
+
+	OcclusionJobData data[MAX_JOBS];
+	JobSystem::JobDecl jobs[MAX_JOBS];
+	int jobs_count = m_bins.size();
+	for (int i = 0; i < jobs_count; ++i)
 	{
-		Vec4 v = vertices[i];
-		u32 vertex_mask = 0;
-		if (v.x < -v.w) vertex_mask |= NEGATIVE_X;
-		if (v.y < -v.w) vertex_mask |= NEGATIVE_Y;
-		if (v.z < -v.w) vertex_mask |= NEGATIVE_Z;
-
-		if (v.x > v.w) vertex_mask |= POSITIVE_X;
-		if (v.y > v.w) vertex_mask |= POSITIVE_Y;
-		if (v.z > v.w) vertex_mask |= POSITIVE_Z;
-
-		triangle_mask |= vertex_mask;
-		if (i == 0) and_mask = vertex_mask;
-		else and_mask &= vertex_mask;
+		data[i] = {this, i, jobs_count};
+		jobs[i].data = &data[i];
+		jobs[i].task = &binJob;
 	}
+	volatile int counter = 0;
+	JobSystem::runJobs(jobs, jobs_count, &counter);
+	JobSystem::wait(&counter);
 
-	bool all_vertices_outside = and_mask != 0;
-	if (all_vertices_outside) return;
+	for (int i = 0; i < jobs_count; ++i) jobs[i].task = &rasterizeJob;
+	JobSystem::runJobs(jobs, jobs_count, &counter);
+	JobSystem::wait(&counter);
+}
 
-	if (triangle_mask == 0)
-	{
-		Vec3 projected[] = { toViewport(vertices[0]), toViewport(vertices[1]), toViewport(vertices[2]) };
-		rasterizeProjectedTriangle(projected, depth);
-	}
-	else
+
+void OcclusionBuffer::buildHierarchy()
+{
+	PROFILE_FUNCTION();
+	for (int level = 1; level < m_mips.size(); ++level)
 	{
-		int triangles_count = 1;
-		bool triangles[64];
-		if (triangle_mask & POSITIVE_X) clipTriangles(Vec4(-1.0f, 0.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & NEGATIVE_X) clipTriangles(Vec4(1.0f, 0.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & POSITIVE_Y) clipTriangles(Vec4(0.0f, -1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & NEGATIVE_Y) clipTriangles(Vec4(0.0f, 1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & POSITIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, -1.0f, 1.0f), vertices, triangles, triangles_count);
-		bool is_homogenous_depth = bgfx::getCaps()->homogeneousDepth;
-		if (triangle_mask & NEGATIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, 1.0f, is_homogenous_depth ? 1.0f : 0.0f), vertices, triangles, triangles_count);
-
-		for (int i = 0; i < triangles_count; ++i)
+		int prev_w = m_width >> (level - 1);
+		int w = m_width >> level;
+		int h = m_height >> level;
+		for (int j = 0; j < h; ++j)
 		{
-			if (!triangles[i]) continue;
-			int index = i * 3;
-			Vec3 projected[] = { toViewport(vertices[index]), toViewport(vertices[index + 1]), toViewport(vertices[index + 2]) };
-			rasterizeProjectedTriangle(projected, depth);
+			int prev_j = j << 1;
+			const float* LUMIX_RESTRICT prev_mip = &m_mips[level - 1][prev_j * prev_w];
+			float* LUMIX_RESTRICT mip = &m_mips[level][j * w];
+			float* end = mip + w;
+			while (mip != end)
+			{
+				*mip = Math::maximum(prev_mip[0], prev_mip[1], prev_mip[prev_w], prev_mip[prev_w + 1]);
+				++mip;
+				prev_mip += 2;
+			}
 		}
 	}
 }
 
 
-template <typename IndexType>
-static void rasterizeOccludingTriangles(const Mesh* mesh, const Matrix& mvp_mtx, int* depth)
+bool OcclusionBuffer::isOccluded(const Matrix& world_transform, const AABB& aabb) const
 {
-	const Vec3* LUMIX_RESTRICT vertices = &mesh->vertices[0];
-	const IndexType* LUMIX_RESTRICT indices = (const IndexType*)&mesh->indices[0];
-	for (int i = 0, n = mesh->indices.size() / sizeof(IndexType); i < n; i += 3)
+	if (m_mips.empty()) return false;
+
+	Matrix mtx = m_view_projection_matrix * world_transform;
+	Vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < 8; ++i)
 	{
-		Vec4 v[64*3] = {
-			mvp_mtx * Vec4(vertices[indices[i + 0]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 1]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 2]], 1)
-		};
-		rasterizeOccludingTriangle(v, depth);
+		Vec3 corner(i & 1 ? aabb.max.x : aabb.min.x, i & 2 ? aabb.max.y : aabb.min.y, i & 4 ? aabb.max.z : aabb.min.z);
+		Vec4 v = mtx * Vec4(corner, 1);
+		// crossing the near plane, the box could be anywhere on the screen
+		if (dotProduct(m_near_plane, v) < 0 || v.w <= 0) return false;
+		float inv_w = 1 / v.w;
+		Vec3 projected(v.x * inv_w * 0.5f + 0.5f, v.y * inv_w * 0.5f + 0.5f, v.z * inv_w * m_depth_sign);
+		min = AABB::minCoords(min, projected);
+		max = AABB::maxCoords(max, projected);
 	}
-}
 
+	if (max.x < 0 || max.y < 0 || min.x >= 1 || min.y >= 1) return false;
 
-void OcclusionBuffer::rasterize(Universe* universe, const Array<MeshInstance>& meshes)
-{
-	PROFILE_FUNCTION();
-	if (m_mips.empty()) init();
-	int* depth = &m_mips[0][0];
-	for (const MeshInstance& mesh_instance : meshes)
+	int min_x = Math::maximum(0, (int)(min.x * m_width));
+	int min_y = Math::maximum(0, (int)(min.y * m_height));
+	int max_x = Math::minimum(m_width - 1, (int)(max.x * m_width));
+	int max_y = Math::minimum(m_height - 1, (int)(max.y * m_height));
+
+	// coarsest mip where the box covers at most 4x4 texels
+	int level = 0;
+	while (level + 1 < m_mips.size() && ((max_x >> level) - (min_x >> level) > 3 || (max_y >> level) - (min_y >> level) > 3))
 	{
-		const Mesh* mesh = mesh_instance.mesh;
-		Matrix mtx = m_view_projection_matrix * universe->getMatrix(mesh_instance.owner);
-		if (mesh->flags.isSet(Mesh::INDICES_16_BIT))
-		{
-			rasterizeOccludingTriangles<u16>(mesh, mtx, depth);
-		}
-		else
+		++level;
+	}
+
+	const float* LUMIX_RESTRICT depth = &m_mips[level][0];
+	int w = m_width >> level;
+	for (int j = min_y >> level, end_j = max_y >> level; j <= end_j; ++j)
+	{
+		for (int i = min_x >> level, end_i = max_x >> level; i <= end_i; ++i)
 		{
-			rasterizeOccludingTriangles<u32>(mesh, mtx, depth);
+			if (depth[i + j * w] >= min.z) return false;
 		}
 	}
+	return true;
 }
 
 
-void OcclusionBuffer::clear()
+bool OcclusionBuffer::isOccluded(const Sphere& sphere) const
 {
-	PROFILE_FUNCTION();
-	for (auto& mip : m_mips)
-	{
-		for (int& i : mip)
-		{
-			i = Z_SCALE;
-		}
-	}
+	Vec3 extents(sphere.radius, sphere.radius, sphere.radius);
+	return isOccluded(Matrix::IDENTITY, AABB(sphere.position - extents, sphere.position + extents));
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -3,6 +3,7 @@
 
 #include "engine/array.h"
 #include "engine/matrix.h"
+#include "engine/vec.h"
 
 
 namespace Lumix
@@ -12,31 +13,71 @@ namespace Lumix
 template <typename T> class Array;
 struct IAllocator;
 struct Mesh;
-struct MeshInstance;
 struct AABB;
-class Universe;
+struct Sphere;
 
 
+// software depth buffer, occluders are binned to tiles and the tiles are rasterized in parallel
 class OcclusionBuffer
 {
 public:
-	OcclusionBuffer(IAllocator& allocator);
+	explicit OcclusionBuffer(IAllocator& allocator);
 
-	bool isOccluded(const Matrix& world_transform, const AABB& aabb);
+	void setSize(int width, int height);
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	void setCamera(const Matrix& view, const Matrix& projection, bool homogeneous_depth);
+	// radius of the sphere on the screen relative to half of the screen height
+	float getScreenSize(const Sphere& sphere) const;
 	void clear();
-	void setCamera(const Matrix& view, const Matrix& projection);
-	void rasterize(Universe* universe, const Array<MeshInstance>& meshes);
+	void addOccluder(const Matrix& world_transform, const Mesh& mesh);
+	int getOccludersCount() const { return m_occluders.size(); }
+	void rasterize();
 	void buildHierarchy();
-	const int* getMip(int level) { return &m_mips[level][0]; }
+	bool isOccluded(const Matrix& world_transform, const AABB& aabb) const;
+	bool isOccluded(const Sphere& sphere) const;
+	const float* getMip(int level) const { return &m_mips[level][0]; }
 
 private:
-	void init();
+	struct Occluder
+	{
+		Matrix mvp;
+		const Mesh* mesh;
+		int first_triangle;
+	};
+
+	struct ScreenTriangle
+	{
+		float edges[3][3];
+		float z[3];
+		int min_x, min_y, max_x, max_y;
+	};
+
+	struct Bins
+	{
+		explicit Bins(IAllocator& allocator);
 
-	using Mip = Array<int>;
+		Array<ScreenTriangle> triangles;
+		Array<Array<int>> tiles;
+	};
+
+	void init();
+	void binTriangles(Bins& bins, int from, int to) const;
+	void rasterizeTile(int tile) const;
+	static void binJob(void* data);
+	static void rasterizeJob(void* data);
 
 	IAllocator& m_allocator;
-	Array<Mip> m_mips;
+	int m_width;
+	int m_height;
+	Array<Array<float>> m_mips;
+	Array<Occluder> m_occluders;
+	Array<Bins> m_bins;
+	int m_triangles_count;
 	Matrix m_view_projection_matrix;
+	float m_projection_scale;
+	float m_depth_sign;
+	Vec4 m_near_plane;
 };
 
 
@@ -10,6 +10,7 @@
 #include "engine/mt/atomic.h"
 #include "engine/profiler.h"
 #include "engine/engine.h"
+#include "engine/timer.h"
 #include "imgui/imgui.h"
 #include "renderer/draw2d.h"
 #include "renderer/font_manager.h"
@@ -38,6 +39,7 @@ namespace Lumix
 	
 static const float SHADOW_CAM_NEAR = 50.0f;
 static const float SHADOW_CAM_FAR = 5000.0f;
+static const int SHADOWMAP_CASCADES_COUNT = 4;
 
 
 struct InstanceData
@@ -47,11 +49,14 @@ struct InstanceData
 	bgfx::InstanceDataBuffer buffer;
 	int offset = 0;
 	int instances_count = 0;
+	u32 depth = 0;
 	const Mesh* mesh = nullptr;
 };
 
 
 static thread_local InstanceData s_instance_data;
+// set while a job records a shadow view, meshes of all layers go to that view
+static thread_local int s_recorded_view_idx = -1;
 
 
 struct View
@@ -264,6 +269,16 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	};
 
 
+	struct ShadowViewJob
+	{
+		PipelineImpl* pipeline;
+		const Array<MeshInstance>* meshes;
+		int view_idx;
+		int stats_idx;
+		u64 duration;
+	};
+
+
 	struct BaseVertex
 	{
 		float x, y, z;
@@ -291,6 +306,15 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		, m_terrains_buffer(allocator)
 		, m_grasses_buffer(allocator)
 		, m_is_rendering_in_shadowmap(false)
+		, m_frame_index(0)
+		, m_shadow_cascades_meshes(allocator)
+		, m_shadow_cascades_frame(0xffFFffFF)
+		, m_shadow_cascades_light(INVALID_ENTITY)
+		, m_shadow_cascades_camera(INVALID_ENTITY)
+		, m_shadow_cascades_layer_mask(0)
+		, m_shadow_views_count(0)
+		, m_shadow_view_jobs(allocator)
+		, m_shadow_view_job_decls(allocator)
 		, m_is_ready(false)
 		, m_debug_index_buffer(BGFX_INVALID_HANDLE)
 		, m_scene(nullptr)
@@ -300,6 +324,8 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		, m_draw2d(allocator)
 		, m_is_first_render(true)
 		, m_occlusion_buffer(allocator)
+		, m_occlusion_camera(INVALID_ENTITY)
+		, m_occluder_screen_size(0.25f)
 	{
 		for (auto& handle : m_debug_vertex_buffers)
 		{
@@ -328,6 +354,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		createParticleBuffers();
 		createCubeBuffers();
 		m_stats = {};
+		m_timer = Timer::create(m_allocator);
 
 		FontAtlas& font_atlas = m_renderer.getFontManager().getFontAtlas();
 		m_draw2d.FontTexUvWhitePixel = font_atlas.TexUvWhitePixel;
@@ -641,6 +668,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		{
 			if (bgfx::isValid(handle)) bgfx::destroy(handle);
 		}
+		Timer::destroy(m_timer);
 	}
 
 
@@ -766,17 +794,43 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
+	bool isOccluded(const OcclusionBuffer& occlusion_buffer, const ParticleEmitter& emitter) const
+	{
+		if (emitter.m_life.empty()) return false;
+
+		AABB aabb(emitter.m_position[0], emitter.m_position[0]);
+		float max_size = 0;
+		for (int i = 0, c = emitter.m_position.size(); i < c; ++i)
+		{
+			aabb.addPoint(emitter.m_position[i]);
+			max_size = Math::maximum(max_size, emitter.m_size[i]);
+		}
+		aabb.min -= Vec3(max_size, max_size, max_size);
+		aabb.max += Vec3(max_size, max_size, max_size);
+		Matrix mtx = emitter.m_local_space ? m_scene->getUniverse().getMatrix(emitter.m_entity) : Matrix::IDENTITY;
+		return occlusion_buffer.isOccluded(mtx, aabb);
+	}
+
+
 	void renderParticles()
 	{
 		PROFILE_FUNCTION();
+		const OcclusionBuffer* occlusion_buffer = getOcclusionBuffer();
+		int occluded_count = 0;
 		const auto& emitters = m_scene->getParticleEmitters();
 		for (int i = 0, c = emitters.size(); i < c; ++i)
 		{
 			auto* emitter = emitters.at(i);
 			if (!emitter->m_is_valid) continue;
+			if (occlusion_buffer && isOccluded(*occlusion_buffer, *emitter))
+			{
+				++occluded_count;
+				continue;
+			}
 
 			renderParticlesFromEmitter(*emitter);
 		}
+		PROFILE_INT("occluded", occluded_count);
 
 		const auto& scripted_emitters = m_scene->getScriptedParticleEmitters();
 		for (int i = 0, c = scripted_emitters.size(); i < c; ++i)
@@ -857,6 +911,23 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
+	int getMeshViewIndex(int render_layer) const
+	{
+		return s_recorded_view_idx >= 0 ? s_recorded_view_idx : m_layer_to_view_map[render_layer];
+	}
+
+
+	// meshes with the same material are rendered from several jobs at once, so the program variant is picked
+	// without calling setDefine on the shared material
+	ShaderInstance& getMeshShaderInstance(const Material& material, bool instanced) const
+	{
+		u32 instanced_bit = 1 << m_instanced_define_idx;
+		u32 mask = material.getDefineMask();
+		mask = instanced ? mask | instanced_bit : mask & ~instanced_bit;
+		return material.getShader()->getInstance(mask);
+	}
+
+
 	void finishInstances(bgfx::Encoder* encoder)
 	{
 		InstanceData& data = s_instance_data;
@@ -867,27 +938,54 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		const Mesh& mesh = *data.mesh;
 		Material* material = mesh.material;
 
-		material->setDefine(m_instanced_define_idx, true);
+		ShaderInstance& shader_instance = getMeshShaderInstance(*material, true);
 
-		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
-		ASSERT(view_idx >= 0);
-		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
+		auto submit = [&](View& view) {
+			executeCommandBuffer(encoder, material->getCommandBuffer(), material);
+			executeCommandBuffer(encoder, view.command_buffer.buffer, material);
 
-		executeCommandBuffer(encoder, material->getCommandBuffer(), material);
-		executeCommandBuffer(encoder, view.command_buffer.buffer, material);
+			encoder->setVertexBuffer(0, mesh.vertex_buffer_handle);
+			encoder->setIndexBuffer(mesh.index_buffer_handle);
+			encoder->setStencil(view.stencil, BGFX_STENCIL_NONE);
+			encoder->setState(view.render_state | material->getRenderStates());
+			data.buffer.offset += data.offset * sizeof(Matrix);
+			encoder->setInstanceDataBuffer(&data.buffer, 0, data.instances_count);
+			data.buffer.offset -= data.offset * sizeof(Matrix);
+			MT::atomicIncrement(&m_stats.draw_call_count);
+			MT::atomicIncrement(&m_stats.instanced_draw_call_count);
+			MT::atomicAdd(&m_stats.instance_count, data.instances_count);
+			MT::atomicAdd(&m_stats.triangle_count, data.instances_count * mesh.indices_count / 3);
+			encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx), data.depth);
+		};
 
-		encoder->setVertexBuffer(0, mesh.vertex_buffer_handle);
-		encoder->setIndexBuffer(mesh.index_buffer_handle);
-		encoder->setStencil(view.stencil, BGFX_STENCIL_NONE);
-		encoder->setState(view.render_state | material->getRenderStates());
-		data.buffer.offset += data.offset * sizeof(Matrix);
-		encoder->setInstanceDataBuffer(&data.buffer, 0, data.instances_count);
-		data.buffer.offset -= data.offset * sizeof(Matrix);
-		ShaderInstance& shader_instance = material->getShaderInstance();
-		MT::atomicIncrement(&m_stats.draw_call_count);
-		MT::atomicAdd(&m_stats.instance_count, data.instances_count);
-		MT::atomicAdd(&m_stats.triangle_count, data.instances_count * mesh.indices_count / 3);
-		encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx));
+		if (mesh.type == Mesh::MULTILAYER_RIGID)
+		{
+			int view_idx = getMeshViewIndex(material->getRenderLayer());
+			if (view_idx >= 0 && !m_is_rendering_in_shadowmap)
+			{
+				View& view = m_views[view_idx];
+				if (bgfx::isValid(shader_instance.getProgramHandle(view.pass_idx)))
+				{
+					int layers_count = material->getLayersCount();
+					for (int i = 0; i < layers_count; ++i)
+					{
+						Vec4 layer((i + 1) / (float)layers_count, 0, 0, 0);
+						encoder->setUniform(m_layer_uniform, &layer);
+						submit(view);
+					}
+				}
+			}
+
+			static const int default_layer = m_renderer.getLayer("default");
+			int default_view_idx = getMeshViewIndex(default_layer);
+			if (default_view_idx >= 0) submit(m_views[default_view_idx]);
+		}
+		else
+		{
+			int view_idx = getMeshViewIndex(material->getRenderLayer());
+			ASSERT(view_idx >= 0);
+			submit(m_views[view_idx >= 0 ? view_idx : 0]);
+		}
 
 		data.offset += data.instances_count;
 		if (data.offset == InstanceData::MAX_INSTANCE_COUNT)
@@ -1313,6 +1411,20 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		IAllocator& frame_allocator = m_renderer.getEngine().getLIFOAllocator();
 		Array<Entity> local_lights(frame_allocator);
 		m_scene->getPointLights(m_camera_frustum, local_lights);
+		if (const OcclusionBuffer* occlusion_buffer = getOcclusionBuffer())
+		{
+			int occluded_count = 0;
+			Universe& universe = m_scene->getUniverse();
+			for (int i = local_lights.size() - 1; i >= 0; --i)
+			{
+				Entity light = local_lights[i];
+				Sphere sphere(universe.getPosition(m_scene->getPointLightEntity(light)), m_scene->getLightRange(light));
+				if (!occlusion_buffer->isOccluded(sphere)) continue;
+				local_lights.eraseFast(i);
+				++occluded_count;
+			}
+			PROFILE_INT("occluded", occluded_count);
+		}
 
 		PROFILE_INT("light count", local_lights.size());
 		struct Data
@@ -1409,6 +1521,17 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		IAllocator& frame_allocator = m_renderer.getEngine().getLIFOAllocator();
 		Array<DecalInfo> decals(frame_allocator);
 		m_scene->getDecals(m_camera_frustum, decals);
+		if (const OcclusionBuffer* occlusion_buffer = getOcclusionBuffer())
+		{
+			int occluded_count = 0;
+			for (int i = decals.size() - 1; i >= 0; --i)
+			{
+				if (!occlusion_buffer->isOccluded(Sphere(decals[i].position, decals[i].radius))) continue;
+				decals.eraseFast(i);
+				++occluded_count;
+			}
+			PROFILE_INT("occluded", occluded_count);
+		}
 
 		PROFILE_INT("decal count", decals.size());
 
@@ -1434,6 +1557,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
+	// sets up the view, geometry is rendered by renderShadowViews
 	void renderSpotLightShadowmap(Entity light)
 	{
 		newView("point_light", ~0ULL);
@@ -1467,10 +1591,13 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			0.5,  0.5, 0.5, 1.0);
 		s.matrices[0] = biasMatrix * (projection_matrix * view_matrix);
 
-		renderPointLightInfluencedGeometry(light);
+		Frustum frustum;
+		frustum.computePerspective(pos, -mtx.getZVector(), mtx.getYVector(), fov, 1, 0.01f, range);
+		queueShadowView(frustum);
 	}
 
 
+	// sets up a view for each of the four faces, geometry is rendered by renderShadowViews
 	void renderOmniLightShadowmap(Entity light)
 	{
 		Entity light_entity = m_scene->getPointLightEntity(light);
@@ -1500,26 +1627,18 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		shadowmap_info.light = light;
 		//setPointLightUniforms(light);
 
-		IAllocator& frame_allocator = m_renderer.getEngine().getLIFOAllocator();
-		for (int i = 0; i < 4; ++i)
-		{
-			newView("omnilight", 0xff);
-
-			bgfx::setViewClear(m_current_view->bgfx_id, BGFX_CLEAR_DEPTH, 0, 0.0f, 0);
-			bgfx::touch(m_current_view->bgfx_id);
-			u16 view_x = u16(shadowmap_width * viewports[i * 2]);
-			u16 view_y = u16(shadowmap_height * viewports[i * 2 + 1]);
-			bgfx::setViewRect(
-				m_current_view->bgfx_id, view_x, view_y, shadowmap_width >> 1, shadowmap_height >> 1);
+		float fovx = Math::degreesToRadians(143.98570868f + 3.51f);
+		float fovy = Math::degreesToRadians(125.26438968f + 9.85f);
+		float aspect = tanf(fovx * 0.5f) / tanf(fovy * 0.5f);
 
-			float fovx = Math::degreesToRadians(143.98570868f + 3.51f);
-			float fovy = Math::degreesToRadians(125.26438968f + 9.85f);
-			float aspect = tanf(fovx * 0.5f) / tanf(fovy * 0.5f);
-
-			Matrix projection_matrix;
-			projection_matrix.setPerspective(fovx, aspect, 0.01f, range, bgfx::getCaps()->homogeneousDepth, true);
+		Matrix projection_matrix;
+		projection_matrix.setPerspective(fovx, aspect, 0.01f, range, bgfx::getCaps()->homogeneousDepth, true);
 
-			Matrix view_matrix;
+		Matrix view_matrices[4];
+		Frustum frusta[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			Matrix& view_matrix = view_matrices[i];
 			if (bgfx::getCaps()->originBottomLeft)
 			{
 				view_matrix.fromEuler(YPR_gl[i][0], YPR_gl[i][1], YPR_gl[i][2]);
@@ -1529,8 +1648,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 				view_matrix.fromEuler(YPR[i][0], YPR[i][1], YPR[i][2]);
 			}
 			view_matrix.setTranslation(light_pos);
-			Frustum frustum;
-			frustum.computePerspective(light_pos,
+			frusta[i].computePerspective(light_pos,
 				-view_matrix.getZVector(),
 				view_matrix.getYVector(),
 				fovx,
@@ -1540,29 +1658,34 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 
 			view_matrix.fastInverse();
 
-			bgfx::setViewTransform(m_current_view->bgfx_id, &view_matrix.m11, &projection_matrix.m11);
-
 			float ymul = bgfx::getCaps()->originBottomLeft ? 0.5f : -0.5f;
 			static const Matrix biasMatrix(
 				0.5, 0.0, 0.0, 0.0, 0.0, ymul, 0.0, 0.0, 0.0, 0.0, 0.5, 0.0, 0.5, 0.5, 0.5, 1.0);
 			shadowmap_info.matrices[i] = biasMatrix * (projection_matrix * view_matrix);
+		}
 
-			Array<MeshInstance> tmp_meshes(frame_allocator);
-			m_is_current_light_global = false;
-			Vec3 lod_ref_point = m_scene->getUniverse().getPosition(m_applied_camera);
-			m_scene->getPointLightInfluencedGeometry(light
-				, m_applied_camera
-				, lod_ref_point
-				, frustum
-				, tmp_meshes);
+		m_is_current_light_global = false;
+		for (int i = 0; i < 4; ++i)
+		{
+			newView("omnilight", 0xff);
+
+			bgfx::setViewClear(m_current_view->bgfx_id, BGFX_CLEAR_DEPTH, 0, 0.0f, 0);
+			bgfx::touch(m_current_view->bgfx_id);
+			u16 view_x = u16(shadowmap_width * viewports[i * 2]);
+			u16 view_y = u16(shadowmap_height * viewports[i * 2 + 1]);
+			bgfx::setViewRect(
+				m_current_view->bgfx_id, view_x, view_y, shadowmap_width >> 1, shadowmap_height >> 1);
+			bgfx::setViewTransform(m_current_view->bgfx_id, &view_matrices[i].m11, &projection_matrix.m11);
 
-			renderMeshes(tmp_meshes, false);
+			queueShadowView(frusta[i]);
 		}
 	}
 
 
+	// views of all lights are culled in one pass and recorded in one job batch
 	void renderLocalLightShadowmaps(Entity camera, FrameBuffer** fbs, int framebuffers_count)
 	{
+		PROFILE_FUNCTION();
 		if (!camera.isValid()) return;
 
 		Universe& universe = m_scene->getUniverse();
@@ -1590,6 +1713,99 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			}
 			++fb_index;
 		}
+		renderShadowViews();
+	}
+
+
+	// the view is culled and recorded in the next renderShadowViews, with the current view's state
+	void queueShadowView(const Frustum& frustum)
+	{
+		if (m_shadow_views_count == MAX_SHADOW_VIEWS)
+		{
+			g_log_error.log("Renderer") << "Too many shadow views";
+			return;
+		}
+		m_shadow_view_frusta[m_shadow_views_count] = frustum;
+		m_shadow_view_layer_masks[m_shadow_views_count] = m_current_view->layer_mask;
+		m_shadow_view_indices[m_shadow_views_count] = m_view_idx;
+		++m_shadow_views_count;
+	}
+
+
+	static void renderShadowViewJob(void* data)
+	{
+		ShadowViewJob* job = (ShadowViewJob*)data;
+		PipelineImpl* pipeline = job->pipeline;
+		PROFILE_BLOCK("Shadow View Job");
+		PROFILE_INT("view", pipeline->m_views[job->view_idx].bgfx_id);
+		u64 start = pipeline->m_timer->getRawTimeSinceStart();
+		s_recorded_view_idx = job->view_idx;
+		pipeline->renderMeshes(*job->meshes);
+		s_recorded_view_idx = -1;
+		job->duration = pipeline->m_timer->getRawTimeSinceStart() - start;
+	}
+
+
+	// all queued views are culled in one pass, then each chunk of each view is recorded by a job of one batch,
+	// every job on its own encoder; CPU time of the views is in the stats
+	void renderShadowViews()
+	{
+		PROFILE_FUNCTION();
+		int count = m_shadow_views_count;
+		m_shadow_views_count = 0;
+		if (count == 0 || !m_applied_camera.isValid()) return;
+
+		Vec3 lod_ref_point = m_scene->getUniverse().getPosition(m_applied_camera);
+		const Array<Array<MeshInstance>>* views_meshes = m_scene->getModelInstanceInfos(
+			m_shadow_view_frusta, m_shadow_view_layer_masks, count, lod_ref_point, m_applied_camera);
+
+		m_shadow_view_jobs.clear();
+		for (int i = 0; i < count; ++i)
+		{
+			int stats_idx = -1;
+			if (m_stats.shadow_view_count < lengthOf(m_stats.shadow_views))
+			{
+				stats_idx = m_stats.shadow_view_count;
+				++m_stats.shadow_view_count;
+				ShadowViewStats& view_stats = m_stats.shadow_views[stats_idx];
+				view_stats.bgfx_view_id = m_views[m_shadow_view_indices[i]].bgfx_id;
+				view_stats.mesh_count = 0;
+				view_stats.cpu_time = 0;
+			}
+			for (const Array<MeshInstance>& meshes : views_meshes[i])
+			{
+				if (meshes.empty()) continue;
+				ShadowViewJob& job = m_shadow_view_jobs.emplace();
+				job.pipeline = this;
+				job.meshes = &meshes;
+				job.view_idx = m_shadow_view_indices[i];
+				job.stats_idx = stats_idx;
+				job.duration = 0;
+			}
+		}
+		if (m_shadow_view_jobs.empty()) return;
+
+		m_shadow_view_job_decls.resize(m_shadow_view_jobs.size());
+		for (int i = 0; i < m_shadow_view_jobs.size(); ++i)
+		{
+			m_shadow_view_job_decls[i].data = &m_shadow_view_jobs[i];
+			m_shadow_view_job_decls[i].task = &renderShadowViewJob;
+		}
+		bool was_rendering_in_shadowmap = m_is_rendering_in_shadowmap;
+		m_is_rendering_in_shadowmap = true;
+		volatile int counter = 0;
+		JobSystem::runJobs(&m_shadow_view_job_decls[0], m_shadow_view_job_decls.size(), &counter);
+		JobSystem::wait(&counter);
+		m_is_rendering_in_shadowmap = was_rendering_in_shadowmap;
+
+		float frequency = (float)m_timer->getFrequency();
+		for (const ShadowViewJob& job : m_shadow_view_jobs)
+		{
+			if (job.stats_idx < 0) continue;
+			ShadowViewStats& view_stats = m_stats.shadow_views[job.stats_idx];
+			view_stats.mesh_count += job.meshes->size();
+			view_stats.cpu_time += job.duration / frequency;
+		}
 	}
 
 
@@ -1640,34 +1856,19 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderShadowmap(int split_index)
+	void computeShadowmapCascade(int split_index,
+		Entity light,
+		const Matrix& light_mtx,
+		float shadowmap_width,
+		Frustum* shadow_camera_frustum,
+		Matrix* view_matrix,
+		Matrix* projection_matrix)
 	{
-		if (!m_current_view) return;
 		Universe& universe = m_scene->getUniverse();
-		Entity light = m_scene->getActiveGlobalLight();
-		if (!light.isValid() || !m_applied_camera.isValid()) return;
-		float camera_height = m_scene->getCameraScreenHeight(m_applied_camera);
-		if (!camera_height) return;
-
-		Matrix light_mtx = universe.getMatrix(light);
-		m_global_light_shadowmap = m_current_framebuffer;
-		float shadowmap_height = (float)m_current_framebuffer->getHeight();
-		float shadowmap_width = (float)m_current_framebuffer->getWidth();
-		float viewports[] = { 0, 0, 0.5f, 0, 0, 0.5f, 0.5f, 0.5f };
-		float viewports_gl[] = { 0, 0.5f, 0.5f, 0.5f, 0, 0, 0.5f, 0};
 		float camera_fov = m_scene->getCameraFOV(m_applied_camera);
-		float camera_ratio = m_scene->getCameraScreenWidth(m_applied_camera) / camera_height;
+		float camera_ratio = m_scene->getCameraScreenWidth(m_applied_camera) / m_scene->getCameraScreenHeight(m_applied_camera);
 		Vec4 cascades = m_scene->getShadowmapCascades(light);
 		float split_distances[] = {0.1f, cascades.x, cascades.y, cascades.z, cascades.w};
-		m_is_rendering_in_shadowmap = true;
-		bgfx::setViewClear(m_current_view->bgfx_id, BGFX_CLEAR_DEPTH | BGFX_CLEAR_COLOR, 0xffffffff, 0, 0);
-		bgfx::touch(m_current_view->bgfx_id);
-		float* viewport = (bgfx::getCaps()->originBottomLeft ? viewports_gl : viewports) + split_index * 2;
-		bgfx::setViewRect(m_current_view->bgfx_id,
-			(u16)(1 + shadowmap_width * viewport[0]),
-			(u16)(1 + shadowmap_height * viewport[1]),
-			(u16)(0.5f * shadowmap_width - 2),
-			(u16)(0.5f * shadowmap_height - 2));
 
 		Frustum camera_frustum;
 		Matrix camera_matrix = universe.getMatrix(m_applied_camera);
@@ -1684,12 +1885,84 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		float bb_size = frustum_bounding_sphere.radius;
 		shadow_cam_pos = shadowmapTexelAlign(shadow_cam_pos, 0.5f * shadowmap_width - 2, bb_size, light_mtx);
 
-		Matrix projection_matrix;
-		projection_matrix.setOrtho(-bb_size, bb_size, -bb_size, bb_size, SHADOW_CAM_NEAR, SHADOW_CAM_FAR, bgfx::getCaps()->homogeneousDepth, true);
+		projection_matrix->setOrtho(-bb_size, bb_size, -bb_size, bb_size, SHADOW_CAM_NEAR, SHADOW_CAM_FAR, bgfx::getCaps()->homogeneousDepth, true);
 		Vec3 light_forward = light_mtx.getZVector();
 		shadow_cam_pos -= light_forward * SHADOW_CAM_FAR * 0.5f;
+		view_matrix->lookAt(shadow_cam_pos, shadow_cam_pos + light_forward, light_mtx.getYVector());
+
+		shadow_camera_frustum->computeOrtho(
+			shadow_cam_pos, -light_forward, light_mtx.getYVector(), bb_size, bb_size, SHADOW_CAM_NEAR, SHADOW_CAM_FAR);
+
+		findExtraShadowcasterPlanes(light_forward, camera_frustum, camera_matrix.getTranslation(), shadow_camera_frustum);
+	}
+
+
+	// all cascades are culled in one pass when the first of them is rendered
+	void cullShadowmapCascades(Entity light, const Matrix& light_mtx, float shadowmap_width, u64 layer_mask)
+	{
+		Frustum frusta[SHADOWMAP_CASCADES_COUNT];
+		u64 layer_masks[SHADOWMAP_CASCADES_COUNT];
+		for (int i = 0; i < SHADOWMAP_CASCADES_COUNT; ++i)
+		{
+			Matrix view_matrix;
+			Matrix projection_matrix;
+			computeShadowmapCascade(i, light, light_mtx, shadowmap_width, &frusta[i], &view_matrix, &projection_matrix);
+			layer_masks[i] = layer_mask;
+		}
+		Vec3 lod_ref_point = m_scene->getUniverse().getPosition(m_applied_camera);
+		const Array<Array<MeshInstance>>* views_meshes = m_scene->getModelInstanceInfos(
+			frusta, layer_masks, SHADOWMAP_CASCADES_COUNT, lod_ref_point, m_applied_camera);
+
+		// the scene reuses its lists for the next culling, so the cascades are copied
+		while (m_shadow_cascades_meshes.size() < SHADOWMAP_CASCADES_COUNT) m_shadow_cascades_meshes.emplace(m_allocator);
+		for (int i = 0; i < SHADOWMAP_CASCADES_COUNT; ++i)
+		{
+			const Array<Array<MeshInstance>>& src = views_meshes[i];
+			Array<Array<MeshInstance>>& dst = m_shadow_cascades_meshes[i];
+			while (dst.size() < src.size()) dst.emplace(m_allocator);
+			while (dst.size() > src.size()) dst.pop();
+			for (int j = 0; j < src.size(); ++j)
+			{
+				dst[j].resize(src[j].size());
+				if (!src[j].empty()) copyMemory(&dst[j][0], &src[j][0], src[j].size() * sizeof(MeshInstance));
+			}
+		}
+		m_shadow_cascades_frame = m_frame_index;
+		m_shadow_cascades_light = light;
+		m_shadow_cascades_camera = m_applied_camera;
+		m_shadow_cascades_layer_mask = layer_mask;
+	}
+
+
+	// sets up the current view for the cascade
+	bool beginShadowmapCascade(int split_index, Frustum* shadow_camera_frustum)
+	{
+		if (!m_current_view) return false;
+		Universe& universe = m_scene->getUniverse();
+		Entity light = m_scene->getActiveGlobalLight();
+		if (!light.isValid() || !m_applied_camera.isValid()) return false;
+		float camera_height = m_scene->getCameraScreenHeight(m_applied_camera);
+		if (!camera_height) return false;
+
+		Matrix light_mtx = universe.getMatrix(light);
+		m_global_light_shadowmap = m_current_framebuffer;
+		float shadowmap_height = (float)m_current_framebuffer->getHeight();
+		float shadowmap_width = (float)m_current_framebuffer->getWidth();
+		float viewports[] = { 0, 0, 0.5f, 0, 0, 0.5f, 0.5f, 0.5f };
+		float viewports_gl[] = { 0, 0.5f, 0.5f, 0.5f, 0, 0, 0.5f, 0};
+		bgfx::setViewClear(m_current_view->bgfx_id, BGFX_CLEAR_DEPTH | BGFX_CLEAR_COLOR, 0xffffffff, 0, 0);
+		bgfx::touch(m_current_view->bgfx_id);
+		float* viewport = (bgfx::getCaps()->originBottomLeft ? viewports_gl : viewports) + split_index * 2;
+		bgfx::setViewRect(m_current_view->bgfx_id,
+			(u16)(1 + shadowmap_width * viewport[0]),
+			(u16)(1 + shadowmap_height * viewport[1]),
+			(u16)(0.5f * shadowmap_width - 2),
+			(u16)(0.5f * shadowmap_height - 2));
+
 		Matrix view_matrix;
-		view_matrix.lookAt(shadow_cam_pos, shadow_cam_pos + light_forward, light_mtx.getYVector());
+		Matrix projection_matrix;
+		computeShadowmapCascade(
+			split_index, light, light_mtx, shadowmap_width, shadow_camera_frustum, &view_matrix, &projection_matrix);
 		bgfx::setViewTransform(m_current_view->bgfx_id, &view_matrix.m11, &projection_matrix.m11);
 		float ymul = bgfx::getCaps()->originBottomLeft ? 0.5f : -0.5f;
 		static const Matrix biasMatrix(
@@ -1698,19 +1971,69 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			0.0, 0.0, 0.5, 0.0, 
 			0.5, 0.5, 0.5, 1.0);
 		m_shadow_viewprojection[split_index] = biasMatrix * (projection_matrix * view_matrix);
+		return true;
+	}
 
-		Frustum shadow_camera_frustum;
-		shadow_camera_frustum.computeOrtho(
-			shadow_cam_pos, -light_forward, light_mtx.getYVector(), bb_size, bb_size, SHADOW_CAM_NEAR, SHADOW_CAM_FAR);
 
-		findExtraShadowcasterPlanes(light_forward, camera_frustum, camera_matrix.getTranslation(), &shadow_camera_frustum);
+	void renderShadowmap(int split_index)
+	{
+		Frustum shadow_camera_frustum;
+		if (!beginShadowmapCascade(split_index, &shadow_camera_frustum)) return;
 
-		renderAll(shadow_camera_frustum, false, m_applied_camera, m_current_view->layer_mask, false);
+		m_is_rendering_in_shadowmap = true;
+		u64 layer_mask = m_current_view->layer_mask;
+		Entity light = m_scene->getActiveGlobalLight();
+		bool is_cached = split_index != 0 && m_shadow_cascades_frame == m_frame_index &&
+						 m_shadow_cascades_light == light && m_shadow_cascades_camera == m_applied_camera &&
+						 m_shadow_cascades_layer_mask == layer_mask;
+		if (!is_cached)
+		{
+			Matrix light_mtx = m_scene->getUniverse().getMatrix(light);
+			cullShadowmapCascades(light, light_mtx, (float)m_current_framebuffer->getWidth(), layer_mask);
+		}
+		renderAll(shadow_camera_frustum, false, m_applied_camera, layer_mask, false, &m_shadow_cascades_meshes[split_index]);
 
 		m_is_rendering_in_shadowmap = false;
 	}
 
 
+	// renders all cascades, the current view is used for the first one and copied for the rest; unlike
+	// renderShadowmap, the cascades' meshes are recorded in one job batch
+	void renderShadowmapCascades()
+	{
+		PROFILE_FUNCTION();
+		if (!m_current_view) return;
+
+		Vec3 lod_ref_point = m_applied_camera.isValid() ? m_scene->getUniverse().getPosition(m_applied_camera) : Vec3(0, 0, 0);
+		View template_view = *m_current_view;
+		for (int i = 0; i < SHADOWMAP_CASCADES_COUNT; ++i)
+		{
+			if (i > 0)
+			{
+				newView("shadowmap_cascade", template_view.layer_mask);
+				m_current_view->render_state = template_view.render_state;
+				m_current_view->stencil = template_view.stencil;
+				m_current_view->pass_idx = template_view.pass_idx;
+				copyMemory(m_current_view->command_buffer.buffer,
+					template_view.command_buffer.buffer,
+					sizeof(template_view.command_buffer.buffer));
+				m_current_view->command_buffer.pointer =
+					m_current_view->command_buffer.buffer + template_view.command_buffer.getSize();
+			}
+			Frustum frustum;
+			if (!beginShadowmapCascade(i, &frustum)) break;
+
+			m_terrains_buffer.clear();
+			m_scene->getTerrainInfos(frustum, lod_ref_point, m_terrains_buffer);
+			m_is_rendering_in_shadowmap = true;
+			renderTerrains(m_terrains_buffer);
+			m_is_rendering_in_shadowmap = false;
+			queueShadowView(frustum);
+		}
+		renderShadowViews();
+	}
+
+
 	void renderDebugShapes()
 	{
 		if (!bgfx::isValid(m_debug_index_buffer))
@@ -2054,17 +2377,6 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderPointLightInfluencedGeometry(Entity light)
-	{
-		PROFILE_FUNCTION();
-
-		Array<MeshInstance> tmp_meshes(m_renderer.getEngine().getLIFOAllocator());
-		Vec3 lod_ref_point = m_scene->getUniverse().getPosition(m_applied_camera);
-		m_scene->getPointLightInfluencedGeometry(light, m_applied_camera, lod_ref_point, tmp_meshes);
-		renderMeshes(tmp_meshes, false);
-	}
-
-
 	void renderPointLightInfluencedGeometry(const Frustum& frustum)
 	{
 		PROFILE_FUNCTION();
@@ -2086,7 +2398,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 					, lod_ref_point
 					, frustum
 					, tmp_meshes);
-				renderMeshes(tmp_meshes, false);
+				renderMeshes(tmp_meshes);
 			}
 
 			{
@@ -2251,7 +2563,13 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderAll(const Frustum& frustum, bool render_grass, Entity camera, u64 layer_mask, bool use_occlusion_culling)
+	// culled_meshes are used instead of culling the frustum if they are not null
+	void renderAll(const Frustum& frustum,
+		bool render_grass,
+		Entity camera,
+		u64 layer_mask,
+		bool use_occlusion_culling,
+		Array<Array<MeshInstance>>* culled_meshes)
 	{
 		PROFILE_FUNCTION();
 
@@ -2265,32 +2583,55 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 
 		JobSystem::JobDecl jobs[3];
 		JobSystem::LambdaJob job_storage[3];
-		JobSystem::fromLambda([this, &frustum, &lod_ref_point, layer_mask, camera]() {
-			m_mesh_buffer = &m_scene->getModelInstanceInfos(frustum, lod_ref_point, camera, layer_mask);
-		}, &job_storage[0], &jobs[0], nullptr);
-
+		int jobs_count = 0;
 		JobSystem::fromLambda([this, &frustum, &lod_ref_point]() {
 			m_scene->getTerrainInfos(frustum, lod_ref_point, m_terrains_buffer);
-		}, &job_storage[1], &jobs[1], nullptr);
+		}, &job_storage[jobs_count], &jobs[jobs_count], nullptr);
+		++jobs_count;
+
+		if (culled_meshes)
+		{
+			m_mesh_buffer = culled_meshes;
+		}
+		else
+		{
+			const OcclusionBuffer* occlusion_buffer = use_occlusion_culling ? getOcclusionBuffer() : nullptr;
+			JobSystem::fromLambda([this, &frustum, &lod_ref_point, layer_mask, camera, occlusion_buffer]() {
+				m_mesh_buffer = occlusion_buffer
+					? &m_scene->getModelInstanceInfos(frustum, *occlusion_buffer, lod_ref_point, camera, layer_mask)
+					: &m_scene->getModelInstanceInfos(frustum, lod_ref_point, camera, layer_mask);
+			}, &job_storage[jobs_count], &jobs[jobs_count], nullptr);
+			++jobs_count;
+		}
 
 		if (render_grass)
 		{
 			JobSystem::fromLambda([this, &frustum]() {
 				m_scene->getGrassInfos(frustum, m_applied_camera, m_grasses_buffer);
-			}, &job_storage[2], &jobs[2], nullptr);
+			}, &job_storage[jobs_count], &jobs[jobs_count], nullptr);
+			++jobs_count;
 		}
 
 		volatile int counter = 0;
-		JobSystem::runJobs(jobs, render_grass ? 3 : 2, &counter);
+		JobSystem::runJobs(jobs, jobs_count, &counter);
 		JobSystem::wait(&counter);
 		
 		renderTerrains(m_terrains_buffer);
-		renderMeshes(*m_mesh_buffer, use_occlusion_culling);
+		renderMeshes(*m_mesh_buffer);
 		
 		if(render_grass) renderGrasses(m_grasses_buffer);
 	}
 
 
+	// occlusion buffer is valid only for the camera it was rasterized for
+	const OcclusionBuffer* getOcclusionBuffer() const
+	{
+		if (!m_occlusion_camera.isValid() || m_occlusion_camera != m_applied_camera) return nullptr;
+		return &m_occlusion_buffer;
+	}
+
+
+	// meshes flagged as occluders and meshes big enough on the screen are rasterized
 	void rasterizeOccluders(u64 layer_mask)
 	{
 		PROFILE_FUNCTION();
@@ -2306,25 +2647,47 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		Matrix projection = m_scene->getCameraProjection(m_applied_camera);
 		Matrix view = universe->getMatrix(m_applied_camera);
 		view.fastInverse();
-		m_occlusion_buffer.setCamera(view, projection);
+		m_occlusion_buffer.setCamera(view, projection, bgfx::getCaps()->homogeneousDepth);
+		const ModelInstance* model_instances = m_scene->getModelInstances();
 		for (auto& meshes : *m_mesh_buffer)
 		{
-			m_occlusion_buffer.rasterize(universe, meshes);
+			for (const MeshInstance& mesh : meshes)
+			{
+				if (mesh.mesh->type != Mesh::RIGID && mesh.mesh->type != Mesh::RIGID_INSTANCED) continue;
+
+				const ModelInstance& model_instance = model_instances[mesh.owner.index];
+				if (!model_instance.flags.isSet(ModelInstance::OCCLUDER))
+				{
+					float radius = model_instance.model->getBoundingRadius() * universe->getScale(mesh.owner);
+					Sphere sphere(model_instance.matrix.getTranslation(), radius);
+					if (m_occlusion_buffer.getScreenSize(sphere) < m_occluder_screen_size) continue;
+				}
+				m_occlusion_buffer.addOccluder(model_instance.matrix, *mesh.mesh);
+			}
 		}
+		m_occlusion_buffer.rasterize();
 		m_occlusion_buffer.buildHierarchy();
+		m_occlusion_camera = m_applied_camera;
 	}
 
 
+	void setOccluderScreenSize(float size)
+	{
+		m_occluder_screen_size = size;
+	}
+
 
 	void debugOcclusionBuffer()
 	{
-		static bgfx::TextureHandle texture = bgfx::createTexture2D(384, 192, false, 1, bgfx::TextureFormat::RGBA8, 0);
-		auto mem = bgfx::copy(m_occlusion_buffer.getMip(0), 384 * 192 * 4);
-		bgfx::updateTexture2D(texture, 0, 0, 0, 0, 384, 192, mem, 384 * 4);
+		u16 width = (u16)m_occlusion_buffer.getWidth();
+		u16 height = (u16)m_occlusion_buffer.getHeight();
+		static bgfx::TextureHandle texture = bgfx::createTexture2D(width, height, false, 1, bgfx::TextureFormat::R32F, 0);
+		auto mem = bgfx::copy(m_occlusion_buffer.getMip(0), width * height * sizeof(float));
+		bgfx::updateTexture2D(texture, 0, 0, 0, 0, width, height, mem, width * sizeof(float));
 
 		ImGui::Begin("Debug");
 		bgfx::setMarker("xx");
-		ImGui::Image(&texture, { 384, 192 });
+		ImGui::Image(&texture, { (float)width, (float)height });
 		ImGui::End();
 	}
 
@@ -2354,7 +2717,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			switch (mesh.type)
 			{
 				case Mesh::RIGID_INSTANCED:
-					renderRigidMeshInstanced(encoder, s_instance_data, mtx, mesh);
+					renderRigidMeshInstanced(encoder, s_instance_data, mtx, mesh, 0);
 					break;
 				case Mesh::RIGID:
 				{
@@ -2379,9 +2742,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	void renderSkinnedMesh(bgfx::Encoder* encoder, const Pose& pose, const Model& model, const Matrix& matrix, const Mesh& mesh)
 	{
 		Material* material = mesh.material;
-		auto& shader_instance = mesh.material->getShaderInstance();
-
-		material->setDefine(m_instanced_define_idx, false);
+		ShaderInstance& shader_instance = getMeshShaderInstance(*material, false);
 
 		Matrix bone_mtx[196];
 
@@ -2396,7 +2757,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			bone_mtx[bone_index] = (tmp * bone.inv_bind_transform).toMatrix();
 		}
 
-		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
+		int view_idx = getMeshViewIndex(material->getRenderLayer());
 		ASSERT(view_idx >= 0);
 		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
 
@@ -2422,10 +2783,8 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	{
 		Material* material = mesh.material;
 
-		material->setDefine(m_instanced_define_idx, true);
-
 		int layers_count = material->getLayersCount();
-		auto& shader_instance = mesh.material->getShaderInstance();
+		ShaderInstance& shader_instance = getMeshShaderInstance(*material, true);
 
 		auto renderLayer = [&](View& view) {
 			executeCommandBuffer(encoder, material->getCommandBuffer(), material);
@@ -2442,7 +2801,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx));
 		};
 
-		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
+		int view_idx = getMeshViewIndex(material->getRenderLayer());
 		if (view_idx >= 0 && !m_is_rendering_in_shadowmap)
 		{
 			auto& view = m_views[view_idx];
@@ -2458,7 +2817,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		}
 
 		static const int default_layer = m_renderer.getLayer("default");
-		int default_view_idx = m_layer_to_view_map[default_layer];
+		int default_view_idx = getMeshViewIndex(default_layer);
 		if (default_view_idx < 0) return;
 		View& default_view = m_views[default_view_idx];
 		renderLayer(default_view);
@@ -2469,9 +2828,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	{
 		Material* material = mesh.material;
 
-		material->setDefine(m_instanced_define_idx, false);
-
-		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
+		int view_idx = getMeshViewIndex(material->getRenderLayer());
 		ASSERT(view_idx >= 0);
 		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
 
@@ -2483,11 +2840,13 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		encoder->setIndexBuffer(mesh.index_buffer_handle);
 		encoder->setStencil(view.stencil, BGFX_STENCIL_NONE);
 		encoder->setState(view.render_state | material->getRenderStates());
-		ShaderInstance& shader_instance = material->getShaderInstance();
+		ShaderInstance& shader_instance = getMeshShaderInstance(*material, false);
 		++m_stats.draw_call_count;
 		++m_stats.instance_count;
 		m_stats.triangle_count += mesh.indices_count / 3;
-		encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx), Math::floatFlip(*(u32*)&depth));
+		u32 depth_bits;
+		copyMemory(&depth_bits, &depth, sizeof(depth_bits));
+		encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx), Math::floatFlip(depth_bits));
 	}
 
 
@@ -2495,8 +2854,6 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	{
 		Material* material = mesh.material;
 
-		material->setDefine(m_instanced_define_idx, false);
-
 		Matrix bone_mtx[196];
 		Vec3* poss = pose.positions;
 		Quat* rots = pose.rotations;
@@ -2510,7 +2867,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		}
 
 		int layers_count = material->getLayersCount();
-		auto& shader_instance = mesh.material->getShaderInstance();
+		ShaderInstance& shader_instance = getMeshShaderInstance(*material, false);
 
 		auto renderLayer = [&](View& view) {
 			encoder->setUniform(m_bone_matrices_uniform, bone_mtx, pose.count);
@@ -2528,7 +2885,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 			encoder->submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx));
 		};
 
-		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
+		int view_idx = getMeshViewIndex(material->getRenderLayer());
 		if (view_idx >= 0 && !m_is_rendering_in_shadowmap)
 		{
 			auto& view = m_views[view_idx];
@@ -2544,7 +2901,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		}
 
 		static const int default_layer = m_renderer.getLayer("default");
-		int default_view_idx = m_layer_to_view_map[default_layer];
+		int default_view_idx = getMeshViewIndex(default_layer);
 		if (default_view_idx < 0) return;
 		View& default_view = m_views[default_view_idx];
 		renderLayer(default_view);
@@ -2665,7 +3022,12 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 
 
 	
-	LUMIX_FORCE_INLINE void renderRigidMeshInstanced(bgfx::Encoder* encoder, InstanceData& data, const Matrix& matrix, const Mesh& mesh)
+	// consecutive calls with the same mesh are batched to one draw call, depth of the first instance is used for sorting
+	LUMIX_FORCE_INLINE void renderRigidMeshInstanced(bgfx::Encoder* encoder,
+		InstanceData& data,
+		const Matrix& matrix,
+		const Mesh& mesh,
+		float depth)
 	{
 		if (data.mesh != &mesh)
 		{
@@ -2686,6 +3048,9 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 				data.offset = 0;
 			}
 			data.mesh = &mesh;
+			u32 depth_bits;
+			copyMemory(&depth_bits, &depth, sizeof(depth_bits));
+			data.depth = Math::floatFlip(depth_bits);
 		}
 		Matrix* mtcs = (Matrix*)data.buffer.data;
 		copyMemory(&mtcs[data.offset + data.instances_count], &matrix, sizeof(matrix));
@@ -2942,93 +3307,84 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderMeshes(const Array<MeshInstance>& meshes, bool use_occlusion_culling)
+	// part of a run of the same mesh (and so material) in the sorted list, and the shader has an instanced variant
+	bool isInstanceable(const Array<MeshInstance>& meshes, int index) const
+	{
+		const Mesh* mesh = meshes[index].mesh;
+		bool is_run = (index > 0 && meshes[index - 1].mesh == mesh) ||
+					  (index + 1 < meshes.size() && meshes[index + 1].mesh == mesh);
+		return is_run && mesh->material->hasDefine(m_instanced_define_idx);
+	}
+
+
+	void renderMeshes(const Array<MeshInstance>& meshes)
 	{
 		bgfx::Encoder* encoder = m_renderer.getEncoder();
 		PROFILE_FUNCTION();
-		int mesh_count = 0;
 		ModelInstance* model_instances = m_scene->getModelInstances();
-		if (use_occlusion_culling)
+		for (int i = 0, c = meshes.size(); i < c; ++i)
 		{
-			mesh_count += meshes.size();
-			for (auto& mesh : meshes)
+			const MeshInstance& mesh = meshes[i];
+			ModelInstance& model_instance = model_instances[mesh.owner.index];
+			switch (mesh.mesh->type)
 			{
-				ModelInstance& model_instance = model_instances[mesh.owner.index];
-				switch (mesh.mesh->type)
+			case Mesh::RIGID_INSTANCED:
+				renderRigidMeshInstanced(encoder, s_instance_data, model_instance.matrix, *mesh.mesh, 0);
+				break;
+			case Mesh::RIGID:
+				if (isInstanceable(meshes, i))
 				{
-				case Mesh::RIGID_INSTANCED:
-					if (m_occlusion_buffer.isOccluded(model_instance.matrix, model_instance.model->getAABB())) break;
-					renderRigidMeshInstanced(encoder, s_instance_data, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::RIGID:
-					renderRigidMesh(encoder, model_instance.matrix, *mesh.mesh, mesh.depth);
-					break;
-				case Mesh::SKINNED:
-					renderSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::MULTILAYER_SKINNED:
-					renderMultilayerSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::MULTILAYER_RIGID:
-					renderMultilayerRigidMesh(encoder, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
+					renderRigidMeshInstanced(encoder, s_instance_data, model_instance.matrix, *mesh.mesh, mesh.depth);
 				}
-			}
-		}
-		else
-		{
-			mesh_count += meshes.size();
-			for (auto& mesh : meshes)
-			{
-				ModelInstance& model_instance = model_instances[mesh.owner.index];
-				switch (mesh.mesh->type)
+				else
 				{
-				case Mesh::RIGID_INSTANCED:
-					renderRigidMeshInstanced(encoder, s_instance_data, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::RIGID:
 					renderRigidMesh(encoder, model_instance.matrix, *mesh.mesh, mesh.depth);
-					break;
-				case Mesh::SKINNED:
-					renderSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::MULTILAYER_SKINNED:
-					renderMultilayerSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
-				case Mesh::MULTILAYER_RIGID:
+				}
+				break;
+			case Mesh::SKINNED:
+				renderSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
+				break;
+			case Mesh::MULTILAYER_SKINNED:
+				renderMultilayerSkinnedMesh(encoder, *model_instance.pose, *model_instance.model, model_instance.matrix, *mesh.mesh);
+				break;
+			case Mesh::MULTILAYER_RIGID:
+				if (isInstanceable(meshes, i))
+				{
+					renderRigidMeshInstanced(encoder, s_instance_data, model_instance.matrix, *mesh.mesh, 0);
+				}
+				else
+				{
 					renderMultilayerRigidMesh(encoder, *model_instance.model, model_instance.matrix, *mesh.mesh);
-					break;
 				}
+				break;
 			}
 		}
 		finishInstances(encoder);
 		s_instance_data.buffer.data = nullptr;
 		s_instance_data.instances_count = 0;
 		s_instance_data.offset = 0;
-		PROFILE_INT("mesh count", mesh_count);
+		PROFILE_INT("mesh count", meshes.size());
 	}
 
 
-	void renderMeshes(const Array<Array<MeshInstance>>& meshes, bool use_occlusion_culling)
+	void renderMeshes(const Array<Array<MeshInstance>>& meshes)
 	{
 		PROFILE_FUNCTION();
 		struct Data
 		{
 			PipelineImpl* that;
 			const Array<MeshInstance>* meshes;
-			bool use_occlusion_culling;
 		} data[64];
 		JobSystem::JobDecl jobs[64];
 		volatile int counter = 0;
 		for (int i = 0; i < meshes.size(); ++i)
 		{
 			data[i].that = this;
-			data[i].use_occlusion_culling = use_occlusion_culling;
 			data[i].meshes = &meshes[i];
 			jobs[i].data = &data[i];
 			jobs[i].task = [](void* data) {
 				Data* job_data = (Data*)data;
-				job_data->that->renderMeshes(*job_data->meshes, job_data->use_occlusion_culling);
+				job_data->that->renderMeshes(*job_data->meshes);
 			};
 		}
 		JobSystem::runJobs(jobs, meshes.size(), &counter);
@@ -3086,7 +3442,9 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 
 		m_stats = {};
 		m_applied_camera = INVALID_ENTITY;
+		m_occlusion_camera = INVALID_ENTITY;
 		m_global_light_shadowmap = nullptr;
+		++m_frame_index;
 		m_current_view = nullptr;
 		m_view_idx = -1;
 		m_layer_mask = 0;
@@ -3268,10 +3626,24 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	Frustum m_camera_frustum;
 
 	Array<Array<MeshInstance>>* m_mesh_buffer;
+	u32 m_frame_index;
+	// per cascade, culled when the first cascade is rendered and reused by the rest in the same frame
+	Array<Array<Array<MeshInstance>>> m_shadow_cascades_meshes;
+	u32 m_shadow_cascades_frame;
+	Entity m_shadow_cascades_light;
+	Entity m_shadow_cascades_camera;
+	u64 m_shadow_cascades_layer_mask;
+	Frustum m_shadow_view_frusta[MAX_SHADOW_VIEWS];
+	u64 m_shadow_view_layer_masks[MAX_SHADOW_VIEWS];
+	int m_shadow_view_indices[MAX_SHADOW_VIEWS];
+	int m_shadow_views_count;
+	Array<ShadowViewJob> m_shadow_view_jobs;
+	Array<JobSystem::JobDecl> m_shadow_view_job_decls;
+	Timer* m_timer;
 	Array<TerrainInfo> m_terrains_buffer;
 	Array<GrassInfo> m_grasses_buffer;
 
-	Matrix m_shadow_viewprojection[4];
+	Matrix m_shadow_viewprojection[SHADOWMAP_CASCADES_COUNT];
 	int m_width;
 	int m_height;
 	string m_define;
@@ -3314,6 +3686,8 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	bgfx::DynamicVertexBufferHandle m_debug_vertex_buffers[32];
 	bgfx::DynamicIndexBufferHandle m_debug_index_buffer;
 	OcclusionBuffer m_occlusion_buffer;
+	Entity m_occlusion_camera;
+	float m_occluder_screen_size;
 	int m_debug_buffer_idx;
 	int m_has_shadowmap_define_idx;
 	int m_instanced_define_idx;
@@ -3455,7 +3829,7 @@ int renderModels(lua_State* L)
 
 	Entity cam = pipeline->m_applied_camera;
 
-	pipeline->renderAll(pipeline->m_camera_frustum, true, cam, pipeline->m_layer_mask, use_occlusion_culling);
+	pipeline->renderAll(pipeline->m_camera_frustum, true, cam, pipeline->m_layer_mask, use_occlusion_culling, nullptr);
 	pipeline->m_layer_mask = 0;
 	return 0;
 }
@@ -3573,6 +3947,7 @@ void Pipeline::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(render2D);
 	REGISTER_FUNCTION(rasterizeOccluders);
 	REGISTER_FUNCTION(debugOcclusionBuffer);
+	REGISTER_FUNCTION(setOccluderScreenSize);
 	REGISTER_FUNCTION(drawQuad);
 	REGISTER_FUNCTION(getLayerMask);
 	REGISTER_FUNCTION(drawQuadEx);
@@ -3603,6 +3978,7 @@ void Pipeline::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(clear);
 	REGISTER_FUNCTION(renderPointLightLitGeometry);
 	REGISTER_FUNCTION(renderShadowmap);
+	REGISTER_FUNCTION(renderShadowmapCascades);
 	REGISTER_FUNCTION(copyRenderbuffer);
 	REGISTER_FUNCTION(setActiveGlobalLightUniforms);
 	REGISTER_FUNCTION(setStencil);
@@ -68,11 +68,24 @@ struct CommandBufferGenerator
 class LUMIX_RENDERER_API Pipeline
 {
 	public:
+		static const int MAX_SHADOW_VIEWS = 64;
+
+		struct ShadowViewStats
+		{
+			int bgfx_view_id;
+			int mesh_count;
+			// seconds, summed over the jobs recording the view
+			float cpu_time;
+		};
+
 		struct Stats
 		{
 			int draw_call_count;
+			int instanced_draw_call_count;
 			int instance_count;
 			int triangle_count;
+			ShadowViewStats shadow_views[MAX_SHADOW_VIEWS];
+			int shadow_view_count;
 		};
 
 		struct CustomCommandHandler
@@ -12,10 +12,12 @@
 #include "engine/math_utils.h"
 #include "engine/plugin_manager.h"
 #include "engine/profiler.h"
+#include "engine/radix_sort.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/resource_manager_base.h"
 #include "engine/serializer.h"
+#include "engine/string.h"
 #include "engine/universe/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/culling_system.h"
@@ -24,15 +26,17 @@
 #include "renderer/material.h"
 #include "renderer/material_manager.h"
 #include "renderer/model.h"
+#include "renderer/occlusion_buffer.h"
 #include "renderer/particle_system.h"
 #include "renderer/pipeline.h"
 #include "renderer/pose.h"
 #include "renderer/renderer.h"
+#include "renderer/shader.h"
 #include "renderer/terrain.h"
 #include "renderer/texture.h"
 #include <cfloat>
 #include <cmath>
-#include <algorithm>
+#include <cstdlib>
 
 
 namespace Lumix
@@ -51,6 +55,7 @@ enum class RenderSceneVersion : int
 	POINT_LIGHT_NO_COMPONENT,
 	MODEL_INSTANCE_ENABLE,
 	ENVIRONMENT_PROBE_FLAGS,
+	MODEL_INSTANCE_RECORDS,
 
 	LATEST
 };
@@ -135,6 +140,29 @@ struct Camera
 };
 
 
+// LODs selected for a camera in its last culling pass, each camera keeps its own hysteresis state
+struct LODView
+{
+	explicit LODView(IAllocator& allocator) : lods(allocator) {}
+
+	Entity camera;
+	Array<i8> lods; // indexed by model instance entity index
+};
+
+
+// model instances are saved as an array of these, loaded with one copy;
+// paths of custom materials follow the array in the order of the instances
+struct ModelInstanceRecord
+{
+	Entity entity;
+	u32 model; // path hash, 0 without a model
+	u8 flags;
+	u8 materials_count;
+	u16 padding;
+};
+static_assert(sizeof(ModelInstanceRecord) == 12, "ModelInstanceRecord must not have implicit padding");
+
+
 struct EnvironmentProbe
 {
 	enum Flags
@@ -258,9 +286,12 @@ public:
 
 	~RenderSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
-		m_universe.entityDestroyed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
+		m_universe.unsubscribeTransformed<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesDestroyed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntitiesDestroyed>(this);
 		CullingSystem::destroy(*m_culling_system);
+		CullingSystem::destroy(*m_light_culling_system);
+		CullingSystem::destroy(*m_decal_culling_system);
+		CullingSystem::destroy(*m_environment_probe_culling_system);
 	}
 
 
@@ -296,6 +327,7 @@ public:
 			if (decal.material) material_manager->unload(*decal.material);
 		}
 		m_decals.clear();
+		m_decal_culling_system->clear();
 
 		m_cameras.clear();
 
@@ -326,6 +358,9 @@ public:
 			}
 		}
 		m_model_instances.clear();
+		m_lod_views.clear();
+		for (int view : m_camera_culling_views) m_culling_system->destroyView(view);
+		m_camera_culling_views.clear();
 		m_culling_system->clear();
 
 		for (auto& probe : m_environment_probes)
@@ -335,6 +370,7 @@ public:
 			if (probe.irradiance) probe.irradiance->getResourceManager().unload(*probe.irradiance);
 		}
 		m_environment_probes.clear();
+		m_environment_probe_culling_system->clear();
 	}
 
 
@@ -733,6 +769,7 @@ public:
 		r.flags.set(ModelInstance::ENABLED);
 		r.meshes = nullptr;
 		r.mesh_count = 0;
+		resetLOD(entity);
 
 		r.matrix = m_universe.getMatrix(r.entity);
 
@@ -832,7 +869,6 @@ public:
 
 	void deserializePointLight(IDeserializer& serializer, Entity entity, int scene_version)
 	{
-		m_light_influenced_geometry.emplace(m_allocator);
 		PointLight& light = m_point_lights.emplace();
 		light.m_entity = entity;
 		serializer.read(&light.m_attenuation_param);
@@ -850,6 +886,7 @@ public:
 		serializer.read(&light.m_specular_color);
 		serializer.read(&light.m_specular_intensity);
 		m_point_lights_map.insert(light.m_entity, m_point_lights.size() - 1);
+		m_light_culling_system->addStatic(light.m_entity, getPointLightSphere(light), 1);
 
 		m_universe.onComponentCreated(light.m_entity, POINT_LIGHT_TYPE, this);
 	}
@@ -1166,6 +1203,7 @@ public:
 		auto* texture_manager = m_engine.getResourceManager().get(Texture::TYPE);
 		StaticString<MAX_PATH_LENGTH> probe_dir("universes/", m_universe.getName(), "/probes/");
 		EnvironmentProbe& probe = m_environment_probes.insert(entity);
+		m_environment_probe_culling_system->addStatic(entity, getEnvironmentProbeSphere(entity), 1);
 		serializer.read(&probe.guid);
 		if (scene_version > (int)RenderSceneVersion::ENVIRONMENT_PROBE_FLAGS)
 		{
@@ -1530,9 +1568,9 @@ public:
 	void serializeLights(OutputBlob& serializer)
 	{
 		serializer.write((i32)m_point_lights.size());
-		for (int i = 0, c = m_point_lights.size(); i < c; ++i)
+		if (!m_point_lights.empty())
 		{
-			serializer.write(m_point_lights[i]);
+			serializer.write(&m_point_lights[0], m_point_lights.size() * sizeof(m_point_lights[0]));
 		}
 
 		serializer.write((i32)m_global_lights.size());
@@ -1545,25 +1583,29 @@ public:
 
 	void serializeModelInstances(OutputBlob& serializer)
 	{
-		serializer.write((i32)m_model_instances.size());
-		for (auto& r : m_model_instances)
+		Array<ModelInstanceRecord> records(m_allocator);
+		records.resize(m_model_instances.size());
+		for (int i = 0, c = m_model_instances.size(); i < c; ++i)
 		{
-			serializer.write(r.entity);
-			serializer.write(u8(r.flags.base & ModelInstance::PERSISTENT_FLAGS));
-			if(r.entity != INVALID_ENTITY)
+			const ModelInstance& r = m_model_instances[i];
+			ModelInstanceRecord& record = records[i];
+			bool has_changed_materials = r.model && r.model->isReady() && r.meshes != &r.model->getMesh(0);
+			record.entity = r.entity;
+			record.flags = u8(r.flags.base & ModelInstance::PERSISTENT_FLAGS);
+			record.model = r.entity.isValid() && r.model ? r.model->getPath().getHash() : 0;
+			record.materials_count = r.entity.isValid() && has_changed_materials ? (u8)r.mesh_count : 0;
+			record.padding = 0;
+		}
+
+		serializer.write((i32)records.size());
+		if (!records.empty()) serializer.write(&records[0], records.size() * sizeof(records[0]));
+		for (int i = 0, c = records.size(); i < c; ++i)
+		{
+			const ModelInstance& r = m_model_instances[i];
+			for (int j = 0; j < records[i].materials_count; ++j)
 			{
-				serializer.write(r.model ? r.model->getPath().getHash() : 0);
-				bool has_changed_materials = r.model && r.model->isReady() && r.meshes != &r.model->getMesh(0);
-				serializer.write(has_changed_materials ? r.mesh_count : 0);
-				if (has_changed_materials)
-				{
-					for (int i = 0; i < r.mesh_count; ++i)
-					{
-						serializer.writeString(r.meshes[i].material->getPath().c_str());
-					}
-				}
+				serializer.writeString(r.meshes[j].material->getPath().c_str());
 			}
-			
 		}
 	}
 
@@ -1679,6 +1721,7 @@ public:
 			Entity entity;
 			serializer.read(entity);
 			EnvironmentProbe& probe = m_environment_probes.insert(entity);
+			m_environment_probe_culling_system->addStatic(entity, getEnvironmentProbeSphere(entity), 1);
 			serializer.read(probe.guid);
 			serializer.read(probe.flags.base);
 			serializer.read(probe.radiance_size);
@@ -1857,13 +1900,17 @@ public:
 	{
 		i32 size = 0;
 		serializer.read(size);
+		Array<ModelInstanceRecord> records(m_allocator);
+		records.resize(size);
+		if (size > 0) serializer.read(&records[0], size * sizeof(records[0]));
+
 		m_model_instances.reserve(size);
 		for (int i = 0; i < size; ++i)
 		{
+			const ModelInstanceRecord& record = records[i];
 			auto& r = m_model_instances.emplace();
-			serializer.read(r.entity);
-			serializer.read(r.flags);
-			r.flags.base &= ModelInstance::PERSISTENT_FLAGS;
+			r.entity = record.entity;
+			r.flags.base = record.flags & ModelInstance::PERSISTENT_FLAGS;
 			ASSERT(r.entity.index == i || !r.entity.isValid());
 			r.model = nullptr;
 			r.pose = nullptr;
@@ -1874,21 +1921,16 @@ public:
 			{
 				r.matrix = m_universe.getMatrix(r.entity);
 
-				u32 path;
-				serializer.read(path);
-
-				if (path != 0)
+				if (record.model != 0)
 				{
-					auto* model = static_cast<Model*>(m_engine.getResourceManager().get(Model::TYPE)->load(Path(path)));
+					auto* model = static_cast<Model*>(m_engine.getResourceManager().get(Model::TYPE)->load(Path(record.model)));
 					setModel(r.entity, model);
 				}
 
-				int material_count;
-				serializer.read(material_count);
-				if (material_count > 0)
+				if (record.materials_count > 0)
 				{
-					allocateCustomMeshes(r, material_count);
-					for (int j = 0; j < material_count; ++j)
+					allocateCustomMeshes(r, record.materials_count);
+					for (int j = 0; j < record.materials_count; ++j)
 					{
 						char path[MAX_PATH_LENGTH];
 						serializer.readString(path, lengthOf(path));
@@ -1906,12 +1948,12 @@ public:
 		i32 size = 0;
 		serializer.read(size);
 		m_point_lights.resize(size);
+		if (size > 0) serializer.read(&m_point_lights[0], size * sizeof(m_point_lights[0]));
 		for (int i = 0; i < size; ++i)
 		{
-			m_light_influenced_geometry.emplace(m_allocator);
-			PointLight& light = m_point_lights[i];
-			serializer.read(light);
+			const PointLight& light = m_point_lights[i];
 			m_point_lights_map.insert(light.m_entity, i);
+			m_light_culling_system->addStatic(light.m_entity, getPointLightSphere(light), 1);
 
 			m_universe.onComponentCreated(light.m_entity, POINT_LIGHT_TYPE, this);
 		}
@@ -1975,25 +2017,13 @@ public:
 		if (probe.irradiance) probe.irradiance->getResourceManager().unload(*probe.irradiance);
 		if (probe.radiance) probe.radiance->getResourceManager().unload(*probe.radiance);
 		m_environment_probes.erase(entity);
+		m_environment_probe_culling_system->removeStatic(entity);
 		m_universe.onComponentDestroyed(entity, ENVIRONMENT_PROBE_TYPE, this);
 	}
 
 
 	void destroyModelInstance(Entity entity)
 	{
-		for (int i = 0; i < m_light_influenced_geometry.size(); ++i)
-		{
-			Array<Entity>& influenced_geometry = m_light_influenced_geometry[i];
-			for (int j = 0; j < influenced_geometry.size(); ++j)
-			{
-				if (influenced_geometry[j] == entity)
-				{
-					influenced_geometry.erase(j);
-					break;
-				}
-			}
-		}
-
 		setModel(entity, nullptr);
 		auto& model_instance = m_model_instances[entity.index];
 		LUMIX_DELETE(m_allocator, model_instance.pose);
@@ -2018,6 +2048,7 @@ public:
 	void destroyDecal(Entity entity)
 	{
 		m_decals.erase(entity);
+		m_decal_culling_system->removeStatic(entity);
 		m_universe.onComponentDestroyed(entity, DECAL_TYPE, this);
 	}
 
@@ -2027,7 +2058,7 @@ public:
 		int index = m_point_lights_map[entity];
 		m_point_lights.eraseFast(index);
 		m_point_lights_map.erase(entity);
-		m_light_influenced_geometry.eraseFast(index);
+		m_light_culling_system->removeStatic(entity);
 		if (index < m_point_lights.size())
 		{
 			m_point_lights_map[{m_point_lights[index].m_entity.index}] = index;
@@ -2047,6 +2078,15 @@ public:
 
 	void destroyCamera(Entity entity)
 	{
+		for (int i = 0; i < m_lod_views.size(); ++i)
+		{
+			if (m_lod_views[i].camera == entity)
+			{
+				m_lod_views.eraseFast(i);
+				break;
+			}
+		}
+		setCameraVisibilityCache(entity, 0);
 		m_cameras.erase(entity);
 		m_universe.onComponentDestroyed(entity, CAMERA_TYPE, this);
 	}
@@ -2683,35 +2723,25 @@ public:
 	}
 
 
-	Frustum getPointLightFrustum(int light_idx) const
-	{
-		const PointLight& light = m_point_lights[light_idx];
-		Frustum frustum;
-		frustum.computeOrtho(m_universe.getPosition(light.m_entity),
-			Vec3(1, 0, 0),
-			Vec3(0, 1, 0),
-			light.m_range,
-			light.m_range,
-			-light.m_range,
-			light.m_range);
-
-		return frustum;
-	}
-
-
-	void onEntityDestroyed(Entity entity)
+	void onEntitiesDestroyed(const Entity* entities, int count)
 	{
+		// one pass for the whole batch, destroyed parents are not alive anymore
 		for (auto& i : m_bone_attachments)
 		{
-			if (i.parent_entity == entity)
+			if (i.parent_entity.isValid() && !m_universe.hasEntity(i.parent_entity))
 			{
 				i.parent_entity = INVALID_ENTITY;
-				break;
 			}
 		}
 	}
 
 
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		for (int i = 0; i < count; ++i) onEntityMoved(entities[i]);
+	}
+
+
 	void onEntityMoved(Entity entity)
 	{
 		int index = entity.index;
@@ -2727,26 +2757,6 @@ public:
 				Vec3 position = m_universe.getPosition(entity);
 				m_culling_system->updateBoundingSphere({position, radius}, entity);
 			}
-
-			float bounding_radius = r.model ? r.model->getBoundingRadius() : 1;
-			for (int light_idx = 0, c = m_point_lights.size(); light_idx < c; ++light_idx)
-			{
-				for (int j = 0, c2 = m_light_influenced_geometry[light_idx].size(); j < c2; ++j)
-				{
-					if(m_light_influenced_geometry[light_idx][j] == entity)
-					{
-						m_light_influenced_geometry[light_idx].eraseFast(j);
-						break;
-					}
-				}
-
-				Vec3 pos = m_universe.getPosition(r.entity);
-				Frustum frustum = getPointLightFrustum(light_idx);
-				if(frustum.isSphereInside(pos, bounding_radius))
-				{
-					m_light_influenced_geometry[light_idx].push(entity);
-				}
-			}
 		}
 
 		int decal_idx = m_decals.find(entity);
@@ -2755,13 +2765,15 @@ public:
 			updateDecalInfo(m_decals.at(decal_idx));
 		}
 
-		for (int i = 0, c = m_point_lights.size(); i < c; ++i)
+		auto light_iter = m_point_lights_map.find(entity);
+		if (light_iter.isValid())
 		{
-			if (m_point_lights[i].m_entity == entity)
-			{
-				detectLightInfluencedGeometry({ m_point_lights[i].m_entity.index });
-				break;
-			}
+			m_light_culling_system->updateBoundingSphere(getPointLightSphere(m_point_lights[light_iter.value()]), entity);
+		}
+
+		if (m_environment_probes.find(entity) >= 0)
+		{
+			m_environment_probe_culling_system->updateBoundingSphere(getEnvironmentProbeSphere(entity), entity);
 		}
 
 		bool was_updating = m_is_updating_attachments;
@@ -2877,11 +2889,14 @@ public:
 
 	void getDecals(const Frustum& frustum, Array<DecalInfo>& decals) override
 	{
-		decals.reserve(m_decals.size());
-		for (const Decal& decal : m_decals)
+		const CullingSystem::Results& results = m_decal_culling_system->cull(frustum, ~0ULL);
+		for (const CullingSystem::Subresults& subresults : results)
 		{
-			if (!decal.material || !decal.material->isReady()) continue;
-			if (frustum.isSphereInside(decal.position, decal.radius)) decals.push(decal);
+			for (Entity entity : subresults)
+			{
+				const Decal& decal = m_decals[entity];
+				if (decal.material && decal.material->isReady()) decals.push(decal);
+			}
 		}
 	}
 
@@ -2986,6 +3001,18 @@ public:
 	}
 
 
+	bool isModelInstanceOccluder(Entity entity) override
+	{
+		return m_model_instances[entity.index].flags.isSet(ModelInstance::OCCLUDER);
+	}
+
+
+	void setModelInstanceOccluder(Entity entity, bool is_occluder) override
+	{
+		m_model_instances[entity.index].flags.set(ModelInstance::OCCLUDER, is_occluder);
+	}
+
+
 	void enableModelInstance(Entity entity, bool enable) override
 	{
 		ModelInstance& model_instance = m_model_instances[entity.index];
@@ -3435,15 +3462,17 @@ public:
 
 	void getPointLights(const Frustum& frustum, Array<Entity>& lights) override
 	{
-		for (int i = 0, ci = m_point_lights.size(); i < ci; ++i)
+		PROFILE_FUNCTION();
+		int first = lights.size();
+		const CullingSystem::Results& results = m_light_culling_system->cull(frustum, ~0ULL);
+		for (const CullingSystem::Subresults& subresults : results)
 		{
-			PointLight& light = m_point_lights[i];
-
-			if (frustum.isSphereInside(m_universe.getPosition(light.m_entity), light.m_range))
+			for (Entity light : subresults)
 			{
-				lights.push(light.m_entity);
+				lights.push(light);
 			}
 		}
+		cullLitGeometry(frustum, lights.empty() ? nullptr : &lights[first], lights.size() - first);
 	}
 
 
@@ -3467,23 +3496,64 @@ public:
 	{
 		PROFILE_FUNCTION();
 
-		int light_index = m_point_lights_map[light];
 		float lod_multiplier = getCameraLODMultiplier(camera);
 		float final_lod_multiplier = m_lod_multiplier * lod_multiplier;
-		for (int j = 0, cj = m_light_influenced_geometry[light_index].size(); j < cj; ++j)
+		const i8* lods = getLODs(camera);
+		int count;
+		const Entity* entities = getPointLightInfluencedEntities(light, &count);
+		for (int i = 0; i < count; ++i)
 		{
-			Entity model_instance_entity = m_light_influenced_geometry[light_index][j];
+			Entity model_instance_entity = entities[i];
 			ModelInstance& model_instance = m_model_instances[model_instance_entity.index];
-			const Sphere& sphere = m_culling_system->getSphere(model_instance_entity);
-			float squared_distance = (model_instance.matrix.getTranslation() - lod_ref_point).squaredLength();
-			squared_distance *= final_lod_multiplier;
+			Sphere sphere = m_culling_system->getSphere(model_instance_entity);
+			if (!frustum.isSphereInside(sphere.position, sphere.radius)) continue;
 
-			if (frustum.isSphereInside(sphere.position, sphere.radius))
+			int lod_index = getLODIndex(model_instance, lods[model_instance_entity.index], lod_ref_point, final_lod_multiplier);
+			LODMeshIndices lod = model_instance.model->getLODMeshIndices(lod_index);
+			for (int k = lod.from, c = lod.to; k <= c; ++k)
 			{
-				LODMeshIndices lod = model_instance.model->getLODMeshIndices(squared_distance);
-				for (int k = lod.from, c = lod.to; k <= c; ++k)
+				auto& info = infos.emplace();
+				info.mesh = &model_instance.model->getMesh(k);
+				info.owner = model_instance_entity;
+			}
+		}
+	}
+
+
+	void getPointLightInfluencedGeometry(Entity light,
+		Entity camera,
+		const Vec3& lod_ref_point,
+		const Frustum* frusta,
+		int count,
+		Array<MeshInstance>* infos) override
+	{
+		PROFILE_FUNCTION();
+
+		float final_lod_multiplier = m_lod_multiplier * getCameraLODMultiplier(camera);
+		const i8* lods = getLODs(camera);
+		int entities_count;
+		const Entity* entities = getPointLightInfluencedEntities(light, &entities_count);
+		for (int j = 0; j < entities_count; ++j)
+		{
+			Entity model_instance_entity = entities[j];
+			ModelInstance& model_instance = m_model_instances[model_instance_entity.index];
+			Sphere sphere = m_culling_system->getSphere(model_instance_entity);
+			LODMeshIndices lod;
+			bool is_lod_selected = false;
+			for (int i = 0; i < count; ++i)
+			{
+				if (!frusta[i].isSphereInside(sphere.position, sphere.radius)) continue;
+
+				// all frusta share the reference point, so the LOD is selected once per instance
+				if (!is_lod_selected)
 				{
-					auto& info = infos.emplace();
+					int lod_index = getLODIndex(model_instance, lods[model_instance_entity.index], lod_ref_point, final_lod_multiplier);
+					lod = model_instance.model->getLODMeshIndices(lod_index);
+					is_lod_selected = true;
+				}
+				for (int k = lod.from; k <= lod.to; ++k)
+				{
+					auto& info = infos[i].emplace();
 					info.mesh = &model_instance.model->getMesh(k);
 					info.owner = model_instance_entity;
 				}
@@ -3499,21 +3569,22 @@ public:
 	{
 		PROFILE_FUNCTION();
 
-		int light_index = m_point_lights_map[light];
-		auto& geoms = m_light_influenced_geometry[light_index];
 		float lod_multiplier = getCameraLODMultiplier(camera);
 		float final_lod_multiplier = m_lod_multiplier * lod_multiplier;
-		for (int j = 0, cj = geoms.size(); j < cj; ++j)
+		const i8* lods = getLODs(camera);
+		int count;
+		const Entity* entities = getPointLightInfluencedEntities(light, &count);
+		for (int i = 0; i < count; ++i)
 		{
-			const ModelInstance& model_instance = m_model_instances[geoms[j].index];
-			float squared_distance = (model_instance.matrix.getTranslation() - lod_ref_point).squaredLength();
-			squared_distance *= final_lod_multiplier;
-			LODMeshIndices lod = model_instance.model->getLODMeshIndices(squared_distance);
+			Entity model_instance_entity = entities[i];
+			const ModelInstance& model_instance = m_model_instances[model_instance_entity.index];
+			int lod_index = getLODIndex(model_instance, lods[model_instance_entity.index], lod_ref_point, final_lod_multiplier);
+			LODMeshIndices lod = model_instance.model->getLODMeshIndices(lod_index);
 			for (int k = lod.from, kc = lod.to; k <= kc; ++k)
 			{
 				auto& info = infos.emplace();
 				info.mesh = &model_instance.model->getMesh(k);
-				info.owner = geoms[j];
+				info.owner = model_instance_entity;
 			}
 		}
 	}
@@ -3535,6 +3606,61 @@ public:
 	}
 
 
+	// LOD is selected by the size of the bounding sphere on the screen, lod_multiplier (camera FOV and the global
+	// quality knob) scales the distance; the instance switches from its current LOD only once the size is
+	// LOD_HYSTERESIS past the boundary, so it does not pop back and forth
+	static int getLODIndex(const ModelInstance& model_instance, int current, const Vec3& lod_ref_point, float lod_multiplier)
+	{
+		const Model* model = model_instance.model;
+		const Matrix& mtx = model_instance.matrix;
+		float squared_distance = (mtx.getTranslation() - lod_ref_point).squaredLength() * lod_multiplier;
+		float squared_radius = model->getBoundingRadius() * model->getBoundingRadius() * mtx.getXVector().squaredLength();
+		float squared_screen_size = squared_radius / Math::maximum(squared_distance, 1e-10f);
+
+		static const float LOD_HYSTERESIS = 0.1f;
+		int lod_index = model->getLODIndex(squared_screen_size);
+		if (lod_index > current)
+		{
+			float grow = (1 + LOD_HYSTERESIS) * (1 + LOD_HYSTERESIS);
+			return Math::maximum(current, model->getLODIndex(squared_screen_size * grow));
+		}
+		if (lod_index < current)
+		{
+			float shrink = (1 - LOD_HYSTERESIS) * (1 - LOD_HYSTERESIS);
+			return Math::minimum(current, model->getLODIndex(squared_screen_size * shrink));
+		}
+		return lod_index;
+	}
+
+
+	// all culling passes of a camera (main view, shadows, point lights) share its state,
+	// they have the same LOD reference point; not thread safe, call before the culling jobs
+	i8* getLODs(Entity camera)
+	{
+		LODView* view = nullptr;
+		for (LODView& iter : m_lod_views)
+		{
+			if (iter.camera == camera) view = &iter;
+		}
+		if (!view)
+		{
+			view = &m_lod_views.emplace(m_allocator);
+			view->camera = camera;
+		}
+		if (view->lods.size() < m_model_instances.size()) view->lods.resize(m_model_instances.size());
+		return view->lods.empty() ? nullptr : &view->lods[0];
+	}
+
+
+	void resetLOD(Entity entity)
+	{
+		for (LODView& view : m_lod_views)
+		{
+			if (entity.index < view.lods.size()) view.lods[entity.index] = 0;
+		}
+	}
+
+
 	float getCameraLODMultiplier(Entity camera)
 	{
 		float lod_multiplier;
@@ -3551,82 +3677,307 @@ public:
 	}
 
 
-	Array<Array<MeshInstance>>& getModelInstanceInfos(const Frustum& frustum,
+	void fillMeshInstances(const CullingSystem::Subresults& results,
 		const Vec3& lod_ref_point,
-		Entity camera,
-		u64 layer_mask) override
+		float lod_multiplier,
+		u64 layer_mask,
+		const OcclusionBuffer* occlusion_buffer,
+		i8* lods,
+		Array<MeshInstance>& infos)
+	{
+		infos.clear();
+		if (results.empty()) return;
+
+		Vec3 ref_point = lod_ref_point;
+		const Entity* LUMIX_RESTRICT raw_subresults = &results[0];
+		ModelInstance* LUMIX_RESTRICT model_instances = &m_model_instances[0];
+		int occluded_count = 0;
+		for (int i = 0, c = results.size(); i < c; ++i)
+		{
+			ModelInstance* LUMIX_RESTRICT model_instance = &model_instances[raw_subresults[i].index];
+			if (occlusion_buffer && occlusion_buffer->isOccluded(model_instance->matrix, model_instance->model->getAABB()))
+			{
+				++occluded_count;
+				continue;
+			}
+			float squared_distance = (model_instance->matrix.getTranslation() - ref_point).squaredLength();
+			squared_distance *= lod_multiplier;
+
+			const Model* LUMIX_RESTRICT model = model_instance->model;
+			int entity_index = raw_subresults[i].index;
+			int lod_index = getLODIndex(*model_instance, lods[entity_index], ref_point, lod_multiplier);
+			lods[entity_index] = (i8)lod_index;
+			LODMeshIndices lod = model->getLODMeshIndices(lod_index);
+			for (int j = lod.from, c = lod.to; j <= c; ++j)
+			{
+				Mesh& mesh = model_instance->meshes[j];
+				if ((mesh.layer_mask & layer_mask) == 0) continue;
+				
+				MeshInstance& info = infos.emplace();
+				info.owner = raw_subresults[i];
+				info.mesh = &mesh;
+				info.depth = squared_distance;
+				info.sort_key = getSortKey(mesh, squared_distance);
+			}
+		}
+		if (occlusion_buffer) PROFILE_INT("occluded", occluded_count);
+	}
+
+
+	// from the most significant bits: render layer, shader, material, mesh, depth;
+	// shader, material and mesh bits are filled in sortMeshInstances
+	static u64 getSortKey(const Mesh& mesh, float depth)
 	{
-		for (auto& i : m_temporary_infos) i.clear();
-		const CullingSystem::Results& results = m_culling_system->cull(frustum, layer_mask);
+		u64 layer = mesh.material->getRenderLayer() & 0xff;
+		u32 depth_bits;
+		copyMemory(&depth_bits, &depth, sizeof(depth_bits));
+		u64 depth_key = Math::floatFlip(depth_bits) >> 16;
+		return (layer << 56) | depth_key;
+	}
+
+
+	// dense per scene index of a resource, stable between frames
+	static u32 getSortIndex(HashMap<void*, u32>& indices, void* resource, u32 max_index)
+	{
+		auto iter = indices.find(resource);
+		if (iter.isValid()) return iter.value();
+		// more live resources than bits in the key, such ones share the last index
+		u32 index = Math::minimum((u32)indices.size(), max_index);
+		indices.insert(resource, index);
+		return index;
+	}
+
+
+	static void prepareSortIndices(HashMap<void*, u32>& indices, u32 max_index)
+	{
+		// entries of destroyed resources are never removed, start over before they use up the bits
+		if (indices.size() > (int)max_index / 2) indices.clear();
+	}
+
+
+	// merges the subresults of all jobs into one sorted draw list and splits it back to the same number of
+	// chunks, runs of the same mesh are not split so they can be instanced together
+	void sortMeshInstances(Array<Array<MeshInstance>>& infos)
+	{
+		PROFILE_FUNCTION();
+		int count = 0;
+		for (const Array<MeshInstance>& subinfos : infos) count += subinfos.size();
+		PROFILE_INT("count", count);
+		if (count == 0) return;
+
+		static const u32 MAX_SHADER_INDEX = 0x3ff;
+		static const u32 MAX_MATERIAL_INDEX = 0x3fff;
+		static const u32 MAX_MESH_INDEX = 0xffff;
+		prepareSortIndices(m_shader_sort_indices, MAX_SHADER_INDEX);
+		prepareSortIndices(m_material_sort_indices, MAX_MATERIAL_INDEX);
+		prepareSortIndices(m_mesh_sort_indices, MAX_MESH_INDEX);
+
+		m_sort_keys.resize(count * 2);
+		m_sort_indices.resize(count * 2);
+		m_sorted_infos.clear();
+		m_sorted_infos.reserve(count);
+		Mesh* last_mesh = nullptr;
+		u64 mesh_key = 0;
+		for (const Array<MeshInstance>& subinfos : infos)
+		{
+			for (const MeshInstance& info : subinfos)
+			{
+				if (info.mesh != last_mesh)
+				{
+					last_mesh = info.mesh;
+					Material* material = info.mesh->material;
+					Shader* shader = material->getShader();
+					u64 shader_index = shader ? getSortIndex(m_shader_sort_indices, shader, MAX_SHADER_INDEX) : 0;
+					u64 material_index = getSortIndex(m_material_sort_indices, material, MAX_MATERIAL_INDEX);
+					u64 mesh_index = getSortIndex(m_mesh_sort_indices, info.mesh, MAX_MESH_INDEX);
+					mesh_key = (shader_index << 46) | (material_index << 32) | (mesh_index << 16);
+				}
+				m_sort_keys[m_sorted_infos.size()] = info.sort_key | mesh_key;
+				m_sort_indices[m_sorted_infos.size()] = m_sorted_infos.size();
+				m_sorted_infos.push(info);
+			}
+		}
+		radixSort(&m_sort_keys[0], &m_sort_indices[0], count, &m_sort_keys[count], &m_sort_indices[count], m_allocator);
 
-		while (m_temporary_infos.size() < results.size())
+		int chunk_size = (count + infos.size() - 1) / infos.size();
+		int chunk_index = 0;
+		for (Array<MeshInstance>& subinfos : infos) subinfos.clear();
+		for (int i = 0; i < count; ++i)
 		{
-			m_temporary_infos.emplace(m_allocator);
+			MeshInstance& info = m_sorted_infos[m_sort_indices[i]];
+			info.sort_key = m_sort_keys[i];
+			Array<MeshInstance>* subinfos = &infos[chunk_index];
+			if (subinfos->size() >= chunk_size && chunk_index + 1 < infos.size() && subinfos->back().mesh != info.mesh)
+			{
+				++chunk_index;
+				subinfos = &infos[chunk_index];
+			}
+			subinfos->push(info);
 		}
-		while (m_temporary_infos.size() > results.size())
+	}
+
+
+	static void resizeInfos(Array<Array<MeshInstance>>& infos, int size, IAllocator& allocator)
+	{
+		while (infos.size() < size)
 		{
-			m_temporary_infos.pop();
+			infos.emplace(allocator);
 		}
+		while (infos.size() > size)
+		{
+			infos.pop();
+		}
+	}
+
+
+	Array<Array<MeshInstance>>& getModelInstanceInfos(const Frustum& frustum,
+		const Vec3& lod_ref_point,
+		Entity camera,
+		u64 layer_mask) override
+	{
+		return getModelInstanceInfos(frustum, nullptr, lod_ref_point, camera, layer_mask);
+	}
+
+
+	Array<Array<MeshInstance>>& getModelInstanceInfos(const Frustum& frustum,
+		const OcclusionBuffer& occlusion_buffer,
+		const Vec3& lod_ref_point,
+		Entity camera,
+		u64 layer_mask) override
+	{
+		return getModelInstanceInfos(frustum, &occlusion_buffer, lod_ref_point, camera, layer_mask);
+	}
+
+
+	Array<Array<MeshInstance>>& getModelInstanceInfos(const Frustum& frustum,
+		const OcclusionBuffer* occlusion_buffer,
+		const Vec3& lod_ref_point,
+		Entity camera,
+		u64 layer_mask)
+	{
+		for (auto& i : m_temporary_infos) i.clear();
+		auto culling_view = m_camera_culling_views.find(camera);
+		const CullingSystem::Results& results = culling_view.isValid()
+			? m_culling_system->cull(culling_view.value(), frustum, layer_mask)
+			: m_culling_system->cull(frustum, layer_mask);
+		resizeInfos(m_temporary_infos, results.size(), m_allocator);
 
 		JobSystem::JobDecl jobs[64];
 		JobSystem::LambdaJob job_storage[64];
 		ASSERT(results.size() <= lengthOf(jobs));
 
+		float lod_multiplier = m_lod_multiplier * getCameraLODMultiplier(camera);
+		i8* lods = getLODs(camera);
 		volatile int counter = 0;
 		for (int subresult_index = 0; subresult_index < results.size(); ++subresult_index)
 		{
-			Array<MeshInstance>& subinfos = m_temporary_infos[subresult_index];
-			subinfos.clear();
+			m_temporary_infos[subresult_index].clear();
 
-			JobSystem::fromLambda([&layer_mask, &subinfos, this, &results, subresult_index, lod_ref_point, camera]() {
+			// the captures must fit in LambdaJob::pool, there is no allocator to fall back to
+			JobSystem::fromLambda([layer_mask, this, &results, subresult_index, lod_multiplier, &lod_ref_point, occlusion_buffer, lods]() {
 				PROFILE_BLOCK("Temporary Info Job");
 				PROFILE_INT("ModelInstance count", results[subresult_index].size());
-				if (results[subresult_index].empty()) return;
-
-				float lod_multiplier = getCameraLODMultiplier(camera);
-				Vec3 ref_point = lod_ref_point;
-				float final_lod_multiplier = m_lod_multiplier * lod_multiplier;
-				const Entity* LUMIX_RESTRICT raw_subresults = &results[subresult_index][0];
-				ModelInstance* LUMIX_RESTRICT model_instances = &m_model_instances[0];
-				for (int i = 0, c = results[subresult_index].size(); i < c; ++i)
-				{
-					const ModelInstance* LUMIX_RESTRICT model_instance = &model_instances[raw_subresults[i].index];
-					float squared_distance = (model_instance->matrix.getTranslation() - ref_point).squaredLength();
-					squared_distance *= final_lod_multiplier;
+				fillMeshInstances(results[subresult_index],
+					lod_ref_point,
+					lod_multiplier,
+					layer_mask,
+					occlusion_buffer,
+					lods,
+					m_temporary_infos[subresult_index]);
+			}, &job_storage[subresult_index], &jobs[subresult_index], nullptr);
+		}
+		JobSystem::runJobs(jobs, results.size(), &counter);
+		JobSystem::wait(&counter);
+		sortMeshInstances(m_temporary_infos);
 
-					const Model* LUMIX_RESTRICT model = model_instance->model;
-					LODMeshIndices lod = model->getLODMeshIndices(squared_distance);
-					for (int j = lod.from, c = lod.to; j <= c; ++j)
-					{
-						Mesh& mesh = model_instance->meshes[j];
-						if ((mesh.layer_mask & layer_mask) == 0) continue;
-						
-						MeshInstance& info = subinfos.emplace();
-						info.owner = raw_subresults[i];
-						info.mesh = &mesh;
-						info.depth = squared_distance;
-					}
-				}
-				if (!subinfos.empty())
+		return m_temporary_infos;
+	}
+
+
+	void setCameraVisibilityCache(Entity camera, float threshold) override
+	{
+		auto iter = m_camera_culling_views.find(camera);
+		if (iter.isValid())
+		{
+			m_culling_system->destroyView(iter.value());
+			m_camera_culling_views.erase(camera);
+		}
+		if (threshold > 0) m_camera_culling_views.insert(camera, m_culling_system->createView(threshold));
+	}
+
+
+	// at most CullingSystem::MAX_VIEWS views are culled in one pass
+	void fillViewsInfos(const Frustum* frusta,
+		const u64* layer_masks,
+		int count,
+		const Vec3& lod_ref_point,
+		float lod_multiplier,
+		i8* lods,
+		Array<Array<MeshInstance>>* views_infos)
+	{
+		const CullingSystem::Results* results = m_culling_system->cull(frusta, layer_masks, count);
+		int subresults_count = results[0].size();
+		for (int i = 0; i < count; ++i)
+		{
+			resizeInfos(views_infos[i], subresults_count, m_allocator);
+		}
+
+		JobSystem::JobDecl jobs[64];
+		JobSystem::LambdaJob job_storage[64];
+		ASSERT(subresults_count <= lengthOf(jobs));
+
+		// a job handles the same subresult of all views, so it walks mostly the same model instances
+		volatile int counter = 0;
+		for (int subresult_index = 0; subresult_index < subresults_count; ++subresult_index)
+		{
+			// the captures must fit in LambdaJob::pool, there is no allocator to fall back to
+			JobSystem::fromLambda([layer_masks, this, results, &lod_ref_point, lods, views_infos, count, subresult_index, lod_multiplier]() {
+				PROFILE_BLOCK("Temporary Info Job");
+				for (int i = 0; i < count; ++i)
 				{
-					PROFILE_BLOCK("Sort");
-					MeshInstance* begin = &subinfos[0];
-					MeshInstance* end = begin + subinfos.size();
-
-					auto cmp = [](const MeshInstance& a, const MeshInstance& b) -> bool {
-						if (a.mesh != b.mesh) return a.mesh < b.mesh;
-						return (a.depth < b.depth);
-					};
-					std::sort(begin, end, cmp);
+					fillMeshInstances(results[i][subresult_index],
+						lod_ref_point,
+						lod_multiplier,
+						layer_masks[i],
+						nullptr,
+						lods,
+						views_infos[i][subresult_index]);
 				}
 			}, &job_storage[subresult_index], &jobs[subresult_index], nullptr);
 		}
-		JobSystem::runJobs(jobs, results.size(), &counter);
+		JobSystem::runJobs(jobs, subresults_count, &counter);
 		JobSystem::wait(&counter);
+	}
 
-		
 
-		return m_temporary_infos;
+	Array<Array<MeshInstance>>* getModelInstanceInfos(const Frustum* frusta,
+		const u64* layer_masks,
+		int count,
+		const Vec3& lod_ref_point,
+		Entity camera) override
+	{
+		while (m_views_infos.size() < count)
+		{
+			m_views_infos.emplace(m_allocator);
+		}
+		float lod_multiplier = m_lod_multiplier * getCameraLODMultiplier(camera);
+		i8* lods = getLODs(camera);
+		for (int first = 0; first < count; first += CullingSystem::MAX_VIEWS)
+		{
+			fillViewsInfos(frusta + first,
+				layer_masks + first,
+				Math::minimum(count - first, CullingSystem::MAX_VIEWS),
+				lod_ref_point,
+				lod_multiplier,
+				lods,
+				&m_views_infos[first]);
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			sortMeshInstances(m_views_infos[i]);
+		}
+
+		return &m_views_infos[0];
 	}
 
 
@@ -4359,7 +4710,9 @@ public:
 
 	void setLightRange(Entity entity, float value) override
 	{
-		m_point_lights[m_point_lights_map[entity]].m_range = value;
+		PointLight& light = m_point_lights[m_point_lights_map[entity]];
+		light.m_range = value;
+		m_light_culling_system->updateBoundingSphere(getPointLightSphere(light), entity);
 	}
 
 
@@ -4501,21 +4854,7 @@ public:
 
 	Entity getNearestEnvironmentProbe(const Vec3& pos) const override
 	{
-		float nearest_dist_squared = FLT_MAX;
-		Entity nearest = INVALID_ENTITY;
-		for (int i = 0, c = m_environment_probes.size(); i < c; ++i)
-		{
-			Entity probe_entity = m_environment_probes.getKey(i);
-			Vec3 probe_pos = m_universe.getPosition(probe_entity);
-			float dist_squared = (pos - probe_pos).squaredLength();
-			if (dist_squared < nearest_dist_squared)
-			{
-				nearest = probe_entity;
-				nearest_dist_squared = dist_squared;
-			}
-		}
-		if (!nearest.isValid()) return INVALID_ENTITY;
-		return nearest;
+		return m_environment_probe_culling_system->getNearest(pos, ~0ULL);
 	}
 
 
@@ -4630,10 +4969,6 @@ public:
 		LUMIX_DELETE(m_allocator, r.pose);
 		r.pose = nullptr;
 
-		for (int i = 0; i < m_point_lights.size(); ++i)
-		{
-			m_light_influenced_geometry[i].eraseItemFast(entity);
-		}
 		m_culling_system->removeStatic(entity);
 	}
 
@@ -4703,18 +5038,6 @@ public:
 		{
 			updateBoneAttachment(m_bone_attachments[r.entity]);
 		}
-
-		for (int i = 0; i < m_point_lights.size(); ++i)
-		{
-			PointLight& light = m_point_lights[i];
-			Vec3 t = r.matrix.getTranslation();
-			float radius = r.model->getBoundingRadius();
-			if ((t - m_universe.getPosition(light.m_entity)).squaredLength() <
-				(radius + light.m_range) * (radius + light.m_range))
-			{
-				m_light_influenced_geometry[i].push(entity);
-			}
-		}
 	}
 
 
@@ -4859,6 +5182,7 @@ public:
 		model_instance.model = model;
 		model_instance.meshes = nullptr;
 		model_instance.mesh_count = 0;
+		resetLOD(entity);
 		LUMIX_DELETE(m_allocator, model_instance.pose);
 		model_instance.pose = nullptr;
 		if (model)
@@ -4876,22 +5200,130 @@ public:
 	IAllocator& getAllocator() override { return m_allocator; }
 
 
-	void detectLightInfluencedGeometry(Entity entity)
+	static int compareEntities(const void* a, const void* b)
+	{
+		return ((const Entity*)a)->index - ((const Entity*)b)->index;
+	}
+
+
+	static bool equalFrusta(const Frustum& a, const Frustum& b)
+	{
+		return compareMemory(a.xs, b.xs, sizeof(a.xs)) == 0 && compareMemory(a.ys, b.ys, sizeof(a.ys)) == 0 &&
+			compareMemory(a.zs, b.zs, sizeof(a.zs)) == 0 && compareMemory(a.ds, b.ds, sizeof(a.ds)) == 0 &&
+			compareMemory(a.points, b.points, sizeof(a.points)) == 0;
+	}
+
+
+	bool isLitGeometryValid() const
+	{
+		return m_is_lit_geometry_valid && m_lit_geometry_version == m_culling_system->getVersion() &&
+			m_lit_lights_version == m_light_culling_system->getVersion();
+	}
+
+
+	// geometry influenced by the lights visible in the frustum, culled in jobs and kept until
+	// the frustum, a light or a model instance changes; lights which were not visible are not culled
+	void cullLitGeometry(const Frustum& frustum, const Entity* lights, int count)
+	{
+		if (isLitGeometryValid() && equalFrusta(m_lit_frustum, frustum)) return;
+
+		PROFILE_FUNCTION();
+		m_lit_lights.resize(count);
+		if (count > 0) copyMemory(&m_lit_lights[0], lights, count * sizeof(lights[0]));
+		qsort(m_lit_lights.begin(), count, sizeof(Entity), compareEntities);
+		m_lit_offsets.resize(count + 1);
+
+		JobSystem::JobDecl jobs[64];
+		JobSystem::LambdaJob job_storage[64];
+		int jobs_count = Math::minimum(count, lengthOf(jobs));
+		while (m_lit_job_entities.size() < jobs_count) m_lit_job_entities.emplace(m_allocator);
+
+		// jobs only read the tree, it must not be rebuilt while they run
+		m_culling_system->updateTree();
+		volatile int counter = 0;
+		for (int job_index = 0; job_index < jobs_count; ++job_index)
+		{
+			int from = count * job_index / jobs_count;
+			int to = count * (job_index + 1) / jobs_count;
+			JobSystem::fromLambda([this, job_index, from, to]() {
+				PROFILE_BLOCK("Lit Geometry Job");
+				Array<Entity>& entities = m_lit_job_entities[job_index];
+				entities.clear();
+				for (int i = from; i < to; ++i)
+				{
+					// offsets are local to the job until they are merged
+					m_lit_offsets[i] = entities.size();
+					const PointLight& light = m_point_lights[m_point_lights_map[m_lit_lights[i]]];
+					m_culling_system->cull(getPointLightSphere(light), ~0ULL, entities);
+				}
+			}, &job_storage[job_index], &jobs[job_index], nullptr);
+		}
+		JobSystem::runJobs(jobs, jobs_count, &counter);
+		JobSystem::wait(&counter);
+
+		m_lit_entities.clear();
+		for (int job_index = 0; job_index < jobs_count; ++job_index)
+		{
+			int from = count * job_index / jobs_count;
+			int to = count * (job_index + 1) / jobs_count;
+			int base = m_lit_entities.size();
+			for (int i = from; i < to; ++i) m_lit_offsets[i] += base;
+			for (Entity entity : m_lit_job_entities[job_index]) m_lit_entities.push(entity);
+		}
+		m_lit_offsets[count] = m_lit_entities.size();
+
+		m_lit_frustum = frustum;
+		m_lit_geometry_version = m_culling_system->getVersion();
+		m_lit_lights_version = m_light_culling_system->getVersion();
+		m_is_lit_geometry_valid = true;
+	}
+
+
+	const Entity* getPointLightInfluencedEntities(Entity light, int* count)
 	{
-		int light_idx = m_point_lights_map[entity];
-		Frustum frustum = getPointLightFrustum(light_idx);
-		const CullingSystem::Results& results = m_culling_system->cull(frustum, ~0ULL);
-		auto& influenced_geometry = m_light_influenced_geometry[light_idx];
-		influenced_geometry.clear();
-		for (int i = 0; i < results.size(); ++i)
+		if (isLitGeometryValid())
 		{
-			const CullingSystem::Subresults& subresult = results[i];
-			influenced_geometry.reserve(influenced_geometry.size() + subresult.size());
-			for (int j = 0, c = subresult.size(); j < c; ++j)
+			int from = 0;
+			int to = m_lit_lights.size();
+			while (from < to)
 			{
-				influenced_geometry.push(subresult[j]);
+				int mid = (from + to) >> 1;
+				if (m_lit_lights[mid].index < light.index)
+				{
+					from = mid + 1;
+				}
+				else
+				{
+					to = mid;
+				}
+			}
+			if (from < m_lit_lights.size() && m_lit_lights[from] == light)
+			{
+				int first = m_lit_offsets[from];
+				*count = m_lit_offsets[from + 1] - first;
+				return *count > 0 ? &m_lit_entities[first] : nullptr;
 			}
 		}
+
+		// the light was not in the last getPointLights or something changed since
+		m_single_lit_entities.clear();
+		const PointLight& point_light = m_point_lights[m_point_lights_map[light]];
+		m_culling_system->cull(getPointLightSphere(point_light), ~0ULL, m_single_lit_entities);
+		*count = m_single_lit_entities.size();
+		return *count > 0 ? &m_single_lit_entities[0] : nullptr;
+	}
+
+
+	Sphere getPointLightSphere(const PointLight& light) const
+	{
+		return {m_universe.getPosition(light.m_entity), light.m_range};
+	}
+
+
+	// probes are looked up by the nearest center, they do not have any extent
+	Sphere getEnvironmentProbeSphere(Entity entity) const
+	{
+		return {m_universe.getPosition(entity), 0};
 	}
 
 
@@ -5060,7 +5492,6 @@ public:
 	void createPointLight(Entity entity)
 	{
 		PointLight& light = m_point_lights.emplace();
-		m_light_influenced_geometry.emplace(m_allocator);
 		light.m_entity = entity;
 		light.m_diffuse_color.set(1, 1, 1);
 		light.m_diffuse_intensity = 1;
@@ -5071,14 +5502,13 @@ public:
 		light.m_attenuation_param = 2;
 		light.m_range = 10;
 		m_point_lights_map.insert(entity, m_point_lights.size() - 1);
+		m_light_culling_system->addStatic(entity, getPointLightSphere(light), 1);
 
 		m_universe.onComponentCreated(entity, POINT_LIGHT_TYPE, this);
-
-		detectLightInfluencedGeometry(entity);
 	}
 
 
-	void updateDecalInfo(Decal& decal) const
+	void updateDecalInfo(Decal& decal)
 	{
 		decal.position = m_universe.getPosition(decal.entity);
 		decal.radius = decal.scale.length();
@@ -5088,6 +5518,16 @@ public:
 		decal.mtx.setZVector(decal.mtx.getZVector() * decal.scale.z);
 		decal.inv_mtx = decal.mtx;
 		decal.inv_mtx.inverse();
+
+		Sphere sphere(decal.position, decal.radius);
+		if (m_decal_culling_system->isAdded(decal.entity))
+		{
+			m_decal_culling_system->updateBoundingSphere(sphere, decal.entity);
+		}
+		else
+		{
+			m_decal_culling_system->addStatic(decal.entity, sphere, 1);
+		}
 	}
 
 
@@ -5114,6 +5554,7 @@ public:
 		probe.radiance = static_cast<Texture*>(texture_manager->load(Path("pipelines/pbr/default_probe.dds")));
 		probe.radiance->setFlag(BGFX_TEXTURE_SRGB, true);
 		probe.guid = Math::randGUID();
+		m_environment_probe_culling_system->addStatic(entity, getEnvironmentProbeSphere(entity), 1);
 
 		m_universe.onComponentCreated(entity, ENVIRONMENT_PROBE_TYPE, this);
 	}
@@ -5147,6 +5588,7 @@ public:
 		r.flags.clear();
 		r.flags.set(ModelInstance::ENABLED);
 		r.mesh_count = 0;
+		resetLOD(entity);
 		r.matrix = m_universe.getMatrix(entity);
 		m_universe.onComponentCreated(entity, MODEL_INSTANCE_TYPE, this);
 	}
@@ -5207,8 +5649,22 @@ private:
 	Renderer& m_renderer;
 	Engine& m_engine;
 	CullingSystem* m_culling_system;
+	// point lights as spheres of their range
+	CullingSystem* m_light_culling_system;
+	// model instances influenced by the lights of the last getPointLights, sorted by index,
+	// m_lit_offsets[i] is the first entity of m_lit_lights[i]
+	Array<Entity> m_lit_lights;
+	Array<int> m_lit_offsets;
+	Array<Entity> m_lit_entities;
+	Array<Array<Entity>> m_lit_job_entities;
+	Array<Entity> m_single_lit_entities;
+	Frustum m_lit_frustum;
+	u32 m_lit_geometry_version;
+	u32 m_lit_lights_version;
+	bool m_is_lit_geometry_valid;
+	CullingSystem* m_decal_culling_system;
+	CullingSystem* m_environment_probe_culling_system;
 
-	Array<Array<Entity>> m_light_influenced_geometry;
 	Entity m_active_global_light_entity;
 	HashMap<Entity, int> m_point_lights_map;
 
@@ -5217,6 +5673,8 @@ private:
 	HashMap<Entity, GlobalLight> m_global_lights;
 	Array<PointLight> m_point_lights;
 	HashMap<Entity, Camera> m_cameras;
+	HashMap<Entity, int> m_camera_culling_views;
+	Array<LODView> m_lod_views;
 	AssociativeArray<Entity, TextMesh*> m_text_meshes;
 	AssociativeArray<Entity, BoneAttachment> m_bone_attachments;
 	AssociativeArray<Entity, EnvironmentProbe> m_environment_probes;
@@ -5229,6 +5687,13 @@ private:
 	Array<DebugPoint> m_debug_points;
 
 	Array<Array<MeshInstance>> m_temporary_infos;
+	Array<Array<Array<MeshInstance>>> m_views_infos;
+	Array<MeshInstance> m_sorted_infos;
+	Array<u64> m_sort_keys;
+	Array<u32> m_sort_indices;
+	HashMap<void*, u32> m_shader_sort_indices;
+	HashMap<void*, u32> m_material_sort_indices;
+	HashMap<void*, u32> m_mesh_sort_indices;
 
 	float m_time;
 	float m_lod_multiplier;
@@ -5293,16 +5758,24 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_model_loaded_callbacks(m_allocator)
 	, m_model_instances(m_allocator)
 	, m_cameras(m_allocator)
+	, m_camera_culling_views(m_allocator)
+	, m_lod_views(m_allocator)
 	, m_text_meshes(m_allocator)
 	, m_terrains(m_allocator)
 	, m_point_lights(m_allocator)
-	, m_light_influenced_geometry(m_allocator)
 	, m_global_lights(m_allocator)
 	, m_decals(m_allocator)
 	, m_debug_triangles(m_allocator)
 	, m_debug_lines(m_allocator)
 	, m_debug_points(m_allocator)
 	, m_temporary_infos(m_allocator)
+	, m_views_infos(m_allocator)
+	, m_sorted_infos(m_allocator)
+	, m_sort_keys(m_allocator)
+	, m_sort_indices(m_allocator)
+	, m_shader_sort_indices(m_allocator)
+	, m_material_sort_indices(m_allocator)
+	, m_mesh_sort_indices(m_allocator)
 	, m_active_global_light_entity(INVALID_ENTITY)
 	, m_is_grass_enabled(true)
 	, m_is_game_running(false)
@@ -5314,10 +5787,25 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_lod_multiplier(1.0f)
 	, m_time(0)
 	, m_is_updating_attachments(false)
+	, m_lit_lights(m_allocator)
+	, m_lit_offsets(m_allocator)
+	, m_lit_entities(m_allocator)
+	, m_lit_job_entities(m_allocator)
+	, m_single_lit_entities(m_allocator)
+	, m_lit_geometry_version(0)
+	, m_lit_lights_version(0)
+	, m_is_lit_geometry_valid(false)
 {
-	m_universe.entityTransformed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
-	m_universe.entityDestroyed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
+	// bone attachments follow their parents, parents are model instances
+	const ComponentType moved_types[] = {
+		MODEL_INSTANCE_TYPE, DECAL_TYPE, POINT_LIGHT_TYPE, ENVIRONMENT_PROBE_TYPE, BONE_ATTACHMENT_TYPE};
+	m_universe.subscribeTransformed<RenderSceneImpl, &RenderSceneImpl::onEntityMoved, &RenderSceneImpl::onEntitiesMoved>(
+		this, moved_types, lengthOf(moved_types));
+	m_universe.entitiesDestroyed().bind<RenderSceneImpl, &RenderSceneImpl::onEntitiesDestroyed>(this);
 	m_culling_system = CullingSystem::create(m_allocator);
+	m_light_culling_system = CullingSystem::create(m_allocator);
+	m_decal_culling_system = CullingSystem::create(m_allocator);
+	m_environment_probe_culling_system = CullingSystem::create(m_allocator);
 	m_model_instances.reserve(5000);
 
 	MaterialManager& manager = m_renderer.getMaterialManager();
@@ -5362,6 +5850,7 @@ void RenderScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(getActiveGlobalLight);
 	REGISTER_FUNCTION(getCameraInSlot);
 	REGISTER_FUNCTION(getCameraSlot);
+	REGISTER_FUNCTION(setCameraVisibilityCache);
 	REGISTER_FUNCTION(getModelInstanceModel);
 	REGISTER_FUNCTION(addDebugCross);
 	REGISTER_FUNCTION(addDebugLine);
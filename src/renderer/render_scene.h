@@ -21,6 +21,7 @@ class LIFOAllocator;
 class Material;
 struct Mesh;
 class Model;
+class OcclusionBuffer;
 class Path;
 struct Pose;
 struct RayCastModelHit;
@@ -64,6 +65,7 @@ struct ModelInstance
 		KEEP_SKIN_DEPRECATED = 1 << 1,
 		IS_BONE_ATTACHMENT_PARENT = 1 << 2,
 		ENABLED = 1 << 3,
+		OCCLUDER = 1 << 4,
 
 		RUNTIME_FLAGS = CUSTOM_MESHES,
 		PERSISTENT_FLAGS = u8(~RUNTIME_FLAGS)
@@ -84,6 +86,7 @@ struct MeshInstance
 	Entity owner;
 	Mesh* mesh;
 	float depth;
+	u64 sort_key;
 };
 
 
@@ -246,6 +249,8 @@ public:
 	virtual float getCameraOrthoSize(Entity entity) = 0;
 	virtual void setCameraOrthoSize(Entity entity, float value) = 0;
 	virtual Vec2 getCameraScreenSize(Entity entity) = 0;
+	// static meshes visible from the camera are reused until it moves by more than threshold, 0 disables it
+	virtual void setCameraVisibilityCache(Entity entity, float threshold) = 0;
 
 	virtual void setScriptedParticleEmitterMaterialPath(Entity entity, const Path& path) = 0;
 	virtual Path getScriptedParticleEmitterMaterialPath(Entity entity) = 0;
@@ -309,6 +314,8 @@ public:
 
 	virtual void enableModelInstance(Entity entity, bool enable) = 0;
 	virtual bool isModelInstanceEnabled(Entity entity) = 0;
+	virtual bool isModelInstanceOccluder(Entity entity) = 0;
+	virtual void setModelInstanceOccluder(Entity entity, bool is_occluder) = 0;
 	virtual ModelInstance* getModelInstance(Entity entity) = 0;
 	virtual ModelInstance* getModelInstances() = 0;
 	virtual Path getModelInstancePath(Entity entity) = 0;
@@ -320,6 +327,19 @@ public:
 		const Vec3& lod_ref_point,
 		Entity entity,
 		u64 layer_mask) = 0;
+	// model instances hidden in the occlusion buffer are skipped
+	virtual Array<Array<MeshInstance>>& getModelInstanceInfos(const Frustum& frustum,
+		const OcclusionBuffer& occlusion_buffer,
+		const Vec3& lod_ref_point,
+		Entity entity,
+		u64 layer_mask) = 0;
+	// culls all frusta in one pass (per CullingSystem::MAX_VIEWS frusta), returns count sets of infos, valid until
+	// the next call
+	virtual Array<Array<MeshInstance>>* getModelInstanceInfos(const Frustum* frusta,
+		const u64* layer_masks,
+		int count,
+		const Vec3& lod_ref_point,
+		Entity camera) = 0;
 	virtual void getModelInstanceEntities(const Frustum& frustum, Array<Entity>& entities) = 0;
 	virtual Entity getFirstModelInstance() = 0;
 	virtual Entity getNextModelInstance(Entity entity) = 0;
@@ -377,6 +397,12 @@ public:
 		const Vec3& lod_ref_point,
 		const Frustum& frustum,
 		Array<MeshInstance>& infos) = 0;
+	virtual void getPointLightInfluencedGeometry(Entity light,
+		Entity camera,
+		const Vec3& lod_ref_point,
+		const Frustum* frusta,
+		int count,
+		Array<MeshInstance>* infos) = 0;
 	virtual void setLightCastShadows(Entity entity, bool cast_shadows) = 0;
 	virtual bool getLightCastShadows(Entity entity) = 0;
 	virtual float getLightAttenuation(Entity entity) = 0;
@@ -228,6 +228,7 @@ static void registerProperties(IAllocator& allocator)
 		),
 		component("renderable",
 			property("Enabled", LUMIX_PROP_FULL(RenderScene, isModelInstanceEnabled, enableModelInstance)),
+			property("Occluder", LUMIX_PROP_FULL(RenderScene, isModelInstanceOccluder, setModelInstanceOccluder)),
 			property("Source", LUMIX_PROP(RenderScene, ModelInstancePath),
 				ResourceAttribute("Mesh (*.msh)", Model::TYPE)),
 			const_array("Materials", &RenderScene::getModelInstanceMaterialsCount, 
@@ -510,6 +511,11 @@ struct RendererImpl LUMIX_FINAL : public Renderer
 				renderer_type = bgfx::RendererType::OpenGL;
 				break;
 			}
+			else if (cmd_line_parser.currentEquals("-noop_renderer"))
+			{
+				renderer_type = bgfx::RendererType::Noop;
+				break;
+			}
 			else if (cmd_line_parser.currentEquals("-no_vsync"))
 			{
 				m_vsync = false;
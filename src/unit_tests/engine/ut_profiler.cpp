@@ -0,0 +1,127 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+#include "engine/mt/thread.h"
+#include "engine/profiler.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+
+
+const char* const COUNTER_NAME = "ut_profiler_counter";
+
+
+Profiler::Block* findRootBlock(const char* name)
+{
+	Profiler::Block* block = Profiler::getRootBlock(MT::getCurrentThreadID());
+	while (block && Profiler::getBlockName(block) != name)
+	{
+		block = Profiler::getBlockNext(block);
+	}
+	return block;
+}
+
+
+void UT_profiler_history(const char* params)
+{
+	for (int i = 1; i <= 100; ++i)
+	{
+		Profiler::record(COUNTER_NAME, i);
+		Profiler::frame();
+	}
+
+	Profiler::Block* block = findRootBlock(COUNTER_NAME);
+	LUMIX_EXPECT(block != nullptr);
+	if (!block) return;
+
+	LUMIX_EXPECT(Profiler::getBlockHistoryCount(block) == 100);
+	LUMIX_EXPECT(Profiler::getBlockHistory(block, 0) == 100);
+	LUMIX_EXPECT(Profiler::getBlockHistory(block, 99) == 1);
+
+	Profiler::HistoryStats stats = Profiler::getBlockHistoryStats(block);
+	LUMIX_EXPECT(stats.count == 100);
+	LUMIX_EXPECT(stats.min == 1);
+	LUMIX_EXPECT(stats.max == 100);
+	LUMIX_EXPECT_CLOSE_EQ(stats.mean, 50.5f, 0.001f);
+	LUMIX_EXPECT(stats.p50 == 51);
+	LUMIX_EXPECT(stats.p95 == 95);
+	LUMIX_EXPECT(stats.p99 == 99);
+	LUMIX_EXPECT(Profiler::getBlockPercentile(block, 0) == 1);
+	LUMIX_EXPECT(Profiler::getBlockPercentile(block, 1) == 100);
+
+	for (int i = 1; i <= 2 * Profiler::MAX_HISTORY_FRAMES; ++i)
+	{
+		Profiler::record(COUNTER_NAME, i);
+		Profiler::frame();
+	}
+	LUMIX_EXPECT(Profiler::getBlockHistoryCount(block) == Profiler::MAX_HISTORY_FRAMES);
+	LUMIX_EXPECT(Profiler::getBlockHistory(block, 0) == 2 * Profiler::MAX_HISTORY_FRAMES);
+	LUMIX_EXPECT(Profiler::getBlockHistoryStats(block).min == Profiler::MAX_HISTORY_FRAMES + 1);
+}
+
+
+void UT_profiler_spike_freeze(const char* params)
+{
+	LUMIX_EXPECT(!Profiler::isFrozen());
+
+	// every frame is a spike
+	Profiler::setSpikeThreshold(1e-9f, 2);
+	for (int i = 1; i <= 10; ++i)
+	{
+		Profiler::record(COUNTER_NAME, i);
+		Profiler::frame();
+	}
+	LUMIX_EXPECT(Profiler::isFrozen());
+
+	Profiler::Block* block = findRootBlock(COUNTER_NAME);
+	LUMIX_EXPECT(block != nullptr);
+	if (block)
+	{
+		// the spike frame and two frames after it are recorded
+		LUMIX_EXPECT(Profiler::getBlockHistory(block, 0) == 3);
+	}
+
+	Profiler::setSpikeThreshold(0, 0);
+	Profiler::freeze(false);
+	Profiler::record(COUNTER_NAME, 42);
+	Profiler::frame();
+	LUMIX_EXPECT(!Profiler::isFrozen());
+	if (block) LUMIX_EXPECT(Profiler::getBlockHistory(block, 0) == 42);
+}
+
+
+void UT_profiler_deep_fiber_switch(const char* params)
+{
+	static const char* const NAMES[] = { "b0", "b1", "b2", "b3", "b4", "b5", "b6", "b7", "b8", "b9",
+		"b10", "b11", "b12", "b13", "b14", "b15", "b16", "b17", "b18", "b19" };
+
+	Profiler::Block* outer = Profiler::getCurrentBlock();
+	Profiler::beginBlock("ut_profiler_fiber_root");
+	Profiler::Block* root = Profiler::getCurrentBlock();
+	for (const char* name : NAMES) Profiler::beginBlock(name);
+
+	Profiler::FiberSwitchData data;
+	Profiler::beforeFiberSwitch(data);
+	LUMIX_EXPECT(data.count == Profiler::FiberSwitchData::MAX_DEPTH);
+	LUMIX_EXPECT(data.depth == lengthOf(NAMES));
+	LUMIX_EXPECT(Profiler::getCurrentBlock() == root);
+
+	Profiler::afterFiberSwitch(data);
+	LUMIX_EXPECT(Profiler::getBlockName(Profiler::getCurrentBlock()) == NAMES[lengthOf(NAMES) - 1]);
+
+	// the ends of the blocks which were not reopened must not pop the thread's blocks
+	for (int i = 0; i < lengthOf(NAMES); ++i) Profiler::endBlock();
+	LUMIX_EXPECT(Profiler::getCurrentBlock() == root);
+	Profiler::endBlock();
+	LUMIX_EXPECT(Profiler::getCurrentBlock() == outer);
+}
+
+
+} // anonymous namespace
+
+
+REGISTER_TEST("unit_tests/engine/profiler/history", UT_profiler_history, "")
+REGISTER_TEST("unit_tests/engine/profiler/spike_freeze", UT_profiler_spike_freeze, "")
+REGISTER_TEST("unit_tests/engine/profiler/deep_fiber_switch", UT_profiler_deep_fiber_switch, "")
@@ -0,0 +1,60 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+#include "engine/array.h"
+#include "engine/job_system.h"
+#include "engine/radix_sort.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	// values are the original indices, so equal keys must keep them ascending
+	void testSort(IAllocator& allocator, int size, u64 key_mask)
+	{
+		Array<u64> keys(allocator);
+		Array<u32> values(allocator);
+		keys.resize(size * 2);
+		values.resize(size * 2);
+		u64 seed = 0x12345678;
+		for (int i = 0; i < size; ++i)
+		{
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			keys[i] = seed & key_mask;
+			values[i] = i;
+		}
+		Array<u64> original_keys(allocator);
+		original_keys.resize(size);
+		for (int i = 0; i < size; ++i) original_keys[i] = keys[i];
+
+		radixSort(&keys[0], &values[0], size, &keys[size], &values[size], allocator);
+
+		for (int i = 0; i < size; ++i)
+		{
+			LUMIX_EXPECT(original_keys[values[i]] == keys[i]);
+		}
+		for (int i = 1; i < size; ++i)
+		{
+			LUMIX_EXPECT(keys[i - 1] <= keys[i]);
+			if (keys[i - 1] == keys[i]) LUMIX_EXPECT(values[i - 1] < values[i]);
+		}
+	}
+
+
+	void UT_radix_sort(const char* params)
+	{
+		DefaultAllocator allocator;
+		testSort(allocator, 1, ~0ULL);
+		testSort(allocator, 100, ~0ULL);
+		testSort(allocator, 1000, 0xff00000000ff00ffULL);
+		testSort(allocator, 1000, 0);
+
+		JobSystem::init(allocator);
+		testSort(allocator, 50000, ~0ULL);
+		testSort(allocator, 50000, 0xf0f0000000000f0fULL);
+		JobSystem::shutdown();
+	}
+}
+
+
+REGISTER_TEST("unit_tests/engine/radix_sort", UT_radix_sort, "");
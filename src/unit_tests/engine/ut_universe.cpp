@@ -1,4 +1,7 @@
+#include "engine/blob.h"
+#include "engine/crc32.h"
 #include "engine/path.h"
+#include "engine/snapshot.h"
 #include "engine/universe/universe.h"
 #include "unit_tests/suite/lumix_unit_tests.h"
 
@@ -277,6 +280,561 @@ namespace
 			LUMIX_EXPECT_CLOSE_EQ(pos.z, float(i), 0.00001f);
 		}
 	}
+
+
+	void UT_universe_transform_arrays(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+
+		Entity e0 = universe.createEntity({1, 2, 3}, {0, 0, 0, 1});
+		Entity e1 = universe.createEntity({4, 5, 6}, {1, 0, 0, 0});
+		Entity e2 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.setScale(e1, 3);
+		universe.setParent(e1, e2);
+		universe.setLocalPosition(e2, {1, 0, 0});
+		universe.destroyEntity(e0);
+
+		LUMIX_EXPECT(universe.getEntitySlotsCount() == 3);
+		const Vec3* positions = universe.getPositions();
+		const Quat* rotations = universe.getRotations();
+		const float* scales = universe.getScales();
+		LUMIX_EXPECT_CLOSE_EQ(positions[e1.index].y, 5, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(rotations[e1.index].x, 1, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(scales[e1.index], 3, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(positions[e2.index].x, universe.getPosition(e2).x, 0.001f);
+
+		OutputBlob blob(allocator);
+		universe.serialize(blob);
+		Universe loaded(allocator);
+		InputBlob in(blob);
+		loaded.deserialize(in);
+
+		LUMIX_EXPECT(!loaded.hasEntity(e0));
+		LUMIX_EXPECT(loaded.hasEntity(e1));
+		LUMIX_EXPECT(loaded.getParent(e2) == e1);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getPosition(e2).x, universe.getPosition(e2).x, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getScale(e1), 3, 0.001f);
+
+		// destroyed slot is reused after load
+		LUMIX_EXPECT(loaded.createEntity({0, 0, 0}, {0, 0, 0, 1}) == e0);
+	}
+
+
+	int g_moved_count = 0;
+	int g_moved_calls = 0;
+	int g_single_moved_count = 0;
+
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		g_moved_count += count;
+		++g_moved_calls;
+	}
+
+
+	void onEntityMoved(Entity entity)
+	{
+		++g_single_moved_count;
+	}
+
+
+	void UT_universe_deferred_transforms(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+		universe.entitiesTransformed().bind<onEntitiesMoved>();
+		g_moved_count = 0;
+		g_moved_calls = 0;
+
+		Entity e0 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity e1 = universe.createEntity({1, 0, 0}, {0, 0, 0, 1});
+		Entity e2 = universe.createEntity({2, 0, 0}, {0, 0, 0, 1});
+		Entity e3 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.setParent(e0, e1);
+		universe.setParent(e1, e2);
+		universe.setDeferredTransforms(true);
+		// subscribers of the single entity event get every moved entity too
+		universe.entityTransformed().bind<onEntityMoved>();
+		g_single_moved_count = 0;
+
+		universe.setPosition(e0, {0, 1, 0});
+		universe.setPosition(e0, {0, 2, 0});
+		universe.setPosition(e3, {0, 0, 1});
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e0).y, 2, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e2).y, 0, 0.001f);
+		LUMIX_EXPECT(g_moved_calls == 0);
+
+		universe.updateTransforms();
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e1).y, 2, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e2).y, 2, 0.001f);
+		LUMIX_EXPECT(g_moved_calls == 1);
+		LUMIX_EXPECT(g_moved_count == 4);
+		LUMIX_EXPECT(g_single_moved_count == 4);
+
+		// setting a descendant of a dirty entity brings its parent up to date first
+		universe.setPosition(e0, {0, 3, 0});
+		universe.setPosition(e2, {5, 0, 0});
+		universe.updateTransforms();
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e1).y, 3, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e2).x, 5, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e2).y, 0, 0.001f);
+		LUMIX_EXPECT(g_moved_calls == 2);
+		LUMIX_EXPECT(g_moved_count == 7);
+		LUMIX_EXPECT(g_single_moved_count == 7);
+
+		universe.updateTransforms();
+		LUMIX_EXPECT(g_moved_calls == 2);
+
+		universe.setPosition(e0, {0, 4, 0});
+		universe.setDeferredTransforms(false);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e1).y, 4, 0.001f);
+		LUMIX_EXPECT(g_moved_calls == 3);
+	}
+
+
+	int g_created_count = 0;
+	int g_created_calls = 0;
+
+
+	void onEntitiesCreated(const Entity* entities, int count)
+	{
+		g_created_count += count;
+		++g_created_calls;
+	}
+
+
+	void UT_universe_bulk(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+		universe.entitiesTransformed().bind<onEntitiesMoved>();
+		universe.entitiesCreated().bind<onEntitiesCreated>();
+		g_moved_count = 0;
+		g_moved_calls = 0;
+		g_created_count = 0;
+		g_created_calls = 0;
+
+		Entity entities[4];
+		universe.createEntities(entities, lengthOf(entities));
+		LUMIX_EXPECT(g_created_calls == 1);
+		LUMIX_EXPECT(g_created_count == 4);
+		for (int i = 0; i < lengthOf(entities); ++i)
+		{
+			LUMIX_EXPECT(universe.hasEntity(entities[i]));
+			LUMIX_EXPECT_CLOSE_EQ(universe.getScale(entities[i]), 1, 0.001f);
+		}
+		universe.setParent(entities[0], entities[1]);
+
+		Transform transforms[3] = {
+			{{0, 0, 5}, {0, 0, 0, 1}, 1},
+			{{1, 0, 0}, {0, 0, 0, 1}, 2},
+			{{0, 1, 0}, {0, 0, 0, 1}, 1}
+		};
+		universe.setTransforms(entities, transforms, lengthOf(transforms));
+		LUMIX_EXPECT(g_moved_calls == 1);
+		LUMIX_EXPECT(g_moved_count == 3);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(entities[1]).x, 1, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getLocalTransform(entities[1]).pos.z, -5, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getScale(entities[1]), 2, 0.001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(entities[2]).y, 1, 0.001f);
+
+		universe.setPosition(entities[0], {0, 0, 0});
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(entities[1]).z, -5, 0.001f);
+
+		universe.destroyEntities(entities, 2);
+		LUMIX_EXPECT(!universe.hasEntity(entities[0]));
+		LUMIX_EXPECT(!universe.hasEntity(entities[1]));
+		LUMIX_EXPECT(universe.hasEntity(entities[2]));
+
+		Entity reused[3];
+		universe.createEntities(reused, lengthOf(reused));
+		LUMIX_EXPECT(universe.getEntitySlotsCount() == 5);
+		LUMIX_EXPECT(g_created_calls == 2);
+		LUMIX_EXPECT(g_created_count == 7);
+		for (int i = 0; i < lengthOf(reused); ++i)
+		{
+			LUMIX_EXPECT(universe.hasEntity(reused[i]));
+			LUMIX_EXPECT(!universe.getParent(reused[i]).isValid());
+			for (int j = 0; j < i; ++j) LUMIX_EXPECT(reused[i] != reused[j]);
+		}
+		Entity next = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		LUMIX_EXPECT(next.index == 5);
+		// single creates are reported in the batched event too
+		LUMIX_EXPECT(g_created_calls == 3);
+		LUMIX_EXPECT(g_created_count == 8);
+	}
+
+
+	void UT_universe_find_by_name(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+
+		Entity root = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity child = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity grandchild = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity other = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.setParent(root, child);
+		universe.setParent(child, grandchild);
+		universe.setEntityName(root, "root");
+		universe.setEntityName(child, "child");
+		universe.setEntityName(grandchild, "grandchild");
+		universe.setEntityName(other, "child");
+
+		LUMIX_EXPECT(universe.findByName(INVALID_ENTITY, "root") == root);
+		LUMIX_EXPECT(universe.findByName(INVALID_ENTITY, "child") == other);
+		LUMIX_EXPECT(universe.findByName(root, "child") == child);
+		LUMIX_EXPECT(!universe.findByName(INVALID_ENTITY, "grandchild").isValid());
+		LUMIX_EXPECT(!universe.findByName(INVALID_ENTITY, "chil").isValid());
+		LUMIX_EXPECT(universe.findByPath(INVALID_ENTITY, "root/child/grandchild") == grandchild);
+		LUMIX_EXPECT(universe.findByPath(root, "child/grandchild") == grandchild);
+		LUMIX_EXPECT(!universe.findByPath(INVALID_ENTITY, "root/grandchild").isValid());
+		LUMIX_EXPECT(!universe.findByPath(INVALID_ENTITY, "root/child/").isValid());
+
+		universe.setEntityName(other, "renamed");
+		LUMIX_EXPECT(!universe.findByName(INVALID_ENTITY, "child").isValid());
+		LUMIX_EXPECT(universe.findByName(INVALID_ENTITY, "renamed") == other);
+
+		universe.destroyEntity(root);
+		LUMIX_EXPECT(!universe.findByName(INVALID_ENTITY, "root").isValid());
+		LUMIX_EXPECT(universe.findByName(INVALID_ENTITY, "child") == child);
+		LUMIX_EXPECT(universe.findByPath(INVALID_ENTITY, "child/grandchild") == grandchild);
+
+		OutputBlob blob(allocator);
+		universe.serialize(blob);
+		Universe loaded(allocator);
+		InputBlob in(blob);
+		loaded.deserialize(in);
+		LUMIX_EXPECT(loaded.findByPath(INVALID_ENTITY, "child/grandchild") == grandchild);
+		LUMIX_EXPECT(loaded.findByName(INVALID_ENTITY, "renamed") == other);
+	}
+
+
+	void UT_universe_query(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+
+		const ComponentType A = {0};
+		const ComponentType B = {1};
+		const ComponentType types[] = {A, B};
+		Entity entities[4];
+		for (Entity& e : entities) e = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.onComponentCreated(entities[0], A, nullptr);
+		universe.onComponentCreated(entities[0], B, nullptr);
+		universe.onComponentCreated(entities[1], A, nullptr);
+
+		int query_ab = universe.registerQuery(types, 2);
+		int query_a = universe.registerQuery(types, 1);
+		LUMIX_EXPECT(universe.registerQuery(types, 2) == query_ab);
+		LUMIX_EXPECT(universe.findQuery(types, 2) == query_ab);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_ab) == 1);
+		LUMIX_EXPECT(universe.getQueryEntities(query_ab)[0] == entities[0]);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_a) == 2);
+
+		universe.onComponentCreated(entities[2], B, nullptr);
+		universe.onComponentCreated(entities[2], A, nullptr);
+		universe.onComponentCreated(entities[3], A, nullptr);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_ab) == 2);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_a) == 4);
+
+		universe.onComponentDestroyed(entities[0], B, nullptr);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_ab) == 1);
+		LUMIX_EXPECT(universe.getQueryEntities(query_ab)[0] == entities[2]);
+		universe.onComponentDestroyed(entities[1], A, nullptr);
+		LUMIX_EXPECT(universe.getQueryEntitiesCount(query_a) == 3);
+		for (int i = 0; i < universe.getQueryEntitiesCount(query_a); ++i)
+		{
+			LUMIX_EXPECT(universe.getQueryEntities(query_a)[i] != entities[1]);
+		}
+
+		universe.unregisterQuery(query_ab);
+		LUMIX_EXPECT(universe.findQuery(types, 2) == query_ab);
+		universe.unregisterQuery(query_ab);
+		LUMIX_EXPECT(universe.findQuery(types, 2) < 0);
+		universe.unregisterQuery(query_a);
+	}
+
+
+	struct TransformListener
+	{
+		void onEntityMoved(Entity entity)
+		{
+			last_moved = entity;
+			++moved_count;
+		}
+
+		void onEntitiesMoved(const Entity* entities, int count)
+		{
+			for (int i = 0; i < count; ++i) onEntityMoved(entities[i]);
+		}
+
+		Entity last_moved = INVALID_ENTITY;
+		int moved_count = 0;
+	};
+
+
+	void UT_universe_transform_listeners(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+
+		const ComponentType A = {0};
+		const ComponentType B = {1};
+		TransformListener listener;
+		universe.subscribeTransformed<TransformListener,
+			&TransformListener::onEntityMoved,
+			&TransformListener::onEntitiesMoved>(&listener, &A, 1);
+
+		Entity e0 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity e1 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Entity e2 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.onComponentCreated(e1, A, nullptr);
+		universe.onComponentCreated(e2, B, nullptr);
+		universe.setParent(e0, e1);
+
+		universe.setPosition(e2, {1, 0, 0});
+		LUMIX_EXPECT(listener.moved_count == 0);
+
+		// only the child has the component
+		universe.setPosition(e0, {1, 0, 0});
+		LUMIX_EXPECT(listener.moved_count == 1);
+		LUMIX_EXPECT(listener.last_moved == e1);
+
+		universe.setDeferredTransforms(true);
+		universe.setPosition(e0, {2, 0, 0});
+		universe.setPosition(e2, {2, 0, 0});
+		universe.updateTransforms();
+		LUMIX_EXPECT(listener.moved_count == 2);
+		LUMIX_EXPECT(listener.last_moved == e1);
+
+		universe.unsubscribeTransformed<TransformListener, &TransformListener::onEntityMoved>(&listener);
+		universe.setPosition(e1, {3, 0, 0});
+		universe.updateTransforms();
+		LUMIX_EXPECT(listener.moved_count == 2);
+
+		// a listener without a batch delegate gets the deferred moves one by one
+		Delegate<void(Entity)> moved;
+		moved.bind<TransformListener, &TransformListener::onEntityMoved>(&listener);
+		universe.addTransformListener(&A, 1, moved, Delegate<void(const Entity*, int)>());
+		universe.setPosition(e0, {4, 0, 0});
+		universe.updateTransforms();
+		LUMIX_EXPECT(listener.moved_count == 3);
+		LUMIX_EXPECT(listener.last_moved == e1);
+		universe.removeTransformListener(moved);
+	}
+
+
+	void UT_universe_snapshot(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+		universe.setDeferredTransforms(true);
+
+		Entity e0 = universe.createEntity({1, 2, 3}, {0, 0, 0, 1});
+		Entity e1 = universe.createEntity({4, 5, 6}, {0, 0, 0, 1});
+		Entity e2 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.setParent(e1, e2);
+		universe.setEntityName(e1, "parent");
+		universe.setEntityName(e2, "child");
+		universe.onComponentCreated(e2, {3}, nullptr);
+		universe.destroyEntity(e0);
+		universe.setPosition(e1, {0, 5, 0});
+
+		OutputBlob blob(allocator);
+		blob.write((u8)1);
+		SnapshotWriter writer(blob, allocator);
+		universe.serialize(writer);
+		writer.beginChunk(crc32("test"));
+		blob.write((i32)42);
+		writer.end();
+		blob.write((u8)7);
+
+		InputBlob in(blob);
+		in.skip(1);
+		SnapshotReader reader(allocator);
+		LUMIX_EXPECT(reader.read(in));
+		LUMIX_EXPECT(in.read<u8>() == 7);
+		int size;
+		const void* chunk = reader.getChunk(crc32("test"), &size);
+		LUMIX_EXPECT(size == sizeof(i32));
+		LUMIX_EXPECT(((const u8*)chunk - (const u8*)in.getData()) % SnapshotWriter::ALIGNMENT == 0);
+		LUMIX_EXPECT(*(const i32*)chunk == 42);
+		LUMIX_EXPECT(!reader.hasChunk(crc32("missing")));
+
+		Universe loaded(allocator);
+		LUMIX_EXPECT(loaded.deserialize(reader));
+		LUMIX_EXPECT(!loaded.hasEntity(e0));
+		LUMIX_EXPECT(loaded.getParent(e2) == e1);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getPosition(e2).y, 0, 0.001f);
+		LUMIX_EXPECT(loaded.hasComponent(e2, {3}));
+		LUMIX_EXPECT(loaded.findByName(e1, "child") == e2);
+		LUMIX_EXPECT(loaded.findByPath(INVALID_ENTITY, "parent/child") == e2);
+		LUMIX_EXPECT(loaded.createEntity({0, 0, 0}, {0, 0, 0, 1}) == e0);
+
+		// deferred transforms are flushed before saving
+		loaded.setDeferredTransforms(true);
+		loaded.setPosition(e1, {0, 6, 0});
+		loaded.updateTransforms();
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getPosition(e2).y, 1, 0.001f);
+
+		// a snapshot without universe chunks is rejected and the universe is left as it was
+		OutputBlob broken_blob(allocator);
+		SnapshotWriter broken_writer(broken_blob, allocator);
+		broken_writer.writeChunk(crc32("test"), &size, sizeof(size));
+		broken_writer.end();
+		InputBlob broken_in(broken_blob);
+		SnapshotReader broken_reader(allocator);
+		LUMIX_EXPECT(broken_reader.read(broken_in));
+		LUMIX_EXPECT(!loaded.deserialize(broken_reader));
+		LUMIX_EXPECT(loaded.getParent(e2) == e1);
+		LUMIX_EXPECT(loaded.findByPath(INVALID_ENTITY, "parent/child") == e2);
+	}
+
+
+	void UT_universe_checkpoint(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+
+		const ComponentType A = {0};
+		TransformListener listener;
+		universe.subscribeTransformed<TransformListener,
+			&TransformListener::onEntityMoved,
+			&TransformListener::onEntitiesMoved>(&listener, &A, 1);
+
+		// more entities than in one chunk
+		Entity e[3000];
+		universe.createEntities(e, lengthOf(e));
+		universe.setParent(e[5], e[2000]);
+		universe.setEntityName(e[5], "root");
+		universe.onComponentCreated(e[2000], A, nullptr);
+		universe.destroyEntity(e[7]);
+
+		universe.saveCheckpoint();
+		LUMIX_EXPECT(universe.hasCheckpoint());
+
+		universe.setPosition(e[5], {1, 0, 0});
+		universe.setParent(e[10], e[2000]);
+		universe.setEntityName(e[2000], "child");
+		universe.setEntityName(e[5], "renamed");
+		Entity created[2000];
+		universe.createEntities(created, lengthOf(created));
+		EntityHandle created_handle = universe.getHandle(created[1999]);
+		universe.setParent(e[2000], created[0]);
+		listener.moved_count = 0;
+
+		LUMIX_EXPECT(universe.restoreCheckpoint());
+		LUMIX_EXPECT(listener.moved_count == 1);
+		LUMIX_EXPECT(listener.last_moved == e[2000]);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e[5]).x, 0, 0.001f);
+		LUMIX_EXPECT(universe.getParent(e[2000]) == e[5]);
+		LUMIX_EXPECT(!universe.getFirstChild(e[10]).isValid());
+		LUMIX_EXPECT(universe.findByPath(INVALID_ENTITY, "root") == e[5]);
+		LUMIX_EXPECT(universe.getEntityName(e[2000])[0] == '\0');
+		LUMIX_EXPECT(!universe.isAlive(created_handle));
+		LUMIX_EXPECT(universe.hasEntity(e[2999]));
+
+		// the parent still moves the child and freed slots can be reused
+		universe.setPosition(e[5], {2, 0, 0});
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e[2000]).x, 2, 0.001f);
+		universe.createEntities(created, lengthOf(created));
+		LUMIX_EXPECT(universe.createEntity({0, 0, 0}, {0, 0, 0, 1}) == e[7]);
+
+		// the checkpoint is kept after restoring
+		LUMIX_EXPECT(universe.restoreCheckpoint());
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e[2000]).x, 0, 0.001f);
+		LUMIX_EXPECT(!universe.hasEntity(e[7]));
+
+		// an entity from the checkpoint lost a component
+		universe.onComponentDestroyed(e[2000], A, nullptr);
+		LUMIX_EXPECT(!universe.restoreCheckpoint());
+		universe.onComponentCreated(e[2000], A, nullptr);
+		LUMIX_EXPECT(universe.restoreCheckpoint());
+
+		universe.destroyEntity(e[2999]);
+		LUMIX_EXPECT(!universe.restoreCheckpoint());
+		LUMIX_EXPECT(!universe.hasEntity(e[2999]));
+		universe.releaseCheckpoint();
+		LUMIX_EXPECT(!universe.hasCheckpoint());
+		LUMIX_EXPECT(!universe.restoreCheckpoint());
+		universe.unsubscribeTransformed<TransformListener, &TransformListener::onEntityMoved>(&listener);
+	}
+
+
+	int g_destroyed_count = 0;
+	int g_destroyed_calls = 0;
+
+
+	void onEntitiesDestroyed(const Entity* entities, int count)
+	{
+		g_destroyed_count += count;
+		++g_destroyed_calls;
+	}
+
+
+	void UT_universe_deferred_destroy(const char* params)
+	{
+		DefaultAllocator allocator;
+		PathManager path_manager(allocator);
+		Universe universe(allocator);
+		universe.entitiesDestroyed().bind<onEntitiesDestroyed>();
+		g_destroyed_count = 0;
+		g_destroyed_calls = 0;
+
+		// e0 -> e1 -> (e2, e3, e4), e3 -> e5
+		Entity e[6];
+		universe.createEntities(e, lengthOf(e));
+		universe.setParent(e[0], e[1]);
+		universe.setParent(e[1], e[2]);
+		universe.setParent(e[1], e[3]);
+		universe.setParent(e[1], e[4]);
+		universe.setParent(e[3], e[5]);
+		universe.setPosition(e[0], {1, 0, 0});
+
+		EntityHandle handle = universe.getHandle(e[3]);
+		LUMIX_EXPECT(universe.isAlive(handle));
+		universe.destroyEntityDeferred(e[3]);
+		universe.destroyEntityDeferred(e[1]);
+		universe.destroyEntityDeferred(e[3]);
+		LUMIX_EXPECT(universe.hasEntity(e[3]));
+		universe.flushDestroyedEntities();
+
+		LUMIX_EXPECT(g_destroyed_calls == 1);
+		LUMIX_EXPECT(g_destroyed_count == 2);
+		LUMIX_EXPECT(!universe.isAlive(handle));
+		LUMIX_EXPECT(!universe.hasEntity(e[1]));
+		LUMIX_EXPECT(!universe.getFirstChild(e[0]).isValid());
+		LUMIX_EXPECT(!universe.getParent(e[2]).isValid());
+		LUMIX_EXPECT(!universe.getParent(e[5]).isValid());
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e[2]).x, 1, 0.001f);
+
+		// the slot is reused, the old handle stays stale
+		Entity reused = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		LUMIX_EXPECT((reused == e[1] || reused == e[3]));
+		LUMIX_EXPECT(!universe.isAlive(handle));
+		LUMIX_EXPECT(universe.isAlive(universe.getHandle(reused)));
+
+		universe.setParent(e[0], e[2]);
+		universe.setParent(e[0], e[4]);
+		universe.setParent(e[0], e[5]);
+		Entity batch[] = {e[4], e[2]};
+		universe.destroyEntities(batch, lengthOf(batch));
+		LUMIX_EXPECT(g_destroyed_calls == 2);
+		LUMIX_EXPECT(universe.getFirstChild(e[0]) == e[5]);
+		LUMIX_EXPECT(!universe.getNextSibling(e[5]).isValid());
+		universe.setPosition(e[0], {2, 0, 0});
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(e[5]).x, 2, 0.001f);
+	}
 } // anonymous namespace
 
 REGISTER_TEST("unit_tests/engine/universe", UT_universe, "");
@@ -284,3 +842,12 @@ REGISTER_TEST("unit_tests/engine/universe/hierarchy", UT_universe_hierarchy, "")
 REGISTER_TEST("unit_tests/engine/universe/hierarchy2", UT_universe_hierarchy2, "");
 REGISTER_TEST("unit_tests/engine/universe/hierarchy3", UT_universe_hierarchy3, "");
 REGISTER_TEST("unit_tests/engine/universe/hierarchy4", UT_universe_hierarchy4, "");
+REGISTER_TEST("unit_tests/engine/universe/transform_arrays", UT_universe_transform_arrays, "");
+REGISTER_TEST("unit_tests/engine/universe/deferred_transforms", UT_universe_deferred_transforms, "");
+REGISTER_TEST("unit_tests/engine/universe/bulk", UT_universe_bulk, "");
+REGISTER_TEST("unit_tests/engine/universe/find_by_name", UT_universe_find_by_name, "");
+REGISTER_TEST("unit_tests/engine/universe/query", UT_universe_query, "");
+REGISTER_TEST("unit_tests/engine/universe/transform_listeners", UT_universe_transform_listeners, "");
+REGISTER_TEST("unit_tests/engine/universe/snapshot", UT_universe_snapshot, "");
+REGISTER_TEST("unit_tests/engine/universe/checkpoint", UT_universe_checkpoint, "");
+REGISTER_TEST("unit_tests/engine/universe/deferred_destroy", UT_universe_deferred_destroy, "");
@@ -2,6 +2,7 @@
 
 #include "engine/geometry.h"
 #include "engine/job_system.h"
+#include "engine/math_utils.h"
 #include "engine/timer.h"
 #include "engine/log.h"
 
@@ -85,6 +86,248 @@ namespace
 		CullingSystem::destroy(*culling_system);
 		JobSystem::shutdown();
 	}
+
+
+	void expectCulled(CullingSystem& culling_system,
+		const Array<Sphere>& spheres,
+		const Array<u64>& layer_masks,
+		const Frustum& frustum,
+		IAllocator& allocator)
+	{
+		Array<int> visible(allocator);
+		visible.resize(spheres.size());
+		for (int& i : visible) i = 0;
+
+		const CullingSystem::Results& results = culling_system.cull(frustum, 1);
+		for (const CullingSystem::Subresults& subresults : results)
+		{
+			for (Entity entity : subresults) ++visible[entity.index];
+		}
+
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			bool expected = (layer_masks[i] & 1) != 0 && frustum.isSphereInside(spheres[i].position, spheres[i].radius);
+			LUMIX_EXPECT(visible[i] == (expected ? 1 : 0));
+		}
+	}
+
+
+	// a view must return every visible sphere once, extra ones only up to slack outside of the frustum
+	void expectViewCulled(CullingSystem& culling_system,
+		int view,
+		const Array<Sphere>& spheres,
+		const Array<u64>& layer_masks,
+		const Frustum& frustum,
+		float slack,
+		IAllocator& allocator)
+	{
+		Array<int> visible(allocator);
+		visible.resize(spheres.size());
+		for (int& i : visible) i = 0;
+
+		const CullingSystem::Results& results = culling_system.cull(view, frustum, 1);
+		for (const CullingSystem::Subresults& subresults : results)
+		{
+			for (Entity entity : subresults) ++visible[entity.index];
+		}
+
+		Frustum grown = frustum;
+		for (float& d : grown.ds) d += slack;
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			bool in_layer = (layer_masks[i] & 1) != 0;
+			if (in_layer && frustum.isSphereInside(spheres[i].position, spheres[i].radius))
+			{
+				LUMIX_EXPECT(visible[i] == 1);
+			}
+			else if (in_layer && grown.isSphereInside(spheres[i].position, spheres[i].radius))
+			{
+				LUMIX_EXPECT(visible[i] <= 1);
+			}
+			else
+			{
+				LUMIX_EXPECT(visible[i] == 0);
+			}
+		}
+	}
+
+
+	void expectQueried(const Array<Entity>& queried, const Array<bool>& expected, IAllocator& allocator)
+	{
+		Array<int> found(allocator);
+		found.resize(expected.size());
+		for (int& i : found) i = 0;
+		for (Entity entity : queried) ++found[entity.index];
+		for (int i = 0; i < expected.size(); ++i)
+		{
+			LUMIX_EXPECT(found[i] == (expected[i] ? 1 : 0));
+		}
+	}
+
+
+	void UT_culling_system_queries(const char* params)
+	{
+		DefaultAllocator allocator;
+		CullingSystem* culling_system = CullingSystem::create(allocator);
+
+		const int SIDE = 64;
+		Array<Sphere> spheres(allocator);
+		for (int i = 0; i < SIDE * SIDE; ++i)
+		{
+			spheres.push(Sphere(float(i % SIDE) * 2.3f, float(i % 5), float(i / SIDE) * 2.3f, 0.5f + (i % 3) * 0.5f));
+			culling_system->addStatic({i}, spheres[i], i % 9 == 0 ? 2 : 1);
+		}
+		// some spheres are out of the tree
+		for (int i = 0; i < spheres.size(); i += 17)
+		{
+			spheres[i].position.x += 3;
+			culling_system->updateBoundingSphere(spheres[i], {i});
+		}
+
+		Array<Entity> queried(allocator);
+		Array<bool> expected(allocator);
+		expected.resize(spheres.size());
+
+		Sphere sphere({40, 2, 50}, 12);
+		culling_system->cull(sphere, 1, queried);
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			float radius = spheres[i].radius + sphere.radius;
+			expected[i] = i % 9 != 0 && (spheres[i].position - sphere.position).squaredLength() <= radius * radius;
+		}
+		expectQueried(queried, expected, allocator);
+
+		AABB aabb({10, -1, 20}, {30, 1.5f, 70});
+		queried.clear();
+		culling_system->cull(aabb, 1, queried);
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			const Vec3& p = spheres[i].position;
+			Vec3 closest(Math::clamp(p.x, aabb.min.x, aabb.max.x),
+				Math::clamp(p.y, aabb.min.y, aabb.max.y),
+				Math::clamp(p.z, aabb.min.z, aabb.max.z));
+			float dist_squared = (closest - p).squaredLength();
+			expected[i] = i % 9 != 0 && dist_squared <= spheres[i].radius * spheres[i].radius;
+		}
+		expectQueried(queried, expected, allocator);
+
+		const Vec3 points[] = {{33.1f, 0, 71.7f}, {-100, 3, 20}, {7, 2, 200}};
+		for (const Vec3& point : points)
+		{
+			int nearest = -1;
+			for (int i = 0; i < spheres.size(); ++i)
+			{
+				if (i % 9 != 0) continue;
+				float dist_squared = (spheres[i].position - point).squaredLength();
+				if (nearest < 0 || dist_squared < (spheres[nearest].position - point).squaredLength()) nearest = i;
+			}
+			LUMIX_EXPECT(culling_system->getNearest(point, 2).index == nearest);
+		}
+
+		CullingSystem::destroy(*culling_system);
+	}
+
+
+	void UT_culling_system_tree(const char* params)
+	{
+		DefaultAllocator allocator;
+		JobSystem::init(allocator);
+		CullingSystem* culling_system = CullingSystem::create(allocator);
+
+		const int SIDE = 100;
+		Array<Sphere> spheres(allocator);
+		Array<u64> layer_masks(allocator);
+		for (int i = 0; i < SIDE * SIDE; ++i)
+		{
+			spheres.push(Sphere(float(i % SIDE - SIDE / 2) * 3.1f, 0.3f, float(i / SIDE - SIDE / 2) * 3.1f, 1.0f));
+			layer_masks.push(i % 7 == 0 ? 2 : 1);
+			culling_system->addStatic({i}, spheres[i], layer_masks[i]);
+		}
+
+		Frustum frustum;
+		frustum.computePerspective({0.1f, 5, 0.2f}, {0.3f, -0.2f, 1}, {0, 1, 0}, Math::degreesToRadians(60), 1.5f, 0.1f, 120);
+		expectCulled(*culling_system, spheres, layer_masks, frustum, allocator);
+
+		// moved spheres leave the tree, removed ones are masked out until the next rebuild
+		for (int i = 0; i < spheres.size(); i += 5)
+		{
+			spheres[i].position.y += 50;
+			culling_system->updateBoundingSphere(spheres[i], {i});
+		}
+		for (int i = 3; i < spheres.size(); i += 11)
+		{
+			culling_system->removeStatic({i});
+			layer_masks[i] = 0;
+		}
+		expectCulled(*culling_system, spheres, layer_masks, frustum, allocator);
+
+		for (int i = 3; i < spheres.size(); i += 11)
+		{
+			layer_masks[i] = 1;
+			culling_system->addStatic({i}, spheres[i], layer_masks[i]);
+			LUMIX_EXPECT(culling_system->getLayerMask({i}) == 1);
+		}
+		expectCulled(*culling_system, spheres, layer_masks, frustum, allocator);
+
+		frustum.computePerspective({0, 200, 0}, {0, -1, 0}, {0, 0, 1}, Math::degreesToRadians(90), 1, 0.1f, 300);
+		expectCulled(*culling_system, spheres, layer_masks, frustum, allocator);
+
+		// one traversal for several views must match culling them one by one
+		Frustum frusta[3];
+		frusta[0] = frustum;
+		frusta[1].computePerspective({0.1f, 5, 0.2f}, {0.3f, -0.2f, 1}, {0, 1, 0}, Math::degreesToRadians(60), 1.5f, 0.1f, 120);
+		frusta[2].computeOrtho({10, 100, 0}, {0, 1, 0}, {0, 0, 1}, 40, 40, 0.1f, 300);
+		const u64 view_layer_masks[] = {1, 2, 3};
+		const CullingSystem::Results* views = culling_system->cull(frusta, view_layer_masks, lengthOf(frusta));
+		Array<int> visible(allocator);
+		for (int view = 0; view < lengthOf(frusta); ++view)
+		{
+			visible.resize(spheres.size());
+			for (int& i : visible) i = 0;
+			for (const CullingSystem::Subresults& subresults : views[view])
+			{
+				for (Entity entity : subresults) ++visible[entity.index];
+			}
+			for (int i = 0; i < spheres.size(); ++i)
+			{
+				bool expected = (layer_masks[i] & view_layer_masks[view]) != 0 &&
+								frusta[view].isSphereInside(spheres[i].position, spheres[i].radius);
+				LUMIX_EXPECT(visible[i] == (expected ? 1 : 0));
+			}
+		}
+
+		// a view reuses its static spheres while the camera moves within the threshold,
+		// moved spheres are dynamic from then on and are tested every call
+		const float threshold = 2;
+		int view = culling_system->createView(threshold);
+		Vec3 camera_pos(0.1f, 5, 0.2f);
+		for (int step = 0; step < 12; ++step)
+		{
+			frustum.computePerspective(camera_pos, {0.3f, -0.2f, 1}, {0, 1, 0}, Math::degreesToRadians(60), 1.5f, 0.1f, 120);
+			expectViewCulled(*culling_system, view, spheres, layer_masks, frustum, threshold * 2, allocator);
+			expectViewCulled(*culling_system, view, spheres, layer_masks, frustum, threshold * 2, allocator);
+			if (step % 3 == 0) camera_pos.z += 0.7f;
+			if (step == 4 || step == 7)
+			{
+				for (int i = 1; i < spheres.size(); i += 13)
+				{
+					spheres[i].position.y -= 0.5f;
+					culling_system->updateBoundingSphere(spheres[i], {i});
+				}
+			}
+			if (step == 5)
+			{
+				culling_system->removeStatic({2});
+				layer_masks[2] = 0;
+			}
+		}
+		culling_system->destroyView(view);
+
+		CullingSystem::destroy(*culling_system);
+		JobSystem::shutdown();
+	}
 }
 
 REGISTER_TEST("unit_tests/graphics/culling_system_async", UT_culling_system_async, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_tree", UT_culling_system_tree, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_queries", UT_culling_system_queries, "");
@@ -0,0 +1,120 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/geometry.h"
+#include "engine/job_system.h"
+#include "engine/math_utils.h"
+
+#include "renderer/model.h"
+#include "renderer/occlusion_buffer.h"
+
+
+using namespace Lumix;
+
+
+namespace
+{
+	// square in the z = 0 plane facing +z, camera looks along -z
+	void initQuad(Mesh& mesh, float min_x, float max_x, float size)
+	{
+		mesh.flags.set(Mesh::INDICES_16_BIT);
+		mesh.vertices.push({min_x, -size, 0});
+		mesh.vertices.push({max_x, -size, 0});
+		mesh.vertices.push({max_x, size, 0});
+		mesh.vertices.push({min_x, size, 0});
+		const u16 indices[] = {0, 1, 2, 0, 2, 3};
+		for (u16 index : indices)
+		{
+			mesh.indices.push(u8(index & 0xff));
+			mesh.indices.push(u8(index >> 8));
+		}
+	}
+
+
+	bool isBoxOccluded(const OcclusionBuffer& buffer, const Vec3& center, float half_size, float depth)
+	{
+		Vec3 extents(half_size, half_size, depth);
+		return buffer.isOccluded(Matrix::IDENTITY, AABB(center - extents, center + extents));
+	}
+
+
+	void testOcclusion(IAllocator& allocator, bool homogeneous_depth, bool is_ortho)
+	{
+		bgfx::VertexDecl decl;
+		Mesh wall(nullptr, decl, "wall", allocator);
+		initQuad(wall, -20, 20, 20);
+		Mesh half_wall(nullptr, decl, "half_wall", allocator);
+		initQuad(half_wall, -20, 0, 20);
+
+		Matrix view = Matrix::IDENTITY;
+		Matrix projection;
+		if (is_ortho)
+		{
+			projection.setOrtho(-8, 8, -4, 4, 0.1f, 100, homogeneous_depth, true);
+		}
+		else
+		{
+			projection.setPerspective(Math::degreesToRadians(60), 2, 0.1f, 100, homogeneous_depth, true);
+		}
+
+		Matrix wall_mtx = Matrix::IDENTITY;
+		wall_mtx.setTranslation({0, 0, -10});
+
+		OcclusionBuffer buffer(allocator);
+		buffer.clear();
+		buffer.setCamera(view, projection, homogeneous_depth);
+		buffer.addOccluder(wall_mtx, wall);
+		buffer.rasterize();
+		buffer.buildHierarchy();
+
+		LUMIX_EXPECT(isBoxOccluded(buffer, {0, 0, -15}, 1, 1));
+		LUMIX_EXPECT(isBoxOccluded(buffer, {3, 2, -50}, 20, 1));
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {0, 0, -7}, 1, 1));
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {0, 0, -10}, 1, 2));
+		LUMIX_EXPECT(buffer.isOccluded(Sphere({1, 1, -20}, 2)));
+		LUMIX_EXPECT(!buffer.isOccluded(Sphere({0, 0, -5}, 2)));
+		LUMIX_EXPECT(!buffer.isOccluded(Sphere({0, 0, 5}, 2)));
+
+		// only the left half of the screen is covered
+		buffer.clear();
+		buffer.addOccluder(wall_mtx, half_wall);
+		buffer.rasterize();
+		buffer.buildHierarchy();
+		LUMIX_EXPECT(isBoxOccluded(buffer, {-3, 0, -15}, 1, 1));
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {3, 0, -15}, 1, 1));
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {0, 0, -15}, 1, 1));
+
+		// back faces do not occlude
+		Matrix flipped_mtx = wall_mtx;
+		flipped_mtx.setXVector({-1, 0, 0});
+		buffer.clear();
+		buffer.addOccluder(flipped_mtx, wall);
+		buffer.rasterize();
+		buffer.buildHierarchy();
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {0, 0, -15}, 1, 1));
+
+		// wall crossing the near plane is clipped, not projected through the camera
+		Matrix crossing_mtx = Matrix::IDENTITY;
+		crossing_mtx.setXVector({0, 0, -1});
+		crossing_mtx.setZVector({1, 0, 0});
+		crossing_mtx.setTranslation({-1, 0, 0});
+		buffer.clear();
+		buffer.addOccluder(crossing_mtx, wall);
+		buffer.rasterize();
+		buffer.buildHierarchy();
+		LUMIX_EXPECT(!isBoxOccluded(buffer, {2, 0, -15}, 0.5f, 0.5f));
+	}
+
+
+	void UT_occlusion_buffer(const char* params)
+	{
+		DefaultAllocator allocator;
+		JobSystem::init(allocator);
+		testOcclusion(allocator, true, false);
+		testOcclusion(allocator, false, false);
+		testOcclusion(allocator, true, true);
+		testOcclusion(allocator, false, true);
+		JobSystem::shutdown();
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/occlusion_buffer", UT_occlusion_buffer, "");